@@ -0,0 +1,171 @@
+// Cost of the CipherSettings of an encrypted vault: connection open (the
+// kdf_iter PBKDF2 of SQLCipher runs there), bulk insert, full scan and point
+// lookups for every page size, with both backends and a plain baseline.
+// SQLCipher rows only run in a build linked against it (PASSMAN_USE_SQLCIPHER).
+// The "plain sqlite" and "pages 4096" rows are the page VFS overhead.
+// Usage: cipher_settings_bench [rows] [dir]
+#include "DatabaseCipher.hpp"
+
+#include <unistd.h>
+
+#define BENCH_OPENS 20
+#define BENCH_LOOKUPS 20000
+#define BENCH_INSERT_GROUP 100
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void removeVault(const std::string &path)
+{
+    unlink(path.c_str());
+    unlink((path + "-wal").c_str());
+    unlink((path + "-shm").c_str());
+}
+
+// Opened and keyed like SQLiteCipherDB's connections, nullptr on failure
+static sqlite3 *openVault(const std::string &path, const DatabaseCipher *cipher, int flags,
+                          std::string *error = nullptr)
+{
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &db, flags, cipher ? cipher->vfsName() : nullptr) != SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return nullptr;
+    }
+    try
+    {
+        if (cipher)
+            cipher->apply(db);
+        else
+            sqlite3_exec(db, "SELECT count(*) FROM sqlite_master", nullptr, nullptr, nullptr);
+    }
+    catch (const std::exception &e)
+    {
+        if (error)
+            *error = e.what();
+        sqlite3_close(db);
+        return nullptr;
+    }
+    return db;
+}
+
+static void run(const char *label, const std::string &path, const DatabaseCipher *cipher, int rows)
+{
+    removeVault(path);
+    std::string error = "can't create the vault";
+    sqlite3 *db = openVault(path, cipher, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, &error);
+    if (!db)
+    {
+        printf("%-28s skipped: %s\n", label, error.c_str());
+        removeVault(path);
+        return;
+    }
+    sqlite3_exec(db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;"
+                 "CREATE TABLE passwords(id INTEGER PRIMARY KEY, website TEXT, username TEXT,"
+                 "encrypted_password TEXT, iv TEXT)", nullptr, nullptr, nullptr);
+
+    // Rows shaped like the vault's: hex ciphertext and IV
+    auto start = std::chrono::steady_clock::now();
+    sqlite3_stmt *insert = nullptr;
+    sqlite3_prepare_v2(db, "INSERT INTO passwords VALUES (?1, 'site' || ?1 || '.example.com', 'user' || ?1,"
+                       "hex(randomblob(48)), hex(randomblob(16)))", -1, &insert, nullptr);
+    for (int i = 0; i < rows; i += BENCH_INSERT_GROUP)
+    {
+        sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+        for (int j = i; j < std::min(rows, i + BENCH_INSERT_GROUP); j++)
+        {
+            sqlite3_bind_int(insert, 1, j + 1);
+            sqlite3_step(insert);
+            sqlite3_reset(insert);
+        }
+        sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+    }
+    sqlite3_finalize(insert);
+    double insertMs = msSince(start);
+    sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE)", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+
+    // Open latency: every reader and writer connection pays it
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_OPENS; i++)
+        sqlite3_close(openVault(path, cipher, SQLITE_OPEN_READONLY));
+    double openMs = msSince(start) / BENCH_OPENS;
+
+    // Cold reader with a small page cache, like the pool's readers
+    db = openVault(path, cipher, SQLITE_OPEN_READONLY);
+    sqlite3_exec(db, "PRAGMA cache_size=-256", nullptr, nullptr, nullptr);
+    start = std::chrono::steady_clock::now();
+    sqlite3_stmt *scan = nullptr;
+    sqlite3_prepare_v2(db, "SELECT website, username, length(encrypted_password) FROM passwords", -1, &scan, nullptr);
+    long long bytes = 0;
+    while (sqlite3_step(scan) == SQLITE_ROW)
+        bytes += sqlite3_column_int(scan, 2);
+    sqlite3_finalize(scan);
+    double scanMs = msSince(start);
+
+    start = std::chrono::steady_clock::now();
+    sqlite3_stmt *lookup = nullptr;
+    sqlite3_prepare_v2(db, "SELECT encrypted_password FROM passwords WHERE id = ?", -1, &lookup, nullptr);
+    unsigned seed = 1;
+    for (int i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        sqlite3_bind_int(lookup, 1, (seed >> 8) % rows + 1);
+        sqlite3_step(lookup);
+        sqlite3_reset(lookup);
+    }
+    sqlite3_finalize(lookup);
+    double lookupUs = msSince(start) * 1000 / BENCH_LOOKUPS;
+    sqlite3_close(db);
+
+    printf("%-28s %9.2f %11.1f %9.2f %10.2f\n", label, openMs, insertMs, scanMs, lookupUs);
+    // Page VFS work behind the timings (all zero with SQLCipher)
+    PageCipherStats pages = cipher ? cipher->pageStats() : PageCipherStats{};
+    if (pages.encrypted || pages.decrypted)
+        printf("%-28s pages encrypted %llu, decrypted %llu, cache hits %llu\n", "",
+               pages.encrypted, pages.decrypted, pages.cacheHits);
+    removeVault(path);
+}
+
+int main(int argc, char **argv)
+{
+    int rows = argc > 1 ? atoi(argv[1]) : 20000;
+    std::string dir = argc > 2 ? argv[2] : ".";
+    std::string path = dir + "/cipher_settings_bench.db";
+    RedirectLogs(nullptr);
+    if (rows <= 0)
+        rows = 20000;
+
+    SecureBytes key(DB_KEY_SIZE, 7);
+    SecureBytes salt(DB_SALT_SIZE, 9);
+
+    printf("%d rows\n%-28s %9s %11s %9s %10s\n", rows, "settings", "open ms", "insert ms", "scan ms", "lookup us");
+    run("plain sqlite", path, nullptr, rows);
+
+    for (int pageSize : {1024, 4096, 8192, 16384, 65536})
+    {
+        CipherSettings settings;
+        settings.backend = CipherBackend::Pages;
+        settings.pageSize = pageSize;
+        DatabaseCipher cipher(key, salt, settings);
+        std::string label = "pages " + std::to_string(pageSize);
+        run(label.c_str(), path, &cipher, rows);
+    }
+
+    for (int pageSize : {1024, 4096, 8192, 16384})
+        for (int kdfIter : {0, 4000, 64000, 256000})
+        {
+            if (pageSize != DB_CIPHER_PAGE_SIZE && kdfIter != DB_CIPHER_KDF_ITER)
+                continue;
+            CipherSettings settings;
+            settings.backend = CipherBackend::SQLCipher;
+            settings.pageSize = pageSize;
+            settings.kdfIter = kdfIter;
+            DatabaseCipher cipher(key, salt, settings);
+            std::string label = "sqlcipher " + std::to_string(pageSize) + " kdf " + std::to_string(kdfIter);
+            run(label.c_str(), path, &cipher, rows);
+        }
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Records/s of CryptoManager::decryptBatch / encryptBatch from 1 to N threads,
+// and the cost of a small batch run serially or split across the pool (the
+// CRYPTO_BATCH_MIN_CHUNK threshold). Usage: crypto_batch_bench [records] [threads]
+#include "CryptoManager.hpp"
+
+#define BENCH_SMALL_ROUNDS 100
+
+static double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Pool running a batch on `threads` threads: the caller always works, so it
+// gets threads - 1 workers (none for a single thread)
+static std::unique_ptr<TaskScheduler> makePool(size_t threads)
+{
+    return threads > 1 ? std::make_unique<TaskScheduler>(threads - 1) : nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    size_t records = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t maxThreads = argc > 2 ? strtoul(argv[2], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    RedirectLogs(nullptr);
+
+    CryptoManager crypto;
+    std::string master = "Secret123!";
+    std::string salt = "00112233445566778899aabbccddeeff";
+
+    std::vector<std::string> secrets(records);
+    std::vector<SecretView> plaintexts;
+    for (size_t i = 0; i < records; i++)
+    {
+        secrets[i] = "P@ss-" + std::to_string(i * 2654435761u) + "-bench";
+        plaintexts.emplace_back(secrets[i]);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned char key[CRYPTO_KEY_SIZE];
+    crypto.deriveKey(SecretView(master), SecretView(salt), key);
+    double kdfMs = msSince(start);
+    printf("%zu records, key derivation %.2f ms per batch (included below)\n\n", records, kdfMs);
+
+    std::vector<EncryptedField> encrypted;
+    std::vector<SecureString> decrypted;
+    crypto.encryptBatch(plaintexts, encrypted, SecretView(master), SecretView(salt));
+    // Warm up: the output buffers keep their capacity from here on
+    crypto.decryptBatch(encrypted, decrypted, SecretView(master), SecretView(salt));
+
+    printf("threads   encrypt rec/s  speedup   decrypt rec/s  speedup\n");
+    double encryptBase = 0;
+    double decryptBase = 0;
+    for (size_t threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(threads * 2, maxThreads) : threads + 1)
+    {
+        std::unique_ptr<TaskScheduler> pool = makePool(threads);
+        std::vector<EncryptedField> out;
+
+        start = std::chrono::steady_clock::now();
+        crypto.encryptBatch(plaintexts, out, SecretView(master), SecretView(salt), pool.get());
+        double encryptRate = records / (msSince(start) / 1000);
+
+        start = std::chrono::steady_clock::now();
+        size_t failed = crypto.decryptBatch(encrypted, decrypted, SecretView(master), SecretView(salt), pool.get());
+        double decryptRate = records / (msSince(start) / 1000);
+        if (failed)
+        {
+            fprintf(stderr, "%zu records failed to decrypt\n", failed);
+            return 1;
+        }
+
+        if (threads == 1)
+        {
+            encryptBase = encryptRate;
+            decryptBase = decryptRate;
+        }
+        printf("%7zu %15.0f %7.2fx %15.0f %7.2fx\n", threads, encryptRate, encryptRate / encryptBase,
+               decryptRate, decryptRate / decryptBase);
+    }
+
+    // Around the threshold: below 2 * CRYPTO_BATCH_MIN_CHUNK records a batch stays
+    // on the caller, the pooled column then matches the serial one
+    std::unique_ptr<TaskScheduler> pool = makePool(maxThreads);
+    printf("\ndecrypt of a small batch, us per batch without its key derivation "
+           "(CRYPTO_BATCH_MIN_CHUNK %d, %zu threads)\n", CRYPTO_BATCH_MIN_CHUNK, maxThreads);
+    printf("records     serial     pooled\n");
+    for (size_t size : {16, 32, 48, 63, 64, 96, 128, 256, 512, 1024})
+    {
+        if (size > encrypted.size())
+            break;
+        std::span<const EncryptedField> batch(encrypted.data(), size);
+        double perBatch[2];
+        for (int pooled = 0; pooled < 2; pooled++)
+        {
+            // The key derivation is timed right next to each batch and taken out
+            double batchMs = 0;
+            double deriveMs = 0;
+            for (int round = 0; round < BENCH_SMALL_ROUNDS; round++)
+            {
+                start = std::chrono::steady_clock::now();
+                crypto.deriveKey(SecretView(master), SecretView(salt), key);
+                deriveMs += msSince(start);
+                start = std::chrono::steady_clock::now();
+                crypto.decryptBatch(batch, decrypted, SecretView(master), SecretView(salt), pooled ? pool.get() : nullptr);
+                batchMs += msSince(start);
+            }
+            perBatch[pooled] = (batchMs - deriveMs) * 1000 / BENCH_SMALL_ROUNDS;
+        }
+        printf("%7zu %10.1f %10.1f\n", size, perBatch[0], perBatch[1]);
+    }
+    return 0;
+}
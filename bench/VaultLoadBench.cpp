@@ -0,0 +1,85 @@
+// Rows/s and heap allocations per row of loading a big vault: the vector
+// loader (getPasswordsByUserId) against the streaming one (forEachPassword).
+// The synthetic vault is created on the first run and reused after.
+// Usage: vault_load_bench [rows] [path]
+#include "SQLiteCipherDB.hpp"
+
+#include <unistd.h>
+#include <new>
+
+#define BENCH_ROUNDS 3
+
+static std::atomic<unsigned long long> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Rows written straight through SQLite: one user, vault shaped fields
+static void fill(const std::string &path, int rows)
+{
+    sqlite3 *db = nullptr;
+    sqlite3_open(path.c_str(), &db);
+    sqlite3_exec(db, "INSERT INTO users (username, password_hash, password_salt, is_admin) "
+                 "VALUES ('bench', 'h', 's', 1); BEGIN", nullptr, nullptr, nullptr);
+    sqlite3_stmt *insert = nullptr;
+    sqlite3_prepare_v2(db, "INSERT INTO passwords (user_id, website, username, encrypted_password, iv, created_at) "
+                       "VALUES (1, 'site' || ?1 || '.example.com', 'user' || (?1 % 50) || '@example.com', "
+                       "hex(zeroblob(48)), hex(zeroblob(16)), '2026-10-19 12:00:00')", -1, &insert, nullptr);
+    for (int i = 0; i < rows; i++)
+    {
+        sqlite3_bind_int(insert, 1, i);
+        sqlite3_step(insert);
+        sqlite3_reset(insert);
+    }
+    sqlite3_finalize(insert);
+    sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+}
+
+int main(int argc, char **argv)
+{
+    int rows = argc > 1 ? atoi(argv[1]) : 1000000;
+    std::string path = argc > 2 ? argv[2] : "vault_load_bench.db";
+    RedirectLogs(nullptr);
+
+    bool fresh = access(path.c_str(), F_OK) != 0;
+    SQLiteCipherDB db(path);
+    if (fresh)
+    {
+        printf("creating %d rows in %s...\n", rows, path.c_str());
+        fill(path, rows);
+    }
+
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        unsigned long long before = g_allocations;
+        auto start = std::chrono::steady_clock::now();
+        size_t loaded = db.getPasswordsByUserId(1).size();
+        double seconds = secondsSince(start);
+        printf("getPasswordsByUserId  %zu rows  %5.2f allocs/row  %8.0f rows/s\n", loaded,
+               static_cast<double>(g_allocations - before) / std::max<size_t>(loaded, 1), loaded / seconds);
+
+        before = g_allocations;
+        start = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+        loaded = db.forEachPassword(1, [&bytes](const PasswordView &row) { bytes += row.website.size(); });
+        seconds = secondsSince(start);
+        printf("forEachPassword       %zu rows  %5.2f allocs/row  %8.0f rows/s\n", loaded,
+               static_cast<double>(g_allocations - before) / std::max<size_t>(loaded, 1), loaded / seconds);
+    }
+    return 0;
+}
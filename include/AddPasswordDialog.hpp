@@ -1,8 +1,10 @@
 #ifndef ADDPASSDIALOG_HPP
 # define ADDPASSDIALOG_HPP
 
-#include "library.hpp"
-#include "SessionManager.hpp"
+#include "qtlibrary.hpp"
+#include "VaultContext.hpp"
+#include "Task.hpp"
+#include "SecureQString.hpp"
 
 class AddPasswordDialog : public QDialog
 {
@@ -10,6 +12,9 @@ class AddPasswordDialog : public QDialog
 
     private:
         void setupUi();
+
+        // Vault the entry is added to
+        VaultContext &_vault;
         
         QLineEdit *webEdit;
         QLineEdit *userEdit;
@@ -18,13 +23,19 @@ class AddPasswordDialog : public QDialog
         QPushButton *saveBttn;
         QPushButton *cancelBttn;
 
+        // Pending saves are cancelled when the dialog closes
+        CancellationSource _cancel;
+
+        // Encrypt and store the new entry off the GUI thread
+        Task<void> saveEntry(QString web, QString user, QString pass);
+
     // User event functions
     private slots: 
         void onSaveClicked();
         void onCancelClicked();
     
     public:
-        explicit AddPasswordDialog(QWidget* parent = nullptr);
+        explicit AddPasswordDialog(VaultContext &vault, QWidget* parent = nullptr);
         
         ~AddPasswordDialog();
 
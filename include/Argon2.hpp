@@ -0,0 +1,66 @@
+#ifndef ARGON2_HPP
+# define ARGON2_HPP
+
+#include "library.hpp"
+#include "SecureString.hpp"
+#include "TaskScheduler.hpp"
+
+// BLAKE2b (RFC 7693): OpenSSL 3.0 only has the fixed 64 byte digest,
+// Argon2 needs every output length from 1 to 64
+#define BLAKE2B_BLOCK_SIZE 128
+#define BLAKE2B_MAX_OUT 64
+
+// Argon2 (RFC 9106)
+#define ARGON2_BLOCK_SIZE 1024
+#define ARGON2_SYNC_POINTS 4
+#define ARGON2_VERSION_10 0x10
+#define ARGON2_VERSION_13 0x13
+
+// Unkeyed, incremental
+class Blake2b
+{
+    private:
+        uint64_t _h[8];
+        uint64_t _t[2];
+        unsigned char _buffer[BLAKE2B_BLOCK_SIZE];
+        size_t _filled;
+        size_t _outLength;
+
+        void compress(const unsigned char *block, bool last);
+
+    public:
+        // outLength 1..BLAKE2B_MAX_OUT
+        explicit Blake2b(size_t outLength);
+        ~Blake2b();
+
+        Blake2b &update(const void *data, size_t length);
+        Blake2b &updateU32(uint32_t value);         // little endian
+        void final(unsigned char *out);
+};
+
+enum class Argon2Type
+{
+    D = 0,
+    I = 1,
+    ID = 2
+};
+
+struct Argon2Params
+{
+    Argon2Type type = Argon2Type::ID;
+    uint32_t iterations = 3;
+    uint32_t memoryKiB = 64 * 1024;
+    uint32_t lanes = 1;
+    uint32_t version = ARGON2_VERSION_13;
+    std::span<const unsigned char> salt;
+    std::span<const unsigned char> secret;            // K, optional
+    std::span<const unsigned char> associated;        // X, optional
+};
+
+// Hash password into outLength bytes. Throws on invalid parameters or when
+// the memory can't be allocated. With a scheduler the lanes of every slice
+// are filled in parallel (don't call from one of its workers)
+void argon2Hash(const Argon2Params &params, SecretView password,
+                unsigned char *out, size_t outLength, TaskScheduler *scheduler = nullptr);
+
+#endif
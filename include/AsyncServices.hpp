@@ -0,0 +1,66 @@
+#ifndef ASYNCSERVICES_HPP
+# define ASYNCSERVICES_HPP
+
+#include "library.hpp"
+#include "Task.hpp"
+#include "SQLiteCipherDB.hpp"
+#include "CryptoManager.hpp"
+
+// Coroutine front-ends of the blocking services.
+// Every call hops to the service executor and resumes the awaiting coroutine
+// back on its own executor, e.g.  auto rows = co_await db.listPasswords(uid);
+// Arguments are taken by value: a lazy task may start after the caller's locals are gone.
+// Secrets are owned SecureStrings for the same reason (clone() the session ones).
+
+class AsyncDatabase
+{
+    private:
+        const SQLiteCipherDB &_db;
+        Executor &_exec;
+
+    public:
+        AsyncDatabase(const SQLiteCipherDB &db, Executor &exec);
+
+        Task<std::vector<Password>> listPasswords(int user_id) const;
+        Task<std::optional<Password>> getPassword(int id) const;
+        Task<long long> getChangeSeq() const;
+        Task<std::vector<Password>> getPasswordsChangedSince(int user_id, long long seq) const;
+        Task<std::vector<int>> getDeletedPasswordIdsSince(int user_id, long long seq) const;
+
+        Task<bool> addPassword(int user_id, std::string website, std::string username,
+                               std::string encrypted_password, std::string iv) const;
+        Task<bool> updatePassword(int id, std::string website, std::string username,
+                                  std::string encrypted_password, std::string iv) const;
+        Task<bool> deletePassword(int id) const;
+};
+
+class AsyncCrypto
+{
+    private:
+        const CryptoManager &_crypto;
+        Executor &_exec;
+        TaskScheduler *_scheduler;
+
+    public:
+        // With a scheduler, listings are decrypted in parallel on its workers
+        AsyncCrypto(const CryptoManager &crypto, Executor &exec, TaskScheduler *scheduler = nullptr);
+
+        Task<std::pair<std::string, std::string>> encryptPassword(
+            SecureString plaintext, SecureString masterPassword, SecureString salt) const;
+
+        Task<SecureString> decryptPassword(
+            std::string ciphertext_hex, std::string iv_hex,
+            SecureString masterPassword, SecureString salt) const;
+
+        // Decrypt a whole listing in a single hop (same order as pwds)
+        Task<std::vector<SecureString>> decryptPasswords(
+            std::vector<Password> pwds, SecureString masterPassword, SecureString salt) const;
+
+        // Record key of a session, for listings decrypted chunk by chunk
+        Task<SecureBytes> deriveKey(SecureString masterPassword, SecureString salt) const;
+
+        // Decrypt a chunk of a listing with a key from deriveKey (same order as pwds)
+        Task<std::vector<SecureString>> decryptPasswords(std::vector<Password> pwds, SecureBytes key) const;
+};
+
+#endif
@@ -2,20 +2,25 @@
 # define AUTHMANAGER_HPP
 
 #include "library.hpp"
+#include "SecureString.hpp"
+#include "SQLiteCipherDB.hpp"
+#include "CryptoManager.hpp"
 
 class AuthenticationManager
 {
-    private:      
-        
+    private:
+        const SQLiteCipherDB &_db;
+        const CryptoManager &_crypto;
+
     public:
-        AuthenticationManager();
+        AuthenticationManager(const SQLiteCipherDB &db, const CryptoManager &crypto);
         ~AuthenticationManager();
 
         //  Authenticate existed user
-        bool    authenticateUser(const std::string &username, const std::string &password) const;
+        bool    authenticateUser(const std::string &username, SecretView password) const;
         
         //  Register a new user into the system 
-        bool    registerNewUser(const std::string &username, const std::string &password, bool isMaster) const;
+        bool    registerNewUser(const std::string &username, SecretView password, bool isMaster) const;
 };
 
 #endif // AUTHMANAGER_HPP
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef CANCELLATION_HPP
+# define CANCELLATION_HPP
+
+#include "library.hpp"
+
+// Thrown instead of a result when the work was skipped because its token was cancelled
+class OperationCancelled : public std::runtime_error
+{
+    public:
+        OperationCancelled() : std::runtime_error("operation cancelled") {}
+};
+
+// Shared flag of a source; a linked flag also reports its parents' cancellation
+struct CancellationState
+{
+    std::atomic<bool> cancelled{false};
+    std::vector<std::shared_ptr<CancellationState>> parents;
+
+    bool isCancelled() const
+    {
+        if (cancelled.load())
+            return true;
+        for (const auto &parent : parents)
+            if (parent->isCancelled())
+                return true;
+        return false;
+    }
+};
+
+// Read side of a cancellation flag, cheap to copy into every awaiting task
+class CancellationToken
+{
+    private:
+        std::shared_ptr<CancellationState> _state;
+
+    public:
+        CancellationToken() {}
+        explicit CancellationToken(std::shared_ptr<CancellationState> state) : _state(std::move(state)) {}
+
+        bool isValid() const { return _state != nullptr; }
+        bool isCancelled() const { return _state && _state->isCancelled(); }
+        void throwIfCancelled() const
+        {
+            if (isCancelled())
+                throw OperationCancelled();
+        }
+
+        // Token cancelled as soon as either a or b is (e.g. dialog closed or session revoked)
+        static CancellationToken any(const CancellationToken &a, const CancellationToken &b)
+        {
+            if (!a.isValid())
+                return b;
+            if (!b.isValid())
+                return a;
+
+            auto state = std::make_shared<CancellationState>();
+            state->parents.push_back(a._state);
+            state->parents.push_back(b._state);
+            return CancellationToken(std::move(state));
+        }
+};
+
+// Owner side, cancels on destruction (keep one as a dialog member)
+class CancellationSource
+{
+    private:
+        std::shared_ptr<CancellationState> _state;
+
+    public:
+        CancellationSource() : _state(std::make_shared<CancellationState>()) {}
+        ~CancellationSource() { cancel(); }
+
+        // To prevent copy
+        CancellationSource(const CancellationSource &) = delete;
+        CancellationSource& operator=(const CancellationSource &) = delete;
+
+        CancellationToken token() const { return CancellationToken(_state); }
+        void cancel() { _state->cancelled.store(true); }
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef CONNECTIONMANAGER_HPP
+# define CONNECTIONMANAGER_HPP
+
+#include "library.hpp"
+#include "DBWriter.hpp"
+
+#include <unordered_map>
+
+// Upper bound of read-only connections opened by default
+#define DB_MAX_READERS 4
+
+// Read-only db connection with its own prepared statement cache
+class ReadConnection
+{
+    private:
+        sqlite3 *_db;
+        std::mutex _mutex;
+        std::unordered_map<std::string, sqlite3_stmt *> _stmts;
+
+    public:
+        explicit ReadConnection(const std::string &dbPath, const DatabaseCipher *cipher = nullptr);
+        ~ReadConnection();
+
+        // To prevent copy
+        ReadConnection(const ReadConnection &) = delete;
+        ReadConnection& operator=(const ReadConnection &) = delete;
+
+        sqlite3 *handle();
+        std::mutex &mutex();
+
+        // Cached statement, prepared on first use
+        sqlite3_stmt *prepare(const char *sql);
+};
+
+// Exclusive use of a reader by the calling thread. Statements obtained
+// through the lease are owned by the cache: never finalize them, they are
+// reset (closing their read transaction) when the lease goes away.
+class ReaderLease
+{
+    private:
+        ReadConnection *_conn;
+        std::unique_lock<std::mutex> _lock;
+        std::vector<sqlite3_stmt *> _used;
+
+    public:
+        explicit ReaderLease(ReadConnection *conn);
+        ~ReaderLease();
+
+        ReaderLease(ReaderLease &&other) = default;
+        ReaderLease(const ReaderLease &) = delete;
+        ReaderLease& operator=(const ReaderLease &) = delete;
+
+        sqlite3 *handle();
+
+        // Cached statement with bindings cleared, ready to bind and step
+        sqlite3_stmt *prepare(const char *sql);
+};
+
+// One writer connection (DBWriter) plus N read-only connections in WAL mode.
+// Thread affinity: the thread that created the manager (the GUI thread) owns
+// reader 0 alone, any other thread is pinned to one of the remaining readers
+// by its thread id, so UI reads never queue behind background work.
+class ConnectionManager
+{
+    private:
+        std::string _dbPath;
+        const DatabaseCipher *_cipher;
+        std::thread::id _ownerThread;
+        std::vector<std::unique_ptr<ReadConnection>> _readers;
+        std::unique_ptr<DBWriter> _writer;
+
+    public:
+        // cipher (nullable) keys every connection, it must outlive the manager
+        ConnectionManager(const std::string &dbPath, size_t readers = 0, const DatabaseCipher *cipher = nullptr);
+        ~ConnectionManager();
+
+        // To prevent copy
+        ConnectionManager(const ConnectionManager &) = delete;
+        ConnectionManager& operator=(const ConnectionManager &) = delete;
+
+        DBWriter &writer();
+
+        // Reader assigned to the calling thread
+        ReaderLease reader();
+
+        size_t readerCount() const;
+};
+
+#endif
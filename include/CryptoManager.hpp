@@ -2,6 +2,48 @@
 #define CRYPTOMANAGER_HPP
 
 #include "library.hpp"
+#include "TaskScheduler.hpp"
+#include "SecureString.hpp"
+
+// Record encryption: AES-256-CBC, key = PBKDF2-SHA256(master, user salt)
+#define CRYPTO_KEY_SIZE 32
+#define CRYPTO_IV_SIZE 16
+#define CRYPTO_BLOCK_SIZE 16
+#define CRYPTO_KDF_ITERATIONS 10000
+
+// Batches smaller than two chunks run on the calling thread
+#define CRYPTO_BATCH_MIN_CHUNK 32
+
+// Secret wrapping: AES-256-GCM, key = PBKDF2-SHA256(passphrase, random salt)
+#define CRYPTO_WRAP_SALT_SIZE 16
+#define CRYPTO_GCM_NONCE_SIZE 12
+#define CRYPTO_GCM_TAG_SIZE 16
+
+// Encrypted field as stored in the db (hex encoded)
+struct EncryptedField
+{
+    std::string ciphertext_hex;
+    std::string iv_hex;
+};
+
+// Secret sealed under a passphrase, kept in memory only (see VaultSession lock)
+struct WrappedSecret
+{
+    unsigned char salt[CRYPTO_WRAP_SALT_SIZE];
+    unsigned char nonce[CRYPTO_GCM_NONCE_SIZE];
+    unsigned char tag[CRYPTO_GCM_TAG_SIZE];
+    std::vector<unsigned char> ciphertext;
+    int iterations = 0;
+};
+
+// Passphrase already run through the wrap KDF: sealing or opening with it
+// costs no KDF work (see VaultSession lock)
+struct WrapKey
+{
+    unsigned char salt[CRYPTO_WRAP_SALT_SIZE];
+    int iterations = 0;
+    SecureBytes stretched;
+};
 
 class CryptoManager
 {
@@ -29,28 +71,121 @@ public:
 
     // Password Hashing with PBKDF2
     std::pair<std::string, std::string> hashPassword(
-        const std::string &password,
+        SecretView password,
         int iterations = 10000) const;
 
     // Verify that a password matches with it hash
     bool verifyPassword(
-        const std::string &password,
+        SecretView password,
         const std::string &storedHash,
         const std::string &salt,
         int iterations = 10000) const;
 
     // Encrypt a password using Master Password user
     std::pair<std::string, std::string> encryptPassword(
-        const std::string &plaintext,
-        const std::string &masterPassword,
-        const std::string &salt) const;
+        SecretView plaintext,
+        SecretView masterPassword,
+        SecretView salt) const;
 
     // Decrypt a cipher password
-    std::string decryptPassword(
+    SecureString decryptPassword(
         const std::string &ciphertext_hex,
         const std::string &iv_hex,
-        const std::string &masterPassword,
-        const std::string &salt) const;
+        SecretView masterPassword,
+        SecretView salt) const;
+
+    // ALLOCATION FREE HOT PATH
+    // Thread-local cipher contexts only re-keyed per call, results written into
+    // caller buffers. None of these log.
+
+    // Derive the record key of a master password and hex user salt
+    void deriveKey(
+        SecretView masterPassword,
+        SecretView salt,
+        unsigned char key[CRYPTO_KEY_SIZE]) const;
+
+    // Encrypt / decrypt length bytes with a derived key and raw IV.
+    // outSize must be at least length + CRYPTO_BLOCK_SIZE, in and out may be the same buffer.
+    // Return the written length or -1 on failure
+    int encryptInto(const unsigned char *key, const unsigned char *iv,
+                    const unsigned char *in, size_t length,
+                    unsigned char *out, size_t outSize) const;
+    int decryptInto(const unsigned char *key, const unsigned char *iv,
+                    const unsigned char *in, size_t length,
+                    unsigned char *out, size_t outSize) const;
+
+    // Decrypt a stored (hex) record into out, which needs ciphertext_hex.size() / 2
+    // + CRYPTO_BLOCK_SIZE bytes. Returns the plaintext length or -1
+    int decryptRecordInto(
+        const unsigned char *key,
+        std::string_view ciphertext_hex,
+        std::string_view iv_hex,
+        char *out, size_t outSize) const;
+
+    // Decrypt many records with a single key derivation.
+    // out[i] receives the plaintext of records[i] (empty if it failed); out is
+    // resized but its buffers keep their capacity, so reusing it avoids reallocations.
+    // With a scheduler the records are split in chunks across its workers.
+    // Returns the number of records that failed to decrypt.
+    size_t decryptBatch(
+        std::span<const EncryptedField> records,
+        std::vector<SecureString> &out,
+        SecretView masterPassword,
+        SecretView salt,
+        TaskScheduler *scheduler = nullptr,
+        TaskPriority priority = TaskPriority::Interactive) const;
+
+    // Same with a key from deriveKey, for callers decrypting in several batches
+    size_t decryptBatch(
+        std::span<const EncryptedField> records,
+        std::vector<SecureString> &out,
+        const unsigned char *key,
+        TaskScheduler *scheduler = nullptr,
+        TaskPriority priority = TaskPriority::Interactive) const;
+
+    // Encrypt many plaintexts with a single key derivation, a fresh IV each.
+    // out[i] receives the encrypted plaintexts[i]. Throws if any record fails.
+    void encryptBatch(
+        std::span<const SecretView> plaintexts,
+        std::vector<EncryptedField> &out,
+        SecretView masterPassword,
+        SecretView salt,
+        TaskScheduler *scheduler = nullptr,
+        TaskPriority priority = TaskPriority::Interactive) const;
+
+    // KEY WRAPPING
+    // One KDF to seal and one to open, the GCM tag tells a wrong passphrase apart.
+    // The GCM key is HKDF(stretched passphrase || ephemeral), ephemeral optional.
+
+    // Stretch passphrase with a fresh salt, or with the salt of an existing wrap
+    WrapKey deriveWrapKey(SecretView passphrase, int iterations = CRYPTO_KDF_ITERATIONS) const;
+    WrapKey deriveWrapKey(SecretView passphrase, const WrappedSecret &wrapped) const;
+
+    // Seal secret under passphrase with a fresh salt and nonce
+    WrappedSecret wrapSecret(
+        SecretView secret,
+        SecretView passphrase,
+        int iterations = CRYPTO_KDF_ITERATIONS) const;
+
+    // Seal with an already stretched key, mixing in ephemeral when given. No KDF
+    WrappedSecret wrapSecret(
+        SecretView secret,
+        const WrapKey &wrapKey,
+        const SecureBytes *ephemeral = nullptr) const;
+
+    // Open a wrapped secret into out. Returns false on a wrong passphrase
+    // or a tampered blob, out is left untouched then
+    bool unwrapSecret(
+        const WrappedSecret &wrapped,
+        SecretView passphrase,
+        SecureString &out) const;
+
+    // Open with an already stretched key and the same ephemeral used to seal
+    bool unwrapSecret(
+        const WrappedSecret &wrapped,
+        const WrapKey &wrapKey,
+        SecureString &out,
+        const SecureBytes *ephemeral = nullptr) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef DBWRITER_HPP
+# define DBWRITER_HPP
+
+#include "library.hpp"
+#include "DatabaseCipher.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <unordered_map>
+
+// Busy handling for concurrent instances sharing the same db file
+#define DB_BUSY_TIMEOUT_MS 5000
+#define DB_WRITE_RETRIES 5
+#define DB_RETRY_BACKOFF_MS 20
+
+// Group commit tuning
+#define WRITER_GROUP_WINDOW_MS 5
+#define WRITER_MAX_BATCH 256
+
+// A write run on the writer connection inside the current group transaction.
+// Returning false or throwing rolls back only this op
+typedef std::function<bool(sqlite3 *)> WriteOp;
+
+// Called on the writer thread once the op's transaction has committed (or failed),
+// before its future is resolved
+typedef std::function<void(bool)> WriteCallback;
+
+// Dedicated writer thread that owns its own db connection.
+// Writes are queued and everything arriving within WRITER_GROUP_WINDOW_MS is
+// committed in a single transaction, each op isolated by a savepoint.
+class DBWriter
+{
+    private:
+        struct PendingWrite
+        {
+            WriteOp op;
+            WriteCallback onDone;
+            std::promise<bool> done;
+        };
+
+        sqlite3 *_db;
+        std::string _dbPath;
+        int _windowMs;
+        size_t _maxBatch;
+
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::deque<PendingWrite> _queue;
+        bool _running;
+        std::thread _thread;
+
+        // Statements of the writer connection keyed by their SQL, and the ones
+        // handed out to the op in progress (reset once it returns)
+        std::unordered_map<std::string, sqlite3_stmt *> _stmts;
+        std::vector<sqlite3_stmt *> _used;
+
+        void run();
+        void releaseStatements();
+        void commitBatch(std::vector<PendingWrite> &batch);
+
+        // Execute a statement retrying with backoff while the db is busy
+        int execWithRetry(const char *sql);
+
+    public:
+        // cipher: key of an encrypted vault (nullptr for a plaintext one)
+        DBWriter(const std::string &dbPath, const DatabaseCipher *cipher = nullptr,
+                 int windowMs = WRITER_GROUP_WINDOW_MS, size_t maxBatch = WRITER_MAX_BATCH);
+        ~DBWriter();
+
+        // To prevent copy
+        DBWriter(const DBWriter &) = delete;
+        DBWriter& operator=(const DBWriter &) = delete;
+
+        // Queue a write, the future resolves when its group transaction commits
+        std::future<bool> submit(WriteOp op, WriteCallback onDone = nullptr);
+
+        // Cached statement of the writer connection, bindings cleared.
+        // Only from inside a WriteOp; never finalize it, it is reset after the op
+        sqlite3_stmt *prepare(const char *sql);
+
+        // Flush pending writes and stop the thread
+        void stop();
+};
+
+#endif
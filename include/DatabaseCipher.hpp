@@ -0,0 +1,108 @@
+#ifndef DATABASECIPHER_HPP
+# define DATABASECIPHER_HPP
+
+#include "library.hpp"
+#include "SecureMemory.hpp"
+#include "PageCipherVfs.hpp"
+
+// Vault file key: 256 bit key + 128 bit page salt, random per vault
+#define DB_KEY_SIZE 32
+#define DB_SALT_SIZE 16
+
+// Defaults of a new encrypted vault (overridable, see CipherSettings::fromEnvironment).
+// Page VFS rows measured by bench/CipherSettingsBench.cpp, 4096 balances scans
+// and lookups. The SQLCipher rows need a build linked against it
+#define DB_CIPHER_PAGE_SIZE 4096
+// 0: the key is handed to SQLCipher raw and no KDF runs when a connection
+// opens. The key is random, stretching it adds nothing but open latency
+#define DB_CIPHER_KDF_ITER 0
+
+// Key file written next to the vault: <vault>.key
+#define DB_KEYFILE_SUFFIX ".key"
+#define DB_KEYFILE_MAGIC "passman-vault-key 1"
+
+// What encrypts the pages: SQLCipher's codec, or the in-tree AES-GCM VFS
+// (PageCipherVfs, works with a plain SQLite)
+enum class CipherBackend
+{
+    SQLCipher,
+    Pages,
+};
+
+// Cipher parameters of one vault. They are part of the file format: they
+// are recorded in the key file when the vault is encrypted and every
+// connection must use the same ones. The page VFS only uses pageSize
+struct CipherSettings
+{
+#ifdef PASSMAN_PAGE_VFS
+    CipherBackend backend = CipherBackend::Pages;
+#else
+    CipherBackend backend = CipherBackend::SQLCipher;
+#endif
+    int pageSize = DB_CIPHER_PAGE_SIZE;     // cipher_page_size, power of two 512..65536
+    int kdfIter = DB_CIPHER_KDF_ITER;       // kdf_iter, 0 = raw key
+    bool hmac = true;                       // cipher_use_hmac: per page authentication
+    int plaintextHeader = 0;                // cipher_plaintext_header_size: 0 or 32
+
+    // Defaults overridden by PASSMAN_CIPHER_BACKEND (sqlcipher / pages),
+    // PASSMAN_CIPHER_PAGE_SIZE, PASSMAN_CIPHER_KDF_ITER,
+    // PASSMAN_CIPHER_HMAC (0 / 1) and PASSMAN_CIPHER_PLAINTEXT_HEADER.
+    // Throws on a value SQLCipher would reject
+    static CipherSettings fromEnvironment();
+};
+
+// Page encryption of a vault file (build with PASSMAN_USE_SQLCIPHER or
+// PASSMAN_USE_PAGE_VFS).
+// Everything on disk, usernames, websites and timestamps included, is
+// encrypted with a random device key kept in the vault's key file (0600).
+// The master password can't be the key: the users table must be readable
+// before anyone logs in. Keep the key file out of backups of the vault.
+class DatabaseCipher
+{
+    private:
+        SecureBytes _key;
+        SecureBytes _salt;
+        CipherSettings _settings;
+        std::unique_ptr<PageCipherVfs> _vfs;    // Pages backend only
+
+        // PRAGMA key / ATTACH KEY value: "x'<key><salt>'" (raw) or the hex key (passphrase)
+        SecureChars keyLiteral() const;
+        void configure(sqlite3 *db, const char *schema) const;
+        void exportVault(sqlite3 *db, const std::string &tmpPath, long long &users, long long &passwords) const;
+
+    public:
+        DatabaseCipher(SecureBytes key, SecureBytes salt, const CipherSettings &settings);
+
+        // To prevent copy
+        DatabaseCipher(const DatabaseCipher &) = delete;
+        DatabaseCipher& operator=(const DatabaseCipher &) = delete;
+
+        // Cipher of the vault at dbPath: read from its key file, or a new key
+        // file for a new or still plaintext vault. Throws if an encrypted vault
+        // lost its key file
+        static std::unique_ptr<DatabaseCipher> forVault(const std::string &dbPath);
+
+        static std::string keyFilePath(const std::string &dbPath);
+
+        // Existing vault readable without a key (written by a build without SQLCipher)
+        static bool isPlaintextVault(const std::string &dbPath);
+
+        // VFS every connection to the vault must be opened with (sqlite3_open_v2
+        // zVfs), nullptr for the default one
+        const char *vfsName() const;
+
+        // Key a fresh connection, before anything else touches it. Throws on a
+        // wrong key or when the linked SQLite has no SQLCipher codec
+        void apply(sqlite3 *db) const;
+
+        // One-shot migration of a plaintext vault: sqlcipher_export (or VACUUM
+        // INTO through the page VFS) into a new file, checked, then renamed
+        // over the original
+        void encryptVault(const std::string &dbPath) const;
+
+        const CipherSettings &settings() const;
+        // Page VFS counters, all zero with SQLCipher
+        PageCipherStats pageStats() const;
+};
+
+#endif
@@ -1,8 +1,10 @@
 #ifndef EDITPASSDIALOG_HPP
 # define EDITPASSDIALOG_HPP
 
-#include "library.hpp"
-#include "SessionManager.hpp"
+#include "qtlibrary.hpp"
+#include "VaultContext.hpp"
+#include "Task.hpp"
+#include "SecureQString.hpp"
 
 class EditPasswordDialog : public QDialog
 {
@@ -10,7 +12,9 @@ class EditPasswordDialog : public QDialog
 
     private:
         void setupUi();
-        
+
+        // Vault the entry belongs to
+        VaultContext &_vault;
         int _passwordId;
         
         QLineEdit *webEdit;
@@ -18,18 +22,27 @@ class EditPasswordDialog : public QDialog
         QLineEdit *userEdit;
         std::string userStr;
         QLineEdit *passEdit;
-        std::string passStr;
+        SecureString passStr;
 
         QPushButton *saveBttn;
         QPushButton *cancelBttn;
 
+        // Pending loads / saves are cancelled when the dialog closes
+        CancellationSource _cancel;
+
+        // Load and decrypt the entry off the GUI thread
+        Task<void> loadEntry();
+
+        // Encrypt and store the edited entry off the GUI thread
+        Task<void> saveEntry(QString web, QString user, QString pass);
+
     // User event functions
     private slots: 
         void onSaveClicked();
         void onCancelClicked();
     
     public:
-        explicit EditPasswordDialog(QWidget* parent = nullptr, int id = 0);
+        explicit EditPasswordDialog(VaultContext &vault, QWidget* parent = nullptr, int id = 0);
         
         ~EditPasswordDialog();
 };
@@ -0,0 +1,25 @@
+#ifndef EXECUTOR_HPP
+# define EXECUTOR_HPP
+
+#include "library.hpp"
+
+// Something that runs posted work on its own thread(s)
+class Executor
+{
+    private:
+        static thread_local Executor *_current;
+
+    protected:
+        // Mark the calling thread as driven by this executor
+        static void setCurrent(Executor *exec);
+
+    public:
+        virtual ~Executor() {}
+
+        virtual void post(std::function<void()> fn) = 0;
+
+        // Executor driving the calling thread (nullptr for unmanaged threads)
+        static Executor *current();
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef GUIEXECUTOR_HPP
+# define GUIEXECUTOR_HPP
+
+#include "qtlibrary.hpp"
+#include "Executor.hpp"
+
+// Runs posted work on the Qt main thread through its event loop.
+// Must be created on the GUI thread: coroutines awaiting from there resume here.
+class GuiExecutor : public Executor
+{
+    public:
+        GuiExecutor();
+        ~GuiExecutor();
+
+        void post(std::function<void()> fn) override;
+};
+
+#endif
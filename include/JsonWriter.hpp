@@ -0,0 +1,58 @@
+#ifndef JSONWRITER_HPP
+# define JSONWRITER_HPP
+
+#include "library.hpp"
+#include "SecureMemory.hpp"
+#include "SecureString.hpp"
+#include "VaultCache.hpp"
+
+// Minimal streaming JSON writer for the CLI output.
+// The text is built in secure memory: exports put plaintext passwords in it.
+// Commas are inserted automatically, nesting is the caller's responsibility.
+class JsonWriter
+{
+    private:
+        SecureChars _out;
+        std::vector<bool> _hasItems;    // one entry per open object / array
+        bool _afterKey;
+
+        void separate();
+        void append(const char *text, size_t length);
+        void appendString(const char *text, size_t length);
+
+    public:
+        JsonWriter();
+
+        JsonWriter &beginObject();
+        JsonWriter &endObject();
+        JsonWriter &beginArray();
+        JsonWriter &endArray();
+
+        JsonWriter &key(const std::string &name);
+        JsonWriter &value(SecretView text);
+        JsonWriter &value(const std::string &text);
+        JsonWriter &value(std::string_view text);
+        JsonWriter &value(const char *text);
+        JsonWriter &value(long long number);
+        JsonWriter &value(int number) { return value(static_cast<long long>(number)); }
+        JsonWriter &value(size_t number) { return value(static_cast<long long>(number)); }
+        JsonWriter &value(bool flag);
+        JsonWriter &null();
+
+        // key + value shortcut
+        template <typename T>
+        JsonWriter &field(const std::string &name, const T &v) { key(name); return value(v); }
+
+        // Written document, valid until the writer changes
+        SecretView view() const;
+
+        // Wipe and drop what view() returned, the open containers stay open:
+        // a long document goes out in parts
+        void clearOutput();
+};
+
+// Non-secret fields of a vault entry, inside an object the caller opened
+void writeEntryFields(JsonWriter &json, const PasswordView &pwd);
+void writeEntryFields(JsonWriter &json, const CachedEntry &entry);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef KDBXREADER_HPP
+# define KDBXREADER_HPP
+
+#include "library.hpp"
+#include "SecureString.hpp"
+#include "TaskScheduler.hpp"
+#include "Cancellation.hpp"
+
+// Entries handed out at a time
+#define KDBX_BATCH 1024
+// Limits checked before anything is allocated
+#define KDBX_MAX_HEADER (1024 * 1024)
+#define KDBX_MAX_BLOCK (64 * 1024 * 1024)
+#define KDBX_MAX_FIELD (1024 * 1024)
+// Argon2 memory a file may ask for
+#define KDBX_MAX_KDF_MEMORY (2ULL * 1024 * 1024 * 1024)
+
+// Live entry of the database (history and recycle bin left out),
+// valid during the callback only
+struct KdbxEntry
+{
+    std::string_view title;
+    std::string_view url;
+    std::string_view username;
+    SecretView password;
+};
+
+struct KdbxStats
+{
+    size_t entries = 0;
+    size_t recycled = 0;        // entries of the recycle bin, not handed out
+    size_t blocks = 0;
+    long long bytes = 0;        // file size
+    double kdfMs = 0;
+    double ms = 0;
+};
+
+// Reader of KeePass 2 databases in the KDBX 4 format: AES-KDF or Argon2d /
+// Argon2id key derivation, AES-256-CBC or ChaCha20 payload, gzip, and the
+// ChaCha20 inner stream of protected values. Password and / or key file
+// (XML v1 / v2, 32 raw bytes, 64 hex digits or any file, hashed).
+//
+// The file is read twice, block by block, and never held whole: first every
+// HMAC block is checked, then the blocks are checked again, decrypted,
+// inflated and fed to a streaming XML parser. Memory is one block (KeePass
+// writes 1 MiB ones), the inflate window and KDBX_BATCH entries.
+class KdbxReader
+{
+    private:
+        TaskScheduler *_scheduler;
+
+    public:
+        // The scheduler (nullable) fills the Argon2 lanes, don't call read()
+        // from one of its workers
+        explicit KdbxReader(TaskScheduler *scheduler = nullptr);
+
+        // Hand the entries to onEntries, KDBX_BATCH at a time. Throws on a wrong
+        // key ("wrong password or key file"), a damaged or unsupported file,
+        // and OperationCancelled once token is cancelled. A file whose blocks
+        // don't all authenticate delivers nothing
+        KdbxStats read(const std::string &path, SecretView password, const std::string &keyFile,
+                       const std::function<void(std::span<const KdbxEntry>)> &onEntries,
+                       CancellationToken token = CancellationToken()) const;
+
+        // The file starts with the KeePass 2 signature
+        static bool isKdbx(const std::string &path);
+};
+
+#endif
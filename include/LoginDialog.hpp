@@ -1,14 +1,18 @@
 #ifndef LOGINDIALOG_HPP
 #define LOGINDIALOG_HPP
 
-#include "library.hpp"
-#include "SessionManager.hpp"
+#include "qtlibrary.hpp"
+#include "VaultContext.hpp"
+#include "SecureQString.hpp"
 
 class LoginDialog : public QDialog
 {
     Q_OBJECT // Signals, slots and meta objects
 
     private:
+        // Vault to log into / register in
+        VaultContext &_vault;
+
         // Tab widget
         QTabWidget *tabWidget;
         
@@ -35,8 +39,8 @@ class LoginDialog : public QDialog
         void setupRegisterTab();
         
         // Helper methods
-        int calculatePasswordStrength(const std::string &password);
-        bool validatePassword(const std::string &password);
+        int calculatePasswordStrength(SecretView password);
+        bool validatePassword(SecretView password);
 
     // User event functions
     private slots: 
@@ -47,7 +51,7 @@ class LoginDialog : public QDialog
         void onPasswordChanged(const QString &pass);
     
     public:
-        explicit LoginDialog(QWidget* parent = nullptr);
+        explicit LoginDialog(VaultContext &vault, QWidget* parent = nullptr);
         ~LoginDialog();
         
         // Set which tab to show initially (0 = Login, 1 = Register)
@@ -1,17 +1,30 @@
 #ifndef MAINWINDOW_HPP
 #define MAINWINDOW_HPP
 
-#include "library.hpp"
-#include "SessionManager.hpp"
+#include "qtlibrary.hpp"
+#include "VaultContext.hpp"
 #include "AddPasswordDialog.hpp"
 #include "EditPasswordDialog.hpp"
+#include "VaultWatcher.hpp"
+#include "VaultBackup.hpp"
+#include "Task.hpp"
+#include "SecureQString.hpp"
 
+// Idle time before the vault locks itself
+#define IDLE_LOCK_MS (5 * 60 * 1000)
+// How often the decrypted entries whose TTL elapsed are wiped
+#define SECRET_PURGE_MS (10 * 1000)
+// Rows decrypted per hop when (re)filling the table, bounds the plaintexts alive at once
+#define UI_DECRYPT_BATCH 256
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT // Signals, slots and meta objects
 
     private:
+        // Vault shown by this window
+        VaultContext &_vault;
+
         QTableWidget *passwordTable;
         
         void setupUI();
@@ -20,18 +33,78 @@ class MainWindow : public QMainWindow
         QPushButton *addBttn;
         QPushButton *refreshBttn;
         QPushButton *logoutBttn;
+        QPushButton *lockBttn;
+        QPushButton *pinBttn;
+        QPushButton *backupBttn;
+
+        // Idle auto-lock
+        QTimer *idleTimer;
+        QWidget *lockPanel;
+        QLineEdit *unlockEdit;
+        QCheckBox *unlockPinCheck;
+        QPushButton *unlockBttn;
+
+        // Wipes expired entries of the vault's SecretCache
+        QTimer *secretsTimer;
+
+        // Cross-process change detection
+        std::unique_ptr<VaultWatcher> vaultWatcher;
+        long long _lastDataVersion;
+        long long _lastChangeSeq;
+
+        // Cancels in-flight loads when the window goes away
+        CancellationSource _cancel;
+        unsigned int _loadGeneration;
+        // A reload is filling the table or was dropped halfway (locked meanwhile)
+        bool _tablePartial;
+
+        // Backup running on the scheduler, waited for before the window goes
+        std::future<void> _backup;
+
+        // Load (decrypting off the GUI thread) and show all the user's passwords
+        Task<void> reloadTable();
+
+        // Load and apply only the rows changed since _lastChangeSeq
+        Task<void> applyChanges();
+
+        // Fill a table row with a password entry and its decrypted value
+        void fillRow(int row, const Password &pwd, SecretView plaintext);
+
+        // Find the table row showing a password id (-1 if not shown)
+        int findRowByPasswordId(int id) const;
+
+        // Apply only the rows changed since _lastChangeSeq
+        void refreshChangedRows();
+
+        // Wipe the shown passwords and the session key, keep websites / usernames
+        void lockVault();
+        void showLocked(bool locked);
+
+        // Decrypt the password column again from the ciphertexts kept in the rows
+        Task<void> restorePasswords();
+
+    protected:
+        // Any user input restarts the idle timer
+        bool eventFilter(QObject *watched, QEvent *event) override;
 
     // User event functions
     private slots:
         void onClickAddPssBttn();
         void onClickLogoutBttn();
+        void onClickLockBttn();
+        void onClickUnlockBttn();
+        void onClickPinBttn();
+        void onClickBackupBttn();
 
         void onViewPassword(int id);
         void onEditPassword(int id);
         void onDeletePassword(int id);
 
+        // Called (on the GUI thread) when the watcher sees db activity
+        void onVaultChanged();
+
     public:
-        explicit MainWindow();
+        explicit MainWindow(VaultContext &vault, QWidget *parent = nullptr);
         ~MainWindow();
         
         void    updateUi(void);
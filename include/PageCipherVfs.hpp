@@ -0,0 +1,99 @@
+#ifndef PAGECIPHERVFS_HPP
+# define PAGECIPHERVFS_HPP
+
+#include "library.hpp"
+#include "SecureMemory.hpp"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Per page reserved area (SQLite "reserved bytes"): nonce then tag
+#define PAGE_NONCE_SIZE 12
+#define PAGE_TAG_SIZE 16
+#define PAGE_RESERVED_BYTES (PAGE_NONCE_SIZE + PAGE_TAG_SIZE)
+
+// Decrypted pages kept per vault, shared by all of its connections
+#define PAGE_CACHE_PAGES 64
+
+struct PageCipherStats
+{
+    unsigned long long encrypted;       // pages written
+    unsigned long long decrypted;       // pages authenticated and decrypted
+    unsigned long long cacheHits;       // reads served from the decrypted page cache
+    unsigned long long authFailures;    // pages whose tag did not verify
+};
+
+// SQLite VFS shim encrypting the vault with AES-256-GCM, page by page, on top
+// of the default VFS. The last PAGE_RESERVED_BYTES of every page are reserved
+// by SQLite and hold the page's random nonce and tag; the file kind and offset
+// are authenticated too, so pages can't be swapped around. The whole file is
+// encrypted, header included, and so are the rollback journal and the WAL
+// frames (their headers only hold page numbers, salts and checksums).
+// Temp files are not: connections run with temp_store=MEMORY.
+//
+// SQLite's own cache is per connection and dropped whenever another one
+// commits, so decrypted pages are also kept here, shared by every connection
+// of the vault. A cached page is served only if the nonce and tag read back
+// from the file are the ones it was decrypted from: a page rewritten by any
+// process is decrypted again.
+class PageCipherVfs
+{
+    private:
+        struct File;        // sqlite3_file of the shim, the real file follows it
+        struct Io;          // sqlite3_io_methods / sqlite3_vfs callbacks
+
+        struct CacheSlot
+        {
+            uint64_t key;
+            unsigned char reserved[PAGE_RESERVED_BYTES];
+        };
+
+        sqlite3_vfs _vfs;
+        sqlite3_vfs *_base;
+        std::string _name;
+        SecureBytes _key;
+        int _pageSize;
+
+        // Decrypted page cache: one locked block of PAGE_CACHE_PAGES pages
+        mutable std::mutex _cacheMutex;
+        SecureBytes _cachePages;
+        std::vector<CacheSlot> _slots;
+        std::list<size_t> _lru;                 // slot indices, most recent first
+        std::unordered_map<uint64_t, std::list<size_t>::iterator> _cacheIndex;
+        std::unordered_map<std::string, uint64_t> _fileIds;
+
+        std::atomic<unsigned long long> _encrypted;
+        std::atomic<unsigned long long> _decrypted;
+        std::atomic<unsigned long long> _cacheHits;
+        std::atomic<unsigned long long> _authFailures;
+
+        uint64_t fileId(const char *dbName);
+        bool cachedPage(uint64_t key, const unsigned char *reserved, unsigned char *page);
+        void cachePage(uint64_t key, const unsigned char *page);
+
+        bool encryptPage(EVP_CIPHER_CTX *ctx, const unsigned char *plain, unsigned char *out, int kind, sqlite3_int64 offset);
+        bool decryptPage(EVP_CIPHER_CTX *ctx, unsigned char *page, int kind, sqlite3_int64 offset);
+
+    public:
+        // key: DB_KEY_SIZE bytes. Registers a new VFS (not the default one)
+        PageCipherVfs(const SecureBytes &key, int pageSize);
+        // Unregisters it, every connection using it must be closed
+        ~PageCipherVfs();
+
+        // To prevent copy
+        PageCipherVfs(const PageCipherVfs &) = delete;
+        PageCipherVfs& operator=(const PageCipherVfs &) = delete;
+
+        // Name to open connections with (sqlite3_open_v2 zVfs, ?vfs= URIs)
+        const char *name() const;
+        int pageSize() const;
+
+        // Prepare a connection opened through this VFS, before anything else
+        // touches it: page size and reserved bytes of a new file, no temp files
+        void configure(sqlite3 *db, const char *schema = "main") const;
+
+        PageCipherStats getStats() const;
+};
+
+#endif
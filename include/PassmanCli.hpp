@@ -0,0 +1,91 @@
+#ifndef PASSMANCLI_HPP
+# define PASSMANCLI_HPP
+
+#include "library.hpp"
+#include "TaskScheduler.hpp"
+#include "VaultContext.hpp"
+#include "JsonWriter.hpp"
+#include "Terminal.hpp"
+#include "VaultQuery.hpp"
+#include "VaultBackup.hpp"
+#include "VaultExport.hpp"
+#include "KdbxReader.hpp"
+#include "VaultSync.hpp"
+
+// Exit codes of passman-cli
+#define CLI_OK 0
+#define CLI_ERROR 1
+#define CLI_USAGE 2
+#define CLI_AUTH_FAILED 3
+#define CLI_NOT_FOUND 4
+
+// Plaintext exports are decrypted, written and wiped this many entries at a time
+#define CLI_EXPORT_BATCH 1024
+
+// Headless front-end over passman_core (no Qt), for scripts and batch jobs.
+// Results are JSON on stdout, errors a JSON object on stderr. Secrets (master
+// password, new entry password) are read from the terminal with echo off, or
+// one per line from stdin when it is piped.
+class PassmanCli
+{
+    private:
+        struct Options
+        {
+            std::string dbPath;
+            std::string user;
+            std::string format = "json";
+            std::string output;
+            std::string keyFile;        // import of a KeePass database
+            int keep = -1;              // backup: -1 = BACKUP_KEEP
+            bool compress = false;
+            bool verbose = false;
+            bool agent = false;
+            bool help = false;
+            std::string command;
+            std::vector<std::string> args;
+        };
+
+        Options _opts;
+
+        // Declared first: the vault's async services run on it
+        std::unique_ptr<TaskScheduler> _scheduler;
+        std::unique_ptr<VaultContext> _vault;
+
+        bool parseArgs(int argc, char **argv);
+        void printUsage(std::ostream &out) const;
+        int fail(int code, const std::string &message) const;
+
+        // Open the vault and log in, returns CLI_OK or the exit code to use
+        int openVault();
+
+        // Entries of the logged-in user, not decrypted
+        std::vector<Password> entries() const;
+
+        // Forward list / search / get to a running passmand (--agent)
+        int viaAgent();
+
+        // Subcommands
+        int cmdList();
+        int cmdGet();
+        int cmdAdd();
+        int cmdImport();
+        int cmdExport();
+        int importEncrypted(const std::string &path);
+        int importKdbx(const std::string &path);
+        int exportEncrypted();
+        int cmdSearch();
+        int cmdBackup();
+        int cmdSync();
+
+    public:
+        PassmanCli();
+        ~PassmanCli();
+
+        // To prevent copy
+        PassmanCli(const PassmanCli &) = delete;
+        PassmanCli& operator=(const PassmanCli &) = delete;
+
+        int run(int argc, char **argv);
+};
+
+#endif
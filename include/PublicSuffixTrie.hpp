@@ -0,0 +1,49 @@
+#ifndef PUBLICSUFFIXTRIE_HPP
+# define PUBLICSUFFIXTRIE_HPP
+
+#include "library.hpp"
+
+#include <cstdint>
+#include <istream>
+#include <string_view>
+
+// Public suffix rules (publicsuffix.org format) compiled into a flat trie keyed
+// by labels from right to left. Children of a node are contiguous and sorted,
+// so a lookup is one binary search per label of the host.
+// Rules are plain ("co.uk"), wildcard ("*.ck") or exception ("!www.ck").
+class PublicSuffixTrie
+{
+    private:
+        struct Node
+        {
+            uint32_t label;         // Offset of the label in _labels
+            uint16_t labelLength;
+            uint8_t flags;
+            uint32_t firstChild;    // Index in _nodes of the first child
+            uint32_t childCount;
+        };
+
+        std::vector<Node> _nodes;   // _nodes[0] is the root
+        std::string _labels;
+
+        const Node *findChild(const Node &node, std::string_view label) const;
+
+    public:
+        // Compile the rules read from in, one per line, "//" comments ignored
+        explicit PublicSuffixTrie(std::istream &in);
+
+        // Trie over the rule set built into passman
+        static const PublicSuffixTrie &builtin();
+
+        // Number of labels of the public suffix of host ("a.b.co.uk" -> 2).
+        // Unlisted TLDs count as one label (the implicit "*" rule)
+        size_t suffixLabels(std::string_view host) const;
+
+        // Public suffix plus one label ("a.b.co.uk" -> "b.co.uk"),
+        // empty when host is itself a public suffix
+        std::string registrableDomain(std::string_view host) const;
+
+        size_t ruleCount() const;
+};
+
+#endif
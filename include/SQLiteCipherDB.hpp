@@ -2,18 +2,78 @@
 # define SQLITECIPHERDB_HPP
 
 #include "library.hpp"
+#include "ConnectionManager.hpp"
+#include "VaultCache.hpp"
+#include "DatabaseCipher.hpp"
+
+// Bump when the URL normalization or the public suffix rules change,
+// the host and domain columns are then recomputed on the next open
+#define URL_INDEX_VERSION 1
+
+// Record uuid in bytes, stored as lowercase hex
+#define SYNC_UUID_SIZE 16
+
+// Written next to the vault: <vault>.instance, id of this copy of the file
+// (see SQLiteCipherDB::migrateSync)
+#define SYNC_INSTANCE_SUFFIX ".instance"
+
+// Deleted records of a user without sync peers are forgotten after this
+// long, checked on open (see SQLiteCipherDB::expireDeletions)
+#define SYNC_DELETION_HORIZON_DAYS 90
+
+// Told the id of a password updated or deleted through this instance, on the
+// writer thread right after the commit and before the caller is resumed
+typedef std::function<void(int)> PasswordChangeListener;
+
+// Version of a record as exchanged between vaults (see VaultSync). Versions
+// are ordered by revision, then origin: the greater one wins everywhere.
+// Views into a statement step or a sync segment
+struct SyncRecord
+{
+    std::string_view uuid;          // same on every vault
+    long long revision = 0;         // bumped by every change
+    long long origin = 0;           // vault id of the change
+    long long changeSeq = 0;        // local export order
+    bool deleted = false;           // tombstone, no fields
+    std::string_view website;
+    std::string_view username;
+    std::string_view encrypted_password;
+    std::string_view iv;
+    std::string_view created_at;
+};
+
+struct SyncApplyStats
+{
+    size_t added = 0;
+    size_t updated = 0;
+    size_t deleted = 0;
+    size_t stale = 0;               // older than (or same as) the local version
+};
 
 class SQLiteCipherDB
 {
     private:
-        sqlite3 *db;
         std::string dbPath;
-        
-        void setupDB(void);
+
+        // Page encryption key, only with PASSMAN_USE_SQLCIPHER (nullptr otherwise)
+        std::unique_ptr<DatabaseCipher> cipher;
+
+        // Writer thread + read-only connections (reads never wait on writes)
+        std::unique_ptr<ConnectionManager> connections;
+
+        PasswordChangeListener passwordChanged;
+        WriteCallback notifyPasswordChanged(int id, WriteCallback onDone) const;
+
+        void setupDB(sqlite3 *db);
+        void migrateDB(sqlite3 *db);
+        void migrateSync(sqlite3 *db);
+        void migrateUrlIndex(sqlite3 *db);
+        void expireDeletions(sqlite3 *db);
         bool findDataBasePath();
 
     public:
-        SQLiteCipherDB();
+        // Empty path -> default vault in $HOME/.local/share/passman
+        explicit SQLiteCipherDB(const std::string &path = "");
         ~SQLiteCipherDB();
 
         // Creates a new user in the DB
@@ -55,9 +115,22 @@ class SQLiteCipherDB
         // Get all of a user's passwords from the database 
         std::vector<Password> getPasswordsByUserId(int user_id) const;
 
+        // Stream the user's passwords (ascending id) without copying them: the
+        // view handed to fn dies with the step. fn must not query this db.
+        // Returns the number of rows
+        size_t forEachPassword(int user_id, const std::function<void(const PasswordView &)> &fn) const;
+
+        // Replace the content of cache with the user's passwords, rows are
+        // copied from the statement straight into the cache arena (records decoded)
+        void loadVaultCache(int user_id, VaultCache &cache) const;
+
         // Get a specific password by ID
         bool getPassword(int id, Password &password) const;
 
+        // Entries of the user whose website points at url, from the indexed
+        // host/domain columns: exact host first, then same registrable domain
+        std::vector<UrlMatch> findByUrl(int user_id, const std::string &url) const;
+
         // Update a password by ID
         bool updatePassword(
             int id,
@@ -69,8 +142,77 @@ class SQLiteCipherDB
         // Delete a password by ID
         bool deletePassword(int id) const;
 
+        // ASYNC WRITES
+        // Queued on the writer thread, the future (and onDone, called on the
+        // writer thread) resolves once the group transaction has committed
+        std::future<bool> addPasswordAsync(
+            int user_id,
+            const std::string &website,
+            const std::string &username,
+            const std::string &encrypted_password,
+            const std::string &iv,
+            WriteCallback onDone = nullptr) const;
+
+        std::future<bool> updatePasswordAsync(
+            int id,
+            const std::string &website,
+            const std::string &username,
+            const std::string &encrypted_password,
+            const std::string &iv,
+            WriteCallback onDone = nullptr) const;
+
+        std::future<bool> deletePasswordAsync(int id, WriteCallback onDone = nullptr) const;
+
+        // Set once, before any write (see PasswordChangeListener)
+        void setPasswordChangeListener(PasswordChangeListener listener);
+
         // Get the number of stored passwords
         int getPasswordCount() const;
+
+        // CHANGE DETECTION
+        // Path of the db file (used by VaultWatcher)
+        const std::string &getPath() const;
+
+        // Page encryption of the file, nullptr for a plaintext vault
+        const DatabaseCipher *getCipher() const;
+
+        // Changes whenever another connection commits to the db
+        long long getDataVersion() const;
+
+        // Last change sequence number assigned to a password write
+        long long getChangeSeq() const;
+
+        // Passwords inserted or updated after the given change sequence
+        std::vector<Password> getPasswordsChangedSince(int user_id, long long seq) const;
+
+        // Ids of passwords deleted after the given change sequence
+        std::vector<int> getDeletedPasswordIdsSince(int user_id, long long seq) const;
+
+        // SYNC
+        // Id of this vault file, origin of the changes made here
+        long long getVaultId() const;
+
+        // Sync bookkeeping kept in vault_meta (fallback when missing)
+        long long getSyncState(const std::string &key, long long fallback = 0) const;
+        bool setSyncState(const std::string &key, long long value) const;
+
+        // Forget the user's deletions (tombstones and change_log rows) up to seq,
+        // once every sync peer has acknowledged this vault past it. Deletions
+        // applied from a peer go with the next local change acknowledged after
+        // them. Returns the rows dropped
+        size_t pruneDeletions(int user_id, long long seq) const;
+
+        // Stream the change_log rows of the user made on this vault (not applied
+        // from a peer) after seq, in change order, at most limit. Same rules
+        // as forEachPassword. Returns the number of rows
+        size_t forEachLocalChange(int user_id, long long seq, size_t limit,
+                                  const std::function<void(const SyncRecord &)> &fn) const;
+
+        // Apply a peer's versions to the user's records in one transaction,
+        // those newer than the local ones win. stateKey is set to stateValue
+        // in the same transaction. Throws if the transaction fails
+        SyncApplyStats applySyncRecords(int user_id, std::span<const SyncRecord> records,
+                                        const std::string &stateKey, long long stateValue) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef SECRETCACHE_HPP
+# define SECRETCACHE_HPP
+
+#include "library.hpp"
+#include "SecureString.hpp"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Decrypted entries kept at most, least recently used ones go first
+#define SECRET_CACHE_CAPACITY 64
+// Time a decrypted entry may stay cached after it was stored
+#define SECRET_CACHE_TTL_MS (60 * 1000)
+
+struct SecretCacheStats
+{
+    size_t entries;
+    size_t capacity;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;       // pushed out by capacity
+    unsigned long long expirations;     // TTL elapsed
+    unsigned long long invalidations;   // entry updated or deleted
+    unsigned long long flushes;         // logout, lock, memory pressure
+};
+
+// Bounded LRU of decrypted passwords keyed by entry id, so repeated reveals
+// and copies skip the KDF and the decryption. Plaintexts live in the secure
+// arena and are wiped as soon as they leave the cache.
+// Every entry remembers the IV it was decrypted from: an update re-encrypts
+// with a fresh IV, so a lookup with the current IV never returns an old
+// password even if an invalidation was missed. Safe from any thread.
+class SecretCache
+{
+    private:
+        struct Entry
+        {
+            int id;
+            std::string iv;
+            SecureString plaintext;
+            std::chrono::steady_clock::time_point expires;
+        };
+
+        mutable std::mutex _mutex;
+        std::list<Entry> _lru;     // most recently used first
+        std::unordered_map<int, std::list<Entry>::iterator> _index;
+        size_t _capacity;
+        std::chrono::milliseconds _ttl;
+        SecretCacheStats _stats;
+
+        // Caller holds _mutex
+        void erase(std::unordered_map<int, std::list<Entry>::iterator>::iterator it);
+
+    public:
+        explicit SecretCache(size_t capacity = SECRET_CACHE_CAPACITY,
+                             std::chrono::milliseconds ttl = std::chrono::milliseconds(SECRET_CACHE_TTL_MS));
+
+        // To prevent copy
+        SecretCache(const SecretCache &) = delete;
+        SecretCache& operator=(const SecretCache &) = delete;
+
+        // Copy of the cached plaintext of id if it was decrypted from iv and has
+        // not expired. iv is compared as bytes: a caller keeps one encoding (hex, raw)
+        bool get(int id, std::string_view iv, SecureString &out);
+
+        // Store (or refresh) the plaintext of id, called after a decryption or a save
+        void put(int id, std::string_view iv, SecretView plaintext);
+
+        // Entry updated or deleted
+        void invalidate(int id);
+
+        // Drop every entry whose TTL elapsed
+        void purgeExpired();
+
+        // Drop everything (logout, lock, memory pressure)
+        void flush();
+
+        SecretCacheStats getStats() const;
+};
+
+#endif
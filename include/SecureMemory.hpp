@@ -0,0 +1,118 @@
+#ifndef SECUREMEMORY_HPP
+# define SECUREMEMORY_HPP
+
+#include "library.hpp"
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+// Locked region reserved at first use for small secrets
+#define SECURE_ARENA_SIZE (256 * 1024)
+// Further locked regions mapped whenever the arena runs out of pages
+#define SECURE_ARENA_GROW_SIZE (1024 * 1024)
+
+// Slab size classes: 16, 32, ... SECURE_MAX_CLASS bytes
+#define SECURE_MIN_CLASS 16
+#define SECURE_MAX_CLASS 4096
+#define SECURE_CLASSES 9
+
+struct SecureMemoryStats
+{
+    size_t arenaBytes;           // usable arena size, every region
+    size_t regions;              // first region plus the ones it grew by
+    bool locked;                 // every mapping is mlock'ed (false if RLIMIT_MEMLOCK refused one)
+    unsigned long long lockFailures;   // mappings left unlocked, their secrets may be swapped
+    size_t pagesUsed;            // arena pages handed to a size class
+    size_t inUseBytes;           // bytes currently allocated (size class granularity)
+    size_t peakBytes;
+    unsigned long long allocations;
+    unsigned long long frees;
+    size_t largeBytes;           // live allocations outside the arena
+    unsigned long long largeAllocations;
+};
+
+// Process wide allocator for keys, master passwords and plaintext secrets.
+// mmap'ed regions, mlock'ed and excluded from core dumps, with a PROT_NONE
+// guard page on each side. Small blocks come from per size class free lists
+// carved out of the regions page by page; every block is wiped when freed.
+// A full arena grows by another SECURE_ARENA_GROW_SIZE region (kept for the
+// life of the process), only requests above SECURE_MAX_CLASS get their own
+// locked mapping.
+class SecureArena
+{
+    private:
+        struct Region
+        {
+            size_t pages;
+            std::vector<unsigned char> pageClass;   // size class of every used page
+        };
+
+        mutable std::mutex _mutex;
+        size_t _pageSize;
+        std::map<unsigned char *, Region> _regions;   // by first usable page
+        unsigned char *_arena;           // region pages are carved from
+        size_t _nextPage;
+
+        void *_freeLists[SECURE_CLASSES];
+        std::unordered_map<void *, size_t> _large;
+
+        SecureMemoryStats _stats;
+
+        SecureArena();
+
+        static size_t classIndex(size_t size);
+        static size_t classSize(size_t index);
+
+        bool mapRegion(size_t bytes);
+        bool lockMapping(void *addr, size_t length);
+        bool carvePage(size_t index);
+        void *allocateLarge(size_t size);
+
+    public:
+        // To prevent copy
+        SecureArena(const SecureArena &) = delete;
+        SecureArena& operator=(const SecureArena &) = delete;
+
+        // Never destroyed: static objects freeing secrets at exit may outlive any destructor
+        static SecureArena &instance();
+
+        void *allocate(size_t size);
+        void deallocate(void *ptr);
+
+        SecureMemoryStats getStats() const;
+};
+
+// std allocator drawing from SecureArena
+template <typename T>
+class SecureAllocator
+{
+    public:
+        typedef T value_type;
+
+        SecureAllocator() noexcept {}
+        template <typename U>
+        SecureAllocator(const SecureAllocator<U> &) noexcept {}
+
+        T *allocate(size_t n)
+        {
+            return static_cast<T *>(SecureArena::instance().allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T *ptr, size_t)
+        {
+            SecureArena::instance().deallocate(ptr);
+        }
+
+        template <typename U>
+        bool operator==(const SecureAllocator<U> &) const noexcept { return true; }
+        template <typename U>
+        bool operator!=(const SecureAllocator<U> &) const noexcept { return false; }
+};
+
+// Byte / char buffers living in secure memory.
+// Not std::basic_string: short strings would be stored inline, outside the arena.
+typedef std::vector<unsigned char, SecureAllocator<unsigned char>> SecureBytes;
+typedef std::vector<char, SecureAllocator<char>> SecureChars;
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef SECUREQSTRING_HPP
+# define SECUREQSTRING_HPP
+
+#include "qtlibrary.hpp"
+#include "SecureString.hpp"
+
+// Bridges between Qt text widgets and SecureString.
+// Qt keeps its own copies of what is shown; these only avoid leaving
+// extra std::string / QByteArray copies around.
+
+// QString -> SecureString through a UTF-8 buffer wiped right after
+inline SecureString toSecureString(const QString &text)
+{
+    QByteArray utf8 = text.toUtf8();
+    SecureString secret(utf8.constData(), utf8.size());
+    utf8.fill('\0');
+    return secret;
+}
+
+inline QString toQString(SecretView secret)
+{
+    return QString::fromUtf8(secret.data(), static_cast<int>(secret.size()));
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef SECURERANDOM_HPP
+# define SECURERANDOM_HPP
+
+#include "library.hpp"
+
+// Bytes buffered per thread between two refills from the OpenSSL DRBG
+#define RANDOM_POOL_SIZE 4096
+
+// Requests this large skip the pool and go straight to the DRBG
+#define RANDOM_DIRECT_THRESHOLD (RANDOM_POOL_SIZE / 4)
+
+// AEAD nonces: 4 byte random prefix + 8 byte big endian counter
+#define NONCE_SIZE 12
+#define NONCE_PREFIX_SIZE 4
+
+// Buffered CSPRNG for IVs, salts and nonces.
+// Every thread owns a pool refilled in RANDOM_POOL_SIZE blocks, so the hot
+// path is a memcpy. Bytes are wiped from the pool as they are handed out,
+// the pool is discarded in a forked child (parent and child must never share
+// output). Pools live in the secure arena and are wiped when the thread exits.
+class SecureRandom
+{
+    public:
+        // Fill out with length random bytes, throws if the DRBG fails
+        static void fill(unsigned char *out, size_t length);
+
+        // Drop whatever the calling thread has buffered
+        static void discard();
+};
+
+// Deterministic nonce sequence for AEAD modes (GCM, ChaCha20-Poly1305).
+// Nonces never repeat for one key as long as one sequence is used per key;
+// next() throws instead of wrapping the counter.
+class NonceSequence
+{
+    private:
+        unsigned char _prefix[NONCE_PREFIX_SIZE];
+        std::atomic<unsigned long long> _counter;
+
+    public:
+        // Random prefix, counter from zero
+        NonceSequence();
+        // Known prefix and start (e.g. resuming a stream)
+        NonceSequence(const unsigned char prefix[NONCE_PREFIX_SIZE], unsigned long long start = 0);
+
+        // To prevent copy (two copies would hand out the same nonces)
+        NonceSequence(const NonceSequence &) = delete;
+        NonceSequence& operator=(const NonceSequence &) = delete;
+
+        // Write the next nonce (NONCE_SIZE bytes)
+        void next(unsigned char nonce[NONCE_SIZE]);
+
+        // Number of nonces handed out so far
+        unsigned long long used() const;
+};
+
+#endif
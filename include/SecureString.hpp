@@ -0,0 +1,69 @@
+#ifndef SECURESTRING_HPP
+# define SECURESTRING_HPP
+
+#include "library.hpp"
+#include "SecureMemory.hpp"
+
+// Non-owning, read-only view of secret bytes (master password, salt, plaintext).
+// Cheap to pass by value; it never copies what it points at.
+class SecretView
+{
+    private:
+        const char *_data;
+        size_t _size;
+
+    public:
+        SecretView() : _data(""), _size(0) {}
+        SecretView(const char *data, size_t size) : _data(data), _size(size) {}
+        // Plain strings are accepted for non-secret inputs (salt read from the db, tests)
+        SecretView(const std::string &str) : _data(str.data()), _size(str.size()) {}
+
+        const char *data() const { return _data; }
+        const unsigned char *bytes() const { return reinterpret_cast<const unsigned char *>(_data); }
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+        const char *begin() const { return _data; }
+        const char *end() const { return _data + _size; }
+
+        // Constant time comparison
+        bool equals(SecretView other) const;
+};
+
+// Move-only secret owned in the secure arena and wiped when released.
+// Copies must be asked for with clone(), so none happen by accident.
+class SecureString
+{
+    private:
+        SecureChars _buffer;
+
+    public:
+        SecureString() {}
+        SecureString(const char *data, size_t size);
+        explicit SecureString(SecretView view);
+
+        SecureString(SecureString &&other) noexcept = default;
+        SecureString& operator=(SecureString &&other) noexcept = default;
+
+        // To prevent copy
+        SecureString(const SecureString &) = delete;
+        SecureString& operator=(const SecureString &) = delete;
+
+        // Explicit copy, e.g. to hand the secret to an asynchronous task
+        SecureString clone() const;
+
+        char *data() { return _buffer.data(); }
+        const char *data() const { return _buffer.data(); }
+        size_t size() const { return _buffer.size(); }
+        bool empty() const { return _buffer.empty(); }
+
+        // Shrinking wipes the dropped tail right away
+        void resize(size_t size);
+
+        // Release (and wipe) the secret
+        void clear();
+
+        SecretView view() const { return SecretView(_buffer.data(), _buffer.size()); }
+        operator SecretView() const { return view(); }
+};
+
+#endif
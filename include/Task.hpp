@@ -0,0 +1,278 @@
+#ifndef TASK_HPP
+# define TASK_HPP
+
+#include "library.hpp"
+#include "Executor.hpp"
+#include "Cancellation.hpp"
+
+#include <coroutine>
+#include <utility>
+#include <optional>
+#include <exception>
+#include <type_traits>
+
+// ============ TASK ============
+
+// State shared by every Task<T> promise
+struct TaskPromiseBase
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+    CancellationToken token;
+
+    // Resume whoever awaited us (symmetric transfer, no stack growth)
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+        {
+            std::coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    // Tasks are lazy: they start when awaited
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+// Copy the awaiting coroutine's token into the child so cancellation propagates
+template <typename Parent>
+void inheritToken(TaskPromiseBase &child, std::coroutine_handle<Parent> parent)
+{
+    if constexpr (requires { parent.promise().token; })
+    {
+        if (!child.token.isValid())
+            child.token = parent.promise().token;
+    }
+}
+
+template <typename T>
+class Task;
+
+// Lazily started coroutine returning a T, awaitable from other tasks
+template <typename T>
+class Task
+{
+    public:
+        struct promise_type : TaskPromiseBase
+        {
+            std::optional<T> value;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+            template <typename U>
+            void return_value(U &&v) { value.emplace(std::forward<U>(v)); }
+        };
+
+    private:
+        std::coroutine_handle<promise_type> _handle;
+
+    public:
+        explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+        Task(Task &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+        Task(const Task &) = delete;
+        Task& operator=(const Task &) = delete;
+        ~Task()
+        {
+            if (_handle)
+                _handle.destroy();
+        }
+
+        void setToken(CancellationToken token) { _handle.promise().token = std::move(token); }
+
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() { return handle.done(); }
+
+            template <typename P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> parent)
+            {
+                handle.promise().continuation = parent;
+                inheritToken(handle.promise(), parent);
+                return handle;
+            }
+
+            T await_resume()
+            {
+                if (handle.promise().error)
+                    std::rethrow_exception(handle.promise().error);
+                return std::move(*handle.promise().value);
+            }
+        };
+
+        Awaiter operator co_await() const noexcept { return Awaiter{_handle}; }
+};
+
+template <>
+class Task<void>
+{
+    public:
+        struct promise_type : TaskPromiseBase
+        {
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            void return_void() {}
+        };
+
+    private:
+        std::coroutine_handle<promise_type> _handle;
+
+    public:
+        explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+        Task(Task &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+        Task(const Task &) = delete;
+        Task& operator=(const Task &) = delete;
+        ~Task()
+        {
+            if (_handle)
+                _handle.destroy();
+        }
+
+        void setToken(CancellationToken token) { _handle.promise().token = std::move(token); }
+
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() { return handle.done(); }
+
+            template <typename P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> parent)
+            {
+                handle.promise().continuation = parent;
+                inheritToken(handle.promise(), parent);
+                return handle;
+            }
+
+            void await_resume()
+            {
+                if (handle.promise().error)
+                    std::rethrow_exception(handle.promise().error);
+            }
+        };
+
+        Awaiter operator co_await() const noexcept { return Awaiter{_handle}; }
+};
+
+// ============ EXECUTOR HOPS ============
+
+// co_await runOn(exec, fn): run fn on exec, then resume the awaiting coroutine
+// on the executor it was running on (the GUI thread for UI code)
+template <typename F>
+class RunOnAwaiter
+{
+    private:
+        typedef std::invoke_result_t<F> Result;
+        typedef std::conditional_t<std::is_void_v<Result>, bool, Result> Stored;
+
+        Executor &_exec;
+        F _fn;
+        std::optional<Stored> _result;
+        std::exception_ptr _error;
+        CancellationToken _token;
+
+    public:
+        RunOnAwaiter(Executor &exec, F fn) : _exec(exec), _fn(std::move(fn)) {}
+
+        bool await_ready() { return false; }
+
+        template <typename P>
+        void await_suspend(std::coroutine_handle<P> handle)
+        {
+            if constexpr (requires { handle.promise().token; })
+                _token = handle.promise().token;
+
+            Executor *resumeOn = Executor::current();
+            _exec.post([this, handle, resumeOn]()
+            {
+                // Skip the work entirely if the caller went away meanwhile
+                if (!_token.isCancelled())
+                {
+                    try
+                    {
+                        if constexpr (std::is_void_v<Result>)
+                        {
+                            _fn();
+                            _result.emplace(true);
+                        }
+                        else
+                            _result.emplace(_fn());
+                    }
+                    catch (...)
+                    {
+                        _error = std::current_exception();
+                    }
+                }
+
+                if (resumeOn)
+                    resumeOn->post([handle]() { handle.resume(); });
+                else
+                    handle.resume();
+            });
+        }
+
+        Result await_resume()
+        {
+            _token.throwIfCancelled();
+            if (_error)
+                std::rethrow_exception(_error);
+            if constexpr (!std::is_void_v<Result>)
+                return std::move(*_result);
+        }
+};
+
+template <typename F>
+RunOnAwaiter<F> runOn(Executor &exec, F fn)
+{
+    return RunOnAwaiter<F>(exec, std::move(fn));
+}
+
+// ============ FIRE AND FORGET ============
+
+// Top level coroutine that owns a Task<void> until it finishes
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception()
+        {
+            try
+            {
+                throw;
+            }
+            catch (const OperationCancelled &)
+            {
+                // Expected when the owner (e.g. a dialog) closed before we finished
+            }
+            catch (const std::exception &e)
+            {
+                PrintLog(std::cerr, RED "Task - unhandled error: %s" RESET, e.what());
+            }
+        }
+    };
+};
+
+inline DetachedTask runDetached(Task<void> task)
+{
+    co_await task;
+}
+
+// Start a task without awaiting it, cancelled through token
+inline void spawn(Task<void> task, CancellationToken token = CancellationToken())
+{
+    task.setToken(std::move(token));
+    runDetached(std::move(task));
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef TASKSCHEDULER_HPP
+# define TASKSCHEDULER_HPP
+
+#include "library.hpp"
+#include "Executor.hpp"
+#include "Cancellation.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+
+// Interactive work (reveal, search) always runs before background work
+// (bulk re-encrypt, integrity scan) and background work never takes every core
+enum class TaskPriority
+{
+    Interactive = 0,
+    Background = 1
+};
+
+#define TASK_PRIORITIES 2
+
+// Snapshot of the scheduler counters, indexed by TaskPriority
+struct SchedulerStats
+{
+    size_t workers;
+    size_t queued[TASK_PRIORITIES];
+    size_t running[TASK_PRIORITIES];
+    unsigned long long completed[TASK_PRIORITIES];
+    unsigned long long cancelled[TASK_PRIORITIES];
+    double avgWaitMs[TASK_PRIORITIES];
+    double maxWaitMs[TASK_PRIORITIES];
+    double avgRunMs[TASK_PRIORITIES];
+};
+
+// Shared work-stealing thread pool for crypto and storage jobs.
+// Every worker owns a deque per priority: it pushes and pops its own jobs
+// at the back and idle workers steal from the front of the others.
+// Jobs posted from outside the pool go to a global queue per priority.
+class TaskScheduler
+{
+    private:
+        struct Job
+        {
+            std::function<void()> fn;
+            std::function<void()> onCancel;
+            CancellationToken token;
+            std::chrono::steady_clock::time_point enqueued;
+        };
+
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Job> queues[TASK_PRIORITIES];
+        };
+
+        // Executor facade so coroutines (runOn) and services can target a priority
+        class PriorityExecutor : public Executor
+        {
+            private:
+                TaskScheduler &_scheduler;
+                TaskPriority _priority;
+
+            public:
+                PriorityExecutor(TaskScheduler &scheduler, TaskPriority priority);
+                void post(std::function<void()> fn) override;
+
+                // Run a job with this executor marked as current on the worker
+                void run(const std::function<void()> &fn);
+        };
+
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::vector<std::thread> _threads;
+        std::unique_ptr<PriorityExecutor> _executors[TASK_PRIORITIES];
+
+        std::mutex _globalMutex;
+        std::deque<Job> _global[TASK_PRIORITIES];
+
+        std::mutex _sleepMutex;
+        std::condition_variable _sleepCv;
+        std::atomic<bool> _running;
+
+        // Background jobs may use at most this many workers at once
+        size_t _maxBackground;
+
+        // Counters
+        std::atomic<size_t> _queued[TASK_PRIORITIES];
+        std::atomic<size_t> _active[TASK_PRIORITIES];
+        std::atomic<unsigned long long> _completed[TASK_PRIORITIES];
+        std::atomic<unsigned long long> _cancelled[TASK_PRIORITIES];
+        std::atomic<long long> _totalWaitUs[TASK_PRIORITIES];
+        std::atomic<long long> _maxWaitUs[TASK_PRIORITIES];
+        std::atomic<long long> _totalRunUs[TASK_PRIORITIES];
+
+        void enqueue(TaskPriority priority, Job job);
+        void workerLoop(size_t index);
+        bool popJob(size_t index, TaskPriority priority, Job &job);
+        bool findJob(size_t index, Job &job, TaskPriority &priority);
+        void runJob(Job &job, TaskPriority priority);
+
+    public:
+        // workers = 0 sizes the pool to the machine
+        explicit TaskScheduler(size_t workers = 0);
+        ~TaskScheduler();
+
+        // To prevent copy
+        TaskScheduler(const TaskScheduler &) = delete;
+        TaskScheduler& operator=(const TaskScheduler &) = delete;
+
+        // Fire and forget, silently dropped if token is cancelled before it runs
+        void post(TaskPriority priority, std::function<void()> fn, CancellationToken token = CancellationToken());
+
+        // Run fn on the pool, the future throws OperationCancelled if it was skipped
+        template <typename F>
+        std::future<std::invoke_result_t<F>> submit(TaskPriority priority, F fn, CancellationToken token = CancellationToken());
+
+        // Executor posting at the given priority (see Task.hpp runOn)
+        Executor &executor(TaskPriority priority);
+
+        SchedulerStats getStats() const;
+        size_t workerCount() const;
+
+        // Wait until every queued and running job is done
+        void waitIdle() const;
+};
+
+template <typename F>
+std::future<std::invoke_result_t<F>> TaskScheduler::submit(TaskPriority priority, F fn, CancellationToken token)
+{
+    typedef std::invoke_result_t<F> Result;
+    auto promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> result = promise->get_future();
+
+    Job job;
+    job.token = std::move(token);
+    job.onCancel = [promise]() { promise->set_exception(std::make_exception_ptr(OperationCancelled())); };
+    job.fn = [promise, fn = std::move(fn)]() mutable
+    {
+        try
+        {
+            if constexpr (std::is_void_v<Result>)
+            {
+                fn();
+                promise->set_value();
+            }
+            else
+                promise->set_value(fn());
+        }
+        catch (...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+    };
+
+    enqueue(priority, std::move(job));
+    return result;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef TERMINAL_HPP
+# define TERMINAL_HPP
+
+#include "library.hpp"
+#include "SecureString.hpp"
+
+// Terminal / fd helpers shared by the headless tools (passman-cli, passmand)
+
+// Write the whole buffer, retrying short writes and EINTR
+bool writeAll(int fd, SecretView data);
+
+// One line of secret input: from the terminal with echo off, or from stdin
+// when it is piped (one secret per line, in the order they are asked for)
+SecureString readSecret(const char *prompt);
+
+#endif
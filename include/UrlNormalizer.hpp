@@ -0,0 +1,26 @@
+#ifndef URLNORMALIZER_HPP
+# define URLNORMALIZER_HPP
+
+#include "library.hpp"
+
+// Lookup keys of a website field, stored next to it in the passwords table
+struct NormalizedUrl
+{
+    std::string host;   // "https://www.Accounts.Google.com:443/x" -> "accounts.google.com"
+    std::string domain; // Registrable domain -> "google.com" (the host when there is none)
+};
+
+// Host part of a URL or of free text ("Gmail" -> "gmail"): scheme, user info,
+// port, path, query and fragment are dropped, ASCII is lower cased, a leading
+// "www." and trailing dot are removed and non ASCII labels become punycode
+std::string normalizeHost(const std::string &url);
+
+// host plus its registrable domain from the built-in public suffix trie.
+// IP addresses and one label hosts are their own domain
+NormalizedUrl normalizeUrl(const std::string &url);
+
+// RFC 3492 punycode of one UTF-8 label, without the "xn--" prefix.
+// False when label is not valid UTF-8
+bool punycodeEncode(const std::string &label, std::string &out);
+
+#endif
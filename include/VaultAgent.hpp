@@ -0,0 +1,96 @@
+#ifndef VAULTAGENT_HPP
+# define VAULTAGENT_HPP
+
+#include "library.hpp"
+#include "VaultContext.hpp"
+#include "JsonWriter.hpp"
+#include "VaultCache.hpp"
+
+#include <unordered_map>
+#include <sys/types.h>
+
+#define AGENT_MAX_CLIENTS 64
+// Longest request line, a client sending more is disconnected
+#define AGENT_MAX_LINE 4096
+// Replies a client may leave unread before the agent stops reading its requests
+#define AGENT_MAX_PENDING_OUTPUT (1 << 20)
+// PSI trigger flushing the decrypted entries: 200 ms of memory stall within 2 s
+#define AGENT_MEMORY_PRESSURE_TRIGGER "some 200000 2000000"
+// How often expired decrypted entries are wiped while some are cached
+#define AGENT_SECRET_PURGE_MS 1000
+
+// passmand: keeps one logged-in vault warm (derived record key, entry list,
+// cached statements) and answers lookups over a Unix socket, like ssh-agent.
+//
+// Protocol: one request per line, one JSON reply per line, in order, so a
+// client may pipeline as many requests as it likes on one connection.
+//   ping | list | search <text> | get <id|website> | shutdown
+// Decrypted passwords stay in the vault's SecretCache for a short while; it
+// is flushed on SIGUSR1 and when the kernel reports memory pressure.
+// Errors are {"error": message, "code": "not_found" | "ambiguous" | "bad_request"}.
+// Only peers running as the agent's own uid (SO_PEERCRED) are served.
+class VaultAgent
+{
+    private:
+        struct Client
+        {
+            int fd;
+            std::string input;          // requests hold no secrets
+            SecureChars output;         // replies may hold passwords
+            size_t sent = 0;
+            bool closing = false;       // close once output is flushed
+        };
+
+        VaultContext &_vault;
+        std::string _socketPath;
+        int _listenFd;
+        int _epollFd;
+        int _signalFd;
+        int _pressureFd;
+        bool _running;
+        std::unordered_map<int, std::unique_ptr<Client>> _clients;
+
+        // Warm state, reloaded when another connection commits
+        VaultCache _entries;
+        long long _dataVersion;
+        SecureBytes _key;
+        SecureChars _plain;
+        unsigned long long _served;
+
+        void openSocket();
+        void watchMemoryPressure();
+        void acceptClients();
+        void readClient(Client &client);
+        void writeClient(Client &client);
+        void updateInterest(Client &client);
+        void closeClient(int fd);
+
+        void refreshEntries();
+        void handleRequest(Client &client, const std::string &line);
+        void reply(Client &client, const JsonWriter &json);
+        void replyError(Client &client, const char *code, const std::string &message);
+
+    public:
+        // The vault session must be logged in
+        VaultAgent(VaultContext &vault, const std::string &socketPath);
+        ~VaultAgent();
+
+        // To prevent copy
+        VaultAgent(const VaultAgent &) = delete;
+        VaultAgent& operator=(const VaultAgent &) = delete;
+
+        // Block the handled signals (SIGINT, SIGTERM, SIGHUP stop, SIGUSR1 flushes
+        // the decrypted entries) so they are read by the event loop. Call before
+        // any thread is started
+        static void blockSignals();
+
+        // Derive the key, load the entries and listen. Throws if the socket is in use
+        void start();
+
+        // Serve until a stop signal or a shutdown request
+        void run();
+
+        const std::string &socketPath() const;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef VAULTBACKUP_HPP
+# define VAULTBACKUP_HPP
+
+#include "library.hpp"
+#include "DatabaseCipher.hpp"
+#include "Cancellation.hpp"
+
+// Pages copied per sqlite3_backup_step. The source is read locked only while
+// a step runs: writers and readers get the vault back between steps
+#define BACKUP_PAGES_PER_STEP 128
+// Pause after each step
+#define BACKUP_STEP_PAUSE_MS 2
+// Backups kept per vault, the oldest are removed first (0 = keep all)
+#define BACKUP_KEEP 7
+// Default directory: <vault>.backups, next to the vault
+#define BACKUP_DIR_SUFFIX ".backups"
+
+struct BackupOptions
+{
+    std::string dir;                            // empty = <vault>.backups
+    int pagesPerStep = BACKUP_PAGES_PER_STEP;   // -1 = everything in one step
+    int pauseMs = BACKUP_STEP_PAUSE_MS;
+    size_t keep = BACKUP_KEEP;
+    bool compress = false;                      // gzip, ignored for encrypted vaults
+};
+
+struct BackupProgress
+{
+    int copied;         // pages
+    int total;
+};
+
+struct BackupResult
+{
+    std::string path;                   // <dir>/<vault>-YYYYmmdd-HHMMSS-mmm.db[.gz]
+    int pages = 0;
+    int steps = 0;
+    long long bytes = 0;                // size of the written file
+    double ms = 0;
+    std::vector<std::string> removed;   // older backups rotated out
+};
+
+// Called on the backup's thread after every step
+typedef std::function<void(const BackupProgress &)> BackupProgressCallback;
+
+// Online copy of a vault with the sqlite3_backup API, safe while the app and
+// other instances keep writing. The source connection keeps one WAL read
+// snapshot for the whole copy: writers are never blocked, the copy never
+// restarts and is one consistent state (the WAL can't be checkpointed past
+// it until the backup ends). Encrypted vaults are copied through their cipher
+// and stay encrypted with the same key (the key file is not copied).
+// Files are 0600, written as .partial and renamed once complete.
+class VaultBackup
+{
+    private:
+        std::string _dbPath;
+        const DatabaseCipher *_cipher;
+        BackupOptions _options;
+        std::string _dir;
+        std::string _prefix;        // vault file name without .db
+
+        sqlite3 *openConnection(const std::string &path, int flags) const;
+        void copyPages(const std::string &tmpPath, BackupProgressCallback &progress,
+                       const CancellationToken &token, BackupResult &result) const;
+        void compressFile(const std::string &srcPath, const std::string &dstPath, const CancellationToken &token) const;
+        std::vector<std::string> rotate() const;
+
+    public:
+        // cipher (nullable) must outlive the backup
+        VaultBackup(const std::string &dbPath, const DatabaseCipher *cipher, BackupOptions options = BackupOptions());
+
+        // Blocking, run it as TaskPriority::Background. Throws on failure and
+        // OperationCancelled once token is cancelled; nothing partial is left
+        BackupResult run(BackupProgressCallback progress = nullptr, CancellationToken token = CancellationToken()) const;
+
+        // Backups of this vault in the directory, oldest first
+        std::vector<std::string> list() const;
+        const std::string &directory() const;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef VAULTCACHE_HPP
+# define VAULTCACHE_HPP
+
+#include "library.hpp"
+
+#include <unordered_set>
+
+// One entry of a VaultCache, views into the cache. The record is stored
+// decoded: iv and ciphertext are raw bytes, not hex
+struct CachedEntry
+{
+    int id = 0;
+    std::string_view website;
+    std::string_view username;
+    std::string_view created_at;
+    std::span<const unsigned char> iv;
+    std::span<const unsigned char> ciphertext;
+};
+
+// Compact in-memory copy of a user's entries, for long lived readers (passmand).
+// Fixed size fields live in one array per column, the text and record bytes of
+// every entry in a single arena. Usernames and timestamps repeat a lot (same
+// email everywhere, bulk imports stamped in the same second) so they are
+// interned: stored once, referenced by index.
+// Views returned by the cache are valid until the next append() or clear().
+class VaultCache
+{
+    private:
+        struct Span
+        {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        // Interned strings hashed through their span in the arena
+        struct InternHash
+        {
+            const VaultCache *cache;
+            size_t operator()(uint32_t index) const;
+        };
+        struct InternEqual
+        {
+            const VaultCache *cache;
+            bool operator()(uint32_t a, uint32_t b) const;
+        };
+
+        // Columns, one element per entry, ids ascending
+        std::vector<int> _ids;
+        std::vector<Span> _websites;
+        std::vector<uint32_t> _usernames;   // index in _interned
+        std::vector<uint32_t> _createdAt;   // index in _interned
+        std::vector<Span> _records;         // iv followed by the ciphertext
+
+        std::string _arena;
+        std::vector<Span> _interned;
+        std::unordered_set<uint32_t, InternHash, InternEqual> _internIndex;
+
+        std::string_view text(Span span) const;
+        Span store(std::string_view value);
+        Span storeRecord(std::string_view ivHex, std::string_view ciphertextHex);
+        uint32_t intern(std::string_view value);
+
+    public:
+        VaultCache();
+
+        // Hashers point back at the cache
+        VaultCache(const VaultCache &) = delete;
+        VaultCache& operator=(const VaultCache &) = delete;
+
+        // Room for entries rows holding about textBytes of text
+        void reserve(size_t entries, size_t textBytes);
+
+        // Rows must come in ascending id order (find() relies on it)
+        void append(const PasswordView &row);
+        void clear();
+
+        size_t size() const;
+        bool empty() const;
+        CachedEntry operator[](size_t index) const;
+
+        // Binary search on the id column
+        bool find(int id, CachedEntry &entry) const;
+
+        int id(size_t index) const;
+        std::string_view website(size_t index) const;
+        std::string_view username(size_t index) const;
+
+        // Username index in the intern table, equal for equal usernames
+        uint32_t usernameKey(size_t index) const;
+        size_t internedCount() const;
+
+        // Bytes held by the columns, the arena and the intern table
+        size_t memoryUsage() const;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef VAULTCONTEXT_HPP
+# define VAULTCONTEXT_HPP
+
+#include "library.hpp"
+#include "SQLiteCipherDB.hpp"
+#include "CryptoManager.hpp"
+#include "AuthenticationManager.hpp"
+#include "AsyncServices.hpp"
+#include "TaskScheduler.hpp"
+#include "VaultSession.hpp"
+#include "SecretCache.hpp"
+
+#include <mutex>
+#include <condition_variable>
+
+// One open vault: its db connections, crypto, authentication, coroutine
+// front-ends and logged-in session. Passed explicitly to the windows and
+// dialogs working on it, so several vaults can be open side by side.
+// The scheduler is shared by every vault of the process: the jobs of this
+// vault go through submit() or the async services, so closing it cancels
+// and waits for those only.
+class VaultContext
+{
+    private:
+        // Executor handing jobs to the shared pool, counted as this vault's work
+        class VaultExecutor : public Executor
+        {
+            private:
+                VaultContext &_vault;
+                Executor &_inner;
+
+            public:
+                VaultExecutor(VaultContext &vault, Executor &inner);
+                void post(std::function<void()> fn) override;
+        };
+
+        TaskScheduler &_scheduler;
+
+        // Jobs of this vault queued or running on the pool
+        CancellationSource _closing;
+        std::mutex _jobsMutex;
+        std::condition_variable _jobsDone;
+        size_t _jobs;
+        std::unique_ptr<VaultExecutor> _executor;
+
+        SecretCache _secrets;      // outlives the db: its writer thread invalidates entries
+        std::unique_ptr<SQLiteCipherDB> _db;
+        std::unique_ptr<CryptoManager> _crypto;
+        std::unique_ptr<AuthenticationManager> _auth;
+        std::unique_ptr<AsyncDatabase> _asyncDb;
+        std::unique_ptr<AsyncCrypto> _asyncCrypto;
+        VaultSession _session;
+
+        // Counts a job until the returned handle (kept in the job) is released
+        std::shared_ptr<void> trackJob();
+
+    public:
+        // Empty dbPath -> default vault in $HOME/.local/share/passman
+        explicit VaultContext(TaskScheduler &scheduler, const std::string &dbPath = "");
+        ~VaultContext();
+
+        // To prevent copy
+        VaultContext(const VaultContext &) = delete;
+        VaultContext& operator=(const VaultContext &) = delete;
+
+        SQLiteCipherDB &database() const;
+        CryptoManager &crypto() const;
+        AuthenticationManager &auth() const;
+        AsyncDatabase &asyncDatabase() const;
+        AsyncCrypto &asyncCrypto() const;
+        TaskScheduler &scheduler() const;
+
+        // Run fn on the shared pool as work of this vault: skipped once the
+        // vault closes, and the vault waits for it when already running
+        template <typename F>
+        std::future<std::invoke_result_t<F>> submit(TaskPriority priority, F fn, CancellationToken token = CancellationToken());
+
+        // Cancelled when the vault closes
+        CancellationToken closingToken() const;
+
+        VaultSession &session();
+        const VaultSession &session() const;
+
+        // Decrypted entries of the current session: flushed whenever the
+        // session ends or locks, invalidated by updates and deletes
+        SecretCache &secrets();
+};
+
+template <typename F>
+std::future<std::invoke_result_t<F>> VaultContext::submit(TaskPriority priority, F fn, CancellationToken token)
+{
+    // The handle goes with the job, whether it runs or is dropped
+    return _scheduler.submit(priority, [fn = std::move(fn), job = trackJob()]() mutable { return fn(); },
+                             CancellationToken::any(token, _closing.token()));
+}
+
+#endif
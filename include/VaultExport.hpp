@@ -0,0 +1,93 @@
+#ifndef VAULTEXPORT_HPP
+# define VAULTEXPORT_HPP
+
+#include "library.hpp"
+#include "SQLiteCipherDB.hpp"
+#include "CryptoManager.hpp"
+#include "TaskScheduler.hpp"
+#include "Cancellation.hpp"
+
+// File layout (version 1), integers big endian:
+//   header   magic "PASSMANX" | version u8 | kdf u8 | 0 u16 | iterations u32
+//            | chunk size u32 | salt[16] | nonce prefix[7] | 0[5]
+//   chunks   AES-256-GCM(plaintext) | tag[16], every chunk but the last one
+//            holds exactly chunk size plaintext bytes, the last 1..chunk size
+// Chunk nonce: prefix | chunk counter u32 | last flag u8, the header is the
+// AAD of every chunk (STREAM construction): chunks can't be reordered, dropped,
+// duplicated or moved to another file, and a truncated file has no last chunk.
+#define EXPORT_MAGIC "PASSMANX"
+#define EXPORT_MAGIC_SIZE 8
+#define EXPORT_VERSION 1
+#define EXPORT_KDF_PBKDF2_SHA256 1
+#define EXPORT_HEADER_SIZE 48
+#define EXPORT_NONCE_PREFIX_SIZE 7
+
+// The file leaves the machine: a much slower KDF than the vault's own
+#define EXPORT_KDF_ITERATIONS 300000
+// Plaintext bytes per chunk
+#define EXPORT_CHUNK_SIZE (64 * 1024)
+// Chunks encrypted on the pool ahead of the writer
+#define EXPORT_CHUNKS_IN_FLIGHT 4
+// Sealed chunks are written out in blocks of this size
+#define EXPORT_IO_BUFFER (1024 * 1024)
+
+// Limits checked on import, before anything is allocated or derived
+#define EXPORT_MAX_ITERATIONS 10000000
+#define EXPORT_MAX_CHUNK_SIZE (16 * 1024 * 1024)
+#define EXPORT_MAX_FIELD (1024 * 1024)
+
+// One entry of the plaintext stream, valid during the callback only
+struct ExportEntry
+{
+    std::string_view website;
+    std::string_view username;
+    std::string_view created_at;
+    SecretView password;
+};
+
+struct ExportStats
+{
+    size_t entries = 0;
+    size_t chunks = 0;
+    long long bytes = 0;        // file size
+    double ms = 0;
+};
+
+// Streaming encrypted export / import of one user's entries, under its own
+// passphrase. Memory stays the same whatever the vault size: the export reads
+// the rows through a cursor, fills one chunk at a time, has at most
+// EXPORT_CHUNKS_IN_FLIGHT of them sealed on the pool and writes them in
+// EXPORT_IO_BUFFER blocks. The import holds one chunk and the entry that
+// straddles it, and releases nothing from a chunk before its tag checked out.
+class VaultExport
+{
+    private:
+        const CryptoManager &_crypto;
+        TaskScheduler *_scheduler;
+
+    public:
+        // Without a scheduler chunks are sealed on the calling thread. With one,
+        // don't call from its workers: the export waits for the chunks it queued
+        VaultExport(const CryptoManager &crypto, TaskScheduler *scheduler = nullptr);
+
+        // Write every entry of userId to fd. Throws on failure (fd then holds
+        // a file the import rejects) and OperationCancelled once token is cancelled
+        ExportStats write(int fd, const SQLiteCipherDB &db, int userId,
+                          SecretView masterPassword, SecretView salt, SecretView passphrase,
+                          CancellationToken token = CancellationToken(),
+                          int iterations = EXPORT_KDF_ITERATIONS) const;
+
+        // Read an export from fd, onEntries gets the entries completed by each
+        // authenticated chunk. A seekable fd is verified whole first, so a
+        // tampered or truncated file delivers nothing; a pipe can deliver the
+        // entries of its good chunks before the bad one. Throws on a wrong
+        // passphrase, a damaged file and a cancelled token
+        ExportStats read(int fd, SecretView passphrase,
+                         const std::function<void(std::span<const ExportEntry>)> &onEntries,
+                         CancellationToken token = CancellationToken()) const;
+
+        // The file starts with the export magic
+        static bool isExport(const std::string &path);
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef VAULTQUERY_HPP
+# define VAULTQUERY_HPP
+
+#include "library.hpp"
+#include "VaultCache.hpp"
+
+// Entry lookups shared by passman-cli and passmand, over an already loaded list
+
+// By id when key is a number, otherwise by website (case insensitive)
+std::vector<const Password *> findEntries(const std::vector<Password> &entries, const std::string &key);
+
+// Best ranked tier of a findByUrl result: the exact host matches when there
+// are any, otherwise every entry of the registrable domain
+std::vector<const Password *> bestUrlMatches(const std::vector<UrlMatch> &matches);
+
+// Entries whose website or username contains term (case insensitive)
+std::vector<const Password *> searchEntries(const std::vector<Password> &entries, const std::string &term);
+
+// Same lookups over a VaultCache, the views are valid until the cache changes
+std::vector<CachedEntry> findEntries(const VaultCache &cache, const std::string &key);
+std::vector<CachedEntry> searchEntries(const VaultCache &cache, const std::string &term);
+
+#endif
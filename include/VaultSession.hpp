@@ -0,0 +1,116 @@
+#ifndef VAULTSESSION_HPP
+# define VAULTSESSION_HPP
+
+#include "library.hpp"
+#include "SecureString.hpp"
+#include "Cancellation.hpp"
+#include "CryptoManager.hpp"
+
+#include <mutex>
+
+// Wrong PINs accepted before the PIN is dropped and the master password is required
+#define VAULT_PIN_MAX_ATTEMPTS 3
+#define VAULT_PIN_MIN_LENGTH 4
+// Random key mixed into the unlock wraps, never leaves memory
+#define VAULT_EPHEMERAL_KEY_SIZE 32
+
+// Immutable session data. A login or logout publishes a whole new state,
+// so a thread holding one always sees a consistent user / key pair.
+struct SessionState
+{
+    int userId = 0;
+    std::string username;
+    SecureString masterPassword;     // secure arena, wiped with the state
+    SecureString userSalt;
+    bool authenticated = false;
+    bool locked = false;             // idle lock: master password wiped, user kept
+    unsigned long long epoch = 0;    // bumped by every login / logout
+    CancellationToken revoked;       // cancelled when this session ends
+};
+
+// Logged-in user and key material of one vault (see VaultContext)
+class VaultSession
+{
+    private:
+        // Readers load the snapshot without locking, writers (login / logout)
+        // serialize on _writeMutex and swap it
+        std::atomic<std::shared_ptr<const SessionState>> _state;
+        mutable std::mutex _writeMutex;
+        std::unique_ptr<CancellationSource> _revoke;
+        std::function<void()> _onRevoke;
+        unsigned long long _epoch;
+
+        // Memory-only unlock material, guarded by _writeMutex. Both wraps use
+        // HKDF(passphrase KDF || _ephemeral) as key, so a dump of the wraps alone
+        // is not enough to brute force a short PIN offline.
+        // _lockWrap: master password sealed under itself, made once at login
+        // so lock() runs no KDF and unlock() exactly one,
+        // _pinWrap: master password sealed under the user's PIN
+        const CryptoManager &_crypto;
+        SecureBytes _ephemeral;
+        std::unique_ptr<WrappedSecret> _lockWrap;
+        std::unique_ptr<WrappedSecret> _pinWrap;
+        int _pinFailures;
+
+        void publish(std::shared_ptr<SessionState> state);
+        void publishUnlocked(const SessionState &locked, SecureString masterPassword);
+
+    public:
+        explicit VaultSession(const CryptoManager &crypto);
+        ~VaultSession();
+
+        // To prevent copy
+        VaultSession(const VaultSession &) = delete;
+        VaultSession& operator=(const VaultSession &) = delete;
+
+        // Login: revokes the previous session and publishes the new one at once.
+        // Runs one KDF to prepare the idle lock
+        void beginSession(int userId, const std::string &username, SecureString masterPassword, SecretView userSalt);
+
+        // Current state, safe from any thread; keep the pointer for as long as
+        // the secrets in it are used
+        std::shared_ptr<const SessionState> snapshot() const;
+
+        // Getters (each one reads the current snapshot)
+        int getUserId(void) const;
+        // Views into the current snapshot: GUI thread only (it is the one
+        // clearing the session). clone() them to hand them to asynchronous work
+        SecretView getMasterPassword(void) const;
+        SecretView getUserSalt(void) const;
+        std::string getUsername(void) const;
+        bool isAuthenticated(void) const;
+        bool isLocked(void) const;
+        unsigned long long getEpoch(void) const;
+
+        // Cancelled on logout, link it into tasks working with session secrets
+        CancellationToken revocationToken(void) const;
+
+        // Called whenever the current session ends (login, logout, lock, unlock),
+        // under the session write lock: it must not call back into the session.
+        // Set once, before the first login
+        void setRevokeHook(std::function<void()> hook);
+
+        // Logout: revokes in-flight work and drops the secrets once their last reader is done
+        void clearSession();
+
+        // Idle lock: revokes in-flight work and wipes the master password, the
+        // user, salt and non-secret data stay. No KDF. Returns false if not logged in
+        bool lock();
+
+        // Unlock with one KDF and no db access, false on a wrong password
+        bool unlock(SecretView masterPassword);
+
+        // Unlock with the PIN set while unlocked. After VAULT_PIN_MAX_ATTEMPTS
+        // wrong PINs the PIN is dropped and only unlock() is left
+        bool unlockWithPin(SecretView pin);
+
+        // PIN for quick re-unlock, memory only and gone on logout. Needs an unlocked session
+        void setUnlockPin(SecretView pin);
+        void clearUnlockPin();
+        bool hasUnlockPin() const;
+
+        // Verify session is valid
+        bool isValid() const;
+};
+
+#endif
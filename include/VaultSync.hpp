@@ -0,0 +1,77 @@
+#ifndef VAULTSYNC_HPP
+# define VAULTSYNC_HPP
+
+#include "library.hpp"
+#include "SQLiteCipherDB.hpp"
+#include "CryptoManager.hpp"
+#include "Cancellation.hpp"
+
+// Exchange directory: <dir>/<user tag>/ per user (tag: hash of the username
+// and salt), holding for every vault
+//   <vault>-<from>-<to>.psync  records changed on that vault with change
+//                              sequence in (from, to], 16 hex digits each
+//   <vault>.ack                last segment applied from each peer
+// Segment layout (version 1), integers big endian:
+//   header   magic "PASSMANS" | version u8 | 0[3] | vault id u64 | user tag[8]
+//            | from u64 | to u64 | record count u32 | nonce[12]
+//   body     AES-256-GCM(records) | tag[16], the header is the AAD
+//   record   deleted u8 | revision u64 | origin u64 | uuid, then for live ones
+//            website, username, encrypted_password, iv, created_at
+//            (every string: length u32 | bytes)
+// The key comes from the user's record key, so only vaults sharing the user
+// (same master password and salt, as copies of one vault file) can read it.
+#define SYNC_MAGIC "PASSMANS"
+#define SYNC_MAGIC_SIZE 8
+#define SYNC_VERSION 1
+#define SYNC_HEADER_SIZE 60
+#define SYNC_USER_TAG_SIZE 8
+#define SYNC_EXTENSION ".psync"
+#define SYNC_ACK_EXTENSION ".ack"
+
+// Records per segment: bounds the memory of the first sync of a big vault
+#define SYNC_SEGMENT_RECORDS 4096
+// Limits checked before a peer's segment is read
+#define SYNC_MAX_SEGMENT (64 * 1024 * 1024)
+#define SYNC_MAX_FIELD (1024 * 1024)
+
+struct SyncResult
+{
+    long long vaultId = 0;
+    size_t exported = 0;                // records written for the peers
+    size_t segmentsWritten = 0;
+    size_t segmentsRead = 0;
+    size_t peers = 0;
+    SyncApplyStats applied;
+    size_t pruned = 0;                  // own segments every peer had applied
+    size_t forgotten = 0;               // deletion rows every peer had applied
+    std::vector<std::string> errors;    // peers left for the next run
+    double ms = 0;
+};
+
+// Two-way sync of one user's entries through a shared directory (a synced
+// folder, a USB stick). Only deltas travel: each run exports the records
+// changed here since the last export (change_log, one index range scan) as
+// new segments, then applies the peers' segments past their last applied one.
+// Conflicts are settled by SQLiteCipherDB::applySyncRecords (higher revision,
+// then higher vault id), so every vault ends up with the same version
+// whatever the order of the runs. A damaged, incomplete or missing segment
+// stops that peer until a later run and is reported, the rest goes on.
+class VaultSync
+{
+    private:
+        const SQLiteCipherDB &_db;
+        const CryptoManager &_crypto;
+
+    public:
+        // db and crypto must outlive the sync
+        VaultSync(const SQLiteCipherDB &db, const CryptoManager &crypto);
+
+        // Blocking, run it as TaskPriority::Background. Throws when the
+        // directory can't be used and OperationCancelled once token is
+        // cancelled (segments already applied stay applied)
+        SyncResult run(const std::string &dir, int userId, const std::string &username,
+                       SecretView masterPassword, SecretView salt,
+                       CancellationToken token = CancellationToken()) const;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef VAULTWATCHER_HPP
+# define VAULTWATCHER_HPP
+
+#include "library.hpp"
+
+// Default fallback poll interval when inotify reports nothing
+#define WATCHER_POLL_MS 2000
+// Time used to coalesce bursts of inotify events into one notification
+#define WATCHER_DEBOUNCE_MS 50
+
+// Watches the db file and its WAL with inotify on a background thread and
+// calls onChange when another process may have committed to the vault.
+// Notifications are hints: the receiver confirms them with PRAGMA data_version.
+class VaultWatcher
+{
+    private:
+        std::string _dirPath;
+        std::string _dbName;
+        std::function<void()> _onChange;
+        int _pollMs;
+
+        int _inotifyFd;
+        int _wakeFd;
+        std::thread _thread;
+        std::atomic<bool> _running;
+
+        void run();
+
+        // Read pending inotify events, returns true if any touches the db or WAL
+        bool drainEvents();
+
+    public:
+        VaultWatcher(const std::string &dbPath, std::function<void()> onChange, int pollMs = WATCHER_POLL_MS);
+        ~VaultWatcher();
+
+        // To prevent copy
+        VaultWatcher(const VaultWatcher &) = delete;
+        VaultWatcher& operator=(const VaultWatcher &) = delete;
+
+        // Start / stop the watcher thread
+        bool start();
+        void stop();
+};
+
+#endif
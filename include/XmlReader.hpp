@@ -0,0 +1,66 @@
+#ifndef XMLREADER_HPP
+# define XMLREADER_HPP
+
+#include "library.hpp"
+#include "SecureMemory.hpp"
+
+// Longest tag, comment, CDATA section or processing instruction
+#define XML_MAX_TOKEN (1024 * 1024)
+// Deepest element nesting
+#define XML_MAX_DEPTH 256
+
+struct XmlAttribute
+{
+    std::string_view name;
+    std::string_view value;         // entities decoded
+};
+
+// Events of XmlReader, views are valid during the call only
+class XmlHandler
+{
+    public:
+        virtual ~XmlHandler() {}
+
+        virtual void startElement(std::string_view name, std::span<const XmlAttribute> attributes) = 0;
+        // Character data of the innermost open element, entities decoded.
+        // Long text comes in several pieces
+        virtual void text(std::string_view piece) = 0;
+        virtual void endElement(std::string_view name) = 0;
+};
+
+// Streaming (push) XML parser: the document is fed in pieces of any size and
+// only the token being read is buffered, in secure memory (documents hold
+// decrypted vault data). Comments, processing instructions and CDATA are
+// handled; DTDs are refused, so no entity beyond the five predefined ones and
+// character references is ever expanded. Namespaces are not interpreted.
+// Throws std::runtime_error on malformed input.
+class XmlReader
+{
+    private:
+        XmlHandler &_handler;
+        SecureChars _buffer;                // input not parsed yet
+        SecureChars _text;                  // decoded text / attribute values
+        std::vector<std::string> _open;     // element stack
+        std::vector<XmlAttribute> _attributes;
+        bool _started;                      // byte order mark checked
+        bool _done;                         // root element closed
+
+        size_t parse(bool final);
+        size_t parseTag(size_t start, size_t end);
+        void emitText(const char *data, size_t length);
+        void decode(const char *data, size_t length, SecureChars &out) const;
+
+    public:
+        explicit XmlReader(XmlHandler &handler);
+        ~XmlReader();
+
+        // To prevent copy
+        XmlReader(const XmlReader &) = delete;
+        XmlReader& operator=(const XmlReader &) = delete;
+
+        void feed(const char *data, size_t length);
+        // End of input: throws if the root element is not closed
+        void finish();
+};
+
+#endif
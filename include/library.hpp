@@ -11,6 +11,14 @@
 #include <cstdio>
 #include <ctime>
 #include <stdexcept>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <cstdint>
 #include <sys/stat.h>
 #include <sqlite3.h>
 #include <openssl/rand.h>
@@ -18,24 +26,6 @@
 #include <openssl/bio.h>
 #include <openssl/buffer.h>
 
-// Qt includes
-#include <QApplication>
-#include <QMainWindow>
-#include <QDialog>
-#include <QWidget>
-#include <QLineEdit>
-#include <QLabel>
-#include <QVBoxLayout>
-#include <QHBoxLayout>
-#include <QPushButton>
-#include <QTableWidget>
-#include <QHeaderView>
-#include <QMessageBox>
-#include <QTabWidget>
-#include <QCheckBox>
-#include <QProgressBar>
-#include <QFont>
-
 // Ansi Colors and constants
 #define BLACK "\033[30m"
 #define RED "\033[31m"
@@ -47,10 +37,9 @@
 #define WHITE "\033[37m"
 #define RESET "\033[0m"
 
-#define WIDTH 800
-#define HEIGHT 600
-
 // Data structures
+struct PasswordView;
+
 struct Password
 {
     int id;                         // Unique ID in DB
@@ -63,22 +52,61 @@ struct Password
     Password()
         : id(0), website(""), username(""), encrypted_password(""), iv(""), created_at("") {}
 
-    Password(int _id, const std::string &_website,
-             const std::string &_username,
-             const std::string &_encrypted,
-             const std::string &_iv,
-             const std::string &_created)
-                : id(_id), website(_website), username(_username),
-                encrypted_password(_encrypted), iv(_iv),
-                created_at(_created) {}
+    // Fields are taken by value: pass owned buffers with std::move to skip the copy
+    Password(int _id, std::string _website,
+             std::string _username,
+             std::string _encrypted,
+             std::string _iv,
+             std::string _created)
+                : id(_id), website(std::move(_website)), username(std::move(_username)),
+                encrypted_password(std::move(_encrypted)), iv(std::move(_iv)),
+                created_at(std::move(_created)) {}
+
+    // Owned copy of a row view (one allocation per field that needs one)
+    explicit Password(const PasswordView &row);
+};
+
+// Non-owning entry: views into a statement step (forEachPassword) or a Password,
+// valid as long as what it points into
+struct PasswordView
+{
+    int id = 0;
+    std::string_view website;
+    std::string_view username;
+    std::string_view encrypted_password;
+    std::string_view iv;
+    std::string_view created_at;
+
+    PasswordView() = default;
+    PasswordView(const Password &pwd)
+        : id(pwd.id), website(pwd.website), username(pwd.username),
+        encrypted_password(pwd.encrypted_password), iv(pwd.iv),
+        created_at(pwd.created_at) {}
+};
+
+inline Password::Password(const PasswordView &row)
+    : id(row.id), website(row.website), username(row.username),
+    encrypted_password(row.encrypted_password), iv(row.iv),
+    created_at(row.created_at) {}
+
+// findByUrl result: exact host matches rank before registrable domain matches
+struct UrlMatch
+{
+    Password password;
+    bool exactHost;
 };
 
 // Utility functions
 std::string ObtainCurrentTime();
 bool createDirectory(const std::string &dirPath);
+
+// passmand socket: $PASSMAN_AGENT_SOCK, else $XDG_RUNTIME_DIR/passman/agent.sock,
+// else /tmp/passman-<uid>/agent.sock
+std::string agentSocketPath();
 void PrintLog(std::ostream &oss, const std::string message, ...);
 
-// SessionManager macro for easy access to the singleton instance
-#define SESSION SessionManager::getInstance()
+// Send every log to out instead of the stream given to PrintLog, nullptr drops them.
+// For the CLI, whose stdout carries JSON
+void RedirectLogs(std::ostream *out);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef QTLIBRARY_HPP
+#define QTLIBRARY_HPP
+
+// Qt Widgets side of library.hpp, only for the GUI (src/ui, main.cpp)
+#include "library.hpp"
+
+// Qt includes
+#include <QApplication>
+#include <QMainWindow>
+#include <QDialog>
+#include <QWidget>
+#include <QLineEdit>
+#include <QLabel>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QTabWidget>
+#include <QCheckBox>
+#include <QProgressBar>
+#include <QFont>
+#include <QPointer>
+#include <QTimer>
+#include <QEvent>
+#include <QInputDialog>
+
+#define WIDTH 800
+#define HEIGHT 600
+
+#endif
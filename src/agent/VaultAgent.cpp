@@ -0,0 +1,507 @@
+#include "VaultAgent.hpp"
+#include "VaultQuery.hpp"
+
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define AGENT_READ_CHUNK 16384
+#define AGENT_MAX_EVENTS 64
+
+// Signals read by the event loop: SIGUSR1 flushes the decrypted entries, the others stop it
+static sigset_t handledSignals()
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGHUP);
+    sigaddset(&set, SIGUSR1);
+    return set;
+}
+
+VaultAgent::VaultAgent(VaultContext &vault, const std::string &socketPath)
+    : _vault(vault), _socketPath(socketPath),
+    _listenFd(-1), _epollFd(-1), _signalFd(-1), _pressureFd(-1), _running(false),
+    _dataVersion(-1), _key(CRYPTO_KEY_SIZE), _served(0)
+{
+}
+
+VaultAgent::~VaultAgent()
+{
+    while (!_clients.empty())
+        closeClient(_clients.begin()->first);
+    if (_listenFd >= 0)
+    {
+        close(_listenFd);
+        unlink(_socketPath.c_str());
+    }
+    if (_signalFd >= 0)
+        close(_signalFd);
+    if (_pressureFd >= 0)
+        close(_pressureFd);
+    if (_epollFd >= 0)
+        close(_epollFd);
+    PrintLog(std::cout, CYAN "VaultAgent" RESET " - Stopped after %llu requests", _served);
+}
+
+void VaultAgent::blockSignals()
+{
+    sigset_t set = handledSignals();
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    // Replies go out with MSG_NOSIGNAL, a vanished client must not kill the agent
+    signal(SIGPIPE, SIG_IGN);
+}
+
+const std::string &VaultAgent::socketPath() const
+{
+    return _socketPath;
+}
+
+// ============ SETUP ============
+
+void VaultAgent::start()
+{
+    std::shared_ptr<const SessionState> session = _vault.session().snapshot();
+    if (!session->authenticated || session->masterPassword.empty())
+        throw std::runtime_error("Vault agent needs an unlocked session");
+
+    // The one KDF of the agent's lifetime
+    _vault.crypto().deriveKey(session->masterPassword, session->userSalt, _key.data());
+    refreshEntries();
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0)
+        throw std::runtime_error(std::string("epoll_create1: ") + strerror(errno));
+
+    sigset_t set = handledSignals();
+    _signalFd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (_signalFd < 0)
+        throw std::runtime_error(std::string("signalfd: ") + strerror(errno));
+
+    openSocket();
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = _listenFd;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &ev);
+    ev.data.fd = _signalFd;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _signalFd, &ev);
+    watchMemoryPressure();
+
+    PrintLog(std::cout, CYAN "VaultAgent" GREEN " - Serving %lu entries on %s" RESET, _entries.size(), _socketPath.c_str());
+}
+
+void VaultAgent::openSocket()
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (_socketPath.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path too long: " + _socketPath);
+    memcpy(addr.sun_path, _socketPath.c_str(), _socketPath.size() + 1);
+
+    // Private directory: the socket is only reachable by its owner
+    std::string dirCopy = _socketPath;
+    std::string dir = dirname(dirCopy.data());
+    if (!createDirectory(dir))
+        throw std::runtime_error("Cannot create " + dir);
+    struct stat st;
+    if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077))
+        throw std::runtime_error("Unsafe socket directory " + dir + " (must be a 0700 directory owned by the user)");
+
+    // A socket left behind by a dead agent is replaced, a live one is not
+    if (lstat(_socketPath.c_str(), &st) == 0)
+    {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool alive = probe >= 0 && connect(probe, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0;
+        if (probe >= 0)
+            close(probe);
+        if (alive)
+            throw std::runtime_error("Another agent is already listening on " + _socketPath);
+        unlink(_socketPath.c_str());
+    }
+
+    _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0)
+        throw std::runtime_error(std::string("socket: ") + strerror(errno));
+
+    mode_t oldMask = umask(077);
+    int res = bind(_listenFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    umask(oldMask);
+    if (res != 0 || listen(_listenFd, SOMAXCONN) != 0)
+    {
+        std::string error = strerror(errno);
+        close(_listenFd);
+        _listenFd = -1;
+        throw std::runtime_error("Cannot listen on " + _socketPath + ": " + error);
+    }
+}
+
+// Kernel PSI trigger: the fd turns EPOLLPRI when the stall threshold is crossed.
+// Without PSI (old kernel, disabled, no access) SIGUSR1 is left
+void VaultAgent::watchMemoryPressure()
+{
+    _pressureFd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (_pressureFd < 0)
+        return;
+
+    const char *trigger = AGENT_MEMORY_PRESSURE_TRIGGER;
+    struct epoll_event ev = {};
+    ev.events = EPOLLPRI;
+    ev.data.fd = _pressureFd;
+    if (write(_pressureFd, trigger, strlen(trigger) + 1) < 0
+        || epoll_ctl(_epollFd, EPOLL_CTL_ADD, _pressureFd, &ev) != 0)
+    {
+        PrintLog(std::cout, CYAN "VaultAgent" RESET " - Memory pressure not watched: %s", strerror(errno));
+        close(_pressureFd);
+        _pressureFd = -1;
+    }
+}
+
+// ============ EVENT LOOP ============
+
+void VaultAgent::run()
+{
+    struct epoll_event events[AGENT_MAX_EVENTS];
+    _running = true;
+
+    while (_running)
+    {
+        // Wake up to wipe expired secrets only while there are some
+        int timeout = _vault.secrets().getStats().entries ? AGENT_SECRET_PURGE_MS : -1;
+        int n = epoll_wait(_epollFd, events, AGENT_MAX_EVENTS, timeout);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("epoll_wait: ") + strerror(errno));
+        }
+
+        _vault.secrets().purgeExpired();
+
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == _listenFd)
+                acceptClients();
+            else if (fd == _signalFd)
+            {
+                struct signalfd_siginfo info;
+                if (read(_signalFd, &info, sizeof(info)) != sizeof(info))
+                    continue;
+                if (info.ssi_signo == SIGUSR1)
+                {
+                    _vault.secrets().flush();
+                    continue;
+                }
+                PrintLog(std::cout, CYAN "VaultAgent" RESET " - Signal %u, stopping", info.ssi_signo);
+                _running = false;
+            }
+            else if (fd == _pressureFd)
+            {
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    epoll_ctl(_epollFd, EPOLL_CTL_DEL, _pressureFd, nullptr);
+                    close(_pressureFd);
+                    _pressureFd = -1;
+                    continue;
+                }
+                PrintLog(std::cout, CYAN "VaultAgent" RESET " - Memory pressure");
+                _vault.secrets().flush();
+            }
+            else
+            {
+                auto it = _clients.find(fd);
+                if (it == _clients.end())
+                    continue;
+                Client &client = *it->second;
+
+                if (events[i].events & (EPOLLHUP | EPOLLERR))
+                    client.closing = true;
+                if (events[i].events & EPOLLIN)
+                    readClient(client);
+                if (client.sent < client.output.size())
+                    writeClient(client);
+
+                if (client.closing && client.sent == client.output.size())
+                    closeClient(fd);
+                else
+                    updateInterest(client);
+            }
+        }
+    }
+}
+
+void VaultAgent::acceptClients()
+{
+    while (true)
+    {
+        int fd = accept4(_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        // Same user only: the socket directory already keeps others out,
+        // this also covers a path given with --socket
+        struct ucred cred = {};
+        socklen_t len = sizeof(cred);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 || cred.uid != geteuid())
+        {
+            PrintLog(std::cerr, RED "VaultAgent - Refused peer pid %d uid %d" RESET, (int)cred.pid, (int)cred.uid);
+            close(fd);
+            continue;
+        }
+        if (_clients.size() >= AGENT_MAX_CLIENTS)
+        {
+            PrintLog(std::cerr, RED "VaultAgent - Too many clients, refused pid %d" RESET, (int)cred.pid);
+            close(fd);
+            continue;
+        }
+
+        auto client = std::make_unique<Client>();
+        client->fd = fd;
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev);
+        _clients[fd] = std::move(client);
+    }
+}
+
+void VaultAgent::readClient(Client &client)
+{
+    char buffer[AGENT_READ_CHUNK];
+    ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+    {
+        if (n == 0 || (errno != EAGAIN && errno != EINTR))
+            client.closing = true;
+        return;
+    }
+    client.input.append(buffer, n);
+
+    // Everything another connection committed shows up before these requests
+    refreshEntries();
+
+    // Answer every complete line now, a pipelined batch gets one write
+    size_t start = 0;
+    size_t end;
+    while (!client.closing && (end = client.input.find('\n', start)) != std::string::npos)
+    {
+        std::string line = client.input.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        start = end + 1;
+        handleRequest(client, line);
+    }
+    client.input.erase(0, start);
+
+    if (client.input.size() > AGENT_MAX_LINE)
+    {
+        replyError(client, "bad_request", "request line too long");
+        client.closing = true;
+    }
+}
+
+void VaultAgent::writeClient(Client &client)
+{
+    while (client.sent < client.output.size())
+    {
+        ssize_t n = send(client.fd, client.output.data() + client.sent,
+                         client.output.size() - client.sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                client.closing = true;
+            break;
+        }
+        client.sent += n;
+    }
+
+    // Fully flushed: wipe the replies, the buffer keeps its capacity
+    if (client.sent == client.output.size())
+    {
+        OPENSSL_cleanse(client.output.data(), client.output.size());
+        client.output.clear();
+        client.sent = 0;
+    }
+}
+
+void VaultAgent::updateInterest(Client &client)
+{
+    struct epoll_event ev = {};
+    ev.data.fd = client.fd;
+    // A client not reading its replies gets no more of them
+    if (client.output.size() - client.sent < AGENT_MAX_PENDING_OUTPUT && !client.closing)
+        ev.events |= EPOLLIN;
+    if (client.sent < client.output.size())
+        ev.events |= EPOLLOUT;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, client.fd, &ev);
+}
+
+void VaultAgent::closeClient(int fd)
+{
+    auto it = _clients.find(fd);
+    if (it == _clients.end())
+        return;
+    Client &client = *it->second;
+    OPENSSL_cleanse(client.output.data(), client.output.size());
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    _clients.erase(it);
+}
+
+// ============ REQUESTS ============
+
+// data_version is a cached statement on a warm connection: microseconds
+void VaultAgent::refreshEntries()
+{
+    long long version = _vault.database().getDataVersion();
+    if (version == _dataVersion)
+        return;
+    _dataVersion = version;
+    _vault.database().loadVaultCache(_vault.session().getUserId(), _entries);
+}
+
+void VaultAgent::reply(Client &client, const JsonWriter &json)
+{
+    SecretView text = json.view();
+    client.output.insert(client.output.end(), text.begin(), text.end());
+    client.output.push_back('\n');
+}
+
+void VaultAgent::replyError(Client &client, const char *code, const std::string &message)
+{
+    JsonWriter json;
+    json.beginObject().field("error", message).field("code", code).endObject();
+    reply(client, json);
+}
+
+void VaultAgent::handleRequest(Client &client, const std::string &line)
+{
+    _served++;
+    size_t space = line.find(' ');
+    std::string command = line.substr(0, space);
+    std::string arg = space == std::string::npos ? "" : line.substr(space + 1);
+
+    JsonWriter json;
+    if (command == "ping" && arg.empty())
+    {
+        json.beginObject()
+            .field("ok", true)
+            .field("user", _vault.session().getUsername())
+            .field("entries", _entries.size())
+            .field("cache_bytes", _entries.memoryUsage());
+
+        SecretCacheStats secrets = _vault.secrets().getStats();
+        json.key("secrets").beginObject()
+            .field("entries", secrets.entries)
+            .field("capacity", secrets.capacity)
+            .field("hits", static_cast<long long>(secrets.hits))
+            .field("misses", static_cast<long long>(secrets.misses))
+            .field("evictions", static_cast<long long>(secrets.evictions))
+            .field("expirations", static_cast<long long>(secrets.expirations))
+            .field("invalidations", static_cast<long long>(secrets.invalidations))
+            .field("flushes", static_cast<long long>(secrets.flushes))
+            .endObject();
+
+        // Page VFS of an encrypted vault
+        const DatabaseCipher *cipher = _vault.database().getCipher();
+        if (cipher && cipher->settings().backend == CipherBackend::Pages)
+        {
+            PageCipherStats pages = cipher->pageStats();
+            json.key("pages").beginObject()
+                .field("encrypted", static_cast<long long>(pages.encrypted))
+                .field("decrypted", static_cast<long long>(pages.decrypted))
+                .field("cache_hits", static_cast<long long>(pages.cacheHits))
+                .field("auth_failures", static_cast<long long>(pages.authFailures))
+                .endObject();
+        }
+        json.endObject();
+    }
+    else if (command == "list" && arg.empty())
+    {
+        json.beginArray();
+        for (size_t i = 0; i < _entries.size(); i++)
+        {
+            json.beginObject();
+            writeEntryFields(json, _entries[i]);
+            json.endObject();
+        }
+        json.endArray();
+    }
+    else if (command == "search" && !arg.empty())
+    {
+        json.beginArray();
+        for (const CachedEntry &entry : searchEntries(_entries, arg))
+        {
+            json.beginObject();
+            writeEntryFields(json, entry);
+            json.endObject();
+        }
+        json.endArray();
+    }
+    else if (command == "get" && !arg.empty())
+    {
+        std::vector<CachedEntry> matches = findEntries(_entries, arg);
+        std::vector<UrlMatch> byUrl;
+        if (matches.empty())
+        {
+            // Not an id or a stored website: look it up as a URL
+            byUrl = _vault.database().findByUrl(_vault.session().getUserId(), arg);
+            CachedEntry entry;
+            for (const Password *pwd : bestUrlMatches(byUrl))
+                if (_entries.find(pwd->id, entry))
+                    matches.push_back(entry);
+        }
+        if (matches.empty())
+            return replyError(client, "not_found", "no entry matches " + arg);
+        if (matches.size() > 1)
+            return replyError(client, "ambiguous", "several entries match " + arg + ", use the id");
+
+        // Recently served: no decryption at all. The raw IV is the fingerprint
+        const CachedEntry &entry = matches[0];
+        std::string_view iv(reinterpret_cast<const char *>(entry.iv.data()), entry.iv.size());
+        SecureString cached;
+        if (_vault.secrets().get(entry.id, iv, cached))
+        {
+            json.beginObject();
+            writeEntryFields(json, entry);
+            json.field("password", cached.view());
+            json.endObject();
+            return reply(client, json);
+        }
+
+        // Held key, decoded record, reused scratch buffer: no KDF, no hex and no allocation once warm
+        _plain.resize(std::max(_plain.size(), entry.ciphertext.size() + CRYPTO_BLOCK_SIZE));
+        unsigned char *plain = reinterpret_cast<unsigned char *>(_plain.data());
+        int len = entry.iv.empty() ? -1 : _vault.crypto().decryptInto(_key.data(), entry.iv.data(),
+                                                                        entry.ciphertext.data(), entry.ciphertext.size(),
+                                                                        plain, _plain.size());
+        if (len < 0)
+            return replyError(client, "bad_request", "entry failed to decrypt");
+
+        json.beginObject();
+        writeEntryFields(json, entry);
+        json.field("password", SecretView(_plain.data(), len));
+        json.endObject();
+        _vault.secrets().put(entry.id, iv, SecretView(_plain.data(), len));
+        OPENSSL_cleanse(_plain.data(), len);
+    }
+    else if (command == "shutdown" && arg.empty())
+    {
+        json.beginObject().field("ok", true).endObject();
+        _running = false;
+    }
+    else
+        return replyError(client, "bad_request", "unknown request: " + command);
+
+    reply(client, json);
+}
@@ -0,0 +1,157 @@
+#include "VaultAgent.hpp"
+#include "Terminal.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static void printUsage(std::ostream &out)
+{
+    out << "Usage: passmand [options]\n"
+           "\n"
+           "Unlocks a vault once and serves lookups to passman-cli --agent and\n"
+           "other clients over a Unix socket (see VaultAgent.hpp for the protocol).\n"
+           "\n"
+           "Options:\n"
+           "  --db <path>         Vault file (default: $HOME/.local/share/passman)\n"
+           "  --user <name>       Vault user (default: $PASSMAN_USER)\n"
+           "  --socket <path>     Socket (default: $PASSMAN_AGENT_SOCK, $XDG_RUNTIME_DIR/passman/agent.sock)\n"
+           "  --foreground        Do not detach, logs on stderr with --verbose\n"
+           "  --verbose           Logs on stderr\n"
+           "  -h, --help          This help\n"
+           "\n"
+           "Prints PASSMAN_AGENT_SOCK=<path> for eval once it is listening.\n";
+}
+
+// Detach, the parent only returns once the child is listening (or failed)
+// so `eval $(passmand)` sees the socket ready. Called before any thread or
+// secret exists: neither survives fork() the way we want.
+static int daemonize(int &readyFd)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid > 0)
+    {
+        close(fds[1]);
+        char status = 0;
+        bool ready = read(fds[0], &status, 1) == 1 && status == '1';
+        close(fds[0]);
+        _exit(ready ? 0 : 1);
+    }
+
+    close(fds[0]);
+    readyFd = fds[1];
+    return 0;
+}
+
+// Child side: leave the terminal now that the password has been read
+static void detach(int readyFd)
+{
+    setsid();
+    int devNull = open("/dev/null", O_RDWR);
+    if (devNull >= 0)
+    {
+        dup2(devNull, STDIN_FILENO);
+        dup2(devNull, STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+        if (devNull > STDERR_FILENO)
+            close(devNull);
+    }
+    writeAll(readyFd, SecretView("1", 1));
+    close(readyFd);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dbPath;
+    std::string user = getenv("PASSMAN_USER") ? getenv("PASSMAN_USER") : "";
+    std::string socketPath = agentSocketPath();
+    bool foreground = false;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--db" && hasValue)
+            dbPath = argv[++i];
+        else if (arg == "--user" && hasValue)
+            user = argv[++i];
+        else if (arg == "--socket" && hasValue)
+            socketPath = argv[++i];
+        else if (arg == "--foreground")
+            foreground = true;
+        else if (arg == "--verbose")
+            verbose = true;
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage(std::cout);
+            return 0;
+        }
+        else
+        {
+            printUsage(std::cerr);
+            return 2;
+        }
+    }
+    if (user.empty())
+    {
+        std::cerr << "passmand: no user given (--user or PASSMAN_USER)" << std::endl;
+        return 2;
+    }
+
+    // stdout is for the PASSMAN_AGENT_SOCK line
+    RedirectLogs(verbose ? &std::cerr : nullptr);
+
+    int readyFd = -1;
+    if (!foreground && daemonize(readyFd) != 0)
+    {
+        std::cerr << "passmand: cannot detach: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // Before the scheduler and db threads start, so they inherit the mask
+    VaultAgent::blockSignals();
+
+    try
+    {
+        struct stat st;
+        if (!dbPath.empty() && stat(dbPath.c_str(), &st) != 0)
+            throw std::runtime_error("no vault at " + dbPath);
+
+        // Lookups run on the event loop thread, the pool only backs VaultContext
+        TaskScheduler scheduler(1);
+        VaultContext vault(scheduler, dbPath);
+
+        SecureString master = readSecret("Master password: ");
+        if (!vault.auth().authenticateUser(user, master))
+            throw std::runtime_error("invalid user or master password");
+
+        std::string hash;
+        std::string salt;
+        if (!vault.database().getUserHash(user, hash, salt))
+            throw std::runtime_error("user not found");
+        vault.session().beginSession(vault.database().getUserIdByUsername(user), user, std::move(master), salt);
+
+        VaultAgent agent(vault, socketPath);
+        agent.start();
+
+        std::string env = "PASSMAN_AGENT_SOCK=" + agent.socketPath() + "; export PASSMAN_AGENT_SOCK;\n"
+                          "echo Agent pid " + std::to_string(getpid()) + ";\n";
+        writeAll(STDOUT_FILENO, env);
+        if (!foreground)
+            detach(readyFd);
+
+        agent.run();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "passmand: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
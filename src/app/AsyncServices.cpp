@@ -0,0 +1,114 @@
+#include "AsyncServices.hpp"
+
+// ============ ASYNC DATABASE ============
+
+AsyncDatabase::AsyncDatabase(const SQLiteCipherDB &db, Executor &exec) : _db(db), _exec(exec) {}
+
+Task<std::vector<Password>> AsyncDatabase::listPasswords(int user_id) const
+{
+    co_return co_await runOn(_exec, [this, user_id]() { return _db.getPasswordsByUserId(user_id); });
+}
+
+Task<std::optional<Password>> AsyncDatabase::getPassword(int id) const
+{
+    co_return co_await runOn(_exec, [this, id]()
+    {
+        Password pwd;
+        return _db.getPassword(id, pwd) ? std::optional<Password>(pwd) : std::nullopt;
+    });
+}
+
+Task<long long> AsyncDatabase::getChangeSeq() const
+{
+    co_return co_await runOn(_exec, [this]() { return _db.getChangeSeq(); });
+}
+
+Task<std::vector<Password>> AsyncDatabase::getPasswordsChangedSince(int user_id, long long seq) const
+{
+    co_return co_await runOn(_exec, [this, user_id, seq]() { return _db.getPasswordsChangedSince(user_id, seq); });
+}
+
+Task<std::vector<int>> AsyncDatabase::getDeletedPasswordIdsSince(int user_id, long long seq) const
+{
+    co_return co_await runOn(_exec, [this, user_id, seq]() { return _db.getDeletedPasswordIdsSince(user_id, seq); });
+}
+
+Task<bool> AsyncDatabase::addPassword(int user_id, std::string website, std::string username,
+                                      std::string encrypted_password, std::string iv) const
+{
+    co_return co_await runOn(_exec, [&]()
+        { return _db.addPassword(user_id, website, username, encrypted_password, iv); });
+}
+
+Task<bool> AsyncDatabase::updatePassword(int id, std::string website, std::string username,
+                                         std::string encrypted_password, std::string iv) const
+{
+    co_return co_await runOn(_exec, [&]()
+        { return _db.updatePassword(id, website, username, encrypted_password, iv); });
+}
+
+Task<bool> AsyncDatabase::deletePassword(int id) const
+{
+    co_return co_await runOn(_exec, [this, id]() { return _db.deletePassword(id); });
+}
+
+// ============ ASYNC CRYPTO ============
+
+AsyncCrypto::AsyncCrypto(const CryptoManager &crypto, Executor &exec, TaskScheduler *scheduler)
+    : _crypto(crypto), _exec(exec), _scheduler(scheduler) {}
+
+Task<std::pair<std::string, std::string>> AsyncCrypto::encryptPassword(
+    SecureString plaintext, SecureString masterPassword, SecureString salt) const
+{
+    co_return co_await runOn(_exec, [&]() { return _crypto.encryptPassword(plaintext, masterPassword, salt); });
+}
+
+Task<SecureString> AsyncCrypto::decryptPassword(
+    std::string ciphertext_hex, std::string iv_hex, SecureString masterPassword, SecureString salt) const
+{
+    co_return co_await runOn(_exec, [&]()
+        { return _crypto.decryptPassword(ciphertext_hex, iv_hex, masterPassword, salt); });
+}
+
+Task<std::vector<SecureString>> AsyncCrypto::decryptPasswords(
+    std::vector<Password> pwds, SecureString masterPassword, SecureString salt) const
+{
+    co_return co_await runOn(_exec, [&]()
+    {
+        std::vector<EncryptedField> records;
+        records.reserve(pwds.size());
+        for (auto &pwd : pwds)
+            records.push_back({std::move(pwd.encrypted_password), std::move(pwd.iv)});
+
+        std::vector<SecureString> plaintexts;
+        if (_crypto.decryptBatch(records, plaintexts, masterPassword, salt, _scheduler) > 0)
+            throw std::runtime_error("Failed to decrypt the password listing");
+        return plaintexts;
+    });
+}
+
+Task<SecureBytes> AsyncCrypto::deriveKey(SecureString masterPassword, SecureString salt) const
+{
+    co_return co_await runOn(_exec, [&]()
+    {
+        SecureBytes key(CRYPTO_KEY_SIZE);
+        _crypto.deriveKey(masterPassword, salt, key.data());
+        return key;
+    });
+}
+
+Task<std::vector<SecureString>> AsyncCrypto::decryptPasswords(std::vector<Password> pwds, SecureBytes key) const
+{
+    co_return co_await runOn(_exec, [&]()
+    {
+        std::vector<EncryptedField> records;
+        records.reserve(pwds.size());
+        for (auto &pwd : pwds)
+            records.push_back({std::move(pwd.encrypted_password), std::move(pwd.iv)});
+
+        std::vector<SecureString> plaintexts;
+        if (_crypto.decryptBatch(records, plaintexts, key.data(), _scheduler) > 0)
+            throw std::runtime_error("Failed to decrypt the password listing");
+        return plaintexts;
+    });
+}
@@ -1,24 +1,24 @@
 #include "AuthenticationManager.hpp"
-#include "SessionManager.hpp"
 
-AuthenticationManager::AuthenticationManager()
+AuthenticationManager::AuthenticationManager(const SQLiteCipherDB &db, const CryptoManager &crypto)
+    : _db(db), _crypto(crypto)
 {
     PrintLog(std::cout, CYAN "Authentication Manager" RESET " - initialized" RESET);
 }
 
 AuthenticationManager::~AuthenticationManager() {}
 
-bool    AuthenticationManager::authenticateUser(const std::string &username, const std::string &password) const
+bool    AuthenticationManager::authenticateUser(const std::string &username, SecretView password) const
 {
     // Search for a user in the DB
     PrintLog(std::cout, CYAN "Authentication Manager" RESET " - authenticating user %s...", username.c_str());
 
     std::string stored_hash, stored_salt;
-    if (!SESSION->getDatabase()->getUserHash(username, stored_hash, stored_salt))
+    if (!_db.getUserHash(username, stored_hash, stored_salt))
         return false;
     
     // Verify Password
-    int res = SESSION->getCryptoManager()->verifyPassword(password, stored_hash, stored_salt);
+    int res = _crypto.verifyPassword(password, stored_hash, stored_salt);
     if (res)
         PrintLog(std::cout, CYAN "Authentication Manager" RESET " - user %s authenticated", username.c_str());
     else
@@ -26,18 +26,18 @@ bool    AuthenticationManager::authenticateUser(const std::string &username, con
     return res;
 }
 
-bool    AuthenticationManager::registerNewUser(const std::string &username, const std::string &password, bool isMaster) const
+bool    AuthenticationManager::registerNewUser(const std::string &username, SecretView password, bool isMaster) const
 {
     PrintLog(std::cout, CYAN "Authentication Manager" RESET " - registing user %s...", username.c_str());
-    if (SESSION->getDatabase()->userExists(username))
+    if (_db.userExists(username))
     {
         PrintLog(std::cout, CYAN "Authentication Manager" RESET " -  user %s already exist", username.c_str());
         return false;
     }
     
     // hash the password
-    auto [hash, salt] = SESSION->getCryptoManager()->hashPassword(password);
-    int res = SESSION->getDatabase()->createUser(username, hash, salt, isMaster);
+    auto [hash, salt] = _crypto.hashPassword(password);
+    int res = _db.createUser(username, hash, salt, isMaster);
 
     if (res)
         PrintLog(std::cout, CYAN "Authentication Manager" RESET " - user %s created", username.c_str());
@@ -0,0 +1,1024 @@
+#include "KdbxReader.hpp"
+#include "Argon2.hpp"
+#include "XmlReader.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <map>
+#include <openssl/core_names.h>
+
+#define KDBX_SIGNATURE_1 0x9AA2D903
+#define KDBX_SIGNATURE_2 0xB54BFB67
+#define KDBX_MAJOR_VERSION 4
+
+// Outer header fields
+#define KDBX_END_OF_HEADER 0
+#define KDBX_CIPHER_ID 2
+#define KDBX_COMPRESSION 3
+#define KDBX_MASTER_SEED 4
+#define KDBX_ENCRYPTION_IV 7
+#define KDBX_KDF_PARAMETERS 11
+
+// Inner header fields
+#define KDBX_INNER_END 0
+#define KDBX_INNER_STREAM_ID 1
+#define KDBX_INNER_STREAM_KEY 2
+#define KDBX_INNER_BINARY 3
+#define KDBX_STREAM_CHACHA20 3
+#define KDBX_MAX_INNER_KEY 64
+
+#define KDBX_HASH_SIZE 32
+#define KDBX_SEED_SIZE 32
+#define KDBX_HMAC_KEY_SIZE 64
+#define KDBX_INFLATE_CHUNK (64 * 1024)
+// Key files this small are checked for the XML / raw / hex formats
+#define KDBX_MAX_KEY_FILE_PARSED (1024 * 1024)
+
+static const unsigned char CIPHER_AES256[16] = {
+    0x31, 0xc1, 0xf2, 0xe6, 0xbf, 0x71, 0x43, 0x50, 0xbe, 0x58, 0x05, 0x21, 0x6a, 0xfc, 0x5a, 0xff};
+static const unsigned char CIPHER_CHACHA20[16] = {
+    0xd6, 0x03, 0x8a, 0x2b, 0x8b, 0x6f, 0x4c, 0xb5, 0xa5, 0x24, 0x33, 0x9a, 0x31, 0xdb, 0xb5, 0x9a};
+static const unsigned char KDF_AES[16] = {
+    0xc9, 0xd9, 0xf3, 0x9a, 0x62, 0x8a, 0x44, 0x60, 0xbf, 0x74, 0x0d, 0x08, 0xc1, 0x8a, 0x4f, 0xea};
+static const unsigned char KDF_ARGON2D[16] = {
+    0xef, 0x63, 0x6d, 0xdf, 0x8c, 0x29, 0x44, 0x4b, 0x91, 0xf7, 0xa9, 0xa4, 0x03, 0xe3, 0x0a, 0x0c};
+static const unsigned char KDF_ARGON2ID[16] = {
+    0x9e, 0x29, 0x8b, 0x19, 0x56, 0xdb, 0x47, 0x73, 0xb2, 0x3d, 0xfc, 0x3e, 0xc6, 0xf0, 0xa1, 0xe6};
+
+typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> CtxPtr;
+typedef std::span<const unsigned char> Bytes;
+
+// ============ HELPERS ============
+
+static uint32_t le32(const unsigned char *p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static uint64_t le64(const unsigned char *p)
+{
+    return uint64_t(le32(p)) | (uint64_t(le32(p + 4)) << 32);
+}
+
+static void putLe64(unsigned char *p, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+static void readExact(int fd, void *out, size_t length)
+{
+    unsigned char *p = static_cast<unsigned char *>(out);
+    while (length > 0)
+    {
+        ssize_t n = ::read(fd, p, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::runtime_error(std::string("read failed: ") + strerror(errno));
+        if (n == 0)
+            throw std::runtime_error("KDBX file is truncated");
+        p += n;
+        length -= n;
+    }
+}
+
+static void digest(const EVP_MD *md, std::initializer_list<Bytes> parts, unsigned char *out)
+{
+    typedef std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> MdPtr;
+    MdPtr ctx(EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+    bool ok = ctx && EVP_DigestInit_ex(ctx.get(), md, nullptr) == 1;
+    for (Bytes part : parts)
+        ok = ok && EVP_DigestUpdate(ctx.get(), part.data(), part.size()) == 1;
+    if (!ok || EVP_DigestFinal_ex(ctx.get(), out, nullptr) != 1)
+        throw std::runtime_error("digest failed");
+}
+
+// HMAC-SHA256 keyed with SHA-512(index || base), index UINT64_MAX for the header
+static void blockHmac(const unsigned char *hmacBase, uint64_t index, std::initializer_list<Bytes> parts,
+                      unsigned char out[KDBX_HASH_SIZE])
+{
+    unsigned char indexBytes[8];
+    putLe64(indexBytes, index);
+    unsigned char key[KDBX_HMAC_KEY_SIZE];
+    digest(EVP_sha512(), {Bytes(indexBytes, 8), Bytes(hmacBase, KDBX_HMAC_KEY_SIZE)}, key);
+
+    static EVP_MAC *hmac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+    typedef std::unique_ptr<EVP_MAC_CTX, decltype(&EVP_MAC_CTX_free)> MacPtr;
+    MacPtr ctx(hmac ? EVP_MAC_CTX_new(hmac) : nullptr, &EVP_MAC_CTX_free);
+    char sha256[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, sha256, 0),
+        OSSL_PARAM_construct_end()};
+
+    size_t length = 0;
+    bool ok = ctx && EVP_MAC_init(ctx.get(), key, sizeof(key), params) == 1;
+    for (Bytes part : parts)
+        ok = ok && EVP_MAC_update(ctx.get(), part.data(), part.size()) == 1;
+    ok = ok && EVP_MAC_final(ctx.get(), out, &length, KDBX_HASH_SIZE) == 1;
+    OPENSSL_cleanse(key, sizeof(key));
+    if (!ok)
+        throw std::runtime_error("HMAC failed");
+}
+
+// Base64 decoded as it streams in: white space skipped, '=' ends the data
+class Base64Decoder
+{
+    private:
+        uint32_t _bits = 0;
+        int _count = 0;
+        bool _ended = false;
+
+        static int value(char c)
+        {
+            if (c >= 'A' && c <= 'Z')
+                return c - 'A';
+            if (c >= 'a' && c <= 'z')
+                return c - 'a' + 26;
+            if (c >= '0' && c <= '9')
+                return c - '0' + 52;
+            if (c == '+')
+                return 62;
+            if (c == '/')
+                return 63;
+            return -1;
+        }
+
+    public:
+        ~Base64Decoder()
+        {
+            _bits = 0;
+        }
+
+        void feed(std::string_view text, SecureChars &out)
+        {
+            for (char c : text)
+            {
+                if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+                    continue;
+                if (c == '=')
+                {
+                    _ended = true;
+                    continue;
+                }
+                int v = value(c);
+                if (v < 0 || _ended)
+                    throw std::runtime_error("invalid base64 in KDBX file");
+                _bits = (_bits << 6) | v;
+                if (++_count == 4)
+                {
+                    out.push_back(static_cast<char>(_bits >> 16));
+                    out.push_back(static_cast<char>(_bits >> 8));
+                    out.push_back(static_cast<char>(_bits));
+                    _bits = 0;
+                    _count = 0;
+                }
+            }
+        }
+
+        void finish(SecureChars &out)
+        {
+            if (_count == 1)
+                throw std::runtime_error("invalid base64 in KDBX file");
+            if (_count >= 2)
+                out.push_back(static_cast<char>(_bits >> (_count == 2 ? 4 : 10)));
+            if (_count == 3)
+                out.push_back(static_cast<char>(_bits >> 2));
+            _bits = 0;
+            _count = 0;
+            _ended = false;
+        }
+};
+
+// ============ KEY ============
+
+// KeePass XML key file: <KeyFile><Meta><Version/></Meta><Key><Data Hash=""/></Key></KeyFile>
+class KeyFileHandler : public XmlHandler
+{
+    public:
+        std::vector<std::string> path;
+        std::string version;
+        std::string hash;
+        SecureChars data;
+
+        void startElement(std::string_view name, std::span<const XmlAttribute> attributes) override
+        {
+            path.emplace_back(name);
+            if (path.size() == 1 && name != "KeyFile")
+                throw std::runtime_error("not a key file");
+            for (const XmlAttribute &attribute : attributes)
+                if (inData() && attribute.name == "Hash")
+                    hash = attribute.value;
+        }
+
+        void text(std::string_view piece) override
+        {
+            if (path.size() == 3 && path[1] == "Meta" && path[2] == "Version")
+                version += piece;
+            else if (inData())
+                data.insert(data.end(), piece.begin(), piece.end());
+        }
+
+        void endElement(std::string_view) override
+        {
+            path.pop_back();
+        }
+
+        bool inData() const
+        {
+            return path.size() == 3 && path[1] == "Key" && path[2] == "Data";
+        }
+};
+
+static bool hexDecode(std::string_view hex, unsigned char *out, size_t size)
+{
+    std::string digits;
+    for (char c : hex)
+        if (!isspace(static_cast<unsigned char>(c)))
+            digits.push_back(c);
+    if (digits.size() != 2 * size)
+        return false;
+    for (size_t i = 0; i < size; i++)
+    {
+        char pair[3] = {digits[2 * i], digits[2 * i + 1], 0};
+        char *end = nullptr;
+        if (!isxdigit(static_cast<unsigned char>(pair[0])) || !isxdigit(static_cast<unsigned char>(pair[1])))
+            return false;
+        out[i] = static_cast<unsigned char>(strtoul(pair, &end, 16));
+    }
+    return true;
+}
+
+// 32 byte key of a key file, the way KeePass reads them
+static void loadKeyFile(const std::string &path, unsigned char key[KDBX_HASH_SIZE])
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("cannot read key file " + path);
+
+    typedef std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> MdPtr;
+    MdPtr sha(EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+    SecureChars content;
+    char buffer[64 * 1024];
+    ssize_t n = 0;
+    bool ok = sha && EVP_DigestInit_ex(sha.get(), EVP_sha256(), nullptr) == 1;
+    while (ok && (n = ::read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        ok = EVP_DigestUpdate(sha.get(), buffer, n) == 1;
+        if (content.size() <= KDBX_MAX_KEY_FILE_PARSED)
+            content.insert(content.end(), buffer, buffer + n);
+    }
+    ok = ok && n == 0;
+    close(fd);
+    OPENSSL_cleanse(buffer, sizeof(buffer));
+    if (!ok)
+        throw std::runtime_error("cannot read key file " + path);
+
+    unsigned char fileHash[KDBX_HASH_SIZE];
+    EVP_DigestFinal_ex(sha.get(), fileHash, nullptr);
+
+    if (content.size() <= KDBX_MAX_KEY_FILE_PARSED)
+    {
+        KeyFileHandler handler;
+        bool xml = true;
+        try
+        {
+            XmlReader reader(handler);
+            reader.feed(content.data(), content.size());
+            reader.finish();
+        }
+        catch (const std::exception &)
+        {
+            xml = false;
+        }
+
+        if (xml && handler.version.rfind("1.0", 0) == 0)
+        {
+            SecureChars decoded;
+            Base64Decoder decoder;
+            decoder.feed(std::string_view(handler.data.data(), handler.data.size()), decoded);
+            decoder.finish(decoded);
+            if (decoded.size() != KDBX_HASH_SIZE)
+                throw std::runtime_error("invalid key file");
+            memcpy(key, decoded.data(), KDBX_HASH_SIZE);
+            return;
+        }
+        if (xml && handler.version.rfind("2.0", 0) == 0)
+        {
+            if (!hexDecode(std::string_view(handler.data.data(), handler.data.size()), key, KDBX_HASH_SIZE))
+                throw std::runtime_error("invalid key file");
+            // Hash: first 4 bytes of SHA-256(key), a typo check
+            unsigned char check[KDBX_HASH_SIZE];
+            unsigned char expected[4];
+            digest(EVP_sha256(), {Bytes(key, KDBX_HASH_SIZE)}, check);
+            if (!handler.hash.empty() && (!hexDecode(handler.hash, expected, 4) || memcmp(check, expected, 4) != 0))
+                throw std::runtime_error("key file checksum mismatch");
+            return;
+        }
+        if (content.size() == KDBX_HASH_SIZE)
+        {
+            memcpy(key, content.data(), KDBX_HASH_SIZE);
+            return;
+        }
+        if (content.size() == 2 * KDBX_HASH_SIZE
+            && hexDecode(std::string_view(content.data(), content.size()), key, KDBX_HASH_SIZE))
+            return;
+    }
+    memcpy(key, fileHash, KDBX_HASH_SIZE);
+}
+
+// SHA-256 of the component keys: SHA-256(password), then the key file's key
+static void compositeKey(SecretView password, const std::string &keyFile, unsigned char out[KDBX_HASH_SIZE])
+{
+    unsigned char components[2 * KDBX_HASH_SIZE];
+    size_t length = 0;
+    if (!password.empty() || keyFile.empty())
+    {
+        digest(EVP_sha256(), {Bytes(password.bytes(), password.size())}, components);
+        length += KDBX_HASH_SIZE;
+    }
+    if (!keyFile.empty())
+    {
+        loadKeyFile(keyFile, components + length);
+        length += KDBX_HASH_SIZE;
+    }
+    digest(EVP_sha256(), {Bytes(components, length)}, out);
+    OPENSSL_cleanse(components, sizeof(components));
+}
+
+// ============ HEADER ============
+
+// KdfParameters: version u16, then type u8 | name length u32 | name | value length u32 | value
+class VariantDictionary
+{
+    private:
+        std::map<std::string, std::vector<unsigned char>> _values;
+
+    public:
+        void parse(const std::vector<unsigned char> &data)
+        {
+            if (data.size() < 2 || data[1] != 1)
+                throw std::runtime_error("unsupported KDF parameters version");
+            size_t pos = 2;
+            auto need = [&](size_t length)
+            {
+                if (data.size() - pos < length)
+                    throw std::runtime_error("KDBX KDF parameters are truncated");
+            };
+            while (true)
+            {
+                need(1);
+                if (data[pos++] == 0)
+                    break;
+                need(4);
+                uint32_t nameLength = le32(&data[pos]);
+                pos += 4;
+                need(nameLength);
+                std::string name(reinterpret_cast<const char *>(&data[pos]), nameLength);
+                pos += nameLength;
+                need(4);
+                uint32_t valueLength = le32(&data[pos]);
+                pos += 4;
+                need(valueLength);
+                _values[name].assign(data.begin() + pos, data.begin() + pos + valueLength);
+                pos += valueLength;
+            }
+        }
+
+        const std::vector<unsigned char> *bytes(const std::string &name) const
+        {
+            auto it = _values.find(name);
+            return it == _values.end() ? nullptr : &it->second;
+        }
+
+        // UInt32 / UInt64 item, fallback when it is missing
+        uint64_t number(const std::string &name, uint64_t fallback) const
+        {
+            const std::vector<unsigned char> *value = bytes(name);
+            if (!value)
+                return fallback;
+            if (value->size() == 4)
+                return le32(value->data());
+            if (value->size() == 8)
+                return le64(value->data());
+            throw std::runtime_error("invalid KDF parameter " + name);
+        }
+};
+
+struct OuterHeader
+{
+    std::vector<unsigned char> raw;     // signature to end of header field, hashed
+    unsigned char cipher[16] = {};
+    bool gzip = false;
+    std::vector<unsigned char> seed;
+    std::vector<unsigned char> iv;
+    VariantDictionary kdf;
+};
+
+static void readOuterHeader(int fd, OuterHeader &header)
+{
+    header.raw.resize(12);
+    readExact(fd, header.raw.data(), 12);
+    if (le32(&header.raw[0]) != KDBX_SIGNATURE_1 || le32(&header.raw[4]) != KDBX_SIGNATURE_2)
+        throw std::runtime_error("not a KeePass database");
+    uint16_t major = header.raw[10] | (header.raw[11] << 8);
+    if (major != KDBX_MAJOR_VERSION)
+        throw std::runtime_error("KDBX " + std::to_string(major) + " is not supported, save the database as KDBX 4");
+
+    bool cipher = false;
+    bool kdf = false;
+    while (true)
+    {
+        size_t start = header.raw.size();
+        header.raw.resize(start + 5);
+        readExact(fd, &header.raw[start], 5);
+        int id = header.raw[start];
+        uint32_t length = le32(&header.raw[start + 1]);
+        if (length > KDBX_MAX_HEADER - header.raw.size())
+            throw std::runtime_error("KDBX header too large");
+        header.raw.resize(start + 5 + length);
+        readExact(fd, &header.raw[start + 5], length);
+        std::vector<unsigned char> value(header.raw.begin() + start + 5, header.raw.end());
+
+        if (id == KDBX_END_OF_HEADER)
+            break;
+        if (id == KDBX_CIPHER_ID && length == 16)
+        {
+            memcpy(header.cipher, value.data(), 16);
+            cipher = true;
+        }
+        else if (id == KDBX_COMPRESSION && length == 4)
+            header.gzip = le32(value.data()) == 1;
+        else if (id == KDBX_MASTER_SEED)
+            header.seed = std::move(value);
+        else if (id == KDBX_ENCRYPTION_IV)
+            header.iv = std::move(value);
+        else if (id == KDBX_KDF_PARAMETERS)
+        {
+            header.kdf.parse(value);
+            kdf = true;
+        }
+    }
+
+    if (!cipher || !kdf || header.seed.size() != KDBX_SEED_SIZE)
+        throw std::runtime_error("KDBX header is incomplete");
+}
+
+// Transformed key of the composite key: AES-KDF or Argon2d / Argon2id
+static void transformKey(const VariantDictionary &kdf, const unsigned char *composite, unsigned char *out,
+                         TaskScheduler *scheduler, const CancellationToken &token)
+{
+    const std::vector<unsigned char> *uuid = kdf.bytes("$UUID");
+    const std::vector<unsigned char> *salt = kdf.bytes("S");
+    if (!uuid || uuid->size() != 16 || !salt)
+        throw std::runtime_error("KDBX KDF parameters are incomplete");
+
+    if (memcmp(uuid->data(), KDF_AES, 16) == 0)
+    {
+        if (salt->size() != KDBX_HASH_SIZE)
+            throw std::runtime_error("invalid AES-KDF seed");
+        uint64_t rounds = kdf.number("R", 0);
+        CtxPtr ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+        unsigned char block[KDBX_HASH_SIZE];
+        memcpy(block, composite, KDBX_HASH_SIZE);
+        int length = 0;
+        bool ok = ctx && EVP_EncryptInit_ex(ctx.get(), EVP_aes_256_ecb(), nullptr, salt->data(), nullptr) == 1
+                  && EVP_CIPHER_CTX_set_padding(ctx.get(), 0) == 1;
+        for (uint64_t r = 0; ok && r < rounds; r++)
+        {
+            if ((r & 0xfffff) == 0)
+                token.throwIfCancelled();
+            ok = EVP_EncryptUpdate(ctx.get(), block, &length, block, KDBX_HASH_SIZE) == 1;
+        }
+        if (!ok)
+            throw std::runtime_error("AES-KDF failed");
+        digest(EVP_sha256(), {Bytes(block, KDBX_HASH_SIZE)}, out);
+        OPENSSL_cleanse(block, sizeof(block));
+        return;
+    }
+
+    Argon2Params params;
+    if (memcmp(uuid->data(), KDF_ARGON2D, 16) == 0)
+        params.type = Argon2Type::D;
+    else if (memcmp(uuid->data(), KDF_ARGON2ID, 16) == 0)
+        params.type = Argon2Type::ID;
+    else
+        throw std::runtime_error("unsupported KDBX key derivation");
+
+    uint64_t memory = kdf.number("M", 0);
+    uint64_t iterations = kdf.number("I", 0);
+    uint64_t lanes = kdf.number("P", 0);
+    if (memory > KDBX_MAX_KDF_MEMORY)
+        throw std::runtime_error("KDBX Argon2 memory above the " + std::to_string(KDBX_MAX_KDF_MEMORY >> 20) + " MiB limit");
+    if (iterations == 0 || iterations > UINT32_MAX || lanes == 0 || lanes > 0xffffff)
+        throw std::runtime_error("invalid KDBX Argon2 parameters");
+    params.memoryKiB = memory / 1024;
+    params.iterations = iterations;
+    params.lanes = lanes;
+    params.version = kdf.number("V", ARGON2_VERSION_13);
+    params.salt = *salt;
+    if (const std::vector<unsigned char> *secret = kdf.bytes("K"))
+        params.secret = *secret;
+    if (const std::vector<unsigned char> *associated = kdf.bytes("A"))
+        params.associated = *associated;
+    token.throwIfCancelled();
+    argon2Hash(params, SecretView(reinterpret_cast<const char *>(composite), KDBX_HASH_SIZE),
+               out, KDBX_HASH_SIZE, scheduler);
+}
+
+// ============ PAYLOAD ============
+
+// XML of the database: live entries are collected and handed out in
+// batches, protected values are XORed with the inner stream in document
+// order (those of history entries too, to stay in step)
+class KdbxXmlHandler : public XmlHandler
+{
+    private:
+        struct StoredEntry
+        {
+            std::string title;
+            std::string url;
+            std::string username;
+            SecureString password;
+        };
+
+        EVP_CIPHER_CTX *_stream;
+        const std::function<void(std::span<const KdbxEntry>)> &_onEntries;
+        KdbxStats &_stats;
+        const CancellationToken &_token;
+
+        std::vector<std::string> _path;
+        std::vector<bool> _recycled;        // per open group
+        std::string _recycleBin;
+        bool _recycleBinEnabled = true;
+
+        bool _inEntry = false;
+        size_t _entryDepth = 0;
+        int _history = 0;
+        std::string _key;
+        bool _protected = false;
+        Base64Decoder _base64;
+        SecureChars _decoded;
+
+        // Where the current text goes
+        std::string *_text = nullptr;
+        SecureChars *_secret = nullptr;
+        std::string _scratch;
+
+        std::string _title;
+        std::string _url;
+        std::string _username;
+        SecureChars _password;
+        std::vector<StoredEntry> _batch;
+
+        bool at(std::initializer_list<const char *> tail) const
+        {
+            if (_path.size() < tail.size())
+                return false;
+            size_t i = _path.size() - tail.size();
+            for (const char *name : tail)
+                if (_path[i++] != name)
+                    return false;
+            return true;
+        }
+
+        void append(const char *data, size_t length)
+        {
+            size_t size = _text ? _text->size() : _secret->size();
+            if (size + length > KDBX_MAX_FIELD)
+                throw std::runtime_error("KDBX entry field too large");
+            if (_text)
+                _text->append(data, length);
+            else
+                _secret->insert(_secret->end(), data, data + length);
+        }
+
+        // Base64 bytes decoded so far, XORed with the inner stream
+        void unprotect()
+        {
+            if (_decoded.empty())
+                return;
+            int length = 0;
+            unsigned char *bytes = reinterpret_cast<unsigned char *>(_decoded.data());
+            if (EVP_EncryptUpdate(_stream, bytes, &length, bytes, _decoded.size()) != 1)
+                throw std::runtime_error("KDBX inner stream failed");
+            if (_text || _secret)
+                append(_decoded.data(), _decoded.size());
+            OPENSSL_cleanse(_decoded.data(), _decoded.size());
+            _decoded.clear();
+        }
+
+    public:
+        KdbxXmlHandler(EVP_CIPHER_CTX *stream, const std::function<void(std::span<const KdbxEntry>)> &onEntries,
+                       KdbxStats &stats, const CancellationToken &token)
+            : _stream(stream), _onEntries(onEntries), _stats(stats), _token(token) {}
+
+        void startElement(std::string_view name, std::span<const XmlAttribute> attributes) override
+        {
+            _path.emplace_back(name);
+            _text = nullptr;
+            _secret = nullptr;
+
+            if (name == "Group")
+                _recycled.push_back(!_recycled.empty() && _recycled.back());
+            else if (name == "Entry" && !_inEntry)
+            {
+                _inEntry = true;
+                _entryDepth = _path.size();
+                _title.clear();
+                _url.clear();
+                _username.clear();
+                _password.clear();
+            }
+            else if (name == "History" && _inEntry)
+                _history++;
+            else if (name == "Key" && _inEntry && !_history && at({"Entry", "String", "Key"}))
+            {
+                _key.clear();
+                _text = &_key;
+            }
+            else if (name == "Value")
+            {
+                _protected = false;
+                for (const XmlAttribute &attribute : attributes)
+                    if (attribute.name == "Protected" && attribute.value == "True")
+                        _protected = true;
+                if (_inEntry && !_history && at({"Entry", "String", "Value"}))
+                {
+                    if (_key == "Title")
+                        _text = &_title;
+                    else if (_key == "URL")
+                        _text = &_url;
+                    else if (_key == "UserName")
+                        _text = &_username;
+                    else if (_key == "Password")
+                        _secret = &_password;
+                }
+            }
+            else if (at({"Meta", "RecycleBinUUID"}) || at({"Meta", "RecycleBinEnabled"}) || at({"Group", "UUID"}))
+            {
+                _scratch.clear();
+                _text = &_scratch;
+            }
+        }
+
+        void text(std::string_view piece) override
+        {
+            if (_protected && !_path.empty() && _path.back() == "Value")
+            {
+                _base64.feed(piece, _decoded);
+                unprotect();
+            }
+            else if (_text || _secret)
+                append(piece.data(), piece.size());
+        }
+
+        void endElement(std::string_view name) override
+        {
+            if (name == "Value" && _protected)
+            {
+                _base64.finish(_decoded);
+                unprotect();
+                _protected = false;
+            }
+            else if (at({"Meta", "RecycleBinUUID"}))
+                _recycleBin = _scratch;
+            else if (at({"Meta", "RecycleBinEnabled"}))
+                _recycleBinEnabled = _scratch == "True";
+            else if (at({"Group", "UUID"}) && _recycleBinEnabled && !_recycleBin.empty() && _scratch == _recycleBin)
+                _recycled.back() = true;
+            else if (name == "Group")
+                _recycled.pop_back();
+            else if (name == "History" && _inEntry)
+                _history--;
+            else if (name == "Entry" && _inEntry && _path.size() == _entryDepth)
+            {
+                _inEntry = false;
+                if (!_recycled.empty() && _recycled.back())
+                    _stats.recycled++;
+                else
+                {
+                    _batch.push_back({std::move(_title), std::move(_url), std::move(_username),
+                                      SecureString(_password.data(), _password.size())});
+                    if (_batch.size() >= KDBX_BATCH)
+                        flush();
+                }
+            }
+            _text = nullptr;
+            _secret = nullptr;
+            _path.pop_back();
+        }
+
+        void flush()
+        {
+            if (_batch.empty())
+                return;
+            _token.throwIfCancelled();
+            std::vector<KdbxEntry> entries;
+            entries.reserve(_batch.size());
+            for (const StoredEntry &entry : _batch)
+                entries.push_back({entry.title, entry.url, entry.username, entry.password.view()});
+            _stats.entries += entries.size();
+            _onEntries(entries);
+            _batch.clear();
+        }
+};
+
+// Decrypted payload: cipher, then gzip, then the inner header, then the XML
+class KdbxPayload
+{
+    private:
+        CtxPtr _cipher;
+        CtxPtr _stream;
+        bool _gzip;
+        z_stream _zlib = {};
+        bool _zlibEnded = false;
+
+        SecureBytes _plain;
+        SecureBytes _inflated;
+
+        // Inner header fields, then the XML
+        bool _inXml = false;
+        unsigned char _field[5];
+        size_t _fieldFilled = 0;
+        uint32_t _fieldLength = 0;
+        uint32_t _fieldRead = 0;
+        SecureBytes _fieldData;
+        uint32_t _streamId = 0;
+        SecureBytes _streamKey;
+
+        KdbxXmlHandler _handler;
+        XmlReader _xml;
+
+        void endField()
+        {
+            int id = _field[0];
+            if (id == KDBX_INNER_STREAM_ID && _fieldData.size() == 4)
+                _streamId = le32(_fieldData.data());
+            else if (id == KDBX_INNER_STREAM_KEY)
+                _streamKey = _fieldData;
+            else if (id == KDBX_INNER_END)
+            {
+                if (_streamId != KDBX_STREAM_CHACHA20 || _streamKey.empty())
+                    throw std::runtime_error("unsupported KDBX inner stream (ChaCha20 only)");
+                // key = SHA-512(stream key)[0, 32), nonce = [32, 44)
+                unsigned char hash[64];
+                unsigned char iv[16] = {};
+                digest(EVP_sha512(), {Bytes(_streamKey.data(), _streamKey.size())}, hash);
+                memcpy(iv + 4, hash + 32, 12);
+                bool ok = EVP_EncryptInit_ex(_stream.get(), EVP_chacha20(), nullptr, hash, iv) == 1;
+                OPENSSL_cleanse(hash, sizeof(hash));
+                if (!ok)
+                    throw std::runtime_error("KDBX inner stream failed");
+                _inXml = true;
+            }
+            _fieldFilled = 0;
+            _fieldRead = 0;
+            _fieldData.clear();
+        }
+
+        void inner(const unsigned char *data, size_t length)
+        {
+            while (length > 0)
+            {
+                if (_inXml)
+                {
+                    _xml.feed(reinterpret_cast<const char *>(data), length);
+                    return;
+                }
+                if (_fieldFilled < sizeof(_field))
+                {
+                    size_t take = std::min(length, sizeof(_field) - _fieldFilled);
+                    memcpy(_field + _fieldFilled, data, take);
+                    _fieldFilled += take;
+                    data += take;
+                    length -= take;
+                    if (_fieldFilled < sizeof(_field))
+                        return;
+                    _fieldLength = le32(_field + 1);
+                    if (_field[0] != KDBX_INNER_BINARY && _fieldLength > KDBX_MAX_INNER_KEY)
+                        throw std::runtime_error("invalid KDBX inner header");
+                }
+                // Attachments are skipped
+                size_t take = std::min<size_t>(length, _fieldLength - _fieldRead);
+                if (_field[0] != KDBX_INNER_BINARY)
+                    _fieldData.insert(_fieldData.end(), data, data + take);
+                _fieldRead += take;
+                data += take;
+                length -= take;
+                if (_fieldRead == _fieldLength)
+                    endField();
+            }
+        }
+
+        void inflateInto(const unsigned char *data, size_t length, bool flush)
+        {
+            if (_zlibEnded)
+            {
+                if (length > 0)
+                    throw std::runtime_error("KDBX payload has data after the gzip stream");
+                return;
+            }
+            _zlib.next_in = const_cast<unsigned char *>(data);
+            _zlib.avail_in = length;
+            do
+            {
+                _zlib.next_out = _inflated.data();
+                _zlib.avail_out = _inflated.size();
+                int res = inflate(&_zlib, flush ? Z_FINISH : Z_NO_FLUSH);
+                if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR)
+                    throw std::runtime_error("KDBX payload is not valid gzip");
+                inner(_inflated.data(), _inflated.size() - _zlib.avail_out);
+                if (res == Z_STREAM_END)
+                {
+                    _zlibEnded = true;
+                    break;
+                }
+                if (res == Z_BUF_ERROR && _zlib.avail_out != 0)
+                    break;
+            } while (_zlib.avail_in > 0 || _zlib.avail_out == 0);
+            if (flush && !_zlibEnded)
+                throw std::runtime_error("KDBX gzip stream is truncated");
+        }
+
+        void decrypted(const unsigned char *data, size_t length, bool last)
+        {
+            if (_gzip)
+                inflateInto(data, length, last);
+            else
+                inner(data, length);
+        }
+
+    public:
+        KdbxPayload(const OuterHeader &header, const unsigned char *key,
+                    const std::function<void(std::span<const KdbxEntry>)> &onEntries,
+                    KdbxStats &stats, const CancellationToken &token)
+            : _cipher(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free),
+              _stream(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free),
+              _gzip(header.gzip), _inflated(KDBX_INFLATE_CHUNK),
+              _handler(_stream.get(), onEntries, stats, token), _xml(_handler)
+        {
+            bool ok = _cipher && _stream;
+            if (ok && memcmp(header.cipher, CIPHER_AES256, 16) == 0 && header.iv.size() == 16)
+                ok = EVP_DecryptInit_ex(_cipher.get(), EVP_aes_256_cbc(), nullptr, key, header.iv.data()) == 1;
+            else if (ok && memcmp(header.cipher, CIPHER_CHACHA20, 16) == 0 && header.iv.size() == 12)
+            {
+                // OpenSSL's ChaCha20 IV is the 32 bit block counter then the nonce
+                unsigned char iv[16] = {};
+                memcpy(iv + 4, header.iv.data(), 12);
+                ok = EVP_DecryptInit_ex(_cipher.get(), EVP_chacha20(), nullptr, key, iv) == 1;
+            }
+            else if (ok)
+                throw std::runtime_error("unsupported KDBX cipher (AES-256 and ChaCha20 only)");
+            if (!ok || (_gzip && inflateInit2(&_zlib, 16 + MAX_WBITS) != Z_OK))
+                throw std::runtime_error("KDBX payload setup failed");
+        }
+
+        ~KdbxPayload()
+        {
+            if (_gzip)
+                inflateEnd(&_zlib);
+        }
+
+        // To prevent copy
+        KdbxPayload(const KdbxPayload &) = delete;
+        KdbxPayload& operator=(const KdbxPayload &) = delete;
+
+        void feed(const unsigned char *data, size_t length)
+        {
+            _plain.resize(length + EVP_MAX_BLOCK_LENGTH);
+            int written = 0;
+            if (EVP_DecryptUpdate(_cipher.get(), _plain.data(), &written, data, length) != 1)
+                throw std::runtime_error("KDBX payload decryption failed");
+            decrypted(_plain.data(), written, false);
+        }
+
+        void finish()
+        {
+            int written = 0;
+            if (EVP_DecryptFinal_ex(_cipher.get(), _plain.data(), &written) != 1)
+                throw std::runtime_error("KDBX payload decryption failed");
+            decrypted(_plain.data(), written, true);
+            if (!_inXml)
+                throw std::runtime_error("KDBX inner header is truncated");
+            _xml.finish();
+            _handler.flush();
+        }
+};
+
+// Authenticate the HMAC blocks from the current offset of fd, and hand their
+// data to fn when set. Returns the number of blocks
+static size_t readBlocks(int fd, const unsigned char *hmacBase, const CancellationToken &token,
+                         const std::function<void(const unsigned char *, size_t)> &fn)
+{
+    std::vector<unsigned char> block;
+    for (uint64_t index = 0;; index++)
+    {
+        token.throwIfCancelled();
+        unsigned char head[KDBX_HASH_SIZE + 4];
+        readExact(fd, head, sizeof(head));
+        uint32_t length = le32(head + KDBX_HASH_SIZE);
+        if (length > KDBX_MAX_BLOCK)
+            throw std::runtime_error("KDBX block too large");
+        block.resize(length);
+        readExact(fd, block.data(), length);
+
+        // Blocks authenticate their index, length and data
+        unsigned char indexBytes[8];
+        unsigned char mac[KDBX_HASH_SIZE];
+        putLe64(indexBytes, index);
+        blockHmac(hmacBase, index, {Bytes(indexBytes, 8), Bytes(head + KDBX_HASH_SIZE, 4), Bytes(block.data(), length)}, mac);
+        if (CRYPTO_memcmp(mac, head, KDBX_HASH_SIZE) != 0)
+            throw std::runtime_error("KDBX block " + std::to_string(index) + " failed authentication");
+        if (length == 0)
+            return index;
+        if (fn)
+            fn(block.data(), length);
+    }
+}
+
+// ============ READER ============
+
+KdbxReader::KdbxReader(TaskScheduler *scheduler) : _scheduler(scheduler) {}
+
+KdbxStats KdbxReader::read(const std::string &path, SecretView password, const std::string &keyFile,
+                           const std::function<void(std::span<const KdbxEntry>)> &onEntries,
+                           CancellationToken token) const
+{
+    auto start = std::chrono::steady_clock::now();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("cannot read " + path + ": " + strerror(errno));
+
+    KdbxStats stats;
+    try
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+            stats.bytes = st.st_size;
+
+        OuterHeader header;
+        readOuterHeader(fd, header);
+        unsigned char hash[KDBX_HASH_SIZE];
+        unsigned char mac[KDBX_HASH_SIZE];
+        unsigned char expected[KDBX_HASH_SIZE];
+        readExact(fd, hash, sizeof(hash));
+        readExact(fd, mac, sizeof(mac));
+        digest(EVP_sha256(), {Bytes(header.raw)}, expected);
+        if (memcmp(hash, expected, KDBX_HASH_SIZE) != 0)
+            throw std::runtime_error("KDBX header is corrupted");
+
+        SecureBytes composite(KDBX_HASH_SIZE);
+        SecureBytes transformed(KDBX_HASH_SIZE);
+        compositeKey(password, keyFile, composite.data());
+        auto kdfStart = std::chrono::steady_clock::now();
+        transformKey(header.kdf, composite.data(), transformed.data(), _scheduler, token);
+        stats.kdfMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - kdfStart).count();
+
+        // Cipher key SHA-256(seed || transformed), HMAC base SHA-512(seed || transformed || 1)
+        SecureBytes cipherKey(KDBX_HASH_SIZE);
+        SecureBytes hmacBase(KDBX_HMAC_KEY_SIZE);
+        const unsigned char one = 1;
+        digest(EVP_sha256(), {Bytes(header.seed), Bytes(transformed)}, cipherKey.data());
+        digest(EVP_sha512(), {Bytes(header.seed), Bytes(transformed), Bytes(&one, 1)}, hmacBase.data());
+
+        blockHmac(hmacBase.data(), UINT64_MAX, {Bytes(header.raw)}, expected);
+        if (CRYPTO_memcmp(mac, expected, KDBX_HASH_SIZE) != 0)
+            throw std::runtime_error("wrong password or key file");
+
+        // Every block is authenticated before anything is decrypted, then read again
+        off_t payloadStart = lseek(fd, 0, SEEK_CUR);
+        readBlocks(fd, hmacBase.data(), token, nullptr);
+        if (payloadStart < 0 || lseek(fd, payloadStart, SEEK_SET) != payloadStart)
+            throw std::runtime_error(std::string("seek failed: ") + strerror(errno));
+
+        KdbxPayload payload(header, cipherKey.data(), onEntries, stats, token);
+        stats.blocks = readBlocks(fd, hmacBase.data(), token,
+            [&payload](const unsigned char *data, size_t length) { payload.feed(data, length); });
+        payload.finish();
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    PrintLog(std::cout, CYAN "KdbxReader" GREEN " - %lu entries read from %s (%lu in the recycle bin, KDF %.0f ms, %.0f ms)" RESET,
+             stats.entries, path.c_str(), stats.recycled, stats.kdfMs, stats.ms);
+    return stats;
+}
+
+bool KdbxReader::isKdbx(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    unsigned char signature[8];
+    bool match = ::read(fd, signature, sizeof(signature)) == sizeof(signature)
+                 && le32(signature) == KDBX_SIGNATURE_1 && le32(signature + 4) == KDBX_SIGNATURE_2;
+    close(fd);
+    return match;
+}
@@ -0,0 +1,124 @@
+#include "SecretCache.hpp"
+
+SecretCache::SecretCache(size_t capacity, std::chrono::milliseconds ttl)
+    : _capacity(capacity), _ttl(ttl), _stats{}
+{
+    _stats.capacity = capacity;
+}
+
+// Caller holds _mutex. The SecureString wipes the plaintext when the node goes
+void SecretCache::erase(std::unordered_map<int, std::list<Entry>::iterator>::iterator it)
+{
+    _lru.erase(it->second);
+    _index.erase(it);
+}
+
+bool SecretCache::get(int id, std::string_view iv, SecureString &out)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(id);
+    if (it == _index.end())
+    {
+        _stats.misses++;
+        return false;
+    }
+
+    Entry &entry = *it->second;
+    if (entry.expires <= std::chrono::steady_clock::now())
+    {
+        _stats.expirations++;
+        _stats.misses++;
+        erase(it);
+        return false;
+    }
+
+    // Re-encrypted since it was cached
+    if (entry.iv != iv)
+    {
+        _stats.invalidations++;
+        _stats.misses++;
+        erase(it);
+        return false;
+    }
+
+    _lru.splice(_lru.begin(), _lru, it->second);
+    out = entry.plaintext.clone();
+    _stats.hits++;
+    return true;
+}
+
+void SecretCache::put(int id, std::string_view iv, SecretView plaintext)
+{
+    if (_capacity == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto expires = std::chrono::steady_clock::now() + _ttl;
+
+    auto it = _index.find(id);
+    if (it != _index.end())
+    {
+        Entry &entry = *it->second;
+        entry.iv.assign(iv);
+        entry.plaintext = SecureString(plaintext);
+        entry.expires = expires;
+        _lru.splice(_lru.begin(), _lru, it->second);
+        return;
+    }
+
+    if (_index.size() >= _capacity)
+    {
+        _stats.evictions++;
+        erase(_index.find(_lru.back().id));
+    }
+
+    _lru.push_front(Entry{id, std::string(iv), SecureString(plaintext), expires});
+    _index.emplace(id, _lru.begin());
+}
+
+void SecretCache::invalidate(int id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(id);
+    if (it == _index.end())
+        return;
+    _stats.invalidations++;
+    erase(it);
+}
+
+void SecretCache::purgeExpired()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = _lru.begin(); it != _lru.end();)
+    {
+        if (it->expires > now)
+        {
+            ++it;
+            continue;
+        }
+        _stats.expirations++;
+        _index.erase(it->id);
+        it = _lru.erase(it);
+    }
+}
+
+void SecretCache::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_lru.empty())
+        return;
+
+    PrintLog(std::cout, CYAN "SecretCache" RESET " - Flushing %lu decrypted entries", _lru.size());
+    _stats.flushes++;
+    _index.clear();
+    _lru.clear();
+}
+
+SecretCacheStats SecretCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    SecretCacheStats stats = _stats;
+    stats.entries = _lru.size();
+    return stats;
+}
@@ -0,0 +1,104 @@
+#include "VaultContext.hpp"
+
+VaultContext::VaultExecutor::VaultExecutor(VaultContext &vault, Executor &inner) : _vault(vault), _inner(inner) {}
+
+void VaultContext::VaultExecutor::post(std::function<void()> fn)
+{
+    // Not cancellable here: a dropped coroutine resumption would never finish,
+    // the awaiting tasks skip their work themselves once the session is revoked
+    _inner.post([fn = std::move(fn), job = _vault.trackJob()]() { fn(); });
+}
+
+VaultContext::VaultContext(TaskScheduler &scheduler, const std::string &dbPath)
+    : _scheduler(scheduler),
+    _jobs(0),
+    _executor(std::make_unique<VaultExecutor>(*this, scheduler.executor(TaskPriority::Interactive))),
+    _db(std::make_unique<SQLiteCipherDB>(dbPath)),
+    _crypto(std::make_unique<CryptoManager>()),
+    _auth(std::make_unique<AuthenticationManager>(*_db, *_crypto)),
+    _asyncDb(std::make_unique<AsyncDatabase>(*_db, *_executor)),
+    _asyncCrypto(std::make_unique<AsyncCrypto>(*_crypto, *_executor, &scheduler)),
+    _session(*_crypto)
+{
+    _session.setRevokeHook([this]() { _secrets.flush(); });
+    _db->setPasswordChangeListener([this](int id) { _secrets.invalidate(id); });
+    PrintLog(std::cout, CYAN "VaultContext" GREEN " - Vault %s open" RESET, _db->getPath().c_str());
+}
+
+VaultContext::~VaultContext()
+{
+    // Revoke in-flight work and wait for it before the services it uses go away:
+    // queued jobs are dropped, running ones see the cancellation and return
+    _closing.cancel();
+    _session.clearSession();
+
+    std::unique_lock<std::mutex> lock(_jobsMutex);
+    if (_jobs > 0)
+        PrintLog(std::cout, CYAN "VaultContext" RESET " - Waiting for %zu jobs...", _jobs);
+    _jobsDone.wait(lock, [this]() { return _jobs == 0; });
+    lock.unlock();
+
+    PrintLog(std::cout, CYAN "VaultContext" RESET " - Vault closed");
+}
+
+std::shared_ptr<void> VaultContext::trackJob()
+{
+    std::lock_guard<std::mutex> lock(_jobsMutex);
+    _jobs++;
+    return std::shared_ptr<void>(nullptr, [this](void *)
+    {
+        std::lock_guard<std::mutex> lock(_jobsMutex);
+        if (--_jobs == 0)
+            _jobsDone.notify_all();
+    });
+}
+
+CancellationToken VaultContext::closingToken() const
+{
+    return _closing.token();
+}
+
+SQLiteCipherDB &VaultContext::database() const
+{
+    return *_db;
+}
+
+CryptoManager &VaultContext::crypto() const
+{
+    return *_crypto;
+}
+
+AuthenticationManager &VaultContext::auth() const
+{
+    return *_auth;
+}
+
+AsyncDatabase &VaultContext::asyncDatabase() const
+{
+    return *_asyncDb;
+}
+
+AsyncCrypto &VaultContext::asyncCrypto() const
+{
+    return *_asyncCrypto;
+}
+
+TaskScheduler &VaultContext::scheduler() const
+{
+    return _scheduler;
+}
+
+VaultSession &VaultContext::session()
+{
+    return _session;
+}
+
+const VaultSession &VaultContext::session() const
+{
+    return _session;
+}
+
+SecretCache &VaultContext::secrets()
+{
+    return _secrets;
+}
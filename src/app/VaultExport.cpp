@@ -0,0 +1,471 @@
+#include "VaultExport.hpp"
+#include "SecureRandom.hpp"
+#include "Terminal.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <deque>
+
+// Records of the plaintext stream: type u8, then
+//   entry   website, username, password, created_at: each length u32 | bytes
+//   end     entry count u32, last bytes of the stream
+#define EXPORT_RECORD_ENTRY 1
+#define EXPORT_RECORD_END 2
+
+// Header offsets
+#define EXPORT_OFF_VERSION 8
+#define EXPORT_OFF_KDF 9
+#define EXPORT_OFF_ITERATIONS 12
+#define EXPORT_OFF_CHUNK_SIZE 16
+#define EXPORT_OFF_SALT 20
+#define EXPORT_OFF_PREFIX 36
+
+struct ExportHeader
+{
+    unsigned char raw[EXPORT_HEADER_SIZE];
+    uint32_t iterations;
+    uint32_t chunkSize;
+};
+
+// ============ HELPERS ============
+
+static const EVP_CIPHER *chunkCipher()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static EVP_CIPHER *cipher = EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr);
+#else
+    static const EVP_CIPHER *cipher = EVP_aes_256_gcm();
+#endif
+    if (!cipher)
+        throw std::runtime_error("AES-256-GCM not available");
+    return cipher;
+}
+
+static void putU32(unsigned char *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static uint32_t getU32(const unsigned char *in)
+{
+    return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | in[3];
+}
+
+static void deriveExportKey(SecretView passphrase, const ExportHeader &header, unsigned char key[CRYPTO_KEY_SIZE])
+{
+    if (PKCS5_PBKDF2_HMAC(passphrase.data(), passphrase.size(),
+                          header.raw + EXPORT_OFF_SALT, CRYPTO_WRAP_SALT_SIZE,
+                          header.iterations, EVP_sha256(), CRYPTO_KEY_SIZE, key) != 1)
+        throw std::runtime_error("PBKDF2 derivation failed");
+}
+
+// prefix | counter | last flag
+static void chunkNonce(const ExportHeader &header, uint32_t counter, bool last, unsigned char nonce[CRYPTO_GCM_NONCE_SIZE])
+{
+    memcpy(nonce, header.raw + EXPORT_OFF_PREFIX, EXPORT_NONCE_PREFIX_SIZE);
+    putU32(nonce + EXPORT_NONCE_PREFIX_SIZE, counter);
+    nonce[CRYPTO_GCM_NONCE_SIZE - 1] = last ? 1 : 0;
+}
+
+// length plaintext bytes into out, followed by the tag
+static bool sealChunk(const unsigned char *key, const ExportHeader &header, uint32_t counter, bool last,
+                      const unsigned char *in, size_t length, unsigned char *out)
+{
+    unsigned char nonce[CRYPTO_GCM_NONCE_SIZE];
+    chunkNonce(header, counter, last, nonce);
+
+    typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> CtxPtr;
+    CtxPtr ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    int len = 0;
+    return ctx
+        && EVP_EncryptInit_ex(ctx.get(), chunkCipher(), nullptr, key, nonce) == 1
+        && EVP_EncryptUpdate(ctx.get(), nullptr, &len, header.raw, EXPORT_HEADER_SIZE) == 1
+        && EVP_EncryptUpdate(ctx.get(), out, &len, in, length) == 1
+        && EVP_EncryptFinal_ex(ctx.get(), out + len, &len) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, CRYPTO_GCM_TAG_SIZE, out + length) == 1;
+}
+
+// length bytes of ciphertext followed by the tag, into out. False if the tag doesn't match
+static bool openChunk(const unsigned char *key, const ExportHeader &header, uint32_t counter, bool last,
+                      const unsigned char *in, size_t length, unsigned char *out)
+{
+    unsigned char nonce[CRYPTO_GCM_NONCE_SIZE];
+    chunkNonce(header, counter, last, nonce);
+
+    typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> CtxPtr;
+    CtxPtr ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    int len = 0;
+    bool ok = ctx
+        && EVP_DecryptInit_ex(ctx.get(), chunkCipher(), nullptr, key, nonce) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, CRYPTO_GCM_TAG_SIZE,
+                               const_cast<unsigned char *>(in + length)) == 1
+        && EVP_DecryptUpdate(ctx.get(), nullptr, &len, header.raw, EXPORT_HEADER_SIZE) == 1
+        && EVP_DecryptUpdate(ctx.get(), out, &len, in, length) == 1
+        && EVP_DecryptFinal_ex(ctx.get(), out + len, &len) == 1;
+    // The plaintext of a forged chunk never leaves here
+    if (!ok)
+        OPENSSL_cleanse(out, length);
+    return ok;
+}
+
+// Sequential reads of fd through one large buffer
+class InputBuffer
+{
+    private:
+        int _fd;
+        std::vector<unsigned char> _buffer;
+        size_t _pos = 0;
+        size_t _end = 0;
+
+        bool refill()
+        {
+            ssize_t n;
+            do
+                n = ::read(_fd, _buffer.data(), _buffer.size());
+            while (n < 0 && errno == EINTR);
+            if (n < 0)
+                throw std::runtime_error(std::string("read failed: ") + strerror(errno));
+            _pos = 0;
+            _end = n;
+            return n > 0;
+        }
+
+    public:
+        InputBuffer(int fd) : _fd(fd), _buffer(EXPORT_IO_BUFFER) {}
+
+        // Up to n bytes into out, fewer only at the end of the file
+        size_t read(unsigned char *out, size_t n)
+        {
+            size_t copied = 0;
+            while (copied < n && (_pos < _end || refill()))
+            {
+                size_t length = std::min(n - copied, _end - _pos);
+                memcpy(out + copied, _buffer.data() + _pos, length);
+                _pos += length;
+                copied += length;
+            }
+            return copied;
+        }
+
+        bool atEnd()
+        {
+            return _pos == _end && !refill();
+        }
+};
+
+static void readHeader(InputBuffer &input, ExportHeader &header)
+{
+    if (input.read(header.raw, EXPORT_HEADER_SIZE) != EXPORT_HEADER_SIZE
+        || memcmp(header.raw, EXPORT_MAGIC, EXPORT_MAGIC_SIZE) != 0)
+        throw std::runtime_error("not a passman export");
+    if (header.raw[EXPORT_OFF_VERSION] != EXPORT_VERSION)
+        throw std::runtime_error("unsupported export version " + std::to_string(header.raw[EXPORT_OFF_VERSION]));
+    if (header.raw[EXPORT_OFF_KDF] != EXPORT_KDF_PBKDF2_SHA256)
+        throw std::runtime_error("unsupported export key derivation");
+
+    header.iterations = getU32(header.raw + EXPORT_OFF_ITERATIONS);
+    header.chunkSize = getU32(header.raw + EXPORT_OFF_CHUNK_SIZE);
+    if (header.iterations == 0 || header.iterations > EXPORT_MAX_ITERATIONS
+        || header.chunkSize == 0 || header.chunkSize > EXPORT_MAX_CHUNK_SIZE)
+        throw std::runtime_error("invalid export header");
+}
+
+static void putField(SecureBytes &plain, const char *data, size_t size)
+{
+    if (size > EXPORT_MAX_FIELD)
+        throw std::runtime_error("entry field too large to export");
+    unsigned char length[4];
+    putU32(length, size);
+    plain.insert(plain.end(), length, length + sizeof(length));
+    plain.insert(plain.end(), data, data + size);
+}
+
+// One field at pos, false if the data stops before its end
+static bool getField(const SecureBytes &plain, size_t &pos, std::string_view &field)
+{
+    if (plain.size() - pos < 4)
+        return false;
+    uint32_t length = getU32(plain.data() + pos);
+    if (length > EXPORT_MAX_FIELD)
+        throw std::runtime_error("corrupt export: oversized field");
+    if (plain.size() - pos - 4 < length)
+        return false;
+    field = std::string_view(reinterpret_cast<const char *>(plain.data()) + pos + 4, length);
+    pos += 4 + length;
+    return true;
+}
+
+// ============ EXPORT ============
+
+VaultExport::VaultExport(const CryptoManager &crypto, TaskScheduler *scheduler)
+    : _crypto(crypto), _scheduler(scheduler) {}
+
+ExportStats VaultExport::write(int fd, const SQLiteCipherDB &db, int userId,
+                               SecretView masterPassword, SecretView salt, SecretView passphrase,
+                               CancellationToken token, int iterations) const
+{
+    auto start = std::chrono::steady_clock::now();
+    if (iterations <= 0 || iterations > EXPORT_MAX_ITERATIONS)
+        throw std::runtime_error("invalid export iteration count");
+
+    ExportHeader header = {};
+    memcpy(header.raw, EXPORT_MAGIC, EXPORT_MAGIC_SIZE);
+    header.raw[EXPORT_OFF_VERSION] = EXPORT_VERSION;
+    header.raw[EXPORT_OFF_KDF] = EXPORT_KDF_PBKDF2_SHA256;
+    header.iterations = iterations;
+    header.chunkSize = EXPORT_CHUNK_SIZE;
+    putU32(header.raw + EXPORT_OFF_ITERATIONS, header.iterations);
+    putU32(header.raw + EXPORT_OFF_CHUNK_SIZE, header.chunkSize);
+    SecureRandom::fill(header.raw + EXPORT_OFF_SALT, CRYPTO_WRAP_SALT_SIZE);
+    SecureRandom::fill(header.raw + EXPORT_OFF_PREFIX, EXPORT_NONCE_PREFIX_SIZE);
+
+    SecureBytes key(CRYPTO_KEY_SIZE);
+    deriveExportKey(passphrase, header, key.data());
+    SecureBytes recordKey(CRYPTO_KEY_SIZE);
+    _crypto.deriveKey(masterPassword, salt, recordKey.data());
+
+    ExportStats stats;
+    std::vector<unsigned char> out(header.raw, header.raw + EXPORT_HEADER_SIZE);
+    out.reserve(EXPORT_IO_BUFFER + header.chunkSize + CRYPTO_GCM_TAG_SIZE);
+
+    SecureBytes plain;
+    plain.reserve(2 * header.chunkSize);
+    SecureChars password;
+    std::deque<std::future<std::vector<unsigned char>>> sealing;
+    uint32_t counter = 0;
+    size_t failed = 0;
+
+    auto flush = [&](size_t threshold)
+    {
+        if (out.empty() || out.size() < threshold)
+            return;
+        if (!writeAll(fd, SecretView(reinterpret_cast<const char *>(out.data()), out.size())))
+            throw std::runtime_error(std::string("write failed: ") + strerror(errno));
+        stats.bytes += out.size();
+        out.clear();
+    };
+    auto append = [&](const std::vector<unsigned char> &sealed)
+    {
+        out.insert(out.end(), sealed.begin(), sealed.end());
+        flush(EXPORT_IO_BUFFER);
+    };
+
+    // The first length bytes of plain become the next chunk, sealed on the
+    // pool while the cursor goes on. Chunks are written in order
+    auto seal = [&](size_t length, bool last)
+    {
+        token.throwIfCancelled();
+        if (counter == UINT32_MAX)
+            throw std::runtime_error("export too large");
+
+        SecureBytes chunk(plain.begin(), plain.begin() + length);
+        plain.erase(plain.begin(), plain.begin() + length);
+        auto job = [rawKey = key.data(), &header, counter, last, chunk = std::move(chunk)]()
+        {
+            std::vector<unsigned char> sealed(chunk.size() + CRYPTO_GCM_TAG_SIZE);
+            if (!sealChunk(rawKey, header, counter, last, chunk.data(), chunk.size(), sealed.data()))
+                throw std::runtime_error("chunk encryption failed");
+            return sealed;
+        };
+        counter++;
+        stats.chunks++;
+
+        if (!_scheduler)
+        {
+            append(job());
+            return;
+        }
+        while (sealing.size() >= EXPORT_CHUNKS_IN_FLIGHT)
+        {
+            std::vector<unsigned char> sealed = sealing.front().get();
+            sealing.pop_front();
+            append(sealed);
+        }
+        sealing.push_back(_scheduler->submit(TaskPriority::Background, std::move(job)));
+    };
+
+    try
+    {
+        db.forEachPassword(userId, [&](const PasswordView &row)
+        {
+            password.resize(row.encrypted_password.size() / 2 + CRYPTO_BLOCK_SIZE);
+            int length = _crypto.decryptRecordInto(recordKey.data(), row.encrypted_password, row.iv,
+                                                   password.data(), password.size());
+            if (length < 0)
+            {
+                failed++;
+                return;
+            }
+
+            plain.push_back(EXPORT_RECORD_ENTRY);
+            putField(plain, row.website.data(), row.website.size());
+            putField(plain, row.username.data(), row.username.size());
+            putField(plain, password.data(), length);
+            putField(plain, row.created_at.data(), row.created_at.size());
+            stats.entries++;
+
+            // A full chunk is sealed once more bytes follow it: only then is it
+            // known not to be the last one
+            while (plain.size() > header.chunkSize)
+                seal(header.chunkSize, false);
+        });
+        if (failed > 0)
+            throw std::runtime_error(std::to_string(failed) + " entries failed to decrypt");
+
+        unsigned char end[5] = {EXPORT_RECORD_END};
+        putU32(end + 1, stats.entries);
+        plain.insert(plain.end(), end, end + sizeof(end));
+        while (plain.size() > header.chunkSize)
+            seal(header.chunkSize, false);
+        seal(plain.size(), true);
+
+        while (!sealing.empty())
+        {
+            std::vector<unsigned char> sealed = sealing.front().get();
+            sealing.pop_front();
+            append(sealed);
+        }
+        flush(0);
+    }
+    catch (...)
+    {
+        // Jobs still queued read the key and the header
+        for (std::future<std::vector<unsigned char>> &job : sealing)
+            job.wait();
+        throw;
+    }
+
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    PrintLog(std::cout, CYAN "VaultExport" GREEN " - %lu entries exported in %lu chunks (%.0f ms, %lld bytes)" RESET,
+             stats.entries, stats.chunks, stats.ms, stats.bytes);
+    return stats;
+}
+
+// ============ IMPORT ============
+
+// Authenticate every chunk after the header, and hand the entries to
+// onEntries when it is set. Throws at the first bad chunk
+static void readChunks(InputBuffer &input, const ExportHeader &header, const unsigned char *key,
+                       const std::function<void(std::span<const ExportEntry>)> *onEntries,
+                       const CancellationToken &token, ExportStats &stats)
+{
+    const size_t segment = header.chunkSize + CRYPTO_GCM_TAG_SIZE;
+    std::vector<unsigned char> sealed(segment);
+    // Plaintext not parsed yet: at most one chunk and the entry straddling it
+    SecureBytes plain;
+    std::vector<ExportEntry> entries;
+    bool ended = false;
+    uint32_t expected = 0;
+
+    for (uint32_t counter = 0; !ended; counter++)
+    {
+        token.throwIfCancelled();
+        size_t length = input.read(sealed.data(), segment);
+        stats.bytes += length;
+        bool last = length < segment || input.atEnd();
+        if (length <= CRYPTO_GCM_TAG_SIZE)
+            throw std::runtime_error("export is truncated");
+        if (counter == UINT32_MAX)
+            throw std::runtime_error("export is too large");
+
+        length -= CRYPTO_GCM_TAG_SIZE;
+        size_t offset = plain.size();
+        plain.resize(offset + length);
+        if (!openChunk(key, header, counter, last, sealed.data(), length, plain.data() + offset))
+            throw std::runtime_error(counter == 0 ? "wrong export passphrase or damaged file"
+                                                  : "export chunk " + std::to_string(counter) + " failed authentication");
+        stats.chunks++;
+
+        size_t pos = 0;
+        entries.clear();
+        while (pos < plain.size())
+        {
+            size_t recordStart = pos++;
+            if (plain[recordStart] == EXPORT_RECORD_END)
+            {
+                if (plain.size() - pos < 4)
+                {
+                    pos = recordStart;
+                    break;
+                }
+                expected = getU32(plain.data() + pos);
+                pos += 4;
+                ended = true;
+                break;
+            }
+            if (plain[recordStart] != EXPORT_RECORD_ENTRY)
+                throw std::runtime_error("corrupt export: unknown record");
+
+            ExportEntry entry;
+            std::string_view password;
+            if (!getField(plain, pos, entry.website) || !getField(plain, pos, entry.username)
+                || !getField(plain, pos, password) || !getField(plain, pos, entry.created_at))
+            {
+                pos = recordStart;
+                break;
+            }
+            entry.password = SecretView(password.data(), password.size());
+            entries.push_back(entry);
+        }
+
+        if (ended && (pos != plain.size() || !last))
+            throw std::runtime_error("corrupt export: data after the end record");
+        if (last && !ended)
+            throw std::runtime_error("corrupt export: no end record");
+
+        stats.entries += entries.size();
+        if (onEntries && !entries.empty())
+            (*onEntries)(entries);
+        plain.erase(plain.begin(), plain.begin() + pos);
+    }
+
+    if (expected != stats.entries)
+        throw std::runtime_error("corrupt export: entry count mismatch");
+}
+
+ExportStats VaultExport::read(int fd, SecretView passphrase,
+                              const std::function<void(std::span<const ExportEntry>)> &onEntries,
+                              CancellationToken token) const
+{
+    auto start = std::chrono::steady_clock::now();
+    off_t origin = lseek(fd, 0, SEEK_CUR);
+
+    InputBuffer input(fd);
+    ExportHeader header;
+    readHeader(input, header);
+    SecureBytes key(CRYPTO_KEY_SIZE);
+    deriveExportKey(passphrase, header, key.data());
+
+    ExportStats stats;
+    if (origin >= 0)
+    {
+        // Seekable: the whole file is authenticated before any entry is released
+        readChunks(input, header, key.data(), nullptr, token, stats);
+        if (lseek(fd, origin + EXPORT_HEADER_SIZE, SEEK_SET) < 0)
+            throw std::runtime_error(std::string("seek failed: ") + strerror(errno));
+        stats = ExportStats();
+        input = InputBuffer(fd);
+    }
+    readChunks(input, header, key.data(), &onEntries, token, stats);
+    stats.bytes += EXPORT_HEADER_SIZE;
+
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    PrintLog(std::cout, CYAN "VaultExport" GREEN " - %lu entries read from %lu chunks (%.0f ms)" RESET,
+             stats.entries, stats.chunks, stats.ms);
+    return stats;
+}
+
+bool VaultExport::isExport(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    char magic[EXPORT_MAGIC_SIZE];
+    bool match = ::read(fd, magic, sizeof(magic)) == EXPORT_MAGIC_SIZE
+                 && memcmp(magic, EXPORT_MAGIC, EXPORT_MAGIC_SIZE) == 0;
+    close(fd);
+    return match;
+}
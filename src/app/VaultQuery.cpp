@@ -0,0 +1,116 @@
+#include "VaultQuery.hpp"
+
+#include <algorithm>
+
+static std::string toLower(const std::string &text)
+{
+    std::string lower(text);
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return lower;
+}
+
+// Case insensitive substring test, needle already lower case
+static bool containsLower(std::string_view haystack, const std::string &needle)
+{
+    auto it = std::search(haystack.begin(), haystack.end(), needle.begin(), needle.end(),
+                          [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+    return it != haystack.end() || needle.empty();
+}
+
+static bool equalsLower(std::string_view text, const std::string &lower)
+{
+    return text.size() == lower.size() && containsLower(text, lower);
+}
+
+static bool isNumber(const std::string &text)
+{
+    return !text.empty() && text.size() < 10 && std::all_of(text.begin(), text.end(),
+                                        [](unsigned char c) { return std::isdigit(c); });
+}
+
+std::vector<const Password *> findEntries(const std::vector<Password> &entries, const std::string &key)
+{
+    std::vector<const Password *> matches;
+    if (isNumber(key))
+    {
+        int id = std::stoi(key);
+        for (const Password &pwd : entries)
+            if (pwd.id == id)
+                matches.push_back(&pwd);
+        return matches;
+    }
+
+    std::string website = toLower(key);
+    for (const Password &pwd : entries)
+        if (toLower(pwd.website) == website)
+            matches.push_back(&pwd);
+    return matches;
+}
+
+std::vector<const Password *> bestUrlMatches(const std::vector<UrlMatch> &matches)
+{
+    // findByUrl sorts exact host matches first
+    std::vector<const Password *> best;
+    bool exact = !matches.empty() && matches[0].exactHost;
+    for (const UrlMatch &match : matches)
+        if (match.exactHost == exact)
+            best.push_back(&match.password);
+    return best;
+}
+
+std::vector<const Password *> searchEntries(const std::vector<Password> &entries, const std::string &term)
+{
+    std::string lower = toLower(term);
+    std::vector<const Password *> matches;
+    for (const Password &pwd : entries)
+    {
+        if (toLower(pwd.website).find(lower) != std::string::npos
+            || toLower(pwd.username).find(lower) != std::string::npos)
+            matches.push_back(&pwd);
+    }
+    return matches;
+}
+
+std::vector<CachedEntry> findEntries(const VaultCache &cache, const std::string &key)
+{
+    std::vector<CachedEntry> matches;
+    if (isNumber(key))
+    {
+        int id = std::stoi(key);
+        for (size_t i = 0; i < cache.size(); i++)
+            if (cache.id(i) == id)
+                matches.push_back(cache[i]);
+        return matches;
+    }
+
+    std::string website = toLower(key);
+    for (size_t i = 0; i < cache.size(); i++)
+        if (equalsLower(cache.website(i), website))
+            matches.push_back(cache[i]);
+    return matches;
+}
+
+std::vector<CachedEntry> searchEntries(const VaultCache &cache, const std::string &term)
+{
+    std::string lower = toLower(term);
+    std::vector<CachedEntry> matches;
+
+    // Usernames are interned: test each distinct one once (-1 unknown)
+    std::vector<signed char> usernameMatch(cache.internedCount(), -1);
+    for (size_t i = 0; i < cache.size(); i++)
+    {
+        if (containsLower(cache.website(i), lower))
+        {
+            matches.push_back(cache[i]);
+            continue;
+        }
+
+        signed char &byUser = usernameMatch[cache.usernameKey(i)];
+        if (byUser < 0)
+            byUser = containsLower(cache.username(i), lower);
+        if (byUser)
+            matches.push_back(cache[i]);
+    }
+    return matches;
+}
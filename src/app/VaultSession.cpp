@@ -0,0 +1,249 @@
+#include "VaultSession.hpp"
+#include "SecureRandom.hpp"
+
+VaultSession::VaultSession(const CryptoManager &crypto)
+    : _state(std::make_shared<const SessionState>()),
+    _epoch(0),
+    _crypto(crypto),
+    _pinFailures(0)
+{
+}
+
+VaultSession::~VaultSession()
+{
+    // Cancel whatever still works with this vault's secrets
+    if (_revoke)
+        _revoke->cancel();
+}
+
+// Caller holds _writeMutex
+void VaultSession::publish(std::shared_ptr<SessionState> state)
+{
+    // Work started under the previous session must not finish with its secrets
+    if (_revoke)
+        _revoke->cancel();
+    _revoke = std::make_unique<CancellationSource>();
+    if (_onRevoke)
+        _onRevoke();
+
+    state->epoch = ++_epoch;
+    state->revoked = _revoke->token();
+    _state.store(std::move(state));
+}
+
+void VaultSession::beginSession(int userId, const std::string &username, SecureString masterPassword, SecretView userSalt)
+{
+    auto state = std::make_shared<SessionState>();
+    state->userId = userId;
+    state->username = username;
+    state->masterPassword = std::move(masterPassword);
+    state->userSalt = SecureString(userSalt);
+    state->authenticated = true;
+
+    // The master password is at hand only now: seal it for the idle lock here,
+    // outside the write lock, so lock() itself has no KDF to run
+    SecureBytes ephemeral(VAULT_EPHEMERAL_KEY_SIZE);
+    SecureRandom::fill(ephemeral.data(), ephemeral.size());
+    auto lockWrap = std::make_unique<WrappedSecret>(_crypto.wrapSecret(
+        state->masterPassword, _crypto.deriveWrapKey(state->masterPassword), &ephemeral));
+
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _ephemeral.swap(ephemeral);
+    _lockWrap = std::move(lockWrap);
+    _pinWrap.reset();
+    _pinFailures = 0;
+    publish(std::move(state));
+    PrintLog(std::cout, CYAN "VaultSession" GREEN " - Session initialized for user ID: %d" RESET, userId);
+}
+
+std::shared_ptr<const SessionState> VaultSession::snapshot() const
+{
+    return _state.load();
+}
+
+int VaultSession::getUserId() const
+{
+    return snapshot()->userId;
+}
+
+SecretView VaultSession::getMasterPassword() const
+{
+    return snapshot()->masterPassword.view();
+}
+
+SecretView VaultSession::getUserSalt() const
+{
+    return snapshot()->userSalt.view();
+}
+
+std::string VaultSession::getUsername() const
+{
+    return snapshot()->username;
+}
+
+bool VaultSession::isAuthenticated() const
+{
+    return snapshot()->authenticated;
+}
+
+bool VaultSession::isLocked() const
+{
+    return snapshot()->locked;
+}
+
+unsigned long long VaultSession::getEpoch() const
+{
+    return snapshot()->epoch;
+}
+
+CancellationToken VaultSession::revocationToken() const
+{
+    return snapshot()->revoked;
+}
+
+void VaultSession::setRevokeHook(std::function<void()> hook)
+{
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _onRevoke = std::move(hook);
+}
+
+void VaultSession::clearSession()
+{
+    PrintLog(std::cout, CYAN "VaultSession" RESET " - Clearing session...");
+
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    _lockWrap.reset();
+    _pinWrap.reset();
+    SecureBytes().swap(_ephemeral);
+    _pinFailures = 0;
+    publish(std::make_shared<SessionState>());
+
+    PrintLog(std::cout, CYAN "VaultSession" GREEN " - Session cleared" RESET);
+}
+
+bool VaultSession::lock()
+{
+    std::lock_guard<std::mutex> guard(_writeMutex);
+    std::shared_ptr<const SessionState> current = _state.load();
+    if (!current->authenticated || !_lockWrap)
+        return false;
+    if (current->locked)
+        return true;
+
+    // _lockWrap was sealed at login under the master password itself:
+    // unlocking proves knowledge of it with a single KDF instead of the
+    // login hash check plus a reload
+
+    auto state = std::make_shared<SessionState>();
+    state->userId = current->userId;
+    state->username = current->username;
+    state->userSalt = current->userSalt.clone();
+    state->authenticated = true;
+    state->locked = true;
+    publish(std::move(state));
+
+    PrintLog(std::cout, CYAN "VaultSession" YELLOW " - Vault locked for user ID: %d" RESET, current->userId);
+    return true;
+}
+
+// Caller holds _writeMutex
+void VaultSession::publishUnlocked(const SessionState &locked, SecureString masterPassword)
+{
+    auto state = std::make_shared<SessionState>();
+    state->userId = locked.userId;
+    state->username = locked.username;
+    state->masterPassword = std::move(masterPassword);
+    state->userSalt = locked.userSalt.clone();
+    state->authenticated = true;
+    _pinFailures = 0;
+    publish(std::move(state));
+
+    PrintLog(std::cout, CYAN "VaultSession" GREEN " - Vault unlocked for user ID: %d" RESET, locked.userId);
+}
+
+bool VaultSession::unlock(SecretView masterPassword)
+{
+    std::lock_guard<std::mutex> guard(_writeMutex);
+    std::shared_ptr<const SessionState> current = _state.load();
+    if (!current->locked || !_lockWrap)
+        return false;
+
+    SecureString master;
+    if (!_crypto.unwrapSecret(*_lockWrap, _crypto.deriveWrapKey(masterPassword, *_lockWrap), master, &_ephemeral))
+    {
+        PrintLog(std::cerr, RED "VaultSession - Unlock failed: wrong master password" RESET);
+        return false;
+    }
+    publishUnlocked(*current, std::move(master));
+    return true;
+}
+
+bool VaultSession::unlockWithPin(SecretView pin)
+{
+    std::lock_guard<std::mutex> guard(_writeMutex);
+    std::shared_ptr<const SessionState> current = _state.load();
+    if (!current->locked || !_pinWrap)
+        return false;
+
+    SecureString master;
+    if (!_crypto.unwrapSecret(*_pinWrap, _crypto.deriveWrapKey(pin, *_pinWrap), master, &_ephemeral))
+    {
+        // A PIN is short, so it only gets a few guesses
+        if (++_pinFailures >= VAULT_PIN_MAX_ATTEMPTS)
+        {
+            _pinWrap.reset();
+            PrintLog(std::cerr, RED "VaultSession - Too many wrong PINs, master password required" RESET);
+        }
+        else
+            PrintLog(std::cerr, RED "VaultSession - Unlock failed: wrong PIN" RESET);
+        return false;
+    }
+    publishUnlocked(*current, std::move(master));
+    return true;
+}
+
+void VaultSession::setUnlockPin(SecretView pin)
+{
+    if (pin.size() < VAULT_PIN_MIN_LENGTH)
+        throw std::runtime_error("PIN too short");
+
+    std::lock_guard<std::mutex> guard(_writeMutex);
+    std::shared_ptr<const SessionState> current = _state.load();
+    if (!current->authenticated || current->locked)
+        throw std::runtime_error("Vault must be unlocked to set a PIN");
+
+    _pinWrap = std::make_unique<WrappedSecret>(
+        _crypto.wrapSecret(current->masterPassword, _crypto.deriveWrapKey(pin), &_ephemeral));
+    _pinFailures = 0;
+    PrintLog(std::cout, CYAN "VaultSession" GREEN " - Unlock PIN set" RESET);
+}
+
+void VaultSession::clearUnlockPin()
+{
+    std::lock_guard<std::mutex> guard(_writeMutex);
+    _pinWrap.reset();
+    _pinFailures = 0;
+}
+
+bool VaultSession::hasUnlockPin() const
+{
+    std::lock_guard<std::mutex> guard(_writeMutex);
+    return _pinWrap != nullptr;
+}
+
+bool VaultSession::isValid() const
+{
+    // All conditions must be true (on one consistent snapshot)
+    std::shared_ptr<const SessionState> state = snapshot();
+    bool valid = state->authenticated
+                 && !state->masterPassword.empty()
+                 && !state->userSalt.empty()
+                 && !state->username.empty();
+    
+    if (!valid)
+    {
+        PrintLog(std::cerr, RED "VaultSession - Invalid session" RESET);
+    }
+    
+    return valid;
+}
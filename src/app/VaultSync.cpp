@@ -0,0 +1,559 @@
+#include "VaultSync.hpp"
+#include "SecureRandom.hpp"
+#include "Terminal.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
+#include <map>
+#include <set>
+
+// Header offsets
+#define SYNC_OFF_VERSION 8
+#define SYNC_OFF_VAULT 12
+#define SYNC_OFF_USER 20
+#define SYNC_OFF_FROM 28
+#define SYNC_OFF_TO 36
+#define SYNC_OFF_COUNT 44
+#define SYNC_OFF_NONCE 48
+
+#define SYNC_ID_DIGITS 16
+#define SYNC_PARTIAL_SUFFIX ".partial"
+#define SYNC_KEY_LABEL "passman sync 1"
+#define SYNC_USER_LABEL "passman sync user"
+
+// A peer's segment as named in the directory
+struct SyncSegment
+{
+    long long vault;
+    long long from;
+    long long to;
+    std::string path;
+};
+
+// ============ HELPERS ============
+
+static const EVP_CIPHER *segmentCipher()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static EVP_CIPHER *cipher = EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr);
+#else
+    static const EVP_CIPHER *cipher = EVP_aes_256_gcm();
+#endif
+    if (!cipher)
+        throw std::runtime_error("AES-256-GCM not available");
+    return cipher;
+}
+
+static void putU32(unsigned char *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static uint32_t getU32(const unsigned char *in)
+{
+    return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | in[3];
+}
+
+static void putU64(unsigned char *out, uint64_t value)
+{
+    putU32(out, value >> 32);
+    putU32(out + 4, static_cast<uint32_t>(value));
+}
+
+static uint64_t getU64(const unsigned char *in)
+{
+    return (uint64_t(getU32(in)) << 32) | getU32(in + 4);
+}
+
+static std::string hex16(long long value)
+{
+    char buffer[SYNC_ID_DIGITS + 1];
+    snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+// Exactly 16 lowercase hex digits at text
+static bool parseHex16(const char *text, long long &value)
+{
+    for (int i = 0; i < SYNC_ID_DIGITS; i++)
+        if (!isdigit(static_cast<unsigned char>(text[i])) && !(text[i] >= 'a' && text[i] <= 'f'))
+            return false;
+    value = static_cast<long long>(strtoull(std::string(text, SYNC_ID_DIGITS).c_str(), nullptr, 16));
+    return true;
+}
+
+static bool endsWith(const std::string &text, const char *suffix)
+{
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+static void syncDirectory(const std::string &dir)
+{
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0)
+    {
+        fsync(dirFd);
+        close(dirFd);
+    }
+}
+
+// Written as .<name>.partial and renamed once on disk, so a peer reading the
+// directory at the same time sees the whole file or nothing
+static void writeFileAtomic(const std::string &dir, const std::string &name, SecretView data)
+{
+    std::string path = dir + "/" + name;
+    std::string tmpPath = dir + "/." + name + SYNC_PARTIAL_SUFFIX;
+    unlink(tmpPath.c_str());
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create " + tmpPath + ": " + strerror(errno));
+    bool ok = writeAll(fd, data) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        int error = errno;
+        unlink(tmpPath.c_str());
+        throw std::runtime_error("Cannot write " + path + ": " + strerror(error));
+    }
+    syncDirectory(dir);
+}
+
+// Whole file, refused past limit bytes
+static bool readFile(const std::string &path, size_t limit, std::vector<unsigned char> &out)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || static_cast<unsigned long long>(st.st_size) > limit)
+    {
+        close(fd);
+        return false;
+    }
+    out.resize(st.st_size);
+    size_t done = 0;
+    while (done < out.size())
+    {
+        ssize_t n = ::read(fd, out.data() + done, out.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+    return done == out.size();
+}
+
+// HMAC-SHA256 of the record key, so the segments don't reuse it directly
+static void deriveSyncKey(const CryptoManager &crypto, SecretView masterPassword, SecretView salt,
+                          unsigned char key[CRYPTO_KEY_SIZE])
+{
+    SecureBytes recordKey(CRYPTO_KEY_SIZE);
+    crypto.deriveKey(masterPassword, salt, recordKey.data());
+    size_t length = 0;
+    if (!EVP_Q_mac(nullptr, "HMAC", nullptr, "SHA256", nullptr, recordKey.data(), recordKey.size(),
+                   reinterpret_cast<const unsigned char *>(SYNC_KEY_LABEL), strlen(SYNC_KEY_LABEL),
+                   key, CRYPTO_KEY_SIZE, &length) || length != CRYPTO_KEY_SIZE)
+        throw std::runtime_error("Sync key derivation failed");
+}
+
+// Directory name of the user, the same on every copy of the vault
+static std::string userTag(const std::string &username, SecretView salt, unsigned char tag[SYNC_USER_TAG_SIZE])
+{
+    std::string input = SYNC_USER_LABEL;
+    input.push_back('\0');
+    input += username;
+    input.push_back('\0');
+    input.append(salt.data(), salt.size());
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (EVP_Digest(input.data(), input.size(), digest, &length, EVP_sha256(), nullptr) != 1)
+        throw std::runtime_error("SHA-256 failed");
+    memcpy(tag, digest, SYNC_USER_TAG_SIZE);
+
+    std::string hex;
+    for (int i = 0; i < SYNC_USER_TAG_SIZE; i++)
+    {
+        char byte[3];
+        snprintf(byte, sizeof(byte), "%02x", tag[i]);
+        hex += byte;
+    }
+    return hex;
+}
+
+static std::string segmentName(long long vault, long long from, long long to)
+{
+    return hex16(vault) + "-" + hex16(from) + "-" + hex16(to) + SYNC_EXTENSION;
+}
+
+// <vault>-<from>-<to>.psync, nothing else
+static bool parseSegmentName(const std::string &name, SyncSegment &segment)
+{
+    const size_t length = 3 * SYNC_ID_DIGITS + 2 + strlen(SYNC_EXTENSION);
+    const char *s = name.c_str();
+    return name.size() == length && endsWith(name, SYNC_EXTENSION)
+        && s[SYNC_ID_DIGITS] == '-' && s[2 * SYNC_ID_DIGITS + 1] == '-'
+        && parseHex16(s, segment.vault)
+        && parseHex16(s + SYNC_ID_DIGITS + 1, segment.from)
+        && parseHex16(s + 2 * SYNC_ID_DIGITS + 2, segment.to)
+        && segment.vault > 0 && segment.from >= 0 && segment.from < segment.to;
+}
+
+// Lines "<peer> <to>" of an ack file: the last segment of each peer applied
+static std::map<long long, long long> readAcks(const std::string &path)
+{
+    std::map<long long, long long> acks;
+    std::vector<unsigned char> data;
+    if (!readFile(path, SYNC_MAX_FIELD, data))
+        return acks;
+    std::string text(data.begin(), data.end());
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos)
+            break;
+        long long peer;
+        long long to;
+        if (end - pos == 2 * SYNC_ID_DIGITS + 1 && text[pos + SYNC_ID_DIGITS] == ' '
+            && parseHex16(text.c_str() + pos, peer) && parseHex16(text.c_str() + pos + SYNC_ID_DIGITS + 1, to))
+            acks[peer] = to;
+        pos = end + 1;
+    }
+    return acks;
+}
+
+// ============ SEGMENTS ============
+
+static void putString(SecureBytes &out, std::string_view value)
+{
+    unsigned char length[4];
+    putU32(length, value.size());
+    out.insert(out.end(), length, length + 4);
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+static void appendRecord(SecureBytes &out, const SyncRecord &record)
+{
+    unsigned char fixed[17];
+    fixed[0] = record.deleted ? 1 : 0;
+    putU64(fixed + 1, record.revision);
+    putU64(fixed + 9, record.origin);
+    out.insert(out.end(), fixed, fixed + sizeof(fixed));
+    putString(out, record.uuid);
+    if (record.deleted)
+        return;
+    putString(out, record.website);
+    putString(out, record.username);
+    putString(out, record.encrypted_password);
+    putString(out, record.iv);
+    putString(out, record.created_at);
+}
+
+// Reads the records of a decrypted body, views into it
+class RecordParser
+{
+    private:
+        const unsigned char *_pos;
+        const unsigned char *_end;
+
+        bool string(std::string_view &out)
+        {
+            if (_end - _pos < 4)
+                return false;
+            uint32_t length = getU32(_pos);
+            _pos += 4;
+            if (length > SYNC_MAX_FIELD || static_cast<size_t>(_end - _pos) < length)
+                return false;
+            out = std::string_view(reinterpret_cast<const char *>(_pos), length);
+            _pos += length;
+            return true;
+        }
+
+    public:
+        RecordParser(const unsigned char *data, size_t length) : _pos(data), _end(data + length) {}
+
+        bool atEnd() const { return _pos == _end; }
+
+        bool next(SyncRecord &record)
+        {
+            if (_end - _pos < 17 || _pos[0] > 1)
+                return false;
+            record = SyncRecord();
+            record.deleted = _pos[0] == 1;
+            record.revision = static_cast<long long>(getU64(_pos + 1));
+            record.origin = static_cast<long long>(getU64(_pos + 9));
+            _pos += 17;
+            if (!string(record.uuid) || record.uuid.size() != 2 * SYNC_UUID_SIZE
+                || !std::all_of(record.uuid.begin(), record.uuid.end(),
+                                [](char c) { return isdigit(static_cast<unsigned char>(c)) || (c >= 'a' && c <= 'f'); })
+                || record.revision <= 0 || record.origin <= 0)
+                return false;
+            if (record.deleted)
+                return true;
+            return string(record.website) && string(record.username) && string(record.encrypted_password)
+                && string(record.iv) && string(record.created_at);
+        }
+};
+
+static void buildHeader(unsigned char header[SYNC_HEADER_SIZE], long long vault, const unsigned char *user,
+                        long long from, long long to, uint32_t count)
+{
+    memset(header, 0, SYNC_HEADER_SIZE);
+    memcpy(header, SYNC_MAGIC, SYNC_MAGIC_SIZE);
+    header[SYNC_OFF_VERSION] = SYNC_VERSION;
+    putU64(header + SYNC_OFF_VAULT, vault);
+    memcpy(header + SYNC_OFF_USER, user, SYNC_USER_TAG_SIZE);
+    putU64(header + SYNC_OFF_FROM, from);
+    putU64(header + SYNC_OFF_TO, to);
+    putU32(header + SYNC_OFF_COUNT, count);
+    SecureRandom::fill(header + SYNC_OFF_NONCE, CRYPTO_GCM_NONCE_SIZE);
+}
+
+// header | body | tag, the header authenticated as AAD
+static bool sealSegment(const unsigned char *key, const unsigned char header[SYNC_HEADER_SIZE],
+                        const SecureBytes &body, std::vector<unsigned char> &out)
+{
+    out.assign(header, header + SYNC_HEADER_SIZE);
+    out.resize(SYNC_HEADER_SIZE + body.size() + CRYPTO_GCM_TAG_SIZE);
+    unsigned char *cipherText = out.data() + SYNC_HEADER_SIZE;
+
+    typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> CtxPtr;
+    CtxPtr ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    int len = 0;
+    return ctx
+        && EVP_EncryptInit_ex(ctx.get(), segmentCipher(), nullptr, key, header + SYNC_OFF_NONCE) == 1
+        && EVP_EncryptUpdate(ctx.get(), nullptr, &len, header, SYNC_HEADER_SIZE) == 1
+        && EVP_EncryptUpdate(ctx.get(), cipherText, &len, body.data(), body.size()) == 1
+        && EVP_EncryptFinal_ex(ctx.get(), cipherText + len, &len) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, CRYPTO_GCM_TAG_SIZE,
+                               cipherText + body.size()) == 1;
+}
+
+// Body of a whole segment file into out. False if the tag doesn't match
+static bool openSegment(const unsigned char *key, const std::vector<unsigned char> &file, SecureBytes &out)
+{
+    const unsigned char *header = file.data();
+    size_t length = file.size() - SYNC_HEADER_SIZE - CRYPTO_GCM_TAG_SIZE;
+    out.resize(length);
+
+    typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> CtxPtr;
+    CtxPtr ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    int len = 0;
+    bool ok = ctx
+        && EVP_DecryptInit_ex(ctx.get(), segmentCipher(), nullptr, key, header + SYNC_OFF_NONCE) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, CRYPTO_GCM_TAG_SIZE,
+                               const_cast<unsigned char *>(file.data() + file.size() - CRYPTO_GCM_TAG_SIZE)) == 1
+        && EVP_DecryptUpdate(ctx.get(), nullptr, &len, header, SYNC_HEADER_SIZE) == 1
+        && EVP_DecryptUpdate(ctx.get(), out.data(), &len, header + SYNC_HEADER_SIZE, length) == 1
+        && EVP_DecryptFinal_ex(ctx.get(), out.data() + len, &len) == 1;
+    // The plaintext of a forged segment never leaves here
+    if (!ok)
+        OPENSSL_cleanse(out.data(), out.size());
+    return ok;
+}
+
+// Read, check and decrypt a peer's segment, its records are views into body
+static void loadSegment(const SyncSegment &segment, const unsigned char *key, const unsigned char *user,
+                        SecureBytes &body, std::vector<SyncRecord> &records)
+{
+    std::vector<unsigned char> file;
+    if (!readFile(segment.path, SYNC_MAX_SEGMENT, file))
+        throw std::runtime_error("cannot read " + segment.path);
+    if (file.size() < SYNC_HEADER_SIZE + CRYPTO_GCM_TAG_SIZE
+        || memcmp(file.data(), SYNC_MAGIC, SYNC_MAGIC_SIZE) != 0)
+        throw std::runtime_error(segment.path + " is not a sync segment");
+    const unsigned char *header = file.data();
+    if (header[SYNC_OFF_VERSION] != SYNC_VERSION)
+        throw std::runtime_error(segment.path + ": unsupported version " + std::to_string(header[SYNC_OFF_VERSION]));
+    // The name is what orders the segments, it must agree with the sealed header
+    if (static_cast<long long>(getU64(header + SYNC_OFF_VAULT)) != segment.vault
+        || static_cast<long long>(getU64(header + SYNC_OFF_FROM)) != segment.from
+        || static_cast<long long>(getU64(header + SYNC_OFF_TO)) != segment.to
+        || memcmp(header + SYNC_OFF_USER, user, SYNC_USER_TAG_SIZE) != 0)
+        throw std::runtime_error(segment.path + ": header doesn't match the file name");
+    uint32_t count = getU32(header + SYNC_OFF_COUNT);
+
+    if (!openSegment(key, file, body))
+        throw std::runtime_error(segment.path + " is damaged or not from this user");
+
+    RecordParser parser(body.data(), body.size());
+    records.clear();
+    SyncRecord record;
+    while (records.size() < count && parser.next(record))
+        records.push_back(record);
+    if (records.size() != count || !parser.atEnd())
+        throw std::runtime_error(segment.path + ": malformed records");
+}
+
+// ============ SYNC ============
+
+VaultSync::VaultSync(const SQLiteCipherDB &db, const CryptoManager &crypto) : _db(db), _crypto(crypto) {}
+
+SyncResult VaultSync::run(const std::string &dir, int userId, const std::string &username,
+                          SecretView masterPassword, SecretView salt, CancellationToken token) const
+{
+    auto start = std::chrono::steady_clock::now();
+    SyncResult result;
+    result.vaultId = _db.getVaultId();
+    if (result.vaultId <= 0)
+        throw std::runtime_error("The vault has no sync id");
+
+    unsigned char user[SYNC_USER_TAG_SIZE];
+    std::string userDir = dir + "/" + userTag(username, salt, user);
+    if (!createDirectory(dir) || !createDirectory(userDir))
+        throw std::runtime_error("Cannot use the sync directory " + dir);
+
+    SecureBytes key(CRYPTO_KEY_SIZE);
+    deriveSyncKey(_crypto, masterPassword, salt, key.data());
+
+    std::string userKey = std::to_string(userId);
+    std::string exportedKey = "sync_exported:" + userKey;
+    auto peerKey = [&userKey](long long peer) { return "sync_peer:" + userKey + ":" + hex16(peer); };
+
+    // Export: the local changes after the last export, one segment per
+    // SYNC_SEGMENT_RECORDS. The mark moves once the segment is on disk
+    long long exported = _db.getSyncState(exportedKey);
+    while (true)
+    {
+        token.throwIfCancelled();
+        SecureBytes body;
+        long long to = exported;
+        size_t count = _db.forEachLocalChange(userId, exported, SYNC_SEGMENT_RECORDS,
+            [&](const SyncRecord &record)
+            {
+                appendRecord(body, record);
+                to = record.changeSeq;
+            });
+        if (count == 0)
+            break;
+
+        unsigned char header[SYNC_HEADER_SIZE];
+        buildHeader(header, result.vaultId, user, exported, to, count);
+        std::vector<unsigned char> file;
+        if (!sealSegment(key.data(), header, body, file))
+            throw std::runtime_error("Sync segment encryption failed");
+        writeFileAtomic(userDir, segmentName(result.vaultId, exported, to),
+                        SecretView(reinterpret_cast<const char *>(file.data()), file.size()));
+        if (!_db.setSyncState(exportedKey, to))
+            throw std::runtime_error("Cannot record the sync export");
+
+        exported = to;
+        result.exported += count;
+        result.segmentsWritten++;
+        if (count < SYNC_SEGMENT_RECORDS)
+            break;
+    }
+
+    // What the directory holds, per vault
+    std::map<long long, std::vector<SyncSegment>> segments;
+    std::set<long long> peers;
+    DIR *handle = opendir(userDir.c_str());
+    if (!handle)
+        throw std::runtime_error("Cannot list " + userDir + ": " + strerror(errno));
+    while (struct dirent *entry = readdir(handle))
+    {
+        std::string name = entry->d_name;
+        SyncSegment segment;
+        long long vault;
+        if (parseSegmentName(name, segment))
+        {
+            segment.path = userDir + "/" + name;
+            segments[segment.vault].push_back(segment);
+        }
+        else if (name.size() == SYNC_ID_DIGITS + strlen(SYNC_ACK_EXTENSION)
+                 && endsWith(name, SYNC_ACK_EXTENSION) && parseHex16(name.c_str(), vault))
+            segment.vault = vault;
+        else
+            continue;
+        if (segment.vault != result.vaultId)
+            peers.insert(segment.vault);
+    }
+    closedir(handle);
+    result.peers = peers.size();
+
+    // Import: each peer's segments in order, past its sync point. A gap or a
+    // bad segment stops that peer, its later segments need this one first
+    SecureBytes body;
+    std::vector<SyncRecord> records;
+    for (auto &[peer, list] : segments)
+    {
+        if (peer == result.vaultId)
+            continue;
+        std::sort(list.begin(), list.end(),
+                  [](const SyncSegment &a, const SyncSegment &b) { return a.to < b.to; });
+        long long point = _db.getSyncState(peerKey(peer));
+        for (const SyncSegment &segment : list)
+        {
+            token.throwIfCancelled();
+            if (segment.to <= point)
+                continue;
+            if (segment.from > point)
+            {
+                result.errors.push_back("vault " + hex16(peer) + ": missing changes " + hex16(point)
+                                        + "-" + hex16(segment.from));
+                break;
+            }
+            try
+            {
+                loadSegment(segment, key.data(), user, body, records);
+                SyncApplyStats stats = _db.applySyncRecords(userId, records, peerKey(peer), segment.to);
+                result.applied.added += stats.added;
+                result.applied.updated += stats.updated;
+                result.applied.deleted += stats.deleted;
+                result.applied.stale += stats.stale;
+            }
+            catch (const std::exception &e)
+            {
+                OPENSSL_cleanse(body.data(), body.size());
+                result.errors.push_back("vault " + hex16(peer) + ": " + e.what());
+                break;
+            }
+            OPENSSL_cleanse(body.data(), body.size());
+            point = segment.to;
+            result.segmentsRead++;
+        }
+    }
+
+    // Tell the peers how far this vault got
+    std::string ack;
+    for (long long peer : peers)
+    {
+        long long point = _db.getSyncState(peerKey(peer));
+        if (point > 0)
+            ack += hex16(peer) + " " + hex16(point) + "\n";
+    }
+    writeFileAtomic(userDir, hex16(result.vaultId) + SYNC_ACK_EXTENSION, SecretView(ack.data(), ack.size()));
+
+    // Prune the own segments every known peer has applied
+    long long applied = peers.empty() ? 0 : LLONG_MAX;
+    for (long long peer : peers)
+    {
+        std::map<long long, long long> acks = readAcks(userDir + "/" + hex16(peer) + SYNC_ACK_EXTENSION);
+        auto found = acks.find(result.vaultId);
+        applied = std::min(applied, found == acks.end() ? 0 : found->second);
+    }
+    for (const SyncSegment &segment : segments[result.vaultId])
+        if (segment.to <= applied && unlink(segment.path.c_str()) == 0)
+            result.pruned++;
+    if (result.pruned)
+        syncDirectory(userDir);
+    // The deletions every peer has applied can't be resurrected by one of them anymore
+    if (applied > 0)
+        result.forgotten = _db.pruneDeletions(userId, applied);
+
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    PrintLog(std::cout, CYAN "VaultSync" RESET " - Exported %zu records, read %zu segments from %zu peers "
+             "(%zu added, %zu updated, %zu deleted, %zu stale), pruned %zu, forgot %zu, %zu errors in %.0f ms",
+             result.exported, result.segmentsRead, result.peers, result.applied.added, result.applied.updated,
+             result.applied.deleted, result.applied.stale, result.pruned, result.forgotten, result.errors.size(), result.ms);
+    return result;
+}
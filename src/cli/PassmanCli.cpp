@@ -0,0 +1,906 @@
+#include "PassmanCli.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <strings.h>
+#include <algorithm>
+
+// ============ HELPERS ============
+
+// Print a finished document followed by a newline
+static bool printDocument(int fd, SecretView document)
+{
+    return writeAll(fd, document) && writeAll(fd, SecretView("\n", 1));
+}
+
+// Whole file into secure memory (imports hold plaintext passwords)
+static bool readFile(const std::string &path, SecureChars &out)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        out.insert(out.end(), buffer, buffer + n);
+    OPENSSL_cleanse(buffer, sizeof(buffer));
+    close(fd);
+    return n == 0;
+}
+
+// RFC 4180 records: quoted fields may hold commas, doubled quotes and newlines
+static std::vector<std::vector<SecureString>> parseCsv(SecretView text)
+{
+    std::vector<std::vector<SecureString>> rows;
+    std::vector<SecureString> row;
+    SecureChars field;
+    bool quoted = false;
+
+    auto endField = [&]()
+    {
+        row.emplace_back(field.data(), field.size());
+        field.clear();
+    };
+    auto endRow = [&]()
+    {
+        endField();
+        // Blank lines are skipped
+        if (row.size() > 1 || !row[0].empty())
+            rows.push_back(std::move(row));
+        row.clear();
+    };
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char c = text.data()[i];
+        if (quoted)
+        {
+            if (c == '"' && i + 1 < text.size() && text.data()[i + 1] == '"')
+            {
+                field.push_back('"');
+                i++;
+            }
+            else if (c == '"')
+                quoted = false;
+            else
+                field.push_back(c);
+        }
+        else if (c == '"')
+            quoted = true;
+        else if (c == ',')
+            endField();
+        else if (c == '\n')
+            endRow();
+        else if (c != '\r')
+            field.push_back(c);
+    }
+    if (!field.empty() || !row.empty())
+        endRow();
+    return rows;
+}
+
+// Append a CSV field, quoted when it needs to be
+static void appendCsvField(SecureChars &out, SecretView field)
+{
+    bool quote = std::any_of(field.begin(), field.end(),
+                             [](char c) { return c == ',' || c == '"' || c == '\n' || c == '\r'; });
+    if (!quote)
+    {
+        out.insert(out.end(), field.begin(), field.end());
+        return;
+    }
+    out.push_back('"');
+    for (char c : field)
+    {
+        if (c == '"')
+            out.push_back('"');
+        out.push_back(c);
+    }
+    out.push_back('"');
+}
+
+// Entry to import, views valid during BatchImport::queue() only
+struct ImportRow
+{
+    std::string_view website;
+    std::string_view username;
+    SecretView password;
+};
+
+// Streamed imports: every batch is re-encrypted with one key derivation, its
+// records split across the pool, and queued; the previous batch's writes are
+// awaited meanwhile so memory stays flat
+class BatchImport
+{
+    private:
+        VaultContext &_vault;
+        TaskScheduler *_scheduler;
+        int _userId;
+        std::vector<SecretView> _plaintexts;
+        std::vector<EncryptedField> _encrypted;
+        std::vector<std::future<bool>> _writes;
+        std::vector<std::future<bool>> _previous;
+
+        void settle()
+        {
+            for (std::future<bool> &write : _previous)
+                (write.get() ? imported : failed)++;
+            _previous.clear();
+        }
+
+    public:
+        size_t imported = 0;
+        size_t failed = 0;
+
+        BatchImport(VaultContext &vault, TaskScheduler *scheduler)
+            : _vault(vault), _scheduler(scheduler), _userId(vault.session().getUserId()) {}
+
+        void queue(std::span<const ImportRow> rows)
+        {
+            if (rows.empty())
+                return;
+            _plaintexts.clear();
+            for (const ImportRow &row : rows)
+                _plaintexts.push_back(row.password);
+            _vault.crypto().encryptBatch(_plaintexts, _encrypted,
+                _vault.session().getMasterPassword(), _vault.session().getUserSalt(),
+                _scheduler, TaskPriority::Background);
+
+            for (size_t i = 0; i < rows.size(); i++)
+                _writes.push_back(_vault.database().addPasswordAsync(_userId,
+                    std::string(rows[i].website), std::string(rows[i].username),
+                    _encrypted[i].ciphertext_hex, _encrypted[i].iv_hex));
+            settle();
+            std::swap(_previous, _writes);
+        }
+
+        // Wait for the writes still queued
+        void finish()
+        {
+            settle();
+        }
+};
+
+// Column of the first header name found (-1 if none)
+static int findColumn(const std::vector<SecureString> &header, std::initializer_list<const char *> names)
+{
+    for (const char *name : names)
+        for (size_t i = 0; i < header.size(); i++)
+            if (strcasecmp(std::string(header[i].data(), header[i].size()).c_str(), name) == 0)
+                return i;
+    return -1;
+}
+
+// ============ CLI ============
+
+PassmanCli::PassmanCli() {}
+
+PassmanCli::~PassmanCli() {}
+
+void PassmanCli::printUsage(std::ostream &out) const
+{
+    out << "Usage: passman-cli [options] <command> [arguments]\n"
+           "\n"
+           "Commands:\n"
+           "  list                      List entries (no passwords)\n"
+           "  search <text>             Entries whose website or username contains text\n"
+           "  get <id|website|url>      Show one entry with its password\n"
+           "  add <website> <username>  Add an entry, its password is read like the master one\n"
+           "  import <file>             Import a CSV with website/url, username and password\n"
+           "                            columns, an encrypted export or a KeePass (KDBX 4)\n"
+           "                            database\n"
+           "  export                    Export every entry with its password\n"
+           "  backup [dir]              Online copy of the vault (default dir: <vault>.backups)\n"
+           "  sync <dir>                Exchange the changes with the copies of the vault\n"
+           "                            syncing through dir\n"
+           "\n"
+           "Options:\n"
+           "  --db <path>               Vault file (default: $HOME/.local/share/passman)\n"
+           "  --user <name>             Vault user (default: $PASSMAN_USER)\n"
+           "  --format json|csv|encrypted\n"
+           "                            Export format (default: json). encrypted is a\n"
+           "                            passphrase protected file, streamed in chunks\n"
+           "  -o, --output <file>       Export to a file created with mode 0600\n"
+           "  --keyfile <file>          Key file of the KeePass database to import\n"
+           "  --keep <n>                Backups kept by backup, 0 = all (default: 7)\n"
+           "  --compress                gzip the backup (plaintext vaults only)\n"
+           "  --agent                   Ask the running passmand (list, search, get),\n"
+           "                            no master password needed\n"
+           "  --verbose                 Logs on stderr\n"
+           "  -h, --help                This help\n"
+           "\n"
+           "The master password is asked on the terminal, or read from the first line\n"
+           "of stdin when it is piped (the entry password of add comes next).\n";
+}
+
+int PassmanCli::fail(int code, const std::string &message) const
+{
+    JsonWriter json;
+    json.beginObject().field("error", message).endObject();
+    printDocument(STDERR_FILENO, json.view());
+    return code;
+}
+
+bool PassmanCli::parseArgs(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--db" && hasValue)
+            _opts.dbPath = argv[++i];
+        else if (arg == "--user" && hasValue)
+            _opts.user = argv[++i];
+        else if (arg == "--format" && hasValue)
+            _opts.format = argv[++i];
+        else if ((arg == "-o" || arg == "--output") && hasValue)
+            _opts.output = argv[++i];
+        else if (arg == "--keyfile" && hasValue)
+            _opts.keyFile = argv[++i];
+        else if (arg == "--keep" && hasValue)
+        {
+            char *end = nullptr;
+            const char *text = argv[++i];
+            long keep = strtol(text, &end, 10);
+            if (end == text || *end != '\0' || keep < 0 || keep > 100000)
+                return false;
+            _opts.keep = static_cast<int>(keep);
+        }
+        else if (arg == "--compress")
+            _opts.compress = true;
+        else if (arg == "--verbose")
+            _opts.verbose = true;
+        else if (arg == "--agent")
+            _opts.agent = true;
+        else if (arg == "-h" || arg == "--help")
+            _opts.help = true;
+        else if (arg.size() > 1 && arg[0] == '-')
+            return false;
+        else if (_opts.command.empty())
+            _opts.command = arg;
+        else
+            _opts.args.push_back(arg);
+    }
+
+    if (_opts.user.empty() && getenv("PASSMAN_USER"))
+        _opts.user = getenv("PASSMAN_USER");
+    return _opts.format == "json" || _opts.format == "csv" || _opts.format == "encrypted";
+}
+
+int PassmanCli::openVault()
+{
+    if (_opts.user.empty())
+        return fail(CLI_USAGE, "no user given (--user or PASSMAN_USER)");
+
+    // An explicit path must exist: opening it would create an empty vault
+    struct stat st;
+    if (!_opts.dbPath.empty() && stat(_opts.dbPath.c_str(), &st) != 0)
+        return fail(CLI_NOT_FOUND, "no vault at " + _opts.dbPath);
+
+    _scheduler = std::make_unique<TaskScheduler>();
+    _vault = std::make_unique<VaultContext>(*_scheduler, _opts.dbPath);
+
+    SecureString master = readSecret("Master password: ");
+    if (!_vault->auth().authenticateUser(_opts.user, master))
+        return fail(CLI_AUTH_FAILED, "invalid user or master password");
+
+    std::string hash;
+    std::string salt;
+    if (!_vault->database().getUserHash(_opts.user, hash, salt))
+        return fail(CLI_AUTH_FAILED, "user not found");
+
+    int userId = _vault->database().getUserIdByUsername(_opts.user);
+    _vault->session().beginSession(userId, _opts.user, std::move(master), salt);
+    return CLI_OK;
+}
+
+std::vector<Password> PassmanCli::entries() const
+{
+    return _vault->database().getPasswordsByUserId(_vault->session().getUserId());
+}
+
+int PassmanCli::run(int argc, char **argv)
+{
+    bool parsed = parseArgs(argc, argv);
+
+    // stdout carries the JSON documents
+    RedirectLogs(_opts.verbose ? &std::cerr : nullptr);
+
+    if (_opts.help)
+    {
+        printUsage(std::cout);
+        return CLI_OK;
+    }
+    if (!parsed || _opts.command.empty())
+    {
+        printUsage(std::cerr);
+        return CLI_USAGE;
+    }
+
+    typedef int (PassmanCli::*Command)();
+    static const std::pair<const char *, Command> commands[] = {
+        {"list", &PassmanCli::cmdList},
+        {"get", &PassmanCli::cmdGet},
+        {"add", &PassmanCli::cmdAdd},
+        {"import", &PassmanCli::cmdImport},
+        {"export", &PassmanCli::cmdExport},
+        {"search", &PassmanCli::cmdSearch},
+        {"backup", &PassmanCli::cmdBackup},
+        {"sync", &PassmanCli::cmdSync},
+    };
+
+    if (_opts.agent)
+        return viaAgent();
+
+    for (const auto &[name, command] : commands)
+    {
+        if (_opts.command != name)
+            continue;
+        try
+        {
+            int res = openVault();
+            if (res != CLI_OK)
+                return res;
+            return (this->*command)();
+        }
+        catch (const std::exception &e)
+        {
+            return fail(CLI_ERROR, e.what());
+        }
+    }
+    return fail(CLI_USAGE, "unknown command: " + _opts.command);
+}
+
+int PassmanCli::viaAgent()
+{
+    bool hasArg = _opts.command == "search" || _opts.command == "get";
+    if ((_opts.command != "list" && !hasArg) || _opts.args.size() != (hasArg ? 1u : 0u))
+        return fail(CLI_USAGE, "--agent serves list, search <text> and get <id|website|url>");
+
+    std::string path = agentSocketPath();
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return fail(CLI_ERROR, "agent socket path too long");
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return fail(CLI_NOT_FOUND, "no agent listening on " + path);
+    }
+
+    std::string request = _opts.command + (hasArg ? " " + _opts.args[0] : "") + "\n";
+    SecureChars replyLine;
+    bool ok = request.find('\n') == request.size() - 1 && writeAll(fd, request);
+    char c;
+    while (ok && read(fd, &c, 1) == 1 && c != '\n')
+        replyLine.push_back(c);
+    close(fd);
+    if (!ok || replyLine.empty())
+        return fail(CLI_ERROR, "no reply from the agent");
+
+    // Agent errors keep their JSON, not found keeps its exit code
+    SecretView reply(replyLine.data(), replyLine.size());
+    static const char errorPrefix[] = "{\"error\"";
+    if (replyLine.size() >= sizeof(errorPrefix) - 1 && memcmp(replyLine.data(), errorPrefix, sizeof(errorPrefix) - 1) == 0)
+    {
+        printDocument(STDERR_FILENO, reply);
+        static const char notFound[] = "\"code\":\"not_found\"";
+        bool missing = std::search(reply.begin(), reply.end(), notFound, notFound + sizeof(notFound) - 1) != reply.end();
+        return missing ? CLI_NOT_FOUND : CLI_ERROR;
+    }
+    printDocument(STDOUT_FILENO, reply);
+    return CLI_OK;
+}
+
+int PassmanCli::cmdList()
+{
+    JsonWriter json;
+    json.beginArray();
+    for (const Password &pwd : entries())
+    {
+        json.beginObject();
+        writeEntryFields(json, pwd);
+        json.endObject();
+    }
+    json.endArray();
+    printDocument(STDOUT_FILENO, json.view());
+    return CLI_OK;
+}
+
+int PassmanCli::cmdSearch()
+{
+    if (_opts.args.size() != 1)
+        return fail(CLI_USAGE, "usage: search <text>");
+
+    std::vector<Password> all = entries();
+    JsonWriter json;
+    json.beginArray();
+    for (const Password *pwd : searchEntries(all, _opts.args[0]))
+    {
+        json.beginObject();
+        writeEntryFields(json, *pwd);
+        json.endObject();
+    }
+    json.endArray();
+    printDocument(STDOUT_FILENO, json.view());
+    return CLI_OK;
+}
+
+int PassmanCli::cmdGet()
+{
+    if (_opts.args.size() != 1)
+        return fail(CLI_USAGE, "usage: get <id|website|url>");
+
+    // By id, or by website (case insensitive), else as a URL through the
+    // domain index, when it is not ambiguous
+    const std::string &wanted = _opts.args[0];
+    std::vector<Password> all = entries();
+    std::vector<const Password *> matches = findEntries(all, wanted);
+    std::vector<UrlMatch> byUrl;
+    if (matches.empty())
+    {
+        byUrl = _vault->database().findByUrl(_vault->session().getUserId(), wanted);
+        matches = bestUrlMatches(byUrl);
+    }
+    if (matches.empty())
+        return fail(CLI_NOT_FOUND, "no entry matches " + wanted);
+    if (matches.size() > 1)
+        return fail(CLI_ERROR, "several entries match " + wanted + ", use the id");
+
+    const Password &pwd = *matches[0];
+    SecureString plaintext = _vault->crypto().decryptPassword(
+        pwd.encrypted_password, pwd.iv,
+        _vault->session().getMasterPassword(), _vault->session().getUserSalt());
+
+    JsonWriter json;
+    json.beginObject();
+    writeEntryFields(json, pwd);
+    json.field("password", plaintext.view());
+    json.endObject();
+    printDocument(STDOUT_FILENO, json.view());
+    return CLI_OK;
+}
+
+int PassmanCli::cmdAdd()
+{
+    if (_opts.args.size() != 2)
+        return fail(CLI_USAGE, "usage: add <website> <username>");
+
+    SecureString password = readSecret("Entry password: ");
+    if (password.empty())
+        return fail(CLI_USAGE, "empty entry password");
+
+    auto [ciphertext, iv] = _vault->crypto().encryptPassword(
+        password, _vault->session().getMasterPassword(), _vault->session().getUserSalt());
+
+    const std::string &website = _opts.args[0];
+    const std::string &username = _opts.args[1];
+    if (!_vault->database().addPassword(_vault->session().getUserId(), website, username, ciphertext, iv))
+        return fail(CLI_ERROR, "failed to store the entry");
+
+    JsonWriter json;
+    json.beginObject()
+        .field("added", true)
+        .field("website", website)
+        .field("username", username)
+        .endObject();
+    printDocument(STDOUT_FILENO, json.view());
+    return CLI_OK;
+}
+
+int PassmanCli::cmdImport()
+{
+    if (_opts.args.size() != 1)
+        return fail(CLI_USAGE, "usage: import <file>");
+
+    if (VaultExport::isExport(_opts.args[0]))
+        return importEncrypted(_opts.args[0]);
+    if (KdbxReader::isKdbx(_opts.args[0]))
+        return importKdbx(_opts.args[0]);
+
+    SecureChars text;
+    if (!readFile(_opts.args[0], text))
+        return fail(CLI_NOT_FOUND, "cannot read " + _opts.args[0]);
+    std::vector<std::vector<SecureString>> rows = parseCsv(SecretView(text.data(), text.size()));
+    if (rows.empty())
+        return fail(CLI_ERROR, "empty CSV");
+
+    // Header names of our own export and of the usual browser / manager exports
+    int webCol = findColumn(rows[0], {"website", "url", "login_uri", "name"});
+    int userCol = findColumn(rows[0], {"username", "login_username", "user", "login"});
+    int passCol = findColumn(rows[0], {"password", "login_password"});
+    if (webCol < 0 || userCol < 0 || passCol < 0)
+        return fail(CLI_ERROR, "CSV header needs website/url, username and password columns");
+
+    size_t needed = std::max({webCol, userCol, passCol}) + 1;
+    std::vector<size_t> valid;
+    std::vector<SecretView> plaintexts;
+    for (size_t i = 1; i < rows.size(); i++)
+    {
+        if (rows[i].size() < needed || rows[i][webCol].empty() || rows[i][passCol].empty())
+            continue;
+        valid.push_back(i);
+        plaintexts.push_back(rows[i][passCol]);
+    }
+
+    // One key derivation for the whole file, records split across the pool
+    std::vector<EncryptedField> encrypted;
+    _vault->crypto().encryptBatch(plaintexts, encrypted,
+        _vault->session().getMasterPassword(), _vault->session().getUserSalt(),
+        _scheduler.get(), TaskPriority::Background);
+
+    // Queued together, the writer commits them in group transactions
+    int userId = _vault->session().getUserId();
+    std::vector<std::future<bool>> writes;
+    for (size_t i = 0; i < valid.size(); i++)
+    {
+        const std::vector<SecureString> &row = rows[valid[i]];
+        writes.push_back(_vault->database().addPasswordAsync(userId,
+            std::string(row[webCol].data(), row[webCol].size()),
+            std::string(row[userCol].data(), row[userCol].size()),
+            encrypted[i].ciphertext_hex, encrypted[i].iv_hex));
+    }
+
+    size_t imported = 0;
+    for (std::future<bool> &write : writes)
+        if (write.get())
+            imported++;
+
+    JsonWriter json;
+    json.beginObject()
+        .field("imported", imported)
+        .field("failed", writes.size() - imported)
+        .field("skipped", rows.size() - 1 - valid.size())
+        .endObject();
+    printDocument(STDOUT_FILENO, json.view());
+    return imported == writes.size() ? CLI_OK : CLI_ERROR;
+}
+
+int PassmanCli::cmdExport()
+{
+    if (!_opts.args.empty())
+        return fail(CLI_USAGE, "usage: export [--format json|csv|encrypted] [-o file]");
+    if (_opts.format == "encrypted")
+        return exportEncrypted();
+
+    // Written next to the target and renamed once complete
+    int fd = STDOUT_FILENO;
+    std::string tmpPath = _opts.output + ".partial";
+    if (!_opts.output.empty())
+    {
+        fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+        if (fd < 0)
+            return fail(CLI_ERROR, "cannot create " + tmpPath + ": " + strerror(errno));
+    }
+
+    SecureBytes key(CRYPTO_KEY_SIZE);
+    _vault->crypto().deriveKey(_vault->session().getMasterPassword(), _vault->session().getUserSalt(), key.data());
+
+    // Entries go out CLI_EXPORT_BATCH at a time: decrypted on the pool, written,
+    // then wiped, so locked memory doesn't grow with the vault.
+    // Both formats are built in secure memory
+    bool csv = _opts.format == "csv";
+    JsonWriter json;
+    SecureChars text;
+    std::vector<Password> batch;
+    std::vector<EncryptedField> records;
+    std::vector<SecureString> plaintexts;
+    size_t failed = 0;
+    bool written = true;
+
+    auto flush = [&]()
+    {
+        records.resize(batch.size());
+        for (size_t i = 0; i < batch.size(); i++)
+            records[i] = {batch[i].encrypted_password, batch[i].iv};
+        failed += _vault->crypto().decryptBatch(records, plaintexts, key.data(),
+                                                _scheduler.get(), TaskPriority::Background);
+        if (failed > 0)
+            return;
+
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (csv)
+            {
+                appendCsvField(text, batch[i].website);
+                text.push_back(',');
+                appendCsvField(text, batch[i].username);
+                text.push_back(',');
+                appendCsvField(text, plaintexts[i]);
+                text.push_back('\n');
+            }
+            else
+            {
+                json.beginObject();
+                writeEntryFields(json, batch[i]);
+                json.field("password", plaintexts[i].view());
+                json.endObject();
+            }
+            // Shrinking wipes, the buffer is reused by the next batch
+            plaintexts[i].resize(0);
+        }
+        written = csv ? writeAll(fd, SecretView(text.data(), text.size())) : writeAll(fd, json.view());
+        OPENSSL_cleanse(text.data(), text.size());
+        text.clear();
+        json.clearOutput();
+        batch.clear();
+    };
+
+    if (csv)
+    {
+        static const char header[] = "website,username,password\n";
+        text.insert(text.end(), header, header + sizeof(header) - 1);
+    }
+    else
+        json.beginArray();
+
+    _vault->database().forEachPassword(_vault->session().getUserId(), [&](const PasswordView &row)
+    {
+        if (failed > 0 || !written)
+            return;
+        batch.emplace_back(row);
+        if (batch.size() == CLI_EXPORT_BATCH)
+            flush();
+    });
+    if (failed == 0 && written)
+        flush();
+    if (failed == 0 && written)
+    {
+        if (csv)
+            written = writeAll(fd, SecretView(text.data(), text.size()));
+        else
+            written = printDocument(fd, json.endArray().view());
+    }
+
+    std::string error;
+    if (failed > 0)
+        error = std::to_string(failed) + " entries failed to decrypt";
+    else if (!written || (fd != STDOUT_FILENO && (fsync(fd) != 0 || rename(tmpPath.c_str(), _opts.output.c_str()) != 0)))
+        error = _opts.output.empty() ? "write failed" : "cannot write " + _opts.output + ": " + strerror(errno);
+    if (fd != STDOUT_FILENO)
+    {
+        close(fd);
+        if (!error.empty())
+            unlink(tmpPath.c_str());
+    }
+    if (!error.empty())
+        return fail(CLI_ERROR, error);
+    return CLI_OK;
+}
+
+int PassmanCli::importEncrypted(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return fail(CLI_NOT_FOUND, "cannot read " + path);
+    SecureString passphrase = readSecret("Export passphrase: ");
+
+    // Entries come one authenticated chunk at a time
+    BatchImport batch(*_vault, _scheduler.get());
+    std::vector<ImportRow> rows;
+    ExportStats stats;
+    try
+    {
+        stats = VaultExport(_vault->crypto(), _scheduler.get()).read(fd, passphrase,
+            [&](std::span<const ExportEntry> entries)
+            {
+                rows.clear();
+                for (const ExportEntry &entry : entries)
+                    rows.push_back({entry.website, entry.username, entry.password});
+                batch.queue(rows);
+            });
+    }
+    catch (const std::exception &e)
+    {
+        batch.finish();
+        close(fd);
+        if (batch.imported > 0)
+            return fail(CLI_ERROR, std::string(e.what()) + " (" + std::to_string(batch.imported) + " entries imported before)");
+        return fail(CLI_ERROR, e.what());
+    }
+    batch.finish();
+    close(fd);
+
+    JsonWriter json;
+    json.beginObject()
+        .field("imported", batch.imported)
+        .field("failed", batch.failed)
+        .field("chunks", stats.chunks)
+        .endObject();
+    printDocument(STDOUT_FILENO, json.view());
+    return batch.failed == 0 ? CLI_OK : CLI_ERROR;
+}
+
+int PassmanCli::importKdbx(const std::string &path)
+{
+    SecureString password = readSecret("KeePass password: ");
+    if (password.empty() && _opts.keyFile.empty())
+        return fail(CLI_USAGE, "empty KeePass password and no --keyfile");
+
+    // Live entries come KDBX_BATCH at a time, the URL is the website unless
+    // it is empty; entries without a website or a password are skipped
+    BatchImport batch(*_vault, _scheduler.get());
+    std::vector<ImportRow> rows;
+    size_t skipped = 0;
+    KdbxStats stats;
+    try
+    {
+        stats = KdbxReader(_scheduler.get()).read(path, password, _opts.keyFile,
+            [&](std::span<const KdbxEntry> entries)
+            {
+                rows.clear();
+                for (const KdbxEntry &entry : entries)
+                {
+                    std::string_view website = entry.url.empty() ? entry.title : entry.url;
+                    if (website.empty() || entry.password.empty())
+                    {
+                        skipped++;
+                        continue;
+                    }
+                    rows.push_back({website, entry.username, entry.password});
+                }
+                batch.queue(rows);
+            });
+    }
+    catch (const std::exception &e)
+    {
+        batch.finish();
+        if (batch.imported > 0)
+            return fail(CLI_ERROR, std::string(e.what()) + " (" + std::to_string(batch.imported) + " entries imported before)");
+        return fail(CLI_ERROR, e.what());
+    }
+    batch.finish();
+
+    JsonWriter json;
+    json.beginObject()
+        .field("imported", batch.imported)
+        .field("failed", batch.failed)
+        .field("skipped", skipped)
+        .field("recycled", stats.recycled)
+        .field("kdf_ms", static_cast<size_t>(stats.kdfMs))
+        .field("ms", static_cast<size_t>(stats.ms))
+        .endObject();
+    printDocument(STDOUT_FILENO, json.view());
+    return batch.failed == 0 ? CLI_OK : CLI_ERROR;
+}
+
+int PassmanCli::exportEncrypted()
+{
+    // Binary output: a file, or stdout when it is not a terminal
+    if (_opts.output.empty() && isatty(STDOUT_FILENO))
+        return fail(CLI_USAGE, "encrypted export needs -o file or a redirected stdout");
+
+    SecureString passphrase = readSecret("Export passphrase: ");
+    if (passphrase.empty())
+        return fail(CLI_USAGE, "empty export passphrase");
+    // Asked twice only on a terminal, piped secrets come one per line
+    if (isatty(STDIN_FILENO) && !readSecret("Repeat export passphrase: ").view().equals(passphrase.view()))
+        return fail(CLI_USAGE, "passphrases don't match");
+
+    // Written next to the target and renamed once complete
+    int fd = STDOUT_FILENO;
+    std::string tmpPath = _opts.output + ".partial";
+    if (!_opts.output.empty())
+    {
+        fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+        if (fd < 0)
+            return fail(CLI_ERROR, "cannot create " + tmpPath + ": " + strerror(errno));
+    }
+
+    ExportStats stats;
+    try
+    {
+        stats = VaultExport(_vault->crypto(), _scheduler.get()).write(fd, _vault->database(),
+            _vault->session().getUserId(), _vault->session().getMasterPassword(),
+            _vault->session().getUserSalt(), passphrase);
+        if (fd != STDOUT_FILENO && (fsync(fd) != 0 || rename(tmpPath.c_str(), _opts.output.c_str()) != 0))
+            throw std::runtime_error("cannot write " + _opts.output + ": " + strerror(errno));
+    }
+    catch (const std::exception &e)
+    {
+        if (fd != STDOUT_FILENO)
+        {
+            close(fd);
+            unlink(tmpPath.c_str());
+        }
+        return fail(CLI_ERROR, e.what());
+    }
+    if (fd == STDOUT_FILENO)
+        return CLI_OK;
+    close(fd);
+
+    JsonWriter json;
+    json.beginObject()
+        .field("exported", stats.entries)
+        .field("file", _opts.output)
+        .field("chunks", stats.chunks)
+        .field("bytes", stats.bytes)
+        .field("ms", static_cast<long long>(stats.ms))
+        .endObject();
+    printDocument(STDOUT_FILENO, json.view());
+    return CLI_OK;
+}
+
+int PassmanCli::cmdBackup()
+{
+    if (_opts.args.size() > 1)
+        return fail(CLI_USAGE, "usage: backup [dir] [--keep n] [--compress]");
+
+    BackupOptions options;
+    if (!_opts.args.empty())
+        options.dir = _opts.args[0];
+    if (_opts.keep >= 0)
+        options.keep = static_cast<size_t>(_opts.keep);
+    options.compress = _opts.compress;
+
+    // Progress goes to the log (--verbose), every 10%
+    int lastDecile = -1;
+    auto progress = [&lastDecile](const BackupProgress &p)
+    {
+        int decile = p.total > 0 ? p.copied * 10 / p.total : 10;
+        if (decile == lastDecile)
+            return;
+        lastDecile = decile;
+        PrintLog(std::cout, CYAN "Backup" RESET " - %d%% (%d / %d pages)", decile * 10, p.copied, p.total);
+    };
+
+    const SQLiteCipherDB &db = _vault->database();
+    VaultBackup backup(db.getPath(), db.getCipher(), options);
+    BackupResult result = backup.run(progress);
+
+    JsonWriter json;
+    json.beginObject()
+        .field("backup", result.path)
+        .field("pages", result.pages)
+        .field("bytes", result.bytes)
+        .field("ms", static_cast<long long>(result.ms));
+    json.key("removed").beginArray();
+    for (const std::string &path : result.removed)
+        json.value(path);
+    json.endArray();
+    json.endObject();
+    printDocument(STDOUT_FILENO, json.view());
+    return CLI_OK;
+}
+
+int PassmanCli::cmdSync()
+{
+    if (_opts.args.size() != 1)
+        return fail(CLI_USAGE, "usage: sync <dir>");
+
+    VaultSync sync(_vault->database(), _vault->crypto());
+    SyncResult result = sync.run(_opts.args[0], _vault->session().getUserId(), _opts.user,
+                                 _vault->session().getMasterPassword(), _vault->session().getUserSalt());
+
+    char vaultId[17];
+    snprintf(vaultId, sizeof(vaultId), "%016llx", static_cast<unsigned long long>(result.vaultId));
+    JsonWriter json;
+    json.beginObject()
+        .field("vault_id", std::string(vaultId))
+        .field("exported", result.exported)
+        .field("segments_written", result.segmentsWritten)
+        .field("segments_read", result.segmentsRead)
+        .field("peers", result.peers)
+        .field("added", result.applied.added)
+        .field("updated", result.applied.updated)
+        .field("deleted", result.applied.deleted)
+        .field("stale", result.applied.stale)
+        .field("pruned", result.pruned)
+        .field("forgotten", result.forgotten)
+        .field("ms", static_cast<long long>(result.ms));
+    json.key("errors").beginArray();
+    for (const std::string &error : result.errors)
+        json.value(error);
+    json.endArray();
+    json.endObject();
+    printDocument(STDOUT_FILENO, json.view());
+    return result.errors.empty() ? CLI_OK : CLI_ERROR;
+}
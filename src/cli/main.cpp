@@ -0,0 +1,8 @@
+#include "PassmanCli.hpp"
+
+// Headless entry point, see PassmanCli.hpp
+int main(int argc, char *argv[])
+{
+    PassmanCli cli;
+    return cli.run(argc, argv);
+}
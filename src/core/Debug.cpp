@@ -1,5 +1,13 @@
 #include "library.hpp"
 
+#include <cstdarg>
+#include <mutex>
+
+// RedirectLogs state: once redirected every log goes to g_logOutput (nullptr = dropped)
+static std::mutex g_logMutex;
+static bool g_logRedirected = false;
+static std::ostream *g_logOutput = nullptr;
+
 /**
  * @brief Obtains ass std::string the current time data for displaying
  */
@@ -26,5 +34,21 @@ void PrintLog(std::ostream& oss, const std::string message, ...)
 	va_end(args);
 
 	std::string fullLog = std::string(ObtainCurrentTime()) + msg;
-	oss << fullLog << std::endl;
+
+	std::lock_guard<std::mutex> lock(g_logMutex);
+	if (!g_logRedirected)
+		oss << fullLog << std::endl;
+	else if (g_logOutput)
+		*g_logOutput << fullLog << std::endl;
+}
+
+/**
+ * @brief Sends every following log to out, whatever stream PrintLog is given
+ * @param out the stream to write to, nullptr to drop the logs
+ */
+void RedirectLogs(std::ostream *out)
+{
+	std::lock_guard<std::mutex> lock(g_logMutex);
+	g_logRedirected = true;
+	g_logOutput = out;
 }
@@ -0,0 +1,15 @@
+#include "Executor.hpp"
+
+// ============ EXECUTOR ============
+
+thread_local Executor *Executor::_current = nullptr;
+
+void Executor::setCurrent(Executor *exec)
+{
+    _current = exec;
+}
+
+Executor *Executor::current()
+{
+    return _current;
+}
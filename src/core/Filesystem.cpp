@@ -1,5 +1,7 @@
 #include "library.hpp"
 
+#include <unistd.h>
+
 // Ensure that the dirpath exits if not create it
 bool createDirectory(const std::string &dirPath)
 {
@@ -15,3 +17,17 @@ bool createDirectory(const std::string &dirPath)
     }
     return true;
 }
+
+// Where passmand listens and clients connect (the directory is created 0700 by the agent)
+std::string agentSocketPath()
+{
+    const char *explicitPath = getenv("PASSMAN_AGENT_SOCK");
+    if (explicitPath && *explicitPath)
+        return explicitPath;
+
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir && *runtimeDir)
+        return std::string(runtimeDir) + "/passman/agent.sock";
+
+    return "/tmp/passman-" + std::to_string(getuid()) + "/agent.sock";
+}
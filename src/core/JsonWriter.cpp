@@ -0,0 +1,168 @@
+#include "JsonWriter.hpp"
+
+JsonWriter::JsonWriter() : _afterKey(false) {}
+
+// Comma before every item but the first of its container
+void JsonWriter::separate()
+{
+    if (_afterKey)
+    {
+        _afterKey = false;
+        return;
+    }
+    if (!_hasItems.empty())
+    {
+        if (_hasItems.back())
+            _out.push_back(',');
+        _hasItems.back() = true;
+    }
+}
+
+void JsonWriter::append(const char *text, size_t length)
+{
+    _out.insert(_out.end(), text, text + length);
+}
+
+// Quoted and escaped, UTF-8 passes through untouched
+void JsonWriter::appendString(const char *text, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    _out.push_back('"');
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = text[i];
+        switch (c)
+        {
+            case '"':  append("\\\"", 2); break;
+            case '\\': append("\\\\", 2); break;
+            case '\n': append("\\n", 2); break;
+            case '\r': append("\\r", 2); break;
+            case '\t': append("\\t", 2); break;
+            case '\b': append("\\b", 2); break;
+            case '\f': append("\\f", 2); break;
+            default:
+                if (c < 0x20)
+                {
+                    char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                    append(escaped, sizeof(escaped));
+                }
+                else
+                    _out.push_back(static_cast<char>(c));
+        }
+    }
+    _out.push_back('"');
+}
+
+JsonWriter &JsonWriter::beginObject()
+{
+    separate();
+    _out.push_back('{');
+    _hasItems.push_back(false);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject()
+{
+    _hasItems.pop_back();
+    _out.push_back('}');
+    return *this;
+}
+
+JsonWriter &JsonWriter::beginArray()
+{
+    separate();
+    _out.push_back('[');
+    _hasItems.push_back(false);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endArray()
+{
+    _hasItems.pop_back();
+    _out.push_back(']');
+    return *this;
+}
+
+JsonWriter &JsonWriter::key(const std::string &name)
+{
+    separate();
+    appendString(name.data(), name.size());
+    _out.push_back(':');
+    _afterKey = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(SecretView text)
+{
+    separate();
+    appendString(text.data(), text.size());
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const std::string &text)
+{
+    return value(SecretView(text));
+}
+
+JsonWriter &JsonWriter::value(std::string_view text)
+{
+    return value(SecretView(text.data(), text.size()));
+}
+
+JsonWriter &JsonWriter::value(const char *text)
+{
+    return value(SecretView(text, strlen(text)));
+}
+
+JsonWriter &JsonWriter::value(long long number)
+{
+    separate();
+    std::string text = std::to_string(number);
+    append(text.data(), text.size());
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(bool flag)
+{
+    separate();
+    if (flag)
+        append("true", 4);
+    else
+        append("false", 5);
+    return *this;
+}
+
+JsonWriter &JsonWriter::null()
+{
+    separate();
+    append("null", 4);
+    return *this;
+}
+
+SecretView JsonWriter::view() const
+{
+    return SecretView(_out.data(), _out.size());
+}
+
+void JsonWriter::clearOutput()
+{
+    OPENSSL_cleanse(_out.data(), _out.size());
+    _out.clear();
+}
+
+void writeEntryFields(JsonWriter &json, const PasswordView &pwd)
+{
+    json.field("id", pwd.id)
+        .field("website", pwd.website)
+        .field("username", pwd.username)
+        .field("created_at", pwd.created_at);
+}
+
+void writeEntryFields(JsonWriter &json, const CachedEntry &entry)
+{
+    json.field("id", entry.id)
+        .field("website", entry.website)
+        .field("username", entry.username)
+        .field("created_at", entry.created_at);
+}
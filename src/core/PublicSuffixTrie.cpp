@@ -0,0 +1,349 @@
+#include "PublicSuffixTrie.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <sstream>
+
+#define PSL_RULE 0x01       // A rule ends at this node
+#define PSL_EXCEPTION 0x02  // "!" rule: the parent is the public suffix
+
+// Built-in subset of the public suffix list: the generic TLDs, the second level
+// registries of the common ccTLDs and the hosting suffixes users keep logins on.
+// Any TLD missing here still gets the implicit "*" rule.
+static const char *BUILTIN_RULES = R"(
+// Generic
+com
+net
+org
+edu
+gov
+mil
+int
+info
+biz
+name
+pro
+io
+co
+me
+tv
+cc
+app
+dev
+ai
+xyz
+online
+site
+store
+shop
+cloud
+page
+tech
+// Country code second levels
+uk
+ac.uk
+co.uk
+gov.uk
+ltd.uk
+me.uk
+net.uk
+nhs.uk
+org.uk
+plc.uk
+sch.uk
+au
+com.au
+edu.au
+gov.au
+id.au
+net.au
+org.au
+nz
+ac.nz
+co.nz
+govt.nz
+net.nz
+org.nz
+jp
+ac.jp
+co.jp
+go.jp
+ne.jp
+or.jp
+*.kawasaki.jp
+!city.kawasaki.jp
+br
+com.br
+edu.br
+gov.br
+net.br
+org.br
+mx
+com.mx
+gob.mx
+org.mx
+ar
+com.ar
+gob.ar
+cn
+com.cn
+edu.cn
+gov.cn
+net.cn
+org.cn
+in
+co.in
+gov.in
+net.in
+org.in
+za
+co.za
+gov.za
+org.za
+tr
+com.tr
+gov.tr
+kr
+co.kr
+go.kr
+or.kr
+sg
+com.sg
+gov.sg
+hk
+com.hk
+gov.hk
+tw
+com.tw
+gov.tw
+il
+ac.il
+co.il
+gov.il
+es
+com.es
+edu.es
+gob.es
+nom.es
+org.es
+pt
+com.pt
+fr
+gouv.fr
+de
+it
+gov.it
+nl
+be
+ch
+at
+co.at
+gv.at
+or.at
+se
+no
+dk
+fi
+pl
+com.pl
+gov.pl
+ru
+ua
+com.ua
+gov.ua
+id
+co.id
+go.id
+my
+com.my
+gov.my
+ph
+com.ph
+pk
+com.pk
+sa
+com.sa
+eg
+com.eg
+ca
+us
+eu
+ie
+gov.ie
+ck
+*.ck
+!www.ck
+er
+*.er
+kh
+*.kh
+np
+*.np
+// Internationalized TLDs (punycode)
+xn--p1ai
+xn--fiqs8s
+xn--j1amh
+// Hosting
+github.io
+gitlab.io
+blogspot.com
+herokuapp.com
+appspot.com
+web.app
+firebaseapp.com
+netlify.app
+vercel.app
+pages.dev
+workers.dev
+azurewebsites.net
+cloudfront.net
+s3.amazonaws.com
+)";
+
+PublicSuffixTrie::PublicSuffixTrie(std::istream &in)
+{
+    // Parse into a map based tree first, then flatten it
+    struct BuildNode
+    {
+        std::map<std::string, BuildNode> children;
+        uint8_t flags = 0;
+    };
+    BuildNode root;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        // The rule is the first whitespace separated token of the line
+        std::istringstream tokens(line);
+        std::string rule;
+        if (!(tokens >> rule) || rule.rfind("//", 0) == 0)
+            continue;
+
+        uint8_t flags = PSL_RULE;
+        if (rule[0] == '!')
+        {
+            flags = PSL_EXCEPTION;
+            rule.erase(0, 1);
+        }
+        std::transform(rule.begin(), rule.end(), rule.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+
+        // Walk the labels right to left
+        BuildNode *node = &root;
+        size_t end = rule.size();
+        while (end > 0)
+        {
+            size_t dot = rule.rfind('.', end - 1);
+            size_t start = (dot == std::string::npos) ? 0 : dot + 1;
+            node = &node->children[rule.substr(start, end - start)];
+            end = (dot == std::string::npos) ? 0 : dot;
+        }
+        node->flags |= flags;
+    }
+
+    // Breadth first so that the children of every node end up contiguous
+    std::deque<std::pair<const BuildNode *, size_t>> pending;
+    _nodes.push_back(Node{0, 0, 0, 0, 0});
+    pending.emplace_back(&root, 0);
+    while (!pending.empty())
+    {
+        auto [build, index] = pending.front();
+        pending.pop_front();
+
+        _nodes[index].firstChild = static_cast<uint32_t>(_nodes.size());
+        _nodes[index].childCount = static_cast<uint32_t>(build->children.size());
+        for (const auto &[label, child] : build->children)
+        {
+            Node node{static_cast<uint32_t>(_labels.size()), static_cast<uint16_t>(label.size()),
+                      child.flags, 0, 0};
+            _labels += label;
+            pending.emplace_back(&child, _nodes.size());
+            _nodes.push_back(node);
+        }
+    }
+}
+
+const PublicSuffixTrie &PublicSuffixTrie::builtin()
+{
+    static const PublicSuffixTrie trie = []()
+    {
+        std::istringstream in(BUILTIN_RULES);
+        return PublicSuffixTrie(in);
+    }();
+    return trie;
+}
+
+const PublicSuffixTrie::Node *PublicSuffixTrie::findChild(const Node &node, std::string_view label) const
+{
+    // Children are sorted like the std::map they came from
+    const Node *first = _nodes.data() + node.firstChild;
+    const Node *last = first + node.childCount;
+    const Node *it = std::lower_bound(first, last, label, [this](const Node &child, std::string_view wanted)
+    {
+        return std::string_view(_labels).substr(child.label, child.labelLength) < wanted;
+    });
+    if (it == last || std::string_view(_labels).substr(it->label, it->labelLength) != label)
+        return nullptr;
+    return it;
+}
+
+size_t PublicSuffixTrie::suffixLabels(std::string_view host) const
+{
+    size_t suffix = 1;
+    const Node *node = &_nodes[0];
+    size_t depth = 0;
+    size_t end = host.size();
+
+    while (end > 0)
+    {
+        size_t dot = host.rfind('.', end - 1);
+        size_t start = (dot == std::string_view::npos) ? 0 : dot + 1;
+        std::string_view label = host.substr(start, end - start);
+
+        const Node *child = findChild(*node, label);
+
+        // "!www.ck": www.ck is registrable, the suffix stops at the parent
+        if (child && (child->flags & PSL_EXCEPTION))
+            return depth;
+
+        // "*.ck": any label under ck is part of the suffix
+        const Node *wildcard = findChild(*node, "*");
+        if (wildcard && (wildcard->flags & PSL_RULE))
+            suffix = std::max(suffix, depth + 1);
+
+        if (!child)
+            break;
+        if (child->flags & PSL_RULE)
+            suffix = std::max(suffix, depth + 1);
+
+        node = child;
+        depth++;
+        end = (dot == std::string_view::npos) ? 0 : dot;
+    }
+    return suffix;
+}
+
+std::string PublicSuffixTrie::registrableDomain(std::string_view host) const
+{
+    // Step back over suffix + 1 labels, start ends on the dot before them (or 0)
+    size_t wanted = suffixLabels(host) + 1;
+    size_t start = host.size();
+    for (size_t i = 0; i < wanted; i++)
+    {
+        if (start == 0)
+            return "";
+        size_t dot = host.rfind('.', start - 1);
+        start = (dot == std::string_view::npos) ? 0 : dot;
+    }
+    return std::string(start == 0 ? host : host.substr(start + 1));
+}
+
+size_t PublicSuffixTrie::ruleCount() const
+{
+    size_t count = 0;
+    for (const Node &node : _nodes)
+        if (node.flags & (PSL_RULE | PSL_EXCEPTION))
+            count++;
+    return count;
+}
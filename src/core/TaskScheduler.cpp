@@ -0,0 +1,342 @@
+#include "TaskScheduler.hpp"
+
+// Worker index of the calling thread inside its scheduler (-1 outside any pool)
+static thread_local const void *t_scheduler = nullptr;
+static thread_local size_t t_workerIndex = 0;
+
+// Idle workers re-check the queues at least this often
+#define SCHEDULER_IDLE_WAIT_MS 50
+
+static long long elapsedUs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// ============ PRIORITY EXECUTOR ============
+
+TaskScheduler::PriorityExecutor::PriorityExecutor(TaskScheduler &scheduler, TaskPriority priority)
+    : _scheduler(scheduler), _priority(priority) {}
+
+void TaskScheduler::PriorityExecutor::post(std::function<void()> fn)
+{
+    _scheduler.post(_priority, std::move(fn));
+}
+
+void TaskScheduler::PriorityExecutor::run(const std::function<void()> &fn)
+{
+    // Coroutines awaiting from this job resume at the same priority
+    setCurrent(this);
+    fn();
+    setCurrent(nullptr);
+}
+
+// ============ TASK SCHEDULER ============
+
+TaskScheduler::TaskScheduler(size_t workers) : _running(true)
+{
+    if (workers == 0)
+        workers = std::max(1u, std::thread::hardware_concurrency());
+
+    // Keep one worker free for interactive jobs whenever there is more than one
+    _maxBackground = (workers > 1) ? workers - 1 : 1;
+
+    for (size_t p = 0; p < TASK_PRIORITIES; p++)
+    {
+        _queued[p] = 0;
+        _active[p] = 0;
+        _completed[p] = 0;
+        _cancelled[p] = 0;
+        _totalWaitUs[p] = 0;
+        _maxWaitUs[p] = 0;
+        _totalRunUs[p] = 0;
+        _executors[p] = std::make_unique<PriorityExecutor>(*this, static_cast<TaskPriority>(p));
+    }
+
+    for (size_t i = 0; i < workers; i++)
+        _workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < workers; i++)
+        _threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+
+    PrintLog(std::cout, CYAN "TaskScheduler" RESET " - %lu workers running (%lu for background jobs)", workers, _maxBackground);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _running = false;
+    }
+    _sleepCv.notify_all();
+
+    for (auto &thread : _threads)
+        if (thread.joinable())
+            thread.join();
+
+    // Jobs left behind (posted while the workers were exiting) are cancelled,
+    // so the submit() futures throw OperationCancelled instead of broken_promise
+    std::vector<std::pair<size_t, Job>> leftover;
+    {
+        std::lock_guard<std::mutex> lock(_globalMutex);
+        for (size_t p = 0; p < TASK_PRIORITIES; p++)
+            for (Job &job : _global[p])
+                leftover.emplace_back(p, std::move(job));
+        for (size_t p = 0; p < TASK_PRIORITIES; p++)
+            _global[p].clear();
+    }
+    for (auto &worker : _workers)
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        for (size_t p = 0; p < TASK_PRIORITIES; p++)
+        {
+            for (Job &job : worker->queues[p])
+                leftover.emplace_back(p, std::move(job));
+            worker->queues[p].clear();
+        }
+    }
+    for (auto &[p, job] : leftover)
+    {
+        _queued[p]--;
+        _cancelled[p]++;
+        if (job.onCancel)
+            job.onCancel();
+    }
+
+    PrintLog(std::cout, CYAN "TaskScheduler" RESET " - stopped");
+}
+
+void TaskScheduler::post(TaskPriority priority, std::function<void()> fn, CancellationToken token)
+{
+    Job job;
+    job.fn = std::move(fn);
+    job.token = std::move(token);
+    enqueue(priority, std::move(job));
+}
+
+void TaskScheduler::enqueue(TaskPriority priority, Job job)
+{
+    size_t p = static_cast<size_t>(priority);
+    job.enqueued = std::chrono::steady_clock::now();
+
+    // Counted before it is visible: a worker may take and finish it at once.
+    // The global queue is checked against shutdown under its lock, so a job
+    // either lands before the destructor drains it or is cancelled here
+    bool accepted = false;
+    if (t_scheduler == this)
+    {
+        // Jobs spawned by a worker stay local (hot caches), the destructor
+        // drains them after the workers are joined
+        Worker &self = *_workers[t_workerIndex];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        _queued[p]++;
+        self.queues[p].push_back(std::move(job));
+        accepted = true;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(_globalMutex);
+        if (_running)
+        {
+            _queued[p]++;
+            _global[p].push_back(std::move(job));
+            accepted = true;
+        }
+    }
+    if (!accepted)
+    {
+        if (job.onCancel)
+            job.onCancel();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _sleepCv.notify_one();
+}
+
+// Own deque (newest first) -> global queue -> steal from others (oldest first)
+bool TaskScheduler::popJob(size_t index, TaskPriority priority, Job &job)
+{
+    size_t p = static_cast<size_t>(priority);
+
+    {
+        Worker &self = *_workers[index];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if (!self.queues[p].empty())
+        {
+            job = std::move(self.queues[p].back());
+            self.queues[p].pop_back();
+            return true;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_globalMutex);
+        if (!_global[p].empty())
+        {
+            job = std::move(_global[p].front());
+            _global[p].pop_front();
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < _workers.size(); offset++)
+    {
+        Worker &victim = *_workers[(index + offset) % _workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queues[p].empty())
+        {
+            job = std::move(victim.queues[p].front());
+            victim.queues[p].pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::findJob(size_t index, Job &job, TaskPriority &priority)
+{
+    size_t interactive = static_cast<size_t>(TaskPriority::Interactive);
+    size_t background = static_cast<size_t>(TaskPriority::Background);
+
+    if (_queued[interactive] > 0 && popJob(index, TaskPriority::Interactive, job))
+    {
+        priority = TaskPriority::Interactive;
+        return true;
+    }
+
+    // Reserve a background slot before taking the job
+    if (_queued[background] > 0)
+    {
+        size_t active = _active[background];
+        while (active < _maxBackground)
+        {
+            if (_active[background].compare_exchange_weak(active, active + 1))
+            {
+                if (popJob(index, TaskPriority::Background, job))
+                {
+                    priority = TaskPriority::Background;
+                    return true;
+                }
+                _active[background]--;
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::runJob(Job &job, TaskPriority priority)
+{
+    size_t p = static_cast<size_t>(priority);
+    _queued[p]--;
+
+    // Background slots were reserved in findJob
+    if (priority == TaskPriority::Interactive)
+        _active[p]++;
+
+    long long waitUs = elapsedUs(job.enqueued);
+    _totalWaitUs[p] += waitUs;
+    long long maxWait = _maxWaitUs[p];
+    while (waitUs > maxWait && !_maxWaitUs[p].compare_exchange_weak(maxWait, waitUs))
+        ;
+
+    if (job.token.isCancelled())
+    {
+        _cancelled[p]++;
+        if (job.onCancel)
+            job.onCancel();
+    }
+    else
+    {
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            _executors[p]->run(job.fn);
+        }
+        catch (const std::exception &e)
+        {
+            PrintLog(std::cerr, RED "TaskScheduler - job failed: %s" RESET, e.what());
+        }
+        catch (...)
+        {
+            PrintLog(std::cerr, RED "TaskScheduler - job failed: unknown exception" RESET);
+        }
+        _totalRunUs[p] += elapsedUs(start);
+        _completed[p]++;
+    }
+
+    _active[p]--;
+}
+
+void TaskScheduler::workerLoop(size_t index)
+{
+    t_scheduler = this;
+    t_workerIndex = index;
+
+    while (true)
+    {
+        Job job;
+        TaskPriority priority;
+        if (findJob(index, job, priority))
+        {
+            runJob(job, priority);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        if (!_running)
+            break;
+        _sleepCv.wait_for(lock, std::chrono::milliseconds(SCHEDULER_IDLE_WAIT_MS));
+        if (!_running)
+            break;
+    }
+
+    t_scheduler = nullptr;
+}
+
+Executor &TaskScheduler::executor(TaskPriority priority)
+{
+    return *_executors[static_cast<size_t>(priority)];
+}
+
+SchedulerStats TaskScheduler::getStats() const
+{
+    SchedulerStats stats;
+    stats.workers = _workers.size();
+
+    for (size_t p = 0; p < TASK_PRIORITIES; p++)
+    {
+        unsigned long long done = _completed[p];
+        unsigned long long dropped = _cancelled[p];
+        unsigned long long started = done + dropped;
+
+        stats.queued[p] = _queued[p];
+        stats.running[p] = _active[p];
+        stats.completed[p] = done;
+        stats.cancelled[p] = dropped;
+        stats.avgWaitMs[p] = started ? _totalWaitUs[p] / 1000.0 / started : 0.0;
+        stats.maxWaitMs[p] = _maxWaitUs[p] / 1000.0;
+        stats.avgRunMs[p] = done ? _totalRunUs[p] / 1000.0 / done : 0.0;
+    }
+    return stats;
+}
+
+size_t TaskScheduler::workerCount() const
+{
+    return _workers.size();
+}
+
+void TaskScheduler::waitIdle() const
+{
+    while (true)
+    {
+        bool idle = true;
+        for (size_t p = 0; p < TASK_PRIORITIES; p++)
+            if (_queued[p] > 0 || _active[p] > 0)
+                idle = false;
+        if (idle)
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
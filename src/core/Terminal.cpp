@@ -0,0 +1,62 @@
+#include "Terminal.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+bool writeAll(int fd, SecretView data)
+{
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+SecureString readSecret(const char *prompt)
+{
+    int fd = STDIN_FILENO;
+    int tty = -1;
+    struct termios saved;
+    bool restore = false;
+
+    if (isatty(STDIN_FILENO))
+    {
+        tty = open("/dev/tty", O_RDWR | O_CLOEXEC);
+        if (tty >= 0)
+        {
+            fd = tty;
+            if (tcgetattr(tty, &saved) == 0)
+            {
+                struct termios noecho = saved;
+                noecho.c_lflag &= ~ECHO;
+                restore = tcsetattr(tty, TCSAFLUSH, &noecho) == 0;
+            }
+            writeAll(tty, SecretView(prompt, strlen(prompt)));
+        }
+    }
+
+    // Byte by byte so nothing past the line is buffered outside secure memory
+    SecureChars line;
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '\n')
+        line.push_back(c);
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+
+    if (restore)
+    {
+        tcsetattr(tty, TCSAFLUSH, &saved);
+        writeAll(tty, SecretView("\n", 1));
+    }
+    if (tty >= 0)
+        close(tty);
+
+    return SecureString(line.data(), line.size());
+}
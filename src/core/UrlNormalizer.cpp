@@ -0,0 +1,261 @@
+#include "UrlNormalizer.hpp"
+#include "PublicSuffixTrie.hpp"
+
+#include <algorithm>
+
+// RFC 3492 parameters
+#define PUNY_BASE 36
+#define PUNY_TMIN 1
+#define PUNY_TMAX 26
+#define PUNY_SKEW 38
+#define PUNY_DAMP 700
+#define PUNY_INITIAL_BIAS 72
+#define PUNY_INITIAL_N 0x80
+
+static bool decodeUtf8(const std::string &text, std::u32string &out)
+{
+    out.clear();
+    size_t i = 0;
+    while (i < text.size())
+    {
+        unsigned char c = text[i];
+        size_t extra;
+        char32_t cp;
+        if (c < 0x80)
+        {
+            extra = 0;
+            cp = c;
+        }
+        else if ((c & 0xE0) == 0xC0)
+        {
+            extra = 1;
+            cp = c & 0x1F;
+        }
+        else if ((c & 0xF0) == 0xE0)
+        {
+            extra = 2;
+            cp = c & 0x0F;
+        }
+        else if ((c & 0xF8) == 0xF0)
+        {
+            extra = 3;
+            cp = c & 0x07;
+        }
+        else
+            return false;
+
+        if (i + extra >= text.size() && extra > 0)
+            return false;
+        for (size_t k = 1; k <= extra; k++)
+        {
+            unsigned char next = text[i + k];
+            if ((next & 0xC0) != 0x80)
+                return false;
+            cp = (cp << 6) | (next & 0x3F);
+        }
+
+        // Reject overlong forms, surrogates and out of range code points
+        static const char32_t minimum[] = {0, 0x80, 0x800, 0x10000};
+        if (cp < minimum[extra] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            return false;
+
+        out.push_back(cp);
+        i += extra + 1;
+    }
+    return true;
+}
+
+static char punyDigit(uint32_t d)
+{
+    return static_cast<char>(d < 26 ? 'a' + d : '0' + (d - 26));
+}
+
+static uint32_t punyAdapt(uint32_t delta, uint32_t points, bool first)
+{
+    delta = first ? delta / PUNY_DAMP : delta / 2;
+    delta += delta / points;
+
+    uint32_t k = 0;
+    while (delta > ((PUNY_BASE - PUNY_TMIN) * PUNY_TMAX) / 2)
+    {
+        delta /= PUNY_BASE - PUNY_TMIN;
+        k += PUNY_BASE;
+    }
+    return k + (PUNY_BASE - PUNY_TMIN + 1) * delta / (delta + PUNY_SKEW);
+}
+
+bool punycodeEncode(const std::string &label, std::string &out)
+{
+    std::u32string input;
+    if (!decodeUtf8(label, input))
+        return false;
+
+    // Basic code points first, then the delimiter
+    out.clear();
+    for (char32_t cp : input)
+        if (cp < 0x80)
+            out.push_back(static_cast<char>(cp));
+    uint32_t basic = static_cast<uint32_t>(out.size());
+    uint32_t handled = basic;
+    if (basic > 0)
+        out.push_back('-');
+
+    uint32_t n = PUNY_INITIAL_N;
+    uint32_t delta = 0;
+    uint32_t bias = PUNY_INITIAL_BIAS;
+    while (handled < input.size())
+    {
+        // Smallest code point not handled yet
+        uint32_t m = 0x10FFFF + 1;
+        for (char32_t cp : input)
+            if (cp >= n && cp < m)
+                m = cp;
+
+        if ((m - n) > (UINT32_MAX - delta) / (handled + 1))
+            return false;
+        delta += (m - n) * (handled + 1);
+        n = m;
+
+        for (char32_t cp : input)
+        {
+            if (cp < n && ++delta == 0)
+                return false;
+            if (cp != n)
+                continue;
+
+            // Variable length integer for delta
+            uint32_t q = delta;
+            for (uint32_t k = PUNY_BASE;; k += PUNY_BASE)
+            {
+                uint32_t t = (k <= bias) ? PUNY_TMIN : (k >= bias + PUNY_TMAX) ? PUNY_TMAX : k - bias;
+                if (q < t)
+                    break;
+                out.push_back(punyDigit(t + (q - t) % (PUNY_BASE - t)));
+                q = (q - t) / (PUNY_BASE - t);
+            }
+            out.push_back(punyDigit(q));
+            bias = punyAdapt(delta, handled + 1, handled == basic);
+            delta = 0;
+            handled++;
+        }
+        delta++;
+        n++;
+    }
+    return true;
+}
+
+static std::string trim(const std::string &text)
+{
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+        return "";
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(start, end - start + 1);
+}
+
+static bool isIpAddress(const std::string &host)
+{
+    if (host.find(':') != std::string::npos)
+        return true; // IPv6, brackets already stripped
+    return !host.empty() && std::all_of(host.begin(), host.end(),
+                                        [](unsigned char c) { return std::isdigit(c) || c == '.'; });
+}
+
+std::string normalizeHost(const std::string &url)
+{
+    std::string host = trim(url);
+
+    // Scheme ("https://", "android://") or scheme relative "//"
+    size_t scheme = host.find("://");
+    if (scheme != std::string::npos && host.find_first_of("/?#") > scheme)
+        host.erase(0, scheme + 3);
+    else if (host.rfind("//", 0) == 0)
+        host.erase(0, 2);
+
+    // Path, query and fragment
+    size_t path = host.find_first_of("/?#");
+    if (path != std::string::npos)
+        host.erase(path);
+
+    // user:pass@
+    size_t at = host.rfind('@');
+    if (at != std::string::npos)
+        host.erase(0, at + 1);
+
+    // [::1]:8080 or host:port
+    if (!host.empty() && host[0] == '[')
+    {
+        size_t close = host.find(']');
+        host = host.substr(1, close == std::string::npos ? std::string::npos : close - 1);
+    }
+    else
+    {
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos && host.find(':') == colon
+            && std::all_of(host.begin() + colon + 1, host.end(), [](unsigned char c) { return std::isdigit(c); }))
+            host.erase(colon);
+    }
+
+    // IDNA dots (U+3002, U+FF0E, U+FF61) are label separators too
+    static const char *dots[] = {"\xE3\x80\x82", "\xEF\xBC\x8E", "\xEF\xBD\xA1"};
+    std::string dotted;
+    dotted.reserve(host.size());
+    size_t segment = 0;
+    for (size_t pos = 0; pos + 3 <= host.size(); pos++)
+    {
+        if (std::none_of(std::begin(dots), std::end(dots),
+                         [&](const char *dot) { return host.compare(pos, 3, dot) == 0; }))
+            continue;
+        dotted.append(host, segment, pos - segment);
+        dotted += '.';
+        segment = pos + 3;
+        pos += 2;
+    }
+    dotted.append(host, segment, std::string::npos);
+    host.swap(dotted);
+
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) { return c < 0x80 ? std::tolower(c) : c; });
+    while (!host.empty() && host.back() == '.')
+        host.pop_back();
+    if (host.rfind("www.", 0) == 0 && host.find('.', 4) != std::string::npos)
+        host.erase(0, 4);
+
+    // Punycode every label holding non ASCII bytes, keep it raw if it is not UTF-8
+    std::string result;
+    size_t start = 0;
+    while (start <= host.size())
+    {
+        size_t dot = host.find('.', start);
+        std::string label = host.substr(start, dot == std::string::npos ? std::string::npos : dot - start);
+
+        std::string encoded;
+        bool ascii = std::all_of(label.begin(), label.end(), [](unsigned char c) { return c < 0x80; });
+        if (!ascii && punycodeEncode(label, encoded))
+            label = "xn--" + encoded;
+
+        if (start > 0)
+            result += '.';
+        result += label;
+        if (dot == std::string::npos)
+            break;
+        start = dot + 1;
+    }
+    return result;
+}
+
+NormalizedUrl normalizeUrl(const std::string &url)
+{
+    NormalizedUrl normalized;
+    normalized.host = normalizeHost(url);
+
+    if (normalized.host.find('.') == std::string::npos || isIpAddress(normalized.host))
+        normalized.domain = normalized.host;
+    else
+    {
+        normalized.domain = PublicSuffixTrie::builtin().registrableDomain(normalized.host);
+        if (normalized.domain.empty())
+            normalized.domain = normalized.host;
+    }
+    return normalized;
+}
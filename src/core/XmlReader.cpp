@@ -0,0 +1,337 @@
+#include "XmlReader.hpp"
+
+#include <algorithm>
+
+// Longest entity or character reference, "&#x10FFFF;"
+#define XML_MAX_ENTITY 12
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void appendUtf8(SecureChars &out, uint32_t cp)
+{
+    if (cp < 0x80)
+        out.push_back(static_cast<char>(cp));
+    else if (cp < 0x800)
+    {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000)
+    {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+XmlReader::XmlReader(XmlHandler &handler) : _handler(handler), _started(false), _done(false) {}
+
+XmlReader::~XmlReader() {}
+
+void XmlReader::feed(const char *data, size_t length)
+{
+    _buffer.insert(_buffer.end(), data, data + length);
+    size_t used = parse(false);
+    _buffer.erase(_buffer.begin(), _buffer.begin() + used);
+    if (_buffer.size() > XML_MAX_TOKEN)
+        throw std::runtime_error("XML token too long");
+}
+
+void XmlReader::finish()
+{
+    parse(true);
+    _buffer.clear();
+    if (!_done)
+        throw std::runtime_error("XML document is incomplete");
+}
+
+// Entities and line ends of data appended to out
+void XmlReader::decode(const char *data, size_t length, SecureChars &out) const
+{
+    const char *end = data + length;
+    while (data < end)
+    {
+        const char *special = std::find_if(data, end, [](char c) { return c == '&' || c == '\r'; });
+        out.insert(out.end(), data, special);
+        if (special == end)
+            break;
+        data = special + 1;
+
+        // CR LF and lone CR are read as LF
+        if (*special == '\r')
+        {
+            out.push_back('\n');
+            if (data < end && *data == '\n')
+                data++;
+            continue;
+        }
+
+        const char *semi = std::find(data, std::min(end, data + XML_MAX_ENTITY), ';');
+        if (semi == std::min(end, data + XML_MAX_ENTITY))
+            throw std::runtime_error("XML entity is not terminated");
+        std::string_view entity(data, semi - data);
+        data = semi + 1;
+
+        if (entity == "lt")
+            out.push_back('<');
+        else if (entity == "gt")
+            out.push_back('>');
+        else if (entity == "amp")
+            out.push_back('&');
+        else if (entity == "quot")
+            out.push_back('"');
+        else if (entity == "apos")
+            out.push_back('\'');
+        else if (entity.size() > 1 && entity[0] == '#')
+        {
+            bool hex = entity[1] == 'x';
+            std::string digits(entity.substr(hex ? 2 : 1));
+            char *stop = nullptr;
+            unsigned long cp = strtoul(digits.c_str(), &stop, hex ? 16 : 10);
+            if (digits.empty() || *stop != '\0' || !isxdigit(static_cast<unsigned char>(digits[0]))
+                || cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+                throw std::runtime_error("invalid XML character reference");
+            appendUtf8(out, cp);
+        }
+        else
+            throw std::runtime_error("unknown XML entity &" + std::string(entity) + ";");
+    }
+}
+
+void XmlReader::emitText(const char *data, size_t length)
+{
+    // Only white space may surround the root element
+    if (_open.empty())
+    {
+        if (!std::all_of(data, data + length, isSpace))
+            throw std::runtime_error("XML text outside the root element");
+        return;
+    }
+
+    _text.clear();
+    decode(data, length, _text);
+    _handler.text(std::string_view(_text.data(), _text.size()));
+    OPENSSL_cleanse(_text.data(), _text.size());
+}
+
+// Start or end tag between the '<' at start and the '>' at end
+size_t XmlReader::parseTag(size_t start, size_t end)
+{
+    const char *b = _buffer.data();
+    size_t i = start + 1;
+    bool closing = b[i] == '/';
+    if (closing)
+        i++;
+
+    size_t nameStart = i;
+    while (i < end && !isSpace(b[i]) && b[i] != '/')
+        i++;
+    std::string_view name(b + nameStart, i - nameStart);
+    if (name.empty())
+        throw std::runtime_error("XML tag without a name");
+
+    if (closing)
+    {
+        while (i < end && isSpace(b[i]))
+            i++;
+        if (i != end || _open.empty() || _open.back() != name)
+            throw std::runtime_error("unexpected XML end tag </" + std::string(name) + ">");
+        _handler.endElement(name);
+        _open.pop_back();
+        _done = _open.empty();
+        return end + 1;
+    }
+    if (_done)
+        throw std::runtime_error("XML content after the root element");
+    if (_open.size() >= XML_MAX_DEPTH)
+        throw std::runtime_error("XML nesting too deep");
+
+    bool empty = b[end - 1] == '/';
+    size_t attributesEnd = empty ? end - 1 : end;
+
+    // Values are decoded into _text first, the views are taken once it stops growing
+    struct Offsets
+    {
+        size_t name;
+        size_t nameLength;
+        size_t value;
+        size_t valueLength;
+    };
+    std::vector<Offsets> offsets;
+    _text.clear();
+    while (true)
+    {
+        while (i < attributesEnd && isSpace(b[i]))
+            i++;
+        if (i >= attributesEnd)
+            break;
+
+        size_t attrName = i;
+        while (i < attributesEnd && b[i] != '=' && !isSpace(b[i]))
+            i++;
+        size_t attrNameLength = i - attrName;
+        while (i < attributesEnd && isSpace(b[i]))
+            i++;
+        if (attrNameLength == 0 || i >= attributesEnd || b[i] != '=')
+            throw std::runtime_error("malformed XML attribute in <" + std::string(name) + ">");
+        i++;
+        while (i < attributesEnd && isSpace(b[i]))
+            i++;
+        if (i >= attributesEnd || (b[i] != '"' && b[i] != '\''))
+            throw std::runtime_error("unquoted XML attribute in <" + std::string(name) + ">");
+
+        char quote = b[i++];
+        const char *close = std::find(b + i, b + attributesEnd, quote);
+        if (close == b + attributesEnd)
+            throw std::runtime_error("malformed XML attribute in <" + std::string(name) + ">");
+        size_t value = _text.size();
+        decode(b + i, close - (b + i), _text);
+        offsets.push_back({attrName, attrNameLength, value, _text.size() - value});
+        i = close - b + 1;
+    }
+
+    _attributes.clear();
+    for (const Offsets &o : offsets)
+        _attributes.push_back({std::string_view(b + o.name, o.nameLength),
+                               std::string_view(_text.data() + o.value, o.valueLength)});
+
+    _open.emplace_back(name);
+    _handler.startElement(name, _attributes);
+    if (empty)
+    {
+        _handler.endElement(name);
+        _open.pop_back();
+        _done = _open.empty();
+    }
+    OPENSSL_cleanse(_text.data(), _text.size());
+    return end + 1;
+}
+
+// Parse what _buffer holds, returns how many bytes were used. Unless final,
+// a token cut by the end of the buffer is left for the next feed
+size_t XmlReader::parse(bool final)
+{
+    const char *b = _buffer.data();
+    size_t size = _buffer.size();
+    size_t pos = 0;
+
+    auto incomplete = [final]()
+    {
+        if (final)
+            throw std::runtime_error("XML document is incomplete");
+    };
+    auto startsWith = [&](const char *prefix, bool &partial)
+    {
+        size_t length = strlen(prefix);
+        size_t avail = size - pos;
+        partial = avail < length && memcmp(b + pos, prefix, avail) == 0;
+        return avail >= length && memcmp(b + pos, prefix, length) == 0;
+    };
+    auto find = [&](size_t from, const char *needle) -> size_t
+    {
+        std::string_view hay(b, size);
+        return hay.find(needle, from);
+    };
+
+    // UTF-8 byte order mark
+    if (!_started)
+    {
+        static const char bom[] = "\xEF\xBB\xBF";
+        if (!final && size < 3 && memcmp(b, bom, size) == 0)
+            return 0;
+        _started = true;
+        if (size >= 3 && memcmp(b, bom, 3) == 0)
+            pos = 3;
+    }
+
+    while (pos < size)
+    {
+        if (b[pos] != '<')
+        {
+            const char *lt = static_cast<const char *>(memchr(b + pos, '<', size - pos));
+            size_t end = lt ? lt - b : size;
+            if (!lt && !final)
+            {
+                // Keep an entity or a CR cut by the end of the buffer
+                size_t amp = std::string_view(b, size).rfind('&');
+                if (amp != std::string_view::npos && amp >= pos && !memchr(b + amp, ';', size - amp))
+                    end = amp;
+                else if (b[end - 1] == '\r')
+                    end--;
+            }
+            if (end > pos)
+                emitText(b + pos, end - pos);
+            pos = end;
+            if (!lt)
+                break;
+            continue;
+        }
+
+        bool partialComment;
+        bool partialCData;
+        bool comment = startsWith("<!--", partialComment);
+        bool cdata = startsWith("<![CDATA[", partialCData);
+        bool partialPi;
+        bool pi = startsWith("<?", partialPi);
+        if (partialComment || partialCData || partialPi)
+        {
+            incomplete();
+            break;
+        }
+
+        if (comment || cdata || pi)
+        {
+            const char *terminator = comment ? "-->" : cdata ? "]]>" : "?>";
+            size_t end = find(pos + (cdata ? 9 : 2), terminator);
+            if (end == std::string_view::npos)
+            {
+                incomplete();
+                break;
+            }
+            if (cdata)
+            {
+                if (_open.empty())
+                    throw std::runtime_error("XML CDATA outside the root element");
+                _handler.text(std::string_view(b + pos + 9, end - pos - 9));
+            }
+            pos = end + strlen(terminator);
+            continue;
+        }
+        if (size - pos >= 2 && b[pos + 1] == '!')
+            throw std::runtime_error("XML DTDs are not supported");
+
+        // Element tag, '>' may appear in quoted attribute values
+        size_t end = pos + 1;
+        char quote = 0;
+        for (; end < size; end++)
+        {
+            char c = b[end];
+            if (quote)
+            {
+                if (c == quote)
+                    quote = 0;
+            }
+            else if (c == '"' || c == '\'')
+                quote = c;
+            else if (c == '>')
+                break;
+        }
+        if (end == size)
+        {
+            incomplete();
+            break;
+        }
+        pos = parseTag(pos, end);
+    }
+    return pos;
+}
@@ -0,0 +1,435 @@
+#include "Argon2.hpp"
+
+// ============ BLAKE2B ============
+
+static const uint64_t BLAKE2B_IV[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+static const uint8_t BLAKE2B_SIGMA[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+};
+
+static inline uint64_t rotr64(uint64_t x, unsigned n)
+{
+    return (x >> n) | (x << (64 - n));
+}
+
+static inline uint64_t load64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static inline void store64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = static_cast<unsigned char>(v >> (8 * i));
+}
+
+Blake2b::Blake2b(size_t outLength) : _t{0, 0}, _filled(0), _outLength(outLength)
+{
+    if (outLength == 0 || outLength > BLAKE2B_MAX_OUT)
+        throw std::invalid_argument("BLAKE2b output length");
+    memcpy(_h, BLAKE2B_IV, sizeof(_h));
+    // Parameter block: digest length, no key, fanout and depth 1
+    _h[0] ^= 0x01010000ULL ^ outLength;
+}
+
+Blake2b::~Blake2b()
+{
+    OPENSSL_cleanse(_h, sizeof(_h));
+    OPENSSL_cleanse(_buffer, sizeof(_buffer));
+}
+
+void Blake2b::compress(const unsigned char *block, bool last)
+{
+    uint64_t m[16];
+    uint64_t v[16];
+    for (int i = 0; i < 16; i++)
+        m[i] = load64(block + 8 * i);
+    for (int i = 0; i < 8; i++)
+    {
+        v[i] = _h[i];
+        v[i + 8] = BLAKE2B_IV[i];
+    }
+    v[12] ^= _t[0];
+    v[13] ^= _t[1];
+    if (last)
+        v[14] = ~v[14];
+
+    auto g = [&v](int a, int b, int c, int d, uint64_t x, uint64_t y)
+    {
+        v[a] = v[a] + v[b] + x;
+        v[d] = rotr64(v[d] ^ v[a], 32);
+        v[c] = v[c] + v[d];
+        v[b] = rotr64(v[b] ^ v[c], 24);
+        v[a] = v[a] + v[b] + y;
+        v[d] = rotr64(v[d] ^ v[a], 16);
+        v[c] = v[c] + v[d];
+        v[b] = rotr64(v[b] ^ v[c], 63);
+    };
+    for (int r = 0; r < 12; r++)
+    {
+        const uint8_t *s = BLAKE2B_SIGMA[r];
+        g(0, 4, 8, 12, m[s[0]], m[s[1]]);
+        g(1, 5, 9, 13, m[s[2]], m[s[3]]);
+        g(2, 6, 10, 14, m[s[4]], m[s[5]]);
+        g(3, 7, 11, 15, m[s[6]], m[s[7]]);
+        g(0, 5, 10, 15, m[s[8]], m[s[9]]);
+        g(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        g(2, 7, 8, 13, m[s[12]], m[s[13]]);
+        g(3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; i++)
+        _h[i] ^= v[i] ^ v[i + 8];
+    OPENSSL_cleanse(m, sizeof(m));
+    OPENSSL_cleanse(v, sizeof(v));
+}
+
+Blake2b &Blake2b::update(const void *data, size_t length)
+{
+    const unsigned char *in = static_cast<const unsigned char *>(data);
+    while (length > 0)
+    {
+        // The last block is compressed by final(), so a full buffer waits for more input
+        if (_filled == BLAKE2B_BLOCK_SIZE)
+        {
+            _t[0] += BLAKE2B_BLOCK_SIZE;
+            if (_t[0] < BLAKE2B_BLOCK_SIZE)
+                _t[1]++;
+            compress(_buffer, false);
+            _filled = 0;
+        }
+        size_t take = std::min(length, BLAKE2B_BLOCK_SIZE - _filled);
+        memcpy(_buffer + _filled, in, take);
+        _filled += take;
+        in += take;
+        length -= take;
+    }
+    return *this;
+}
+
+Blake2b &Blake2b::updateU32(uint32_t value)
+{
+    unsigned char bytes[4] = {
+        static_cast<unsigned char>(value), static_cast<unsigned char>(value >> 8),
+        static_cast<unsigned char>(value >> 16), static_cast<unsigned char>(value >> 24)};
+    return update(bytes, sizeof(bytes));
+}
+
+void Blake2b::final(unsigned char *out)
+{
+    _t[0] += _filled;
+    if (_t[0] < _filled)
+        _t[1]++;
+    memset(_buffer + _filled, 0, BLAKE2B_BLOCK_SIZE - _filled);
+    compress(_buffer, true);
+
+    unsigned char digest[BLAKE2B_MAX_OUT];
+    for (int i = 0; i < 8; i++)
+        store64(digest + 8 * i, _h[i]);
+    memcpy(out, digest, _outLength);
+    OPENSSL_cleanse(digest, sizeof(digest));
+}
+
+// ============ ARGON2 ============
+
+#define ARGON2_QWORDS (ARGON2_BLOCK_SIZE / 8)
+#define ARGON2_ADDRESSES_IN_BLOCK ARGON2_QWORDS
+#define ARGON2_PREHASH_SIZE 64
+
+struct Argon2Block
+{
+    uint64_t v[ARGON2_QWORDS];
+};
+
+// Variable length hash H' of RFC 9106 3.3, input is prefix || data
+static void hashLong(unsigned char *out, size_t outLength, const unsigned char *data, size_t length)
+{
+    if (outLength <= BLAKE2B_MAX_OUT)
+    {
+        Blake2b(outLength).updateU32(outLength).update(data, length).final(out);
+        return;
+    }
+
+    unsigned char v[BLAKE2B_MAX_OUT];
+    Blake2b(BLAKE2B_MAX_OUT).updateU32(outLength).update(data, length).final(v);
+    memcpy(out, v, BLAKE2B_MAX_OUT / 2);
+    out += BLAKE2B_MAX_OUT / 2;
+    size_t remaining = outLength - BLAKE2B_MAX_OUT / 2;
+    while (remaining > BLAKE2B_MAX_OUT)
+    {
+        Blake2b(BLAKE2B_MAX_OUT).update(v, BLAKE2B_MAX_OUT).final(v);
+        memcpy(out, v, BLAKE2B_MAX_OUT / 2);
+        out += BLAKE2B_MAX_OUT / 2;
+        remaining -= BLAKE2B_MAX_OUT / 2;
+    }
+    Blake2b(remaining).update(v, BLAKE2B_MAX_OUT).final(out);
+    OPENSSL_cleanse(v, sizeof(v));
+}
+
+static inline uint64_t blaMka(uint64_t x, uint64_t y)
+{
+    return x + y + 2 * (x & 0xffffffffULL) * (y & 0xffffffffULL);
+}
+
+static inline void mixG(uint64_t &a, uint64_t &b, uint64_t &c, uint64_t &d)
+{
+    a = blaMka(a, b);
+    d = rotr64(d ^ a, 32);
+    c = blaMka(c, d);
+    b = rotr64(b ^ c, 24);
+    a = blaMka(a, b);
+    d = rotr64(d ^ a, 16);
+    c = blaMka(c, d);
+    b = rotr64(b ^ c, 63);
+}
+
+// BLAKE2b round without message on 16 words picked by index
+static inline void roundNoMsg(uint64_t *v, const int *i)
+{
+    mixG(v[i[0]], v[i[4]], v[i[8]], v[i[12]]);
+    mixG(v[i[1]], v[i[5]], v[i[9]], v[i[13]]);
+    mixG(v[i[2]], v[i[6]], v[i[10]], v[i[14]]);
+    mixG(v[i[3]], v[i[7]], v[i[11]], v[i[15]]);
+    mixG(v[i[0]], v[i[5]], v[i[10]], v[i[15]]);
+    mixG(v[i[1]], v[i[6]], v[i[11]], v[i[12]]);
+    mixG(v[i[2]], v[i[7]], v[i[8]], v[i[13]]);
+    mixG(v[i[3]], v[i[4]], v[i[9]], v[i[14]]);
+}
+
+// Compression G: next = P(prev ^ ref) ^ prev ^ ref (^ next with withXor)
+static void fillBlock(const Argon2Block &prev, const Argon2Block &ref, Argon2Block &next, bool withXor)
+{
+    Argon2Block r;
+    Argon2Block tmp;
+    for (int i = 0; i < ARGON2_QWORDS; i++)
+        r.v[i] = prev.v[i] ^ ref.v[i];
+    tmp = r;
+    if (withXor)
+        for (int i = 0; i < ARGON2_QWORDS; i++)
+            tmp.v[i] ^= next.v[i];
+
+    int index[16];
+    // Rows: 16 consecutive words
+    for (int row = 0; row < 8; row++)
+    {
+        for (int k = 0; k < 16; k++)
+            index[k] = 16 * row + k;
+        roundNoMsg(r.v, index);
+    }
+    // Columns: word pairs 2i, 2i + 1 of every row
+    for (int col = 0; col < 8; col++)
+    {
+        for (int k = 0; k < 8; k++)
+        {
+            index[2 * k] = 2 * col + 16 * k;
+            index[2 * k + 1] = 2 * col + 16 * k + 1;
+        }
+        roundNoMsg(r.v, index);
+    }
+
+    for (int i = 0; i < ARGON2_QWORDS; i++)
+        next.v[i] = tmp.v[i] ^ r.v[i];
+}
+
+struct Argon2Instance
+{
+    std::vector<Argon2Block> memory;
+    uint32_t passes;
+    uint32_t lanes;
+    uint32_t laneLength;
+    uint32_t segmentLength;
+    uint32_t memoryBlocks;
+    uint32_t version;
+    Argon2Type type;
+};
+
+static uint32_t indexAlpha(const Argon2Instance &inst, uint32_t pass, uint32_t slice, uint32_t index,
+                           uint32_t pseudoRand, bool sameLane)
+{
+    uint32_t areaSize;
+    if (pass == 0)
+    {
+        if (slice == 0)
+            areaSize = index - 1;
+        else if (sameLane)
+            areaSize = slice * inst.segmentLength + index - 1;
+        else
+            areaSize = slice * inst.segmentLength + (index == 0 ? -1 : 0);
+    }
+    else if (sameLane)
+        areaSize = inst.laneLength - inst.segmentLength + index - 1;
+    else
+        areaSize = inst.laneLength - inst.segmentLength + (index == 0 ? -1 : 0);
+
+    uint64_t relative = pseudoRand;
+    relative = relative * relative >> 32;
+    relative = areaSize - 1 - (static_cast<uint64_t>(areaSize) * relative >> 32);
+
+    uint32_t start = 0;
+    if (pass != 0)
+        start = slice == ARGON2_SYNC_POINTS - 1 ? 0 : (slice + 1) * inst.segmentLength;
+    return (start + relative) % inst.laneLength;
+}
+
+static void fillSegment(Argon2Instance &inst, uint32_t pass, uint32_t lane, uint32_t slice)
+{
+    bool independent = inst.type == Argon2Type::I || (inst.type == Argon2Type::ID && pass == 0 && slice < 2);
+
+    Argon2Block zero = {};
+    Argon2Block input = {};
+    Argon2Block addresses = {};
+    auto nextAddresses = [&]()
+    {
+        input.v[6]++;
+        fillBlock(zero, input, addresses, false);
+        fillBlock(zero, addresses, addresses, false);
+    };
+    if (independent)
+    {
+        input.v[0] = pass;
+        input.v[1] = lane;
+        input.v[2] = slice;
+        input.v[3] = inst.memoryBlocks;
+        input.v[4] = inst.passes;
+        input.v[5] = static_cast<uint64_t>(inst.type);
+    }
+
+    // The first two blocks of every lane come from the pre-hash
+    uint32_t start = 0;
+    if (pass == 0 && slice == 0)
+    {
+        start = 2;
+        if (independent)
+            nextAddresses();
+    }
+
+    uint32_t current = lane * inst.laneLength + slice * inst.segmentLength + start;
+    uint32_t previous = current % inst.laneLength == 0 ? current + inst.laneLength - 1 : current - 1;
+
+    for (uint32_t i = start; i < inst.segmentLength; i++, current++, previous++)
+    {
+        if (current % inst.laneLength == 1)
+            previous = current - 1;
+
+        uint64_t pseudoRand;
+        if (independent)
+        {
+            if (i % ARGON2_ADDRESSES_IN_BLOCK == 0)
+                nextAddresses();
+            pseudoRand = addresses.v[i % ARGON2_ADDRESSES_IN_BLOCK];
+        }
+        else
+            pseudoRand = inst.memory[previous].v[0];
+
+        uint32_t refLane = (pseudoRand >> 32) % inst.lanes;
+        if (pass == 0 && slice == 0)
+            refLane = lane;
+        uint32_t refIndex = indexAlpha(inst, pass, slice, i, pseudoRand & 0xffffffffULL, refLane == lane);
+
+        const Argon2Block &ref = inst.memory[static_cast<size_t>(inst.laneLength) * refLane + refIndex];
+        // Version 1.3 overwrites blocks of later passes by XOR
+        fillBlock(inst.memory[previous], ref, inst.memory[current], inst.version != ARGON2_VERSION_10 && pass != 0);
+    }
+}
+
+void argon2Hash(const Argon2Params &params, SecretView password,
+                unsigned char *out, size_t outLength, TaskScheduler *scheduler)
+{
+    if (params.lanes == 0 || params.lanes > 0xffffff || params.iterations == 0 || outLength < 4
+        || params.salt.size() < 8 || params.memoryKiB < 8 * params.lanes
+        || (params.version != ARGON2_VERSION_10 && params.version != ARGON2_VERSION_13))
+        throw std::invalid_argument("invalid Argon2 parameters");
+
+    Argon2Instance inst;
+    inst.passes = params.iterations;
+    inst.lanes = params.lanes;
+    inst.version = params.version;
+    inst.type = params.type;
+    inst.memoryBlocks = params.memoryKiB / (ARGON2_SYNC_POINTS * params.lanes) * (ARGON2_SYNC_POINTS * params.lanes);
+    inst.laneLength = inst.memoryBlocks / params.lanes;
+    inst.segmentLength = inst.laneLength / ARGON2_SYNC_POINTS;
+    inst.memory.resize(inst.memoryBlocks);
+
+    // H0
+    unsigned char blockHash[ARGON2_PREHASH_SIZE + 8];
+    Blake2b h0(ARGON2_PREHASH_SIZE);
+    h0.updateU32(params.lanes).updateU32(outLength).updateU32(params.memoryKiB)
+      .updateU32(params.iterations).updateU32(params.version).updateU32(static_cast<uint32_t>(params.type));
+    h0.updateU32(password.size()).update(password.data(), password.size());
+    h0.updateU32(params.salt.size()).update(params.salt.data(), params.salt.size());
+    h0.updateU32(params.secret.size()).update(params.secret.data(), params.secret.size());
+    h0.updateU32(params.associated.size()).update(params.associated.data(), params.associated.size());
+    h0.final(blockHash);
+
+    unsigned char bytes[ARGON2_BLOCK_SIZE];
+    for (uint32_t lane = 0; lane < inst.lanes; lane++)
+    {
+        for (uint32_t column = 0; column < 2; column++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                blockHash[ARGON2_PREHASH_SIZE + k] = static_cast<unsigned char>(column >> (8 * k));
+                blockHash[ARGON2_PREHASH_SIZE + 4 + k] = static_cast<unsigned char>(lane >> (8 * k));
+            }
+            hashLong(bytes, ARGON2_BLOCK_SIZE, blockHash, sizeof(blockHash));
+            Argon2Block &block = inst.memory[static_cast<size_t>(lane) * inst.laneLength + column];
+            for (int i = 0; i < ARGON2_QWORDS; i++)
+                block.v[i] = load64(bytes + 8 * i);
+        }
+    }
+
+    // Lanes of one slice only reference finished slices: they fill in parallel
+    for (uint32_t pass = 0; pass < inst.passes; pass++)
+    {
+        for (uint32_t slice = 0; slice < ARGON2_SYNC_POINTS; slice++)
+        {
+            if (!scheduler || inst.lanes == 1)
+            {
+                for (uint32_t lane = 0; lane < inst.lanes; lane++)
+                    fillSegment(inst, pass, lane, slice);
+                continue;
+            }
+            std::vector<std::future<void>> lanes;
+            for (uint32_t lane = 1; lane < inst.lanes; lane++)
+                lanes.push_back(scheduler->submit(TaskPriority::Interactive,
+                    [&inst, pass, lane, slice]() { fillSegment(inst, pass, lane, slice); }));
+            fillSegment(inst, pass, 0, slice);
+            for (std::future<void> &done : lanes)
+                done.get();
+        }
+    }
+
+    // XOR of the last block of every lane
+    Argon2Block tag = inst.memory[inst.laneLength - 1];
+    for (uint32_t lane = 1; lane < inst.lanes; lane++)
+    {
+        const Argon2Block &last = inst.memory[static_cast<size_t>(lane) * inst.laneLength + inst.laneLength - 1];
+        for (int i = 0; i < ARGON2_QWORDS; i++)
+            tag.v[i] ^= last.v[i];
+    }
+    for (int i = 0; i < ARGON2_QWORDS; i++)
+        store64(bytes + 8 * i, tag.v[i]);
+    hashLong(out, outLength, bytes, sizeof(bytes));
+
+    OPENSSL_cleanse(inst.memory.data(), inst.memory.size() * sizeof(Argon2Block));
+    OPENSSL_cleanse(bytes, sizeof(bytes));
+    OPENSSL_cleanse(blockHash, sizeof(blockHash));
+    OPENSSL_cleanse(&tag, sizeof(tag));
+}
@@ -1,4 +1,12 @@
 #include "CryptoManager.hpp"
+#include "SecureRandom.hpp"
+#include "SecureMemory.hpp"
+
+#include <openssl/kdf.h>
+
+#include <climits>
+#include <mutex>
+#include <condition_variable>
 
 // Default constructor
 CryptoManager::CryptoManager()
@@ -9,15 +17,114 @@ CryptoManager::CryptoManager()
 
 CryptoManager::~CryptoManager() {}
 
+// ============ HOT PATH HELPERS ============
+
+// AES-256-CBC fetched once for the whole process: EVP_aes_256_cbc() makes
+// OpenSSL 3 look the implementation up again on every init
+static const EVP_CIPHER *recordCipher()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static EVP_CIPHER *cipher = EVP_CIPHER_fetch(nullptr, "AES-256-CBC", nullptr);
+#else
+    static const EVP_CIPHER *cipher = EVP_aes_256_cbc();
+#endif
+    if (!cipher)
+        throw std::runtime_error("AES-256-CBC not available");
+    return cipher;
+}
+
+// One encrypt and one decrypt context per thread, set up with the cipher once
+// and only re-keyed afterwards
+static EVP_CIPHER_CTX *threadCipherCtx(int enc)
+{
+    typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> CtxPtr;
+    static thread_local CtxPtr contexts[2] = {
+        CtxPtr(nullptr, &EVP_CIPHER_CTX_free), CtxPtr(nullptr, &EVP_CIPHER_CTX_free)};
+
+    CtxPtr &ctx = contexts[enc ? 1 : 0];
+    if (!ctx)
+    {
+        ctx.reset(EVP_CIPHER_CTX_new());
+        if (!ctx || EVP_CipherInit_ex(ctx.get(), recordCipher(), nullptr, nullptr, nullptr, enc) != 1)
+        {
+            ctx.reset();
+            throw std::runtime_error("Failed to create cipher context");
+        }
+    }
+    return ctx.get();
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Decode hex into a fixed buffer, returns the byte count or -1
+static long hexDecode(const char *hex, size_t length, unsigned char *out, size_t outSize)
+{
+    if (length % 2 != 0 || length / 2 > outSize)
+        return -1;
+
+    for (size_t i = 0; i < length / 2; i++)
+    {
+        int hi = hexValue(hex[2 * i]);
+        int lo = hexValue(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return -1;
+        out[i] = static_cast<unsigned char>((hi << 4) | lo);
+    }
+    return length / 2;
+}
+
+static long hexDecode(std::string_view hex, unsigned char *out, size_t outSize)
+{
+    return hexDecode(hex.data(), hex.size(), out, outSize);
+}
+
+static void hexEncode(const unsigned char *bytes, size_t length, std::string &out)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    out.resize(length * 2);
+    for (size_t i = 0; i < length; i++)
+    {
+        out[2 * i] = digits[bytes[i] >> 4];
+        out[2 * i + 1] = digits[bytes[i] & 0x0f];
+    }
+}
+
+// Run one AES-256-CBC pass on the thread context, returns the written length or -1
+static int cipherRaw(int enc, const unsigned char *key, const unsigned char *iv,
+                     const unsigned char *in, size_t length, unsigned char *out, size_t outSize)
+{
+    if (length > INT_MAX - CRYPTO_BLOCK_SIZE || outSize < length + CRYPTO_BLOCK_SIZE)
+        return -1;
+
+    EVP_CIPHER_CTX *ctx = threadCipherCtx(enc);
+    int len = 0, final_len = 0;
+
+    if (EVP_CipherInit_ex(ctx, nullptr, nullptr, key, iv, enc) != 1
+        || EVP_CipherUpdate(ctx, out, &len, in, static_cast<int>(length)) != 1
+        || EVP_CipherFinal_ex(ctx, out + len, &final_len) != 1)
+    {
+        OPENSSL_cleanse(out, outSize);
+        return -1;
+    }
+    return len + final_len;
+}
+
 // Generates random bytes
 std::vector<unsigned char> CryptoManager::generateRandomBytes(size_t length) const
 {
     std::vector<unsigned char> buffer(length); // buffer = bytes
 
-    PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Trying to generate random bytes..." RESET);
-    if (RAND_bytes(buffer.data(), length) != 1)
-        throw std::runtime_error("RAND_bytes failed");
-
+    SecureRandom::fill(buffer.data(), length);
     return buffer;
 }
 
@@ -97,7 +204,7 @@ bool    CryptoManager::validatePassword(const std::string &password)
 
 // Password Hashing with PBKDF2
 std::pair<std::string, std::string> CryptoManager::hashPassword(
-    const std::string &password,
+    SecretView password,
     int iterations) const
 {
     PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Hashing password...");
@@ -109,8 +216,8 @@ std::pair<std::string, std::string> CryptoManager::hashPassword(
     unsigned char hash[32];
 
     int success = PKCS5_PBKDF2_HMAC(
-        password.c_str(),
-        password.length(),
+        password.data(),
+        password.size(),
         salt_bytes.data(),
         salt_bytes.size(),
         iterations,
@@ -131,7 +238,7 @@ std::pair<std::string, std::string> CryptoManager::hashPassword(
 
 // Verify that a password matches with it hash
 bool CryptoManager::verifyPassword(
-    const std::string &password,
+    SecretView password,
     const std::string &storedHash,
     const std::string &salt,
     int iterations) const
@@ -148,8 +255,8 @@ bool CryptoManager::verifyPassword(
         unsigned char computed_hash[32];
 
         int success = PKCS5_PBKDF2_HMAC(
-            password.c_str(),
-            password.length(),
+            password.data(),
+            password.size(),
             salt_bytes.data(),
             salt_bytes.size(),
             iterations,
@@ -163,7 +270,7 @@ bool CryptoManager::verifyPassword(
         std::vector<unsigned char> computed_vec(computed_hash, computed_hash + 32);
         std::string computed_hex = bytesToHex(computed_vec);
 
-        return computed_hex == storedHash;
+        return SecretView(computed_hex).equals(storedHash);
     }
     catch (const std::exception &e)
     {
@@ -174,107 +281,38 @@ bool CryptoManager::verifyPassword(
 
 // Encrypt a password using AES-256-CBC cipher process
 // Returns: {ciphertext_hex, iv_hex}
-std::pair<std::string, std::string> CryptoManager::encryptPassword(const std::string &plaintext,
-                                                                   const std::string &masterPassword,
-                                                                   const std::string &salt) const
+std::pair<std::string, std::string> CryptoManager::encryptPassword(SecretView plaintext,
+                                                                   SecretView masterPassword,
+                                                                   SecretView salt) const
 {
     PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Encrypting password...");
     try
     {
         //  1. Generate random IV (make bytes)
         // IV == Initialization vector
-        auto iv_bytes = generateRandomBytes(16);
+        unsigned char iv_bytes[CRYPTO_IV_SIZE];
+        SecureRandom::fill(iv_bytes, sizeof(iv_bytes));
 
-        //  2. Derivate key from Master Password
-        // salt_hex to bytes conversion needed for the key derivation
-        auto salt_bytes = hexToBytes(salt);
+        //  2. Derivate key from Master Password (secure arena, wiped on release)
+        SecureBytes derived_key(CRYPTO_KEY_SIZE);
+        deriveKey(masterPassword, salt, derived_key.data());
 
-        // Derivate key with PBKDF2-SHA256
-        unsigned char derived_key[32]; // 32 bytes => 256 bits
-
-        int pbkdf2_res = PKCS5_PBKDF2_HMAC(
-            masterPassword.c_str(),  // Password
-            masterPassword.length(), // Password length
-            salt_bytes.data(),       // salt bytes
-            salt_bytes.size(),       // salt length
-            10000,                   // iterations
-            EVP_sha256(),            // hash algorithm
-            32,                      // output key length
-            derived_key              // output buffer
-        );
-
-        if (pbkdf2_res != 1)
-            throw std::runtime_error("PBKDF2 derivation failed in encriptation process");
-
-        PrintLog(std::cout, CYAN "Crypto Manager " RESET "- Key derived successfully");
-
-        // 3. Cipher with AES-256-CBC algorithm
-        // Create encryptation context with openssl
-        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-        if (!ctx)
-            throw std::runtime_error("Failed to create cipher context");
-
-        // Start encryptation process
-        int init_success = EVP_EncryptInit_ex(
-            ctx,               // Context
-            EVP_aes_256_cbc(), // Algorithm
-            nullptr,           // Engine (use default with nullptr)
-            derived_key,       // Derived key (32 bytes)
-            iv_bytes.data()    // IV (16 bytes)
-        );
-
-        if (init_success != 1) // Check for result of init encryptation
-        {
-            EVP_CIPHER_CTX_free(ctx);
-            throw std::runtime_error("Encryptation init failed");
-        }
-
-        // Ciphertext bufer with maximun length of plaintext_len + 16 bits of memory block
-        std::vector<unsigned char> ciphertext(plaintext.length() + 16);
-        int ciphertext_len = 0;
+        //  3. Cipher with AES-256-CBC on the thread context
+        std::vector<unsigned char> ciphertext(plaintext.size() + CRYPTO_BLOCK_SIZE);
+        int ciphertext_len = encryptInto(derived_key.data(), iv_bytes,
+                                         plaintext.bytes(), plaintext.size(),
+                                         ciphertext.data(), ciphertext.size());
 
-        // Cipher the plaintext
-        int update_success = EVP_EncryptUpdate(
-            ctx,                                                        // Context
-            ciphertext.data(),                                          // Output buffer
-            &ciphertext_len,                                            // Output len
-            reinterpret_cast<const unsigned char *>(plaintext.c_str()), // Plaintext (password without cipher)
-            plaintext.length()                                          // Plaintext lenght
-        );
-
-        if (update_success != 1)
-        {
-            EVP_CIPHER_CTX_free(ctx);
-            throw std::runtime_error("Encryptation update failed");
-        }
-
-        // End encryptation
-        int final_len = 0;
-        int final_success = EVP_EncryptFinal_ex(
-            ctx,                                // Context
-            ciphertext.data() + ciphertext_len, // Buffer continuation
-            &final_len                          // Final writed length
-        );
-
-        if (final_success != 1)
-        {
-            EVP_CIPHER_CTX_free(ctx);
-            throw std::runtime_error("Encryptation final failed");
-        }
-
-        ciphertext_len += final_len; // Update ciphertext total length
-        EVP_CIPHER_CTX_free(ctx);    // Free context
-
-        PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Encryptation successful");
+        if (ciphertext_len < 0)
+            throw std::runtime_error("Encryptation failed");
 
         //  4. Convert into hex
         // AES generates binaries bytes => convert its into hex to save in db
-        std::vector<unsigned char> ciphertext_vec(ciphertext.begin(), ciphertext.begin() + ciphertext_len);
+        std::string ciphertext_hex, iv_hex;
+        hexEncode(ciphertext.data(), ciphertext_len, ciphertext_hex);
+        hexEncode(iv_bytes, sizeof(iv_bytes), iv_hex);
 
-        std::string ciphertext_hex = bytesToHex(ciphertext_vec);
-        std::string iv_hex = bytesToHex(iv_bytes);
-
-        PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Ciphertext and IV converted to hex");
+        PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Encryptation successful");
 
         //  5. Return result (cipher hex password + iv in hex)
         return {ciphertext_hex, iv_hex};
@@ -287,110 +325,409 @@ std::pair<std::string, std::string> CryptoManager::encryptPassword(const std::st
 }
 
 // Decrypt a cipher password returning the plaintext decrypted
-std::string CryptoManager::decryptPassword(
+SecureString CryptoManager::decryptPassword(
     const std::string &ciphertext_hex,
     const std::string &iv_hex,
-    const std::string &masterPassword,
-    const std::string &salt) const
+    SecretView masterPassword,
+    SecretView salt) const
 {
     PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Decrypting password...");
 
     try
     {
-        //  1. Convert hex values into bytes to operate with them
-        auto ciphertext_bytes = hexToBytes(ciphertext_hex);
-        auto iv_bytes = hexToBytes(iv_hex);
+        //  1. Derivate key from Master Password (it has to be the same ass cipher for decryptation process)
+        SecureBytes derived_key(CRYPTO_KEY_SIZE);
+        deriveKey(masterPassword, salt, derived_key.data());
 
-        PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Hex converted to bytes");
+        //  2. Decrypt in place into the result buffer
+        SecureString result;
+        result.resize(ciphertext_hex.size() / 2 + CRYPTO_BLOCK_SIZE);
+        int plaintext_len = decryptRecordInto(derived_key.data(), ciphertext_hex, iv_hex, result.data(), result.size());
 
-        //  2. Derivate key from Master Password (it has to be the same ass cipher for decryptation process)
-        // salt_hex to bytes conversion needed for the key derivation
-        auto salt_bytes = hexToBytes(salt);
+        if (plaintext_len < 0)
+            throw std::runtime_error("Decryptation failed");
 
-        // Derivate key with PBKDF2-SHA256
-        unsigned char derived_key[32]; // 32 bytes => 256 bits
+        // Drop the padding tail without leaving plaintext behind
+        result.resize(plaintext_len);
 
-        int pbkdf2_res = PKCS5_PBKDF2_HMAC(
-            masterPassword.c_str(),  // Password
-            masterPassword.length(), // Password length
-            salt_bytes.data(),       // salt bytes
-            salt_bytes.size(),       // salt length
-            10000,                   // iterations
-            EVP_sha256(),            // hash algorithm
-            32,                      // output key length
-            derived_key              // output buffer
-        );
+        PrintLog(std::cout, CYAN "Crypto Manager " RESET "- Decryption successful");
 
-        if (pbkdf2_res != 1)
-            throw std::runtime_error("PBKDF2 derivation failed in desencryptation process");
+        // returns password decrypted
+        return result;
+    }
+    catch (const std::exception &e)
+    {
+        PrintLog(std::cerr, RED "Crypto Manager - Decryption error: %s" RESET, e.what());
+        throw;
+    }
+}
+
+// ============ ALLOCATION FREE HOT PATH ============
+
+void CryptoManager::deriveKey(
+    SecretView masterPassword,
+    SecretView salt,
+    unsigned char key[CRYPTO_KEY_SIZE]) const
+{
+    unsigned char salt_bytes[64];
+    long salt_len = hexDecode(salt.data(), salt.size(), salt_bytes, sizeof(salt_bytes));
+    if (salt_len < 0)
+        throw std::runtime_error("Invalid salt");
+
+    if (PKCS5_PBKDF2_HMAC(masterPassword.data(), masterPassword.size(),
+                          salt_bytes, salt_len,
+                          CRYPTO_KDF_ITERATIONS, EVP_sha256(), CRYPTO_KEY_SIZE, key) != 1)
+        throw std::runtime_error("PBKDF2 derivation failed");
+}
+
+int CryptoManager::encryptInto(const unsigned char *key, const unsigned char *iv,
+                               const unsigned char *in, size_t length,
+                               unsigned char *out, size_t outSize) const
+{
+    return cipherRaw(1, key, iv, in, length, out, outSize);
+}
 
-        PrintLog(std::cout, CYAN "Crypto Manager " RESET "- Key derived successfully");
+int CryptoManager::decryptInto(const unsigned char *key, const unsigned char *iv,
+                               const unsigned char *in, size_t length,
+                               unsigned char *out, size_t outSize) const
+{
+    return cipherRaw(0, key, iv, in, length, out, outSize);
+}
 
-        //  3.  Decrypt with AES-256-CBC
+int CryptoManager::decryptRecordInto(
+    const unsigned char *key,
+    std::string_view ciphertext_hex,
+    std::string_view iv_hex,
+    char *out, size_t outSize) const
+{
+    unsigned char iv[CRYPTO_IV_SIZE];
+    if (hexDecode(iv_hex, iv, sizeof(iv)) != CRYPTO_IV_SIZE)
+        return -1;
 
-        // Create context for decryption operation
-        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-        if (!ctx)
-            throw std::runtime_error("Failed to create cipher context");
+    // Ciphertext bytes are decoded straight into out and decrypted in place
+    unsigned char *buffer = reinterpret_cast<unsigned char *>(out);
+    long length = hexDecode(ciphertext_hex, buffer, outSize);
+    if (length < 0)
+        return -1;
 
-        // Start decryption operation
-        int init_success = EVP_DecryptInit_ex(
-            ctx,
-            EVP_aes_256_cbc(),
-            nullptr,
-            derived_key,
-            iv_bytes.data());
-        
-        if (init_success != 1)
+    return decryptInto(key, iv, buffer, length, buffer, outSize);
+}
+
+// ============ BATCH API ============
+
+// Shared by the caller and the helper jobs of one batch. Helpers may start
+// after the batch returned: they find no chunk left and never touch work.
+struct BatchRun
+{
+    std::function<void(size_t, size_t)> work;
+    size_t count;
+    size_t chunk;
+    size_t chunks;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> finished{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr error;
+};
+
+static void drainBatch(BatchRun &run)
+{
+    size_t index;
+    while ((index = run.next.fetch_add(1)) < run.chunks)
+    {
+        size_t begin = index * run.chunk;
+        try
         {
-            EVP_CIPHER_CTX_free(ctx);
-            throw std::runtime_error("Decryption init failed");
+            run.work(begin, std::min(begin + run.chunk, run.count));
         }
-        // Buffer for plaintext
-        std::vector<unsigned char> plaintext(ciphertext_bytes.size() + 16);
-        int plaintext_len = 0;
-
-        // Decryptation
-        int update_sucess = EVP_DecryptUpdate(
-            ctx,
-            plaintext.data(),
-            &plaintext_len,
-            ciphertext_bytes.data(),
-            ciphertext_bytes.size());
-        
-        if (update_sucess != 1)
-            throw std::runtime_error("Decryptation update failed");
-
-        // Finish decryptation process (remove padding)
-        int final_len = 0;
-        int final_success = EVP_DecryptFinal_ex(
-            ctx,
-            plaintext.data() + plaintext_len,
-            &final_len);
-        
-        if (final_success != 1)
+        catch (...)
         {
-            EVP_CIPHER_CTX_free(ctx);
-            throw std::runtime_error("Decryptation final failed");
+            // Keep counting the chunk as finished or the caller would wait forever
+            std::lock_guard<std::mutex> lock(run.mutex);
+            if (!run.error)
+                run.error = std::current_exception();
         }
 
-        plaintext_len += final_len;
-        EVP_CIPHER_CTX_free(ctx);
+        if (run.finished.fetch_add(1) + 1 == run.chunks)
+        {
+            std::lock_guard<std::mutex> lock(run.mutex);
+            run.cv.notify_all();
+        }
+    }
+}
 
-        PrintLog(std::cout, CYAN "Crypto Manager " RESET "- Decryption successful");
+// Run work(begin, end) over [0, count) split across the scheduler workers
+static void runBatch(size_t count, TaskScheduler *scheduler, TaskPriority priority,
+                     std::function<void(size_t, size_t)> work)
+{
+    if (count == 0)
+        return;
+    if (scheduler == nullptr || count < CRYPTO_BATCH_MIN_CHUNK * 2)
+    {
+        work(0, count);
+        return;
+    }
 
-        //  4. Convert bytes to string
-        std::string result(plaintext.begin(), plaintext.begin() + plaintext_len);
+    size_t workers = scheduler->workerCount();
+    auto run = std::make_shared<BatchRun>();
+    run->work = std::move(work);
+    run->count = count;
+    // Several chunks per worker so the faster threads pick up the slack
+    run->chunk = std::max<size_t>(CRYPTO_BATCH_MIN_CHUNK, count / (workers * 4));
+    run->chunks = (count + run->chunk - 1) / run->chunk;
 
-        // clean memory in plaintext
-        OPENSSL_cleanse(plaintext.data(), plaintext.size());
+    for (size_t i = 0; i < std::min(workers, run->chunks - 1); i++)
+        scheduler->post(priority, [run]() { drainBatch(*run); });
 
-        // returns password decrypted
-        return result;
-    }
-    catch (const std::exception &e)
+    // The caller works too, so a batch started from a pool worker cannot deadlock
+    drainBatch(*run);
+
+    std::unique_lock<std::mutex> lock(run->mutex);
+    run->cv.wait(lock, [&]() { return run->finished == run->chunks; });
+    if (run->error)
+        std::rethrow_exception(run->error);
+}
+
+static bool decryptRecord(const CryptoManager &crypto, const unsigned char *key,
+                          const EncryptedField &record, SecureString &out)
+{
+    // The output buffer is the work buffer, so a reused out vector does not allocate
+    out.resize(record.ciphertext_hex.size() / 2 + CRYPTO_BLOCK_SIZE);
+    int length = crypto.decryptRecordInto(key, record.ciphertext_hex, record.iv_hex, out.data(), out.size());
+
+    out.resize(length < 0 ? 0 : length);
+    return length >= 0;
+}
+
+static bool encryptRecord(const CryptoManager &crypto, const unsigned char *key,
+                          SecretView plaintext, EncryptedField &out)
+{
+    // Scratch buffer keeps its capacity between records
+    static thread_local std::vector<unsigned char> ciphertext;
+    unsigned char iv[CRYPTO_IV_SIZE];
+
+    SecureRandom::fill(iv, sizeof(iv));
+
+    ciphertext.resize(plaintext.size() + CRYPTO_BLOCK_SIZE);
+    int length = crypto.encryptInto(key, iv, plaintext.bytes(), plaintext.size(),
+                                    ciphertext.data(), ciphertext.size());
+    if (length < 0)
+        return false;
+
+    hexEncode(ciphertext.data(), length, out.ciphertext_hex);
+    hexEncode(iv, sizeof(iv), out.iv_hex);
+    return true;
+}
+
+size_t CryptoManager::decryptBatch(
+    std::span<const EncryptedField> records,
+    std::vector<SecureString> &out,
+    SecretView masterPassword,
+    SecretView salt,
+    TaskScheduler *scheduler,
+    TaskPriority priority) const
+{
+    SecureBytes derived_key(CRYPTO_KEY_SIZE);
+    deriveKey(masterPassword, salt, derived_key.data());
+    return decryptBatch(records, out, derived_key.data(), scheduler, priority);
+}
+
+size_t CryptoManager::decryptBatch(
+    std::span<const EncryptedField> records,
+    std::vector<SecureString> &out,
+    const unsigned char *key,
+    TaskScheduler *scheduler,
+    TaskPriority priority) const
+{
+    PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Decrypting batch of %lu records...", records.size());
+
+    out.resize(records.size());
+    std::atomic<size_t> failed{0};
+
+    runBatch(records.size(), scheduler, priority, [&](size_t begin, size_t end)
     {
-        PrintLog(std::cerr, RED "Crypto Manager - Decryption error: %s" RESET, e.what());
-        throw;
-    }
-}
\ No newline at end of file
+        for (size_t i = begin; i < end; i++)
+            if (!decryptRecord(*this, key, records[i], out[i]))
+                failed++;
+    });
+
+    if (failed > 0)
+        PrintLog(std::cerr, RED "Crypto Manager - %lu of %lu records failed to decrypt" RESET, failed.load(), records.size());
+    return failed;
+}
+
+void CryptoManager::encryptBatch(
+    std::span<const SecretView> plaintexts,
+    std::vector<EncryptedField> &out,
+    SecretView masterPassword,
+    SecretView salt,
+    TaskScheduler *scheduler,
+    TaskPriority priority) const
+{
+    PrintLog(std::cout, CYAN "Crypto Manager" RESET " - Encrypting batch of %lu records...", plaintexts.size());
+
+    SecureBytes derived_key(CRYPTO_KEY_SIZE);
+    deriveKey(masterPassword, salt, derived_key.data());
+    const unsigned char *key = derived_key.data();
+
+    out.resize(plaintexts.size());
+    std::atomic<size_t> failed{0};
+
+    runBatch(plaintexts.size(), scheduler, priority, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            if (!encryptRecord(*this, key, plaintexts[i], out[i]))
+                failed++;
+    });
+
+    if (failed > 0)
+        throw std::runtime_error("Batch encryption failed");
+}
+
+// ============ KEY WRAPPING ============
+
+static const EVP_CIPHER *wrapCipher()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static EVP_CIPHER *cipher = EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr);
+#else
+    static const EVP_CIPHER *cipher = EVP_aes_256_gcm();
+#endif
+    if (!cipher)
+        throw std::runtime_error("AES-256-GCM not available");
+    return cipher;
+}
+
+// Bound into the tag so a wrapped secret can't be replayed as another blob type
+static const unsigned char WRAP_AAD[] = "passman-wrap-v1";
+
+WrapKey CryptoManager::deriveWrapKey(SecretView passphrase, int iterations) const
+{
+    WrapKey key;
+    SecureRandom::fill(key.salt, CRYPTO_WRAP_SALT_SIZE);
+    key.iterations = iterations;
+    key.stretched.resize(CRYPTO_KEY_SIZE);
+    if (PKCS5_PBKDF2_HMAC(passphrase.data(), passphrase.size(),
+                          key.salt, CRYPTO_WRAP_SALT_SIZE,
+                          key.iterations, EVP_sha256(), CRYPTO_KEY_SIZE, key.stretched.data()) != 1)
+        throw std::runtime_error("PBKDF2 derivation failed");
+    return key;
+}
+
+WrapKey CryptoManager::deriveWrapKey(SecretView passphrase, const WrappedSecret &wrapped) const
+{
+    WrapKey key;
+    std::memcpy(key.salt, wrapped.salt, CRYPTO_WRAP_SALT_SIZE);
+    key.iterations = wrapped.iterations;
+    key.stretched.resize(CRYPTO_KEY_SIZE);
+    if (wrapped.iterations <= 0
+        || PKCS5_PBKDF2_HMAC(passphrase.data(), passphrase.size(),
+                             key.salt, CRYPTO_WRAP_SALT_SIZE,
+                             key.iterations, EVP_sha256(), CRYPTO_KEY_SIZE, key.stretched.data()) != 1)
+        throw std::runtime_error("PBKDF2 derivation failed");
+    return key;
+}
+
+// GCM key = HKDF-SHA256(stretched || ephemeral, salt = wrap salt). Cheap, no KDF work
+static void sealingKey(const WrapKey &key, const SecureBytes *ephemeral, unsigned char out[CRYPTO_KEY_SIZE])
+{
+    SecureBytes ikm(key.stretched);
+    if (ephemeral)
+        ikm.insert(ikm.end(), ephemeral->begin(), ephemeral->end());
+
+    typedef std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> PkeyCtxPtr;
+    PkeyCtxPtr ctx(EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr), &EVP_PKEY_CTX_free);
+    size_t len = CRYPTO_KEY_SIZE;
+    bool ok = ctx
+        && EVP_PKEY_derive_init(ctx.get()) == 1
+        && EVP_PKEY_CTX_set_hkdf_md(ctx.get(), EVP_sha256()) == 1
+        && EVP_PKEY_CTX_set1_hkdf_salt(ctx.get(), key.salt, CRYPTO_WRAP_SALT_SIZE) == 1
+        && EVP_PKEY_CTX_set1_hkdf_key(ctx.get(), ikm.data(), ikm.size()) == 1
+        && EVP_PKEY_CTX_add1_hkdf_info(ctx.get(), WRAP_AAD, sizeof(WRAP_AAD) - 1) == 1
+        && EVP_PKEY_derive(ctx.get(), out, &len) == 1
+        && len == CRYPTO_KEY_SIZE;
+    if (!ok)
+        throw std::runtime_error("HKDF derivation failed");
+}
+
+WrappedSecret CryptoManager::wrapSecret(
+    SecretView secret,
+    SecretView passphrase,
+    int iterations) const
+{
+    return wrapSecret(secret, deriveWrapKey(passphrase, iterations));
+}
+
+WrappedSecret CryptoManager::wrapSecret(
+    SecretView secret,
+    const WrapKey &wrapKey,
+    const SecureBytes *ephemeral) const
+{
+    WrappedSecret wrapped;
+    std::memcpy(wrapped.salt, wrapKey.salt, CRYPTO_WRAP_SALT_SIZE);
+    wrapped.iterations = wrapKey.iterations;
+    SecureRandom::fill(wrapped.nonce, CRYPTO_GCM_NONCE_SIZE);
+
+    SecureBytes key(CRYPTO_KEY_SIZE);
+    sealingKey(wrapKey, ephemeral, key.data());
+
+    typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> CtxPtr;
+    CtxPtr ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    wrapped.ciphertext.resize(secret.size());
+
+    int len = 0;
+    bool ok = ctx
+        && EVP_EncryptInit_ex(ctx.get(), wrapCipher(), nullptr, key.data(), wrapped.nonce) == 1
+        && EVP_EncryptUpdate(ctx.get(), nullptr, &len, WRAP_AAD, sizeof(WRAP_AAD) - 1) == 1
+        && EVP_EncryptUpdate(ctx.get(), wrapped.ciphertext.data(), &len, secret.bytes(), secret.size()) == 1
+        && EVP_EncryptFinal_ex(ctx.get(), wrapped.ciphertext.data() + len, &len) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, CRYPTO_GCM_TAG_SIZE, wrapped.tag) == 1;
+    if (!ok)
+        throw std::runtime_error("Secret wrapping failed");
+    return wrapped;
+}
+
+bool CryptoManager::unwrapSecret(
+    const WrappedSecret &wrapped,
+    SecretView passphrase,
+    SecureString &out) const
+{
+    if (wrapped.iterations <= 0)
+        return false;
+    return unwrapSecret(wrapped, deriveWrapKey(passphrase, wrapped), out);
+}
+
+bool CryptoManager::unwrapSecret(
+    const WrappedSecret &wrapped,
+    const WrapKey &wrapKey,
+    SecureString &out,
+    const SecureBytes *ephemeral) const
+{
+    if (wrapped.iterations <= 0 || wrapKey.iterations != wrapped.iterations
+        || std::memcmp(wrapKey.salt, wrapped.salt, CRYPTO_WRAP_SALT_SIZE) != 0)
+        return false;
+
+    SecureBytes key(CRYPTO_KEY_SIZE);
+    sealingKey(wrapKey, ephemeral, key.data());
+
+    typedef std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> CtxPtr;
+    CtxPtr ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    SecureString plain;
+    plain.resize(wrapped.ciphertext.size());
+
+    // GCM releases nothing before the tag checks out at Final
+    int len = 0;
+    bool ok = ctx
+        && EVP_DecryptInit_ex(ctx.get(), wrapCipher(), nullptr, key.data(), wrapped.nonce) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, CRYPTO_GCM_TAG_SIZE,
+                               const_cast<unsigned char *>(wrapped.tag)) == 1
+        && EVP_DecryptUpdate(ctx.get(), nullptr, &len, WRAP_AAD, sizeof(WRAP_AAD) - 1) == 1
+        && EVP_DecryptUpdate(ctx.get(), reinterpret_cast<unsigned char *>(plain.data()), &len,
+                             wrapped.ciphertext.data(), wrapped.ciphertext.size()) == 1
+        && EVP_DecryptFinal_ex(ctx.get(), reinterpret_cast<unsigned char *>(plain.data()) + len, &len) == 1;
+    if (!ok)
+        return false;
+
+    out = std::move(plain);
+    return true;
+}
@@ -0,0 +1,209 @@
+#include "SecureMemory.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Exclude from core dumps, best effort (not every kernel knows MADV_DONTDUMP)
+static void dontDump(void *addr, size_t length)
+{
+#ifdef MADV_DONTDUMP
+    madvise(addr, length, MADV_DONTDUMP);
+#else
+    (void)addr;
+    (void)length;
+#endif
+}
+
+// Free list link stored in the first bytes of a free block
+struct FreeBlock
+{
+    FreeBlock *next;
+};
+
+SecureArena::SecureArena()
+    : _pageSize(sysconf(_SC_PAGESIZE)), _arena(nullptr), _nextPage(0), _freeLists(), _stats()
+{
+    _stats.locked = true;
+    if (!mapRegion(SECURE_ARENA_SIZE))
+        throw std::runtime_error(RED "Error" RESET " mapping the secure memory arena");
+
+    if (_stats.locked)
+        PrintLog(std::cout, CYAN "SecureArena" RESET " - %lu KiB locked", _stats.arenaBytes / 1024);
+}
+
+// mlock a mapping, counting and reporting the ones the kernel refuses
+bool SecureArena::lockMapping(void *addr, size_t length)
+{
+    if (mlock(addr, length) == 0)
+        return true;
+
+    // Reported once, the counter keeps track of the rest
+    if (_stats.lockFailures++ == 0)
+        PrintLog(std::cerr, YELLOW "SecureArena - mlock refused (RLIMIT_MEMLOCK?), secrets may be swapped" RESET);
+    _stats.locked = false;
+    return false;
+}
+
+// Map a new region between two guard pages and carve the next pages from it
+bool SecureArena::mapRegion(size_t bytes)
+{
+    size_t pages = (bytes + _pageSize - 1) / _pageSize;
+    size_t total = (pages + 2) * _pageSize;
+
+    void *mapping = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    unsigned char *region = static_cast<unsigned char *>(mapping);
+    unsigned char *arena = region + _pageSize;
+
+    // Guard pages: running off either end of the region faults
+    mprotect(region, _pageSize, PROT_NONE);
+    mprotect(arena + pages * _pageSize, _pageSize, PROT_NONE);
+
+    lockMapping(arena, pages * _pageSize);
+    dontDump(arena, pages * _pageSize);
+
+    Region &entry = _regions[arena];
+    entry.pages = pages;
+    entry.pageClass.assign(pages, 0xff);
+
+    _arena = arena;
+    _nextPage = 0;
+    _stats.arenaBytes += pages * _pageSize;
+    _stats.regions = _regions.size();
+    return true;
+}
+
+SecureArena &SecureArena::instance()
+{
+    static SecureArena *arena = new SecureArena();
+    return *arena;
+}
+
+size_t SecureArena::classIndex(size_t size)
+{
+    size_t index = 0;
+    size_t block = SECURE_MIN_CLASS;
+    while (block < size)
+    {
+        block <<= 1;
+        index++;
+    }
+    return index;
+}
+
+size_t SecureArena::classSize(size_t index)
+{
+    return static_cast<size_t>(SECURE_MIN_CLASS) << index;
+}
+
+// Split the next unused page into blocks of one size class, growing the
+// arena by a new region when the current one is used up
+bool SecureArena::carvePage(size_t index)
+{
+    Region &current = _regions.at(_arena);
+    if (_nextPage == current.pages && !mapRegion(SECURE_ARENA_GROW_SIZE))
+        return false;
+
+    Region &region = _regions.at(_arena);
+    size_t block = classSize(index);
+    unsigned char *page = _arena + _nextPage * _pageSize;
+    region.pageClass[_nextPage] = static_cast<unsigned char>(index);
+    _nextPage++;
+    _stats.pagesUsed++;
+
+    for (size_t offset = 0; offset + block <= _pageSize; offset += block)
+    {
+        FreeBlock *free = reinterpret_cast<FreeBlock *>(page + offset);
+        free->next = static_cast<FreeBlock *>(_freeLists[index]);
+        _freeLists[index] = free;
+    }
+    return true;
+}
+
+// Own locked mapping for buffers above SECURE_MAX_CLASS
+void *SecureArena::allocateLarge(size_t size)
+{
+    size_t length = (size + _pageSize - 1) / _pageSize * _pageSize;
+    void *ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        throw std::bad_alloc();
+
+    lockMapping(ptr, length);
+    dontDump(ptr, length);
+
+    _large[ptr] = length;
+    _stats.largeBytes += length;
+    _stats.largeAllocations++;
+    return ptr;
+}
+
+void *SecureArena::allocate(size_t size)
+{
+    if (size == 0)
+        size = 1;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.allocations++;
+
+    if (size > SECURE_MAX_CLASS)
+        return allocateLarge(size);
+
+    size_t index = classIndex(size);
+    if (_freeLists[index] == nullptr && !carvePage(index))
+        throw std::bad_alloc();
+
+    FreeBlock *block = static_cast<FreeBlock *>(_freeLists[index]);
+    _freeLists[index] = block->next;
+    block->next = nullptr;
+
+    _stats.inUseBytes += classSize(index);
+    _stats.peakBytes = std::max(_stats.peakBytes, _stats.inUseBytes);
+    return block;
+}
+
+void SecureArena::deallocate(void *ptr)
+{
+    if (ptr == nullptr)
+        return;
+
+    unsigned char *bytes = static_cast<unsigned char *>(ptr);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.frees++;
+
+    // Region holding the pointer: the last one starting at or before it
+    auto region = _regions.upper_bound(bytes);
+    if (region != _regions.begin())
+        --region;
+    if (region == _regions.end() || bytes < region->first
+        || bytes >= region->first + region->second.pages * _pageSize)
+    {
+        auto it = _large.find(ptr);
+        if (it == _large.end())
+        {
+            PrintLog(std::cerr, RED "SecureArena - freeing a pointer it does not own" RESET);
+            return;
+        }
+        OPENSSL_cleanse(ptr, it->second);
+        munlock(ptr, it->second);
+        munmap(ptr, it->second);
+        _stats.largeBytes -= it->second;
+        _large.erase(it);
+        return;
+    }
+
+    size_t index = region->second.pageClass[(bytes - region->first) / _pageSize];
+    OPENSSL_cleanse(ptr, classSize(index));
+
+    FreeBlock *block = static_cast<FreeBlock *>(ptr);
+    block->next = static_cast<FreeBlock *>(_freeLists[index]);
+    _freeLists[index] = block;
+    _stats.inUseBytes -= classSize(index);
+}
+
+SecureMemoryStats SecureArena::getStats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
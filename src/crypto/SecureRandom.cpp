@@ -0,0 +1,141 @@
+#include "SecureRandom.hpp"
+#include "SecureMemory.hpp"
+
+#include <mutex>
+#include <pthread.h>
+#include <sys/random.h>
+
+// Bumped in every forked child, pools from an older generation are stale
+static std::atomic<unsigned> g_forkGeneration{0};
+static std::once_flag g_atforkOnce;
+
+static void onForkChild()
+{
+    g_forkGeneration++;
+}
+
+// Slow path used if the DRBG is unavailable
+static bool kernelRandom(unsigned char *out, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t got = getrandom(out, length, 0);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        out += got;
+        length -= got;
+    }
+    return true;
+}
+
+static void drbgBytes(unsigned char *out, size_t length)
+{
+    if (RAND_bytes(out, length) == 1)
+        return;
+    if (!kernelRandom(out, length))
+        throw std::runtime_error("Random generator failed");
+}
+
+// ============ PER THREAD POOL ============
+
+struct RandomPool
+{
+    SecureBytes bytes;          // pool lives in the secure arena
+    size_t pos;
+    unsigned generation;
+
+    RandomPool() : bytes(RANDOM_POOL_SIZE), pos(RANDOM_POOL_SIZE), generation(0)
+    {
+        std::call_once(g_atforkOnce, []() { pthread_atfork(nullptr, nullptr, onForkChild); });
+        generation = g_forkGeneration;
+    }
+
+    void refill()
+    {
+        drbgBytes(bytes.data(), bytes.size());
+        pos = 0;
+    }
+
+    void take(unsigned char *out, size_t length)
+    {
+        if (generation != g_forkGeneration)
+        {
+            // Forked: the parent may hand out the very same buffered bytes
+            OPENSSL_cleanse(bytes.data(), bytes.size());
+            pos = RANDOM_POOL_SIZE;
+            generation = g_forkGeneration;
+        }
+
+        while (length > 0)
+        {
+            if (pos == RANDOM_POOL_SIZE)
+                refill();
+
+            size_t n = std::min(length, RANDOM_POOL_SIZE - pos);
+            memcpy(out, bytes.data() + pos, n);
+            OPENSSL_cleanse(bytes.data() + pos, n);
+            pos += n;
+            out += n;
+            length -= n;
+        }
+    }
+};
+
+static RandomPool &threadPool()
+{
+    static thread_local RandomPool pool;
+    return pool;
+}
+
+void SecureRandom::fill(unsigned char *out, size_t length)
+{
+    if (length >= RANDOM_DIRECT_THRESHOLD)
+    {
+        drbgBytes(out, length);
+        return;
+    }
+    threadPool().take(out, length);
+}
+
+void SecureRandom::discard()
+{
+    RandomPool &pool = threadPool();
+    OPENSSL_cleanse(pool.bytes.data(), pool.bytes.size());
+    pool.pos = RANDOM_POOL_SIZE;
+}
+
+// ============ NONCE SEQUENCE ============
+
+NonceSequence::NonceSequence() : _counter(0)
+{
+    SecureRandom::fill(_prefix, sizeof(_prefix));
+}
+
+NonceSequence::NonceSequence(const unsigned char prefix[NONCE_PREFIX_SIZE], unsigned long long start)
+    : _counter(start)
+{
+    memcpy(_prefix, prefix, sizeof(_prefix));
+}
+
+void NonceSequence::next(unsigned char nonce[NONCE_SIZE])
+{
+    unsigned long long value = _counter.fetch_add(1);
+    if (value == ~0ULL)
+    {
+        _counter = ~0ULL;
+        throw std::runtime_error("Nonce sequence exhausted");
+    }
+
+    memcpy(nonce, _prefix, NONCE_PREFIX_SIZE);
+    for (int i = 0; i < 8; i++)
+        nonce[NONCE_PREFIX_SIZE + i] = static_cast<unsigned char>(value >> (56 - 8 * i));
+}
+
+unsigned long long NonceSequence::used() const
+{
+    return _counter;
+}
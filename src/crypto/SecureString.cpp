@@ -0,0 +1,34 @@
+#include "SecureString.hpp"
+
+// ============ SECRET VIEW ============
+
+bool SecretView::equals(SecretView other) const
+{
+    if (_size != other._size)
+        return false;
+    return CRYPTO_memcmp(_data, other._data, _size) == 0;
+}
+
+// ============ SECURE STRING ============
+
+SecureString::SecureString(const char *data, size_t size) : _buffer(data, data + size) {}
+
+SecureString::SecureString(SecretView view) : _buffer(view.data(), view.data() + view.size()) {}
+
+SecureString SecureString::clone() const
+{
+    return SecureString(view());
+}
+
+void SecureString::resize(size_t size)
+{
+    if (size < _buffer.size())
+        OPENSSL_cleanse(_buffer.data() + size, _buffer.size() - size);
+    _buffer.resize(size);
+}
+
+void SecureString::clear()
+{
+    // Swapping with an empty buffer frees the old one, which wipes it
+    SecureChars().swap(_buffer);
+}
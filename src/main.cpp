@@ -1,11 +1,10 @@
-#include "library.hpp"
-#include "SQLiteCipherDB.hpp"
-#include "CryptoManager.hpp"
-#include "AuthenticationManager.hpp"
+#include "qtlibrary.hpp"
 #include "InitializationManager.hpp"
-#include "SessionManager.hpp"
+#include "VaultContext.hpp"
 #include "MainWindow.hpp"
 #include "LoginDialog.hpp"
+#include "GuiExecutor.hpp"
+#include "TaskScheduler.hpp"
 
 // Principal main
 int main(int argc, char *argv[])
@@ -14,20 +13,20 @@ int main(int argc, char *argv[])
     
     try
     {
-        // Initialize all services
-        SQLiteCipherDB db;
-        CryptoManager crypto;
-        AuthenticationManager authM;
-        InitializationManager init(&db, &authM);
-        
-        // Register services with SessionManager (central dependency injection point)
-        SESSION->initializeServices(&db, &crypto, &authM);
+        // Executors for the coroutine API: results resume on the GUI thread,
+        // crypto and storage jobs share one pool sized to the machine
+        GuiExecutor guiExecutor;
+        TaskScheduler scheduler;
+
+        // Default vault: its services and session are handed to the windows
+        VaultContext vault(scheduler);
+        InitializationManager init(&vault.database(), &vault.auth());
         
         // Check if system is initialized (has admin user)
         bool systemInitialized = init.isSystemInitialized();
         
         // Always show LoginDialog (has both Login and Register tabs)
-        LoginDialog *authDialog = new LoginDialog();
+        LoginDialog *authDialog = new LoginDialog(vault);
         
         if (!systemInitialized)
         {
@@ -46,7 +45,7 @@ int main(int argc, char *argv[])
         {
             // Authentication successful - open main window
             PrintLog(std::cout, GREEN "Authentication successful! Opening MainWindow" RESET);
-            MainWindow window;
+            MainWindow window(vault);
             window.show();
             int result = app.exec();
             delete authDialog;
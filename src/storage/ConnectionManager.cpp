@@ -0,0 +1,143 @@
+#include "ConnectionManager.hpp"
+
+// ============ READ CONNECTION ============
+
+ReadConnection::ReadConnection(const std::string &dbPath, const DatabaseCipher *cipher) : _db(nullptr)
+{
+    int dbRes = sqlite3_open_v2(dbPath.c_str(), &_db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                                cipher ? cipher->vfsName() : nullptr);
+    if (dbRes != SQLITE_OK)
+    {
+        std::string err = sqlite3_errmsg(_db);
+        sqlite3_close(_db);
+        throw std::runtime_error(std::string(RED "Error" RESET " opening reader connection: ") + err);
+    }
+    sqlite3_busy_timeout(_db, DB_BUSY_TIMEOUT_MS);
+    if (cipher)
+    {
+        try
+        {
+            cipher->apply(_db);
+        }
+        catch (const std::exception &e)
+        {
+            sqlite3_close(_db);
+            throw;
+        }
+    }
+}
+
+ReadConnection::~ReadConnection()
+{
+    for (auto &entry : _stmts)
+        sqlite3_finalize(entry.second);
+    _stmts.clear();
+
+    if (_db != nullptr)
+        sqlite3_close(_db);
+    _db = nullptr;
+}
+
+sqlite3 *ReadConnection::handle()
+{
+    return _db;
+}
+
+std::mutex &ReadConnection::mutex()
+{
+    return _mutex;
+}
+
+sqlite3_stmt *ReadConnection::prepare(const char *sql)
+{
+    auto it = _stmts.find(sql);
+    if (it != _stmts.end())
+        return it->second;
+
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v3(_db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK)
+    {
+        PrintLog(std::cerr, CYAN "ConnectionManager" RESET " - " RED "Can't prepare statement: %s" RESET, sqlite3_errmsg(_db));
+        return nullptr;
+    }
+    _stmts.emplace(sql, stmt);
+    return stmt;
+}
+
+// ============ READER LEASE ============
+
+ReaderLease::ReaderLease(ReadConnection *conn) : _conn(conn), _lock(conn->mutex()) {}
+
+ReaderLease::~ReaderLease()
+{
+    // Moved-from lease owns nothing
+    if (!_lock.owns_lock())
+        return;
+
+    // Reset every statement so none keeps its read snapshot open
+    for (sqlite3_stmt *stmt : _used)
+        sqlite3_reset(stmt);
+}
+
+sqlite3 *ReaderLease::handle()
+{
+    return _conn->handle();
+}
+
+sqlite3_stmt *ReaderLease::prepare(const char *sql)
+{
+    sqlite3_stmt *stmt = _conn->prepare(sql);
+    if (stmt == nullptr)
+        return nullptr;
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    _used.push_back(stmt);
+    return stmt;
+}
+
+// ============ CONNECTION MANAGER ============
+
+ConnectionManager::ConnectionManager(const std::string &dbPath, size_t readers, const DatabaseCipher *cipher)
+    : _dbPath(dbPath), _cipher(cipher), _ownerThread(std::this_thread::get_id())
+{
+    // At least two readers: one for the owner thread, one shared by the workers
+    if (readers == 0)
+        readers = std::min<size_t>(DB_MAX_READERS, std::max(2u, std::thread::hardware_concurrency()));
+    readers = std::max<size_t>(2, readers);
+
+    PrintLog(std::cout, CYAN "ConnectionManager" RESET " - Opening 1 writer and %lu reader connections...", readers);
+
+    _writer = std::make_unique<DBWriter>(_dbPath, _cipher);
+    for (size_t i = 0; i < readers; i++)
+        _readers.push_back(std::make_unique<ReadConnection>(_dbPath, _cipher));
+}
+
+ConnectionManager::~ConnectionManager()
+{
+    // Flush pending writes before the readers go away
+    _writer.reset();
+    _readers.clear();
+
+    PrintLog(std::cout, CYAN "ConnectionManager" RESET " - connections closed");
+}
+
+DBWriter &ConnectionManager::writer()
+{
+    return *_writer;
+}
+
+ReaderLease ConnectionManager::reader()
+{
+    std::thread::id self = std::this_thread::get_id();
+    if (self == _ownerThread)
+        return ReaderLease(_readers[0].get());
+
+    size_t index = 1 + std::hash<std::thread::id>()(self) % (_readers.size() - 1);
+    return ReaderLease(_readers[index].get());
+}
+
+size_t ConnectionManager::readerCount() const
+{
+    return _readers.size();
+}
@@ -0,0 +1,234 @@
+#include "DBWriter.hpp"
+
+DBWriter::DBWriter(const std::string &dbPath, const DatabaseCipher *cipher, int windowMs, size_t maxBatch)
+    : _db(nullptr), _dbPath(dbPath), _windowMs(windowMs), _maxBatch(maxBatch), _running(false)
+{
+    PrintLog(std::cout, CYAN "DBWriter" RESET " - Opening writer connection...");
+
+    int dbRes = sqlite3_open_v2(_dbPath.c_str(), &_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX,
+                                cipher ? cipher->vfsName() : nullptr);
+    if (dbRes != SQLITE_OK)
+    {
+        std::string err = sqlite3_errmsg(_db);
+        sqlite3_close(_db);
+        throw std::runtime_error(std::string(RED "Error" RESET " opening writer connection: ") + err);
+    }
+    sqlite3_busy_timeout(_db, DB_BUSY_TIMEOUT_MS);
+    if (cipher)
+    {
+        try
+        {
+            cipher->apply(_db);
+        }
+        catch (const std::exception &e)
+        {
+            sqlite3_close(_db);
+            throw;
+        }
+    }
+
+    _running = true;
+    _thread = std::thread(&DBWriter::run, this);
+
+    PrintLog(std::cout, CYAN "DBWriter" GREEN " - writer running!" RESET);
+}
+
+DBWriter::~DBWriter()
+{
+    stop();
+
+    for (auto &entry : _stmts)
+        sqlite3_finalize(entry.second);
+    _stmts.clear();
+    if (_db != nullptr)
+        sqlite3_close(_db);
+    _db = nullptr;
+
+    PrintLog(std::cout, CYAN "DBWriter" RESET " - writer connection closed");
+}
+
+void DBWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running)
+            return;
+        _running = false;
+    }
+    _cv.notify_all();
+
+    // The thread drains the queue before leaving
+    if (_thread.joinable())
+        _thread.join();
+}
+
+std::future<bool> DBWriter::submit(WriteOp op, WriteCallback onDone)
+{
+    PendingWrite pending;
+    pending.op = std::move(op);
+    pending.onDone = std::move(onDone);
+    std::future<bool> result = pending.done.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running)
+        {
+            PrintLog(std::cerr, CYAN "DBWriter" RESET " - " RED "write rejected, writer is stopped" RESET);
+            if (pending.onDone)
+                pending.onDone(false);
+            pending.done.set_value(false);
+            return result;
+        }
+        _queue.push_back(std::move(pending));
+    }
+    _cv.notify_one();
+    return result;
+}
+
+sqlite3_stmt *DBWriter::prepare(const char *sql)
+{
+    sqlite3_stmt *stmt = nullptr;
+    auto it = _stmts.find(sql);
+    if (it != _stmts.end())
+        stmt = it->second;
+    else
+    {
+        if (sqlite3_prepare_v3(_db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK)
+        {
+            PrintLog(std::cerr, CYAN "DBWriter" RESET " - " RED "Can't prepare statement: %s" RESET, sqlite3_errmsg(_db));
+            sqlite3_finalize(stmt);
+            return nullptr;
+        }
+        _stmts.emplace(sql, stmt);
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    _used.push_back(stmt);
+    return stmt;
+}
+
+void DBWriter::releaseStatements()
+{
+    // Ends pending reads and drops bindings pointing into the op's captures
+    for (sqlite3_stmt *stmt : _used)
+    {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+    _used.clear();
+}
+
+int DBWriter::execWithRetry(const char *sql)
+{
+    int backoff = DB_RETRY_BACKOFF_MS;
+    int rSql = sqlite3_exec(_db, sql, nullptr, nullptr, nullptr);
+
+    for (int attempt = 1; attempt < DB_WRITE_RETRIES && (rSql == SQLITE_BUSY || rSql == SQLITE_LOCKED); attempt++)
+    {
+        PrintLog(std::cerr, CYAN "DBWriter" RESET " - " YELLOW "db busy, retrying in %d ms (%d/%d)" RESET,
+                 backoff, attempt, DB_WRITE_RETRIES - 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+        backoff *= 2;
+        rSql = sqlite3_exec(_db, sql, nullptr, nullptr, nullptr);
+    }
+    return rSql;
+}
+
+void DBWriter::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _cv.wait(lock, [this]() { return !_queue.empty() || !_running; });
+        if (_queue.empty() && !_running)
+            break;
+
+        // Group commit: give other writes a short window to join this transaction
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_windowMs);
+        _cv.wait_until(lock, deadline, [this]() { return _queue.size() >= _maxBatch || !_running; });
+
+        std::vector<PendingWrite> batch;
+        while (!_queue.empty() && batch.size() < _maxBatch)
+        {
+            batch.push_back(std::move(_queue.front()));
+            _queue.pop_front();
+        }
+
+        lock.unlock();
+        commitBatch(batch);
+        lock.lock();
+    }
+}
+
+void DBWriter::commitBatch(std::vector<PendingWrite> &batch)
+{
+    std::vector<bool> results(batch.size(), false);
+
+    // Take the write lock up front so the ops themselves never hit SQLITE_BUSY
+    bool committed = false;
+    if (execWithRetry("BEGIN IMMEDIATE") == SQLITE_OK)
+    {
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            // A failing op only rolls back its own savepoint, not the whole group
+            sqlite3_exec(_db, "SAVEPOINT write_op", nullptr, nullptr, nullptr);
+            // A throwing op (bad_alloc while binding...) counts as a failed one,
+            // it must not escape the writer thread with the transaction open
+            try
+            {
+                results[i] = batch[i].op(_db);
+            }
+            catch (const std::exception &e)
+            {
+                PrintLog(std::cerr, CYAN "DBWriter" RESET " - " RED "write op threw: %s" RESET, e.what());
+                results[i] = false;
+            }
+            catch (...)
+            {
+                PrintLog(std::cerr, CYAN "DBWriter" RESET " - " RED "write op threw an unknown exception" RESET);
+                results[i] = false;
+            }
+            // Reset before leaving the savepoint, no statement is left mid-step
+            releaseStatements();
+            if (!results[i])
+                sqlite3_exec(_db, "ROLLBACK TO write_op", nullptr, nullptr, nullptr);
+            sqlite3_exec(_db, "RELEASE write_op", nullptr, nullptr, nullptr);
+        }
+
+        committed = (execWithRetry("COMMIT") == SQLITE_OK);
+        if (!committed)
+        {
+            PrintLog(std::cerr, CYAN "DBWriter" RESET " - " RED "commit failed: %s" RESET, sqlite3_errmsg(_db));
+            sqlite3_exec(_db, "ROLLBACK", nullptr, nullptr, nullptr);
+        }
+    }
+    else
+        PrintLog(std::cerr, CYAN "DBWriter" RESET " - " RED "can't start write transaction: %s" RESET, sqlite3_errmsg(_db));
+
+    PrintLog(std::cout, CYAN "DBWriter" RESET " - Group of %lu writes %s", batch.size(),
+             committed ? "committed" : "failed");
+
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        bool ok = committed && results[i];
+        // Callbacks first: whoever waits on the future sees their effects
+        // A throwing listener doesn't keep the others or the future from settling
+        if (batch[i].onDone)
+        {
+            try
+            {
+                batch[i].onDone(ok);
+            }
+            catch (const std::exception &e)
+            {
+                PrintLog(std::cerr, CYAN "DBWriter" RESET " - " RED "write callback threw: %s" RESET, e.what());
+            }
+            catch (...)
+            {
+                PrintLog(std::cerr, CYAN "DBWriter" RESET " - " RED "write callback threw an unknown exception" RESET);
+            }
+        }
+        batch[i].done.set_value(ok);
+    }
+}
@@ -0,0 +1,564 @@
+#include "DatabaseCipher.hpp"
+#include "SecureRandom.hpp"
+#include "DBWriter.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static int hexNibble(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static void append(SecureChars &out, const char *text)
+{
+    out.insert(out.end(), text, text + strlen(text));
+}
+
+static void appendHex(SecureChars &out, const SecureBytes &bytes)
+{
+    for (unsigned char byte : bytes)
+    {
+        out.push_back(HEX_DIGITS[byte >> 4]);
+        out.push_back(HEX_DIGITS[byte & 0x0f]);
+    }
+}
+
+static bool decodeHex(const char *hex, size_t length, SecureBytes &out)
+{
+    if (length % 2 != 0)
+        return false;
+    out.clear();
+    for (size_t i = 0; i < length; i += 2)
+    {
+        int hi = hexNibble(hex[i]);
+        int lo = hexNibble(hex[i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        out.push_back(static_cast<unsigned char>((hi << 4) | lo));
+    }
+    return true;
+}
+
+static bool parseInt(const char *text, long min, long max, int &out)
+{
+    char *end = nullptr;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || value < min || value > max)
+        return false;
+    out = static_cast<int>(value);
+    return true;
+}
+
+static bool parseBackend(std::string_view text, CipherBackend &out)
+{
+    if (text == "sqlcipher")
+        out = CipherBackend::SQLCipher;
+    else if (text == "pages")
+        out = CipherBackend::Pages;
+    else
+        return false;
+    return true;
+}
+
+static const char *backendName(CipherBackend backend)
+{
+    return backend == CipherBackend::Pages ? "pages" : "sqlcipher";
+}
+
+// file: URI of a path, to pass the VFS along (VACUUM INTO, ATTACH)
+static std::string fileUri(const std::string &path, const char *vfs)
+{
+    std::string uri = "file:";
+    for (unsigned char c : path)
+    {
+        if (isalnum(c) || strchr("/-._~", c))
+            uri.push_back(static_cast<char>(c));
+        else
+        {
+            uri.push_back('%');
+            uri.push_back(HEX_DIGITS[c >> 4]);
+            uri.push_back(HEX_DIGITS[c & 0x0f]);
+        }
+    }
+    return uri + "?vfs=" + vfs;
+}
+
+static bool validSettings(const CipherSettings &settings)
+{
+    bool powerOfTwo = settings.pageSize >= 512 && settings.pageSize <= 65536
+                      && (settings.pageSize & (settings.pageSize - 1)) == 0;
+    bool header = settings.plaintextHeader >= 0 && settings.plaintextHeader % 16 == 0
+                  && settings.plaintextHeader < settings.pageSize;
+    return powerOfTwo && header && settings.kdfIter >= 0;
+}
+
+// ============ SETTINGS ============
+
+CipherSettings CipherSettings::fromEnvironment()
+{
+    CipherSettings settings;
+    int hmac = 1;
+    struct Variable { const char *name; int *value; long min; long max; };
+    const Variable variables[] = {
+        {"PASSMAN_CIPHER_PAGE_SIZE", &settings.pageSize, 512, 65536},
+        {"PASSMAN_CIPHER_KDF_ITER", &settings.kdfIter, 0, 100000000},
+        {"PASSMAN_CIPHER_HMAC", &hmac, 0, 1},
+        {"PASSMAN_CIPHER_PLAINTEXT_HEADER", &settings.plaintextHeader, 0, 65536},
+    };
+
+    for (const Variable &variable : variables)
+    {
+        const char *text = getenv(variable.name);
+        if (text && *text && !parseInt(text, variable.min, variable.max, *variable.value))
+            throw std::runtime_error(std::string(RED "Error" RESET " invalid ") + variable.name + ": " + text);
+    }
+    settings.hmac = hmac != 0;
+
+    const char *backend = getenv("PASSMAN_CIPHER_BACKEND");
+    if (backend && *backend && !parseBackend(backend, settings.backend))
+        throw std::runtime_error(std::string(RED "Error" RESET " invalid PASSMAN_CIPHER_BACKEND: ") + backend);
+
+    if (!validSettings(settings))
+        throw std::runtime_error(RED "Error" RESET " invalid cipher settings (page size must be a power of two, "
+                                 "plaintext header a multiple of 16 below it)");
+    return settings;
+}
+
+// ============ KEY FILE ============
+
+// Key file: "name value" lines after the magic, key and salt in hex
+static void readKeyFile(const std::string &path, SecureBytes &key, SecureBytes &salt, CipherSettings &settings)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open vault key file " + path + ": " + strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077))
+    {
+        close(fd);
+        throw std::runtime_error("Unsafe vault key file " + path + " (must be a 0600 file owned by the user)");
+    }
+
+    SecureChars content(4096);
+    ssize_t size = read(fd, content.data(), content.size() - 1);
+    close(fd);
+    if (size <= 0)
+        throw std::runtime_error("Cannot read vault key file " + path);
+    content.resize(size);
+
+    std::string_view text(content.data(), content.size());
+    bool magic = false;
+    int hmac = settings.hmac ? 1 : 0;
+    // Key files without a backend line predate the page VFS
+    settings.backend = CipherBackend::SQLCipher;
+    while (!text.empty())
+    {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+        if (line.empty())
+            continue;
+        if (!magic)
+        {
+            magic = (line == DB_KEYFILE_MAGIC);
+            if (!magic)
+                break;
+            continue;
+        }
+
+        size_t space = line.find(' ');
+        std::string_view name = line.substr(0, space);
+        std::string_view value = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+        std::string number(name == "key" || name == "salt" || name == "backend" ? std::string_view() : value);
+
+        bool ok = true;
+        if (name == "key")
+            ok = decodeHex(value.data(), value.size(), key) && key.size() == DB_KEY_SIZE;
+        else if (name == "salt")
+            ok = decodeHex(value.data(), value.size(), salt) && salt.size() == DB_SALT_SIZE;
+        else if (name == "backend")
+            ok = parseBackend(value, settings.backend);
+        else if (name == "page_size")
+            ok = parseInt(number.c_str(), 512, 65536, settings.pageSize);
+        else if (name == "kdf_iter")
+            ok = parseInt(number.c_str(), 0, 100000000, settings.kdfIter);
+        else if (name == "hmac")
+            ok = parseInt(number.c_str(), 0, 1, hmac);
+        else if (name == "plaintext_header")
+            ok = parseInt(number.c_str(), 0, 65536, settings.plaintextHeader);
+        if (!ok)
+            throw std::runtime_error("Corrupted vault key file " + path + " (" + std::string(name) + ")");
+    }
+    settings.hmac = hmac != 0;
+
+    if (!magic || key.size() != DB_KEY_SIZE || salt.size() != DB_SALT_SIZE || !validSettings(settings))
+        throw std::runtime_error("Corrupted vault key file " + path);
+}
+
+// False if another process created it first
+static bool writeKeyFile(const std::string &path, const SecureBytes &key, const SecureBytes &salt,
+                         const CipherSettings &settings)
+{
+    SecureChars content;
+    append(content, DB_KEYFILE_MAGIC "\nkey ");
+    appendHex(content, key);
+    append(content, "\nsalt ");
+    appendHex(content, salt);
+    std::string params = std::string("\nbackend ") + backendName(settings.backend)
+                       + "\npage_size " + std::to_string(settings.pageSize)
+                       + "\nkdf_iter " + std::to_string(settings.kdfIter)
+                       + "\nhmac " + std::to_string(settings.hmac ? 1 : 0)
+                       + "\nplaintext_header " + std::to_string(settings.plaintextHeader) + "\n";
+    append(content, params.c_str());
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0)
+    {
+        if (errno == EEXIST)
+            return false;
+        throw std::runtime_error("Cannot create vault key file " + path + ": " + strerror(errno));
+    }
+
+    bool ok = write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()) && fsync(fd) == 0;
+    close(fd);
+    if (!ok)
+    {
+        unlink(path.c_str());
+        throw std::runtime_error("Cannot write vault key file " + path);
+    }
+    return true;
+}
+
+// ============ DATABASE CIPHER ============
+
+DatabaseCipher::DatabaseCipher(SecureBytes key, SecureBytes salt, const CipherSettings &settings)
+    : _key(std::move(key)), _salt(std::move(salt)), _settings(settings)
+{
+    if (_settings.backend == CipherBackend::Pages)
+        _vfs = std::make_unique<PageCipherVfs>(_key, _settings.pageSize);
+}
+
+std::string DatabaseCipher::keyFilePath(const std::string &dbPath)
+{
+    return dbPath + DB_KEYFILE_SUFFIX;
+}
+
+std::unique_ptr<DatabaseCipher> DatabaseCipher::forVault(const std::string &dbPath)
+{
+    std::string keyPath = keyFilePath(dbPath);
+    SecureBytes key;
+    SecureBytes salt;
+    CipherSettings settings;
+
+    struct stat st;
+    if (lstat(keyPath.c_str(), &st) != 0)
+    {
+        if (errno != ENOENT)
+            throw std::runtime_error("Cannot access vault key file " + keyPath + ": " + strerror(errno));
+
+        // No key file: only a new vault or a plaintext one may get a new key
+        if (stat(dbPath.c_str(), &st) == 0 && st.st_size > 0 && !isPlaintextVault(dbPath))
+            throw std::runtime_error("Vault " + dbPath + " is encrypted but its key file " + keyPath + " is missing");
+
+        settings = CipherSettings::fromEnvironment();
+        key.resize(DB_KEY_SIZE);
+        salt.resize(DB_SALT_SIZE);
+        SecureRandom::fill(key.data(), key.size());
+        SecureRandom::fill(salt.data(), salt.size());
+        if (writeKeyFile(keyPath, key, salt, settings))
+        {
+            PrintLog(std::cout, CYAN "DatabaseCipher" RESET " - New vault key written to %s", keyPath.c_str());
+            return std::make_unique<DatabaseCipher>(std::move(key), std::move(salt), settings);
+        }
+        // Lost the race to another instance: use its key
+        settings = CipherSettings();
+    }
+
+    readKeyFile(keyPath, key, salt, settings);
+    PrintLog(std::cout, CYAN "DatabaseCipher" RESET " - Vault key loaded (%s, page size %d, kdf_iter %d, hmac %s)",
+             backendName(settings.backend), settings.pageSize, settings.kdfIter, settings.hmac ? "on" : "off");
+    return std::make_unique<DatabaseCipher>(std::move(key), std::move(salt), settings);
+}
+
+bool DatabaseCipher::isPlaintextVault(const std::string &dbPath)
+{
+    struct stat st;
+    if (stat(dbPath.c_str(), &st) != 0 || st.st_size == 0)
+        return false;
+
+    // An encrypted page 1 reads as "file is not a database" without the key
+    sqlite3 *db = nullptr;
+    bool plaintext = sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK
+                     && sqlite3_exec(db, "SELECT count(*) FROM sqlite_master", nullptr, nullptr, nullptr) == SQLITE_OK;
+    sqlite3_close(db);
+    return plaintext;
+}
+
+SecureChars DatabaseCipher::keyLiteral() const
+{
+    SecureChars literal;
+    if (_settings.kdfIter > 0)
+    {
+        // Passphrase: SQLCipher runs PBKDF2 (kdf_iter rounds) on every open
+        appendHex(literal, _key);
+        return literal;
+    }
+
+    // Raw key and salt, no KDF
+    append(literal, "x'");
+    appendHex(literal, _key);
+    appendHex(literal, _salt);
+    literal.push_back('\'');
+    return literal;
+}
+
+void DatabaseCipher::configure(sqlite3 *db, const char *schema) const
+{
+    std::string prefix = std::string("PRAGMA ") + schema + ".";
+    std::string sql = prefix + "cipher_page_size = " + std::to_string(_settings.pageSize) + ";"
+                    + prefix + "cipher_use_hmac = " + (_settings.hmac ? "ON" : "OFF") + ";";
+    if (_settings.kdfIter > 0)
+        sql += prefix + "kdf_iter = " + std::to_string(_settings.kdfIter) + ";";
+
+    // The header holds the salt otherwise, keep it in the key then
+    if (_settings.plaintextHeader > 0)
+    {
+        sql += prefix + "cipher_plaintext_header_size = " + std::to_string(_settings.plaintextHeader) + ";";
+        if (_settings.kdfIter > 0)
+        {
+            std::string salt;
+            for (unsigned char byte : _salt)
+            {
+                salt.push_back(HEX_DIGITS[byte >> 4]);
+                salt.push_back(HEX_DIGITS[byte & 0x0f]);
+            }
+            sql += prefix + "cipher_salt = \"x'" + salt + "'\";";
+        }
+    }
+
+    char *errMsg = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        std::string err = errMsg ? errMsg : sqlite3_errmsg(db);
+        sqlite3_free(errMsg);
+        throw std::runtime_error(std::string(RED "Error" RESET " configuring the vault cipher: ") + err);
+    }
+}
+
+const char *DatabaseCipher::vfsName() const
+{
+    return _vfs ? _vfs->name() : nullptr;
+}
+
+void DatabaseCipher::apply(sqlite3 *db) const
+{
+    // Page VFS: the connection was opened through it, nothing to key
+    if (_vfs)
+    {
+        _vfs->configure(db);
+        if (sqlite3_exec(db, "SELECT count(*) FROM sqlite_master", nullptr, nullptr, nullptr) != SQLITE_OK)
+            throw std::runtime_error(std::string(RED "Error" RESET " can't open the vault, wrong key file or not opened "
+                                     "through the page VFS: ") + sqlite3_errmsg(db));
+        return;
+    }
+
+    SecureChars sql;
+    append(sql, "PRAGMA main.key = \"");
+    SecureChars literal = keyLiteral();
+    sql.insert(sql.end(), literal.begin(), literal.end());
+    append(sql, "\";");
+    sql.push_back('\0');
+
+    if (sqlite3_exec(db, sql.data(), nullptr, nullptr, nullptr) != SQLITE_OK)
+        throw std::runtime_error(std::string(RED "Error" RESET " keying the vault: ") + sqlite3_errmsg(db));
+    configure(db, "main");
+
+    // Plain SQLite ignores unknown pragmas: make sure the codec is really there
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v2(db, "PRAGMA cipher_version", -1, &stmt, nullptr);
+    bool codec = stmt && sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    if (!codec)
+        throw std::runtime_error(RED "Error" RESET " the linked SQLite has no SQLCipher codec");
+
+    // First read decrypts page 1
+    if (sqlite3_exec(db, "SELECT count(*) FROM sqlite_master", nullptr, nullptr, nullptr) != SQLITE_OK)
+        throw std::runtime_error(std::string(RED "Error" RESET " can't open the vault, wrong key file or cipher settings: ")
+                                 + sqlite3_errmsg(db));
+}
+
+// users and passwords row counts of a schema
+static bool countRows(sqlite3 *db, const std::string &schema, long long &users, long long &passwords)
+{
+    std::string sql = "SELECT (SELECT count(*) FROM " + schema + ".users), (SELECT count(*) FROM " + schema + ".passwords)";
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    bool ok = stmt && sqlite3_step(stmt) == SQLITE_ROW;
+    if (ok)
+    {
+        users = sqlite3_column_int64(stmt, 0);
+        passwords = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+// Copy of the plaintext main database of db, encrypted, at tmpPath. Throws with
+// the failing step
+void DatabaseCipher::exportVault(sqlite3 *db, const std::string &tmpPath, long long &users, long long &passwords) const
+{
+    auto error = [db](const char *step)
+    {
+        return std::runtime_error(std::string(step) + ": " + sqlite3_errmsg(db));
+    };
+
+    if (_vfs)
+    {
+        // VACUUM INTO rebuilds every page with the page size and reserved
+        // bytes requested on the source, the copy is written through the VFS.
+        // The page_size pragma resets the reserve request: it goes first
+        int reserve = PAGE_RESERVED_BYTES;
+        std::string pageSize = "PRAGMA main.page_size = " + std::to_string(_settings.pageSize);
+        if (sqlite3_exec(db, pageSize.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK)
+            throw error("page size");
+        sqlite3_file_control(db, "main", SQLITE_FCNTL_RESERVE_BYTES, &reserve);
+        if (!countRows(db, "main", users, passwords))
+            throw error("count");
+
+        std::string uri = fileUri(tmpPath, _vfs->name());
+        sqlite3_stmt *stmt = nullptr;
+        sqlite3_prepare_v2(db, "VACUUM INTO ?1", -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, uri.c_str(), -1, SQLITE_STATIC);
+        int rSql = stmt ? sqlite3_step(stmt) : SQLITE_ERROR;
+        sqlite3_finalize(stmt);
+        if (rSql != SQLITE_DONE)
+            throw error("vacuum into");
+
+        // VACUUM can't run in a transaction: catch a writer sneaking in
+        long long nowUsers = -1;
+        long long nowPasswords = -1;
+        if (!countRows(db, "main", nowUsers, nowPasswords) || nowUsers != users || nowPasswords != passwords)
+            throw std::runtime_error("the vault changed during the copy");
+        return;
+    }
+
+    // The key is bound, never spliced into the statement
+    SecureChars literal = keyLiteral();
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v2(db, "ATTACH DATABASE ?1 AS encrypted KEY ?2", -1, &stmt, nullptr);
+    sqlite3_bind_text(stmt, 1, tmpPath.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, literal.data(), static_cast<int>(literal.size()), SQLITE_STATIC);
+    int rSql = stmt ? sqlite3_step(stmt) : SQLITE_ERROR;
+    sqlite3_finalize(stmt);
+    if (rSql != SQLITE_DONE)
+        throw error("attach");
+    configure(db, "encrypted");
+
+    // Writers are held off while the copy is made
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr) != SQLITE_OK)
+        throw error("lock");
+    if (!countRows(db, "main", users, passwords)
+        || sqlite3_exec(db, "SELECT sqlcipher_export('encrypted')", nullptr, nullptr, nullptr) != SQLITE_OK
+        || sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK)
+    {
+        std::runtime_error err = error("sqlcipher_export");
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        throw err;
+    }
+    sqlite3_exec(db, "DETACH DATABASE encrypted", nullptr, nullptr, nullptr);
+}
+
+void DatabaseCipher::encryptVault(const std::string &dbPath) const
+{
+    // Other instances must be closed: a write landing after the rename is lost
+    std::string tmpPath = dbPath + ".encrypting";
+    unlink(tmpPath.c_str());
+    PrintLog(std::cout, CYAN "DatabaseCipher" RESET " - Encrypting plaintext vault %s...", dbPath.c_str());
+
+    sqlite3 *db = nullptr;
+    auto fail = [&](const std::string &what, std::string detail = "")
+    {
+        if (detail.empty())
+            detail = db ? sqlite3_errmsg(db) : "out of memory";
+        std::string err = what + ": " + detail;
+        sqlite3_close(db);
+        unlink(tmpPath.c_str());
+        throw std::runtime_error(std::string(RED "Error" RESET " encrypting the vault, ") + err);
+    };
+
+    // CREATE is inherited by the attached copy, URI lets VACUUM INTO pick the VFS
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | (_vfs ? SQLITE_OPEN_URI : 0);
+    if (sqlite3_open_v2(dbPath.c_str(), &db, flags, nullptr) != SQLITE_OK)
+        fail("open");
+    sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT_MS);
+    sqlite3_exec(db, "PRAGMA wal_checkpoint(TRUNCATE)", nullptr, nullptr, nullptr);
+
+    long long users = 0;
+    long long passwords = 0;
+    try
+    {
+        exportVault(db, tmpPath, users, passwords);
+    }
+    catch (const std::exception &e)
+    {
+        fail("export", e.what());
+    }
+    sqlite3_close(db);
+    db = nullptr;
+
+    // Check the copy with a fresh connection before it replaces the original
+    long long copiedUsers = -1;
+    long long copiedPasswords = -1;
+    if (sqlite3_open_v2(tmpPath.c_str(), &db, SQLITE_OPEN_READWRITE, vfsName()) != SQLITE_OK)
+        fail("reopen");
+    try
+    {
+        apply(db);
+    }
+    catch (const std::exception &e)
+    {
+        fail("check", e.what());
+    }
+    if (!countRows(db, "main", copiedUsers, copiedPasswords) || copiedUsers != users || copiedPasswords != passwords)
+        fail("copy check", "row counts differ");
+    sqlite3_close(db);
+    db = nullptr;
+
+    // The old WAL must not be replayed onto the encrypted file
+    if (rename(tmpPath.c_str(), dbPath.c_str()) != 0)
+        fail("rename", strerror(errno));
+    unlink((dbPath + "-wal").c_str());
+    unlink((dbPath + "-shm").c_str());
+
+    std::string dirCopy = dbPath;
+    int dirFd = open(dirname(dirCopy.data()), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0)
+    {
+        fsync(dirFd);
+        close(dirFd);
+    }
+
+    PrintLog(std::cout, CYAN "DatabaseCipher" GREEN " - Vault encrypted (%lld users, %lld entries)" RESET, users, passwords);
+}
+
+const CipherSettings &DatabaseCipher::settings() const
+{
+    return _settings;
+}
+
+PageCipherStats DatabaseCipher::pageStats() const
+{
+    return _vfs ? _vfs->getStats() : PageCipherStats{};
+}
@@ -0,0 +1,650 @@
+#include "PageCipherVfs.hpp"
+#include "SecureRandom.hpp"
+
+#include <openssl/crypto.h>
+
+// What a file holds, decides which byte ranges are pages
+enum
+{
+    FILE_PLAIN = 0,         // passed through (temp files, super journals)
+    FILE_MAIN = 1,          // pages back to back
+    FILE_WAL = 2,           // 32 byte header, then frames: 24 byte header + page
+    FILE_JOURNAL = 3,       // records: 4 byte page number + page + 4 byte checksum
+};
+
+#define WAL_HEADER_SIZE 32
+#define WAL_FRAME_HEADER_SIZE 24
+
+static std::atomic<unsigned int> g_vfsCount{0};
+
+struct PageCipherVfs::File
+{
+    sqlite3_file base;
+    PageCipherVfs *vfs;
+    int kind;
+    uint64_t id;                    // cache key prefix, 0 = not cached
+    EVP_CIPHER_CTX *enc;
+    EVP_CIPHER_CTX *dec;
+    unsigned char *scratch;         // one page: ciphertext staging
+    unsigned char *page;            // one page: partial reads
+
+    sqlite3_file *real() { return reinterpret_cast<sqlite3_file *>(this + 1); }
+};
+
+// ============ PAGES ============
+
+// Start of the page holding offset in a MAIN or WAL file. In a WAL header:
+// start of the page following it
+static sqlite3_int64 pageStart(int kind, int pageSize, sqlite3_int64 offset)
+{
+    if (kind == FILE_MAIN)
+        return offset - offset % pageSize;
+
+    if (offset < WAL_HEADER_SIZE)
+        return WAL_HEADER_SIZE + WAL_FRAME_HEADER_SIZE;
+    sqlite3_int64 frameSize = pageSize + WAL_FRAME_HEADER_SIZE;
+    sqlite3_int64 frame = (offset - WAL_HEADER_SIZE) / frameSize;
+    return WAL_HEADER_SIZE + frame * frameSize + WAL_FRAME_HEADER_SIZE;
+}
+
+// Journal records sit at a sector boundary + k * (page + 8); their page is 4
+// bytes in, never 8 byte aligned like the journal headers
+static bool isJournalPage(int pageSize, int amount, sqlite3_int64 offset)
+{
+    return amount == pageSize && offset % 8 == 4;
+}
+
+// Cache key: file, kind and page index
+static uint64_t pageKey(uint64_t fileId, int kind, int pageSize, sqlite3_int64 start)
+{
+    sqlite3_int64 index = kind == FILE_MAIN ? start / pageSize
+                                            : (start - WAL_HEADER_SIZE) / (pageSize + WAL_FRAME_HEADER_SIZE);
+    return (fileId << 48) | (static_cast<uint64_t>(kind) << 46) | static_cast<uint64_t>(index);
+}
+
+// A short read zero fills the missing tail: a page never written
+static bool isZero(const unsigned char *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        if (data[i])
+            return false;
+    return true;
+}
+
+static void pageAad(unsigned char aad[16], int kind, sqlite3_int64 offset)
+{
+    memset(aad, 0, 16);
+    aad[7] = static_cast<unsigned char>(kind);
+    for (int i = 0; i < 8; i++)
+        aad[8 + i] = static_cast<unsigned char>(static_cast<uint64_t>(offset) >> (56 - 8 * i));
+}
+
+bool PageCipherVfs::encryptPage(EVP_CIPHER_CTX *ctx, const unsigned char *plain, unsigned char *out,
+                                int kind, sqlite3_int64 offset)
+{
+    int body = _pageSize - PAGE_RESERVED_BYTES;
+    unsigned char *nonce = out + body;
+    unsigned char *tag = nonce + PAGE_NONCE_SIZE;
+    unsigned char aad[16];
+    pageAad(aad, kind, offset);
+    SecureRandom::fill(nonce, PAGE_NONCE_SIZE);
+
+    int len = 0;
+    int tail = 0;
+    bool ok = EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1
+              && EVP_EncryptUpdate(ctx, nullptr, &len, aad, sizeof(aad)) == 1
+              && EVP_EncryptUpdate(ctx, out, &len, plain, body) == 1
+              && EVP_EncryptFinal_ex(ctx, out + len, &tail) == 1
+              && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, PAGE_TAG_SIZE, tag) == 1;
+    if (ok)
+        _encrypted++;
+    return ok;
+}
+
+// In place. A page failing authentication is wiped, never handed to SQLite
+bool PageCipherVfs::decryptPage(EVP_CIPHER_CTX *ctx, unsigned char *page, int kind, sqlite3_int64 offset)
+{
+    int body = _pageSize - PAGE_RESERVED_BYTES;
+    unsigned char *nonce = page + body;
+    unsigned char *tag = nonce + PAGE_NONCE_SIZE;
+    unsigned char aad[16];
+    pageAad(aad, kind, offset);
+
+    int len = 0;
+    int tail = 0;
+    bool ok = EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1
+              && EVP_DecryptUpdate(ctx, nullptr, &len, aad, sizeof(aad)) == 1
+              && EVP_DecryptUpdate(ctx, page, &len, page, body) == 1
+              && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, PAGE_TAG_SIZE, tag) == 1
+              && EVP_DecryptFinal_ex(ctx, page + len, &tail) == 1;
+    if (!ok)
+    {
+        OPENSSL_cleanse(page, body);
+        _authFailures++;
+        return false;
+    }
+    _decrypted++;
+    return true;
+}
+
+// ============ DECRYPTED PAGE CACHE ============
+
+uint64_t PageCipherVfs::fileId(const char *dbName)
+{
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    auto it = _fileIds.find(dbName);
+    if (it != _fileIds.end())
+        return it->second;
+    // 16 bits of the key: past that, new files are simply not cached
+    uint64_t id = _fileIds.size() + 1;
+    if (id >= (1u << 16))
+        return 0;
+    _fileIds.emplace(dbName, id);
+    return id;
+}
+
+// page holds the page as read from the file, its body is replaced on a hit
+bool PageCipherVfs::cachedPage(uint64_t key, const unsigned char *reserved, unsigned char *page)
+{
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    auto it = _cacheIndex.find(key);
+    if (it == _cacheIndex.end())
+        return false;
+
+    size_t slot = *it->second;
+    if (memcmp(_slots[slot].reserved, reserved, PAGE_RESERVED_BYTES) != 0)
+        return false;
+
+    memcpy(page, _cachePages.data() + slot * _pageSize, _pageSize - PAGE_RESERVED_BYTES);
+    _lru.splice(_lru.begin(), _lru, it->second);
+    _cacheHits++;
+    return true;
+}
+
+// page: plaintext body followed by the nonce and tag it is stored with
+void PageCipherVfs::cachePage(uint64_t key, const unsigned char *page)
+{
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    size_t slot;
+    auto it = _cacheIndex.find(key);
+    if (it != _cacheIndex.end())
+    {
+        slot = *it->second;
+        _lru.splice(_lru.begin(), _lru, it->second);
+    }
+    else if (_lru.size() < _slots.size())
+    {
+        slot = _lru.size();
+        _lru.push_front(slot);
+        _cacheIndex.emplace(key, _lru.begin());
+    }
+    else
+    {
+        slot = _lru.back();
+        _cacheIndex.erase(_slots[slot].key);
+        _lru.splice(_lru.begin(), _lru, std::prev(_lru.end()));
+        _cacheIndex.emplace(key, _lru.begin());
+    }
+
+    int body = _pageSize - PAGE_RESERVED_BYTES;
+    _slots[slot].key = key;
+    memcpy(_slots[slot].reserved, page + body, PAGE_RESERVED_BYTES);
+    memcpy(_cachePages.data() + slot * _pageSize, page, body);
+}
+
+// ============ SQLITE CALLBACKS ============
+
+struct PageCipherVfs::Io
+{
+    static const sqlite3_io_methods methods;
+
+    static PageCipherVfs *self(sqlite3_vfs *vfs) { return static_cast<PageCipherVfs *>(vfs->pAppData); }
+    static sqlite3_vfs *base(sqlite3_vfs *vfs) { return self(vfs)->_base; }
+
+    // Page (at start) as read from the file: decrypted in place. SQLite always
+    // sees zeros in the reserved bytes, the WAL checksums cover them
+    static bool openPage(File *file, unsigned char *page, sqlite3_int64 start)
+    {
+        PageCipherVfs *vfs = file->vfs;
+        if (isZero(page, vfs->_pageSize))
+            return true;
+
+        int body = vfs->_pageSize - PAGE_RESERVED_BYTES;
+        uint64_t key = file->id ? pageKey(file->id, file->kind, vfs->_pageSize, start) : 0;
+        if (!key || !vfs->cachedPage(key, page + body, page))
+        {
+            if (!vfs->decryptPage(file->dec, page, file->kind, start))
+                return false;
+            if (key)
+                vfs->cachePage(key, page);
+        }
+        memset(page + body, 0, PAGE_RESERVED_BYTES);
+        return true;
+    }
+
+    static int close(sqlite3_file *f)
+    {
+        File *file = reinterpret_cast<File *>(f);
+        int rc = file->real()->pMethods ? file->real()->pMethods->xClose(file->real()) : SQLITE_OK;
+        EVP_CIPHER_CTX_free(file->enc);
+        EVP_CIPHER_CTX_free(file->dec);
+        if (file->page)
+            OPENSSL_cleanse(file->page, file->vfs->_pageSize);
+        sqlite3_free(file->scratch);
+        sqlite3_free(file->page);
+        return rc;
+    }
+
+    static int read(sqlite3_file *f, void *buf, int amount, sqlite3_int64 offset)
+    {
+        File *file = reinterpret_cast<File *>(f);
+        sqlite3_file *real = file->real();
+        int rc = real->pMethods->xRead(real, buf, amount, offset);
+        if ((rc != SQLITE_OK && rc != SQLITE_IOERR_SHORT_READ) || file->kind == FILE_PLAIN)
+            return rc;
+
+        PageCipherVfs *vfs = file->vfs;
+        unsigned char *out = static_cast<unsigned char *>(buf);
+        if (file->kind == FILE_JOURNAL)
+        {
+            // A torn record reads as zeros, its checksum then stops the playback
+            if (isJournalPage(vfs->_pageSize, amount, offset) && !openPage(file, out, offset))
+                memset(out, 0, amount);
+            return rc;
+        }
+
+        // Every page overlapping the request: in place if it is fully inside,
+        // else read on its own (header reads of page 1, WAL frame headers)
+        sqlite3_int64 end = offset + amount;
+        sqlite3_int64 pos = offset;
+        while (pos < end)
+        {
+            sqlite3_int64 start = pageStart(file->kind, vfs->_pageSize, pos);
+            if (start >= end)
+                break;
+
+            bool ok;
+            if (start >= offset && start + vfs->_pageSize <= end)
+                ok = openPage(file, out + (start - offset), start);
+            else
+            {
+                int prc = real->pMethods->xRead(real, file->page, vfs->_pageSize, start);
+                ok = (prc == SQLITE_OK || prc == SQLITE_IOERR_SHORT_READ) && openPage(file, file->page, start);
+                sqlite3_int64 from = std::max(start, offset);
+                sqlite3_int64 to = std::min(start + vfs->_pageSize, end);
+                if (ok)
+                    memcpy(out + (from - offset), file->page + (from - start), to - from);
+                OPENSSL_cleanse(file->page, vfs->_pageSize);
+            }
+
+            if (!ok)
+            {
+                if (file->kind == FILE_MAIN)
+                {
+                    PrintLog(std::cerr, CYAN "PageCipherVfs" RESET " - " RED "page at %lld failed authentication" RESET,
+                             static_cast<long long>(start));
+                    return SQLITE_IOERR_AUTH;
+                }
+                // WAL: the frame checksum rejects the zeroed page, recovery stops there
+                sqlite3_int64 from = std::max(start, offset);
+                sqlite3_int64 to = std::min(start + vfs->_pageSize, end);
+                memset(out + (from - offset), 0, to - from);
+            }
+            pos = start + vfs->_pageSize;
+        }
+        return rc;
+    }
+
+    static int write(sqlite3_file *f, const void *buf, int amount, sqlite3_int64 offset)
+    {
+        File *file = reinterpret_cast<File *>(f);
+        sqlite3_file *real = file->real();
+        PageCipherVfs *vfs = file->vfs;
+        const unsigned char *in = static_cast<const unsigned char *>(buf);
+
+        bool page;
+        if (file->kind == FILE_MAIN)
+        {
+            // The pager only writes whole pages
+            if (offset % vfs->_pageSize != 0 || amount != vfs->_pageSize)
+            {
+                PrintLog(std::cerr, CYAN "PageCipherVfs" RESET " - " RED "unaligned write of %d bytes at %lld" RESET,
+                         amount, static_cast<long long>(offset));
+                return SQLITE_IOERR_WRITE;
+            }
+            page = true;
+        }
+        else if (file->kind == FILE_WAL)
+            page = amount == vfs->_pageSize && pageStart(FILE_WAL, vfs->_pageSize, offset) == offset;
+        else if (file->kind == FILE_JOURNAL)
+            page = isJournalPage(vfs->_pageSize, amount, offset);
+        else
+            page = false;
+
+        if (!page)
+            return real->pMethods->xWrite(real, buf, amount, offset);
+
+        if (!vfs->encryptPage(file->enc, in, file->scratch, file->kind, offset))
+            return SQLITE_IOERR_WRITE;
+        int rc = real->pMethods->xWrite(real, file->scratch, amount, offset);
+
+        // Write-through: the other connections' next read of it is a cache hit
+        if (rc == SQLITE_OK && file->id)
+        {
+            int body = vfs->_pageSize - PAGE_RESERVED_BYTES;
+            memcpy(file->page, in, body);
+            memcpy(file->page + body, file->scratch + body, PAGE_RESERVED_BYTES);
+            vfs->cachePage(pageKey(file->id, file->kind, vfs->_pageSize, offset), file->page);
+            OPENSSL_cleanse(file->page, body);
+        }
+        return rc;
+    }
+
+    static int truncate(sqlite3_file *f, sqlite3_int64 size)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xTruncate(real, size);
+    }
+
+    static int sync(sqlite3_file *f, int flags)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xSync(real, flags);
+    }
+
+    static int fileSize(sqlite3_file *f, sqlite3_int64 *size)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xFileSize(real, size);
+    }
+
+    static int lock(sqlite3_file *f, int level)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xLock(real, level);
+    }
+
+    static int unlock(sqlite3_file *f, int level)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xUnlock(real, level);
+    }
+
+    static int checkReservedLock(sqlite3_file *f, int *out)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xCheckReservedLock(real, out);
+    }
+
+    static int fileControl(sqlite3_file *f, int op, void *arg)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        // Memory mapped pages would bypass the decryption
+        if (op == SQLITE_FCNTL_MMAP_SIZE)
+        {
+            *static_cast<sqlite3_int64 *>(arg) = 0;
+            return SQLITE_OK;
+        }
+        return real->pMethods->xFileControl(real, op, arg);
+    }
+
+    static int sectorSize(sqlite3_file *f)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xSectorSize(real);
+    }
+
+    static int deviceCharacteristics(sqlite3_file *f)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xDeviceCharacteristics(real);
+    }
+
+    static int shmMap(sqlite3_file *f, int region, int size, int extend, void volatile **out)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xShmMap(real, region, size, extend, out);
+    }
+
+    static int shmLock(sqlite3_file *f, int offset, int n, int flags)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xShmLock(real, offset, n, flags);
+    }
+
+    static void shmBarrier(sqlite3_file *f)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        real->pMethods->xShmBarrier(real);
+    }
+
+    static int shmUnmap(sqlite3_file *f, int deleteFlag)
+    {
+        sqlite3_file *real = reinterpret_cast<File *>(f)->real();
+        return real->pMethods->xShmUnmap(real, deleteFlag);
+    }
+
+    static int fetch(sqlite3_file *, sqlite3_int64, int, void **out)
+    {
+        *out = nullptr;
+        return SQLITE_OK;
+    }
+
+    static int unfetch(sqlite3_file *, sqlite3_int64, void *)
+    {
+        return SQLITE_OK;
+    }
+
+    // ---- VFS ----
+
+    static int open(sqlite3_vfs *vfs, sqlite3_filename name, sqlite3_file *f, int flags, int *outFlags)
+    {
+        PageCipherVfs *owner = self(vfs);
+        File *file = reinterpret_cast<File *>(f);
+        memset(file, 0, sizeof(File));
+        file->vfs = owner;
+
+        int rc = owner->_base->xOpen(owner->_base, name, file->real(), flags, outFlags);
+        if (rc != SQLITE_OK)
+            return rc;
+
+        if (flags & SQLITE_OPEN_MAIN_DB)
+            file->kind = FILE_MAIN;
+        else if (flags & SQLITE_OPEN_WAL)
+            file->kind = FILE_WAL;
+        else if (flags & SQLITE_OPEN_MAIN_JOURNAL)
+            file->kind = FILE_JOURNAL;
+        else
+            file->kind = FILE_PLAIN;
+
+        if (file->kind != FILE_PLAIN)
+        {
+            file->enc = EVP_CIPHER_CTX_new();
+            file->dec = EVP_CIPHER_CTX_new();
+            file->scratch = static_cast<unsigned char *>(sqlite3_malloc(owner->_pageSize));
+            file->page = static_cast<unsigned char *>(sqlite3_malloc(owner->_pageSize));
+            bool ok = file->enc && file->dec && file->scratch && file->page
+                      && EVP_EncryptInit_ex(file->enc, EVP_aes_256_gcm(), nullptr, owner->_key.data(), nullptr) == 1
+                      && EVP_DecryptInit_ex(file->dec, EVP_aes_256_gcm(), nullptr, owner->_key.data(), nullptr) == 1;
+            if (!ok)
+            {
+                file->base.pMethods = &methods;
+                close(f);
+                file->base.pMethods = nullptr;
+                return SQLITE_NOMEM;
+            }
+            // Journal pages are read back once, at most: not worth caching
+            if (name && file->kind != FILE_JOURNAL)
+                file->id = owner->fileId(file->kind == FILE_MAIN ? name : sqlite3_filename_database(name));
+        }
+        file->base.pMethods = &methods;
+        return SQLITE_OK;
+    }
+
+    static int remove(sqlite3_vfs *vfs, const char *name, int syncDir)
+    {
+        return base(vfs)->xDelete(base(vfs), name, syncDir);
+    }
+
+    static int access(sqlite3_vfs *vfs, const char *name, int flags, int *out)
+    {
+        return base(vfs)->xAccess(base(vfs), name, flags, out);
+    }
+
+    static int fullPathname(sqlite3_vfs *vfs, const char *name, int size, char *out)
+    {
+        return base(vfs)->xFullPathname(base(vfs), name, size, out);
+    }
+
+    static void *dlOpen(sqlite3_vfs *vfs, const char *name)
+    {
+        return base(vfs)->xDlOpen(base(vfs), name);
+    }
+
+    static void dlError(sqlite3_vfs *vfs, int size, char *out)
+    {
+        base(vfs)->xDlError(base(vfs), size, out);
+    }
+
+    static void (*dlSym(sqlite3_vfs *vfs, void *handle, const char *symbol))(void)
+    {
+        return base(vfs)->xDlSym(base(vfs), handle, symbol);
+    }
+
+    static void dlClose(sqlite3_vfs *vfs, void *handle)
+    {
+        base(vfs)->xDlClose(base(vfs), handle);
+    }
+
+    static int randomness(sqlite3_vfs *vfs, int size, char *out)
+    {
+        return base(vfs)->xRandomness(base(vfs), size, out);
+    }
+
+    static int sleep(sqlite3_vfs *vfs, int micros)
+    {
+        return base(vfs)->xSleep(base(vfs), micros);
+    }
+
+    static int currentTime(sqlite3_vfs *vfs, double *out)
+    {
+        return base(vfs)->xCurrentTime(base(vfs), out);
+    }
+
+    static int lastError(sqlite3_vfs *vfs, int size, char *out)
+    {
+        return base(vfs)->xGetLastError(base(vfs), size, out);
+    }
+
+    static int currentTimeInt64(sqlite3_vfs *vfs, sqlite3_int64 *out)
+    {
+        return base(vfs)->xCurrentTimeInt64(base(vfs), out);
+    }
+};
+
+const sqlite3_io_methods PageCipherVfs::Io::methods = {
+    3,
+    PageCipherVfs::Io::close,
+    PageCipherVfs::Io::read,
+    PageCipherVfs::Io::write,
+    PageCipherVfs::Io::truncate,
+    PageCipherVfs::Io::sync,
+    PageCipherVfs::Io::fileSize,
+    PageCipherVfs::Io::lock,
+    PageCipherVfs::Io::unlock,
+    PageCipherVfs::Io::checkReservedLock,
+    PageCipherVfs::Io::fileControl,
+    PageCipherVfs::Io::sectorSize,
+    PageCipherVfs::Io::deviceCharacteristics,
+    PageCipherVfs::Io::shmMap,
+    PageCipherVfs::Io::shmLock,
+    PageCipherVfs::Io::shmBarrier,
+    PageCipherVfs::Io::shmUnmap,
+    PageCipherVfs::Io::fetch,
+    PageCipherVfs::Io::unfetch,
+};
+
+// ============ PAGE CIPHER VFS ============
+
+PageCipherVfs::PageCipherVfs(const SecureBytes &key, int pageSize)
+    : _base(sqlite3_vfs_find(nullptr)), _key(key), _pageSize(pageSize),
+    _cachePages(static_cast<size_t>(PAGE_CACHE_PAGES) * pageSize), _slots(PAGE_CACHE_PAGES),
+    _encrypted(0), _decrypted(0), _cacheHits(0), _authFailures(0)
+{
+    if (_base == nullptr || _base->iVersion < 2)
+        throw std::runtime_error(RED "Error" RESET " no usable default SQLite VFS");
+    if (_key.size() != 32 || pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0)
+        throw std::runtime_error(RED "Error" RESET " invalid page cipher key or page size");
+
+    _name = "passman-pages-" + std::to_string(++g_vfsCount);
+
+    memset(&_vfs, 0, sizeof(_vfs));
+    _vfs.iVersion = 2;
+    _vfs.szOsFile = static_cast<int>(sizeof(File)) + _base->szOsFile;
+    _vfs.mxPathname = _base->mxPathname;
+    _vfs.zName = _name.c_str();
+    _vfs.pAppData = this;
+    _vfs.xOpen = Io::open;
+    _vfs.xDelete = Io::remove;
+    _vfs.xAccess = Io::access;
+    _vfs.xFullPathname = Io::fullPathname;
+    _vfs.xDlOpen = Io::dlOpen;
+    _vfs.xDlError = Io::dlError;
+    _vfs.xDlSym = Io::dlSym;
+    _vfs.xDlClose = Io::dlClose;
+    _vfs.xRandomness = Io::randomness;
+    _vfs.xSleep = Io::sleep;
+    _vfs.xCurrentTime = Io::currentTime;
+    _vfs.xGetLastError = Io::lastError;
+    _vfs.xCurrentTimeInt64 = Io::currentTimeInt64;
+
+    if (sqlite3_vfs_register(&_vfs, 0) != SQLITE_OK)
+        throw std::runtime_error(RED "Error" RESET " registering the page cipher VFS");
+    PrintLog(std::cout, CYAN "PageCipherVfs" RESET " - %s registered (AES-256-GCM, %d byte pages)", _name.c_str(), pageSize);
+}
+
+PageCipherVfs::~PageCipherVfs()
+{
+    sqlite3_vfs_unregister(&_vfs);
+}
+
+const char *PageCipherVfs::name() const
+{
+    return _name.c_str();
+}
+
+int PageCipherVfs::pageSize() const
+{
+    return _pageSize;
+}
+
+void PageCipherVfs::configure(sqlite3 *db, const char *schema) const
+{
+    // Page size and reserve only matter while the file is still empty. The
+    // page_size pragma resets the reserve request: it goes first
+    std::string prefix = std::string("PRAGMA ") + schema + ".";
+    std::string sql = prefix + "page_size = " + std::to_string(_pageSize) + ";"
+                    + prefix + "mmap_size = 0;"
+                    + "PRAGMA temp_store = MEMORY;";
+
+    char *errMsg = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        std::string err = errMsg ? errMsg : sqlite3_errmsg(db);
+        sqlite3_free(errMsg);
+        throw std::runtime_error(std::string(RED "Error" RESET " configuring the page cipher: ") + err);
+    }
+
+    int reserve = PAGE_RESERVED_BYTES;
+    sqlite3_file_control(db, schema, SQLITE_FCNTL_RESERVE_BYTES, &reserve);
+}
+
+PageCipherStats PageCipherVfs::getStats() const
+{
+    PageCipherStats stats;
+    stats.encrypted = _encrypted.load();
+    stats.decrypted = _decrypted.load();
+    stats.cacheHits = _cacheHits.load();
+    stats.authFailures = _authFailures.load();
+    return stats;
+}
@@ -1,21 +1,58 @@
 #include "SQLiteCipherDB.hpp"
+#include "UrlNormalizer.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
 
 // Start with: Constructor -> Helper -> Destructor -> Main Methods
-SQLiteCipherDB::SQLiteCipherDB() : db(nullptr), dbPath("")
+SQLiteCipherDB::SQLiteCipherDB(const std::string &path) : dbPath(path)
 {
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Initializing db...");
 
     // Looking for the database path
-    if (!findDataBasePath())
+    if (dbPath.empty() && !findDataBasePath())
         throw std::runtime_error(RED "Error" RESET " failed to determinate database path");
 
-    // Trying to open or create the db
-    int dbRes = sqlite3_open(dbPath.c_str(), &db);
+#if defined(PASSMAN_SQLCIPHER) || defined(PASSMAN_PAGE_VFS)
+    // Key from the vault key file, a vault left in plaintext is encrypted once
+    cipher = DatabaseCipher::forVault(dbPath);
+    if (DatabaseCipher::isPlaintextVault(dbPath))
+        cipher->encryptVault(dbPath);
+#endif
+
+    // Trying to open or create the db (this connection only lives during setup)
+    sqlite3 *db = nullptr;
+    int dbRes = sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                                cipher ? cipher->vfsName() : nullptr);
     if (dbRes != SQLITE_OK)
-        throw std::runtime_error(std::string(RED "Error" RESET " opening DB: ") + sqlite3_errmsg(db));
+    {
+        std::string err = sqlite3_errmsg(db);
+        sqlite3_close(db);
+        throw std::runtime_error(std::string(RED "Error" RESET " opening DB: ") + err);
+    }
+
+    // Wait for other instances holding the db lock instead of failing with SQLITE_BUSY
+    sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT_MS);
+
+    // Set up db (the key goes first: nothing can be read before it)
+    try
+    {
+        if (cipher)
+            cipher->apply(db);
+
+        // WAL lets readers keep going while a writer (ours or another process) commits
+        sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr);
+        setupDB(db);
+    }
+    catch (const std::exception &e)
+    {
+        sqlite3_close(db);
+        throw;
+    }
+    sqlite3_close(db);
 
-    // Set up db
-    setupDB();
+    // Open the writer and reader connections once the schema exists
+    connections = std::make_unique<ConnectionManager>(dbPath, 0, cipher.get());
 
     PrintLog(std::cout, CYAN "SQLiteCipherDB" GREEN " - db running!" RESET);
 }
@@ -46,7 +83,7 @@ bool SQLiteCipherDB::findDataBasePath(void)
     return true;
 }
 
-void SQLiteCipherDB::setupDB(void)
+void SQLiteCipherDB::setupDB(sqlite3 *db)
 {
     // sql variable (SQL execution)
     const char *sql = "CREATE TABLE IF NOT EXISTS users("
@@ -64,7 +101,15 @@ void SQLiteCipherDB::setupDB(void)
                       "encrypted_password TEXT NOT NULL,"
                       "iv TEXT NOT NULL,"
                       "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
-                      "FOREIGN KEY (user_id) REFERENCES users(id))";
+                      "FOREIGN KEY (user_id) REFERENCES users(id));"
+                      "CREATE TABLE IF NOT EXISTS vault_meta("
+                      "key TEXT PRIMARY KEY,"
+                      "value INTEGER NOT NULL);"
+                      "INSERT OR IGNORE INTO vault_meta (key, value) VALUES ('change_seq', 0);"
+                      "CREATE TABLE IF NOT EXISTS password_tombstones("
+                      "id INTEGER PRIMARY KEY,"
+                      "user_id INTEGER NOT NULL,"
+                      "change_seq INTEGER NOT NULL)";
 
     // Try to mount sql db
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Executing sql...");
@@ -76,15 +121,364 @@ void SQLiteCipherDB::setupDB(void)
         sqlite3_free(errMsg);
         throw std::runtime_error(RED "Error" RESET " Failed to create table");
     }
+
+    // Bring older db files up to the current schema
+    migrateDB(db);
+
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Setup completed!");
 }
 
+void SQLiteCipherDB::migrateDB(sqlite3 *db)
+{
+    // Check if passwords table already has the change_seq column
+    const char *checkSql = "SELECT COUNT(*) FROM pragma_table_info('passwords') WHERE name = 'change_seq'";
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v2(db, checkSql, -1, &stmt, nullptr);
+    bool hasChangeSeq = (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) > 0);
+    sqlite3_finalize(stmt);
+
+    if (!hasChangeSeq)
+    {
+        PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Adding change_seq column to passwords...");
+        const char *alterSql = "ALTER TABLE passwords ADD COLUMN change_seq INTEGER NOT NULL DEFAULT 0";
+        if (sqlite3_exec(db, alterSql, nullptr, nullptr, nullptr) != SQLITE_OK)
+            throw std::runtime_error(std::string(RED "Error" RESET " Failed to migrate passwords table: ") + sqlite3_errmsg(db));
+    }
+
+    const char *sql = "CREATE INDEX IF NOT EXISTS idx_passwords_user_seq ON passwords(user_id, change_seq);"
+                      "CREATE INDEX IF NOT EXISTS idx_tombstones_user_seq ON password_tombstones(user_id, change_seq);";
+
+    char *errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        PrintLog(std::cerr, RED "%s" RESET, errMsg ? errMsg : sqlite3_errmsg(db));
+        sqlite3_free(errMsg);
+        throw std::runtime_error(RED "Error" RESET " Failed to create change tracking indexes");
+    }
+
+    migrateSync(db);
+    migrateUrlIndex(db);
+    expireDeletions(db);
+}
+
+// SQL side of the uuid given to rows written before sync existed: a hash of
+// the row, so the copies of a vault file agree on it
+static void sqlLegacyUuid(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    typedef std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> MdPtr;
+    MdPtr md(EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    bool ok = md && EVP_DigestInit_ex(md.get(), EVP_sha256(), nullptr) == 1;
+    for (int i = 0; ok && i < argc; i++)
+    {
+        const unsigned char *text = sqlite3_value_text(argv[i]);
+        ok = EVP_DigestUpdate(md.get(), text ? text : reinterpret_cast<const unsigned char *>(""),
+                              text ? sqlite3_value_bytes(argv[i]) : 0) == 1
+             && EVP_DigestUpdate(md.get(), "\x1f", 1) == 1;
+    }
+    if (!ok || EVP_DigestFinal_ex(md.get(), hash, nullptr) != 1)
+    {
+        sqlite3_result_error(ctx, "sha256 failed", -1);
+        return;
+    }
+
+    char uuid[2 * SYNC_UUID_SIZE + 1];
+    for (int i = 0; i < SYNC_UUID_SIZE; i++)
+        snprintf(uuid + 2 * i, 3, "%02x", hash[i]);
+    sqlite3_result_text(ctx, uuid, 2 * SYNC_UUID_SIZE, SQLITE_TRANSIENT);
+}
+
+// Instance id of a <vault>.instance file: 16 hex digits, 0 if missing or unreadable
+static long long readInstanceId(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0)
+        return 0;
+    char buffer[32] = {};
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    char *end = nullptr;
+    long long value = n > 0 ? static_cast<long long>(strtoull(buffer, &end, 16)) : 0;
+    return end && (*end == '\n' || *end == '\0') && value > 0 ? value : 0;
+}
+
+static bool writeInstanceId(const std::string &path, long long instance)
+{
+    char content[32];
+    int length = snprintf(content, sizeof(content), "%016llx\n", static_cast<unsigned long long>(instance));
+    // A damaged file is replaced
+    unlink(path.c_str());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0)
+        return false;
+    bool ok = write(fd, content, length) == length && fsync(fd) == 0;
+    close(fd);
+    if (!ok)
+        unlink(path.c_str());
+    return ok;
+}
+
+void SQLiteCipherDB::migrateSync(sqlite3 *db)
+{
+    auto exec = [db](const char *sql)
+    {
+        char *errMsg = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+        {
+            std::string message = errMsg ? errMsg : sqlite3_errmsg(db);
+            sqlite3_free(errMsg);
+            sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+            throw std::runtime_error(std::string(RED "Error" RESET " Failed to set up sync tracking: ") + message);
+        }
+    };
+    auto queryInt = [db](const char *sql, long long fallback)
+    {
+        sqlite3_stmt *stmt = nullptr;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        long long value = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : fallback;
+        sqlite3_finalize(stmt);
+        return value;
+    };
+
+    sqlite3_create_function_v2(db, "passman_legacy_uuid", 4, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                               nullptr, sqlLegacyUuid, nullptr, nullptr, nullptr);
+
+    // change_log keeps the last version of every record of the vault (deleted
+    // ones too), which is what a peer needs: VaultSync exports the rows past
+    // its last export, a peer's versions are applied when they are newer
+    exec("BEGIN IMMEDIATE;"
+         "CREATE TABLE IF NOT EXISTS change_log("
+         "uuid TEXT PRIMARY KEY,"
+         "user_id INTEGER NOT NULL,"
+         "change_seq INTEGER NOT NULL,"
+         "revision INTEGER NOT NULL,"
+         "origin INTEGER NOT NULL,"
+         "deleted INTEGER NOT NULL DEFAULT 0,"
+         "synced INTEGER NOT NULL DEFAULT 0,"
+         "deleted_at INTEGER NOT NULL DEFAULT 0);"
+         "CREATE INDEX IF NOT EXISTS idx_change_log_user_seq ON change_log(user_id, change_seq);"
+         "INSERT OR IGNORE INTO vault_meta (key, value) VALUES ('vault_id', (random() & 0x7fffffffffffffff) | 1);");
+
+    if (queryInt("SELECT COUNT(*) FROM pragma_table_info('change_log') WHERE name = 'deleted_at'", 0) == 0)
+    {
+        // Deletions of unknown age start their horizon now. The delete trigger is replaced
+        exec("ALTER TABLE change_log ADD COLUMN deleted_at INTEGER NOT NULL DEFAULT 0;"
+             "UPDATE change_log SET deleted_at = CAST(strftime('%s', 'now') AS INTEGER) WHERE deleted = 1;"
+             "DROP TRIGGER IF EXISTS passwords_seq_delete;");
+    }
+
+    if (queryInt("SELECT COUNT(*) FROM pragma_table_info('passwords') WHERE name = 'uuid'", 0) == 0)
+    {
+        PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Adding sync columns to passwords...");
+        // Existing rows are version 0 of no vault: identical on the copies of a
+        // file, so they are not taken for changes. The triggers are replaced
+        exec("ALTER TABLE passwords ADD COLUMN uuid TEXT NOT NULL DEFAULT '';"
+             "ALTER TABLE passwords ADD COLUMN revision INTEGER NOT NULL DEFAULT 0;"
+             "ALTER TABLE passwords ADD COLUMN origin INTEGER NOT NULL DEFAULT 0;"
+             "UPDATE passwords SET uuid = passman_legacy_uuid(id, user_id, created_at, website);"
+             "INSERT OR IGNORE INTO change_log (uuid, user_id, change_seq, revision, origin) "
+             "SELECT uuid, user_id, change_seq, revision, origin FROM passwords;"
+             "DROP TRIGGER IF EXISTS passwords_seq_insert;"
+             "DROP TRIGGER IF EXISTS passwords_seq_update;"
+             "DROP TRIGGER IF EXISTS passwords_seq_delete;");
+    }
+
+    // Every write on passwords (from any process) bumps the vault change sequence,
+    // stamps the row with it and records the new version in change_log. A local
+    // write (revision and origin left alone) is a new revision of this vault;
+    // VaultSync sets both itself. Deletions leave a tombstone behind
+    exec("CREATE UNIQUE INDEX IF NOT EXISTS idx_passwords_uuid ON passwords(uuid);"
+         "CREATE TRIGGER IF NOT EXISTS passwords_seq_insert AFTER INSERT ON passwords BEGIN "
+         "UPDATE vault_meta SET value = value + 1 WHERE key = 'change_seq';"
+         "UPDATE passwords SET change_seq = (SELECT value FROM vault_meta WHERE key = 'change_seq'),"
+         "uuid = CASE WHEN NEW.uuid = '' THEN lower(hex(randomblob(16))) ELSE NEW.uuid END,"
+         "revision = CASE WHEN NEW.origin = 0 THEN 1 ELSE NEW.revision END,"
+         "origin = CASE WHEN NEW.origin = 0 THEN (SELECT value FROM vault_meta WHERE key = 'vault_id') ELSE NEW.origin END "
+         "WHERE id = NEW.id;"
+         "DELETE FROM password_tombstones WHERE id = NEW.id;"
+         "INSERT OR REPLACE INTO change_log (uuid, user_id, change_seq, revision, origin, deleted, synced) "
+         "SELECT uuid, user_id, change_seq, revision, origin, 0, 0 FROM passwords WHERE id = NEW.id;"
+         "END;"
+         "CREATE TRIGGER IF NOT EXISTS passwords_seq_update "
+         "AFTER UPDATE OF user_id, website, username, encrypted_password, iv ON passwords BEGIN "
+         "UPDATE vault_meta SET value = value + 1 WHERE key = 'change_seq';"
+         "UPDATE passwords SET change_seq = (SELECT value FROM vault_meta WHERE key = 'change_seq'),"
+         "revision = CASE WHEN NEW.revision = OLD.revision AND NEW.origin = OLD.origin "
+         "THEN OLD.revision + 1 ELSE NEW.revision END,"
+         "origin = CASE WHEN NEW.revision = OLD.revision AND NEW.origin = OLD.origin "
+         "THEN (SELECT value FROM vault_meta WHERE key = 'vault_id') ELSE NEW.origin END "
+         "WHERE id = NEW.id;"
+         "INSERT OR REPLACE INTO change_log (uuid, user_id, change_seq, revision, origin, deleted, synced) "
+         "SELECT uuid, user_id, change_seq, revision, origin, 0, 0 FROM passwords WHERE id = NEW.id;"
+         "END;"
+         "CREATE TRIGGER IF NOT EXISTS passwords_seq_delete AFTER DELETE ON passwords BEGIN "
+         "UPDATE vault_meta SET value = value + 1 WHERE key = 'change_seq';"
+         "INSERT OR REPLACE INTO password_tombstones (id, user_id, change_seq) "
+         "VALUES (OLD.id, OLD.user_id, (SELECT value FROM vault_meta WHERE key = 'change_seq'));"
+         "INSERT OR REPLACE INTO change_log (uuid, user_id, change_seq, revision, origin, deleted, synced, deleted_at) "
+         "VALUES (OLD.uuid, OLD.user_id, (SELECT value FROM vault_meta WHERE key = 'change_seq'), "
+         "OLD.revision + 1, (SELECT value FROM vault_meta WHERE key = 'vault_id'), 1, 0, "
+         "CAST(strftime('%s', 'now') AS INTEGER));"
+         "END;");
+
+    // A copy of the file takes a new vault id, or its changes would be mixed
+    // up with the original's. The original becomes a peer already applied up
+    // to its last export, the changes past it are exported again under the new
+    // id (the original sees them as stale).
+    // Copies are told by the instance id kept next to the file (<vault>.instance)
+    // and in it: the pair survives the file being replaced by rename (encryptVault,
+    // editors, sync tools) but a copy of the file alone has no matching one.
+    // Left ambiguous: a copy made together with its .instance file keeps the
+    // vault id (copy the .db alone), and a lost .instance file is taken for a
+    // copy (one extra export, nothing is lost)
+    long long stored = queryInt("SELECT value FROM vault_meta WHERE key = 'vault_instance'", 0);
+    std::string instancePath = dbPath + SYNC_INSTANCE_SUFFIX;
+    long long instance = readInstanceId(instancePath);
+    if (instance == 0)
+    {
+        // A new id: the first open since tracking started (nothing stored)
+        // keeps the vault id, otherwise this is a copy
+        instance = queryInt("SELECT (random() & 0x7fffffffffffffff) | 1", 1);
+        if (!writeInstanceId(instancePath, instance))
+        {
+            // Without the file every open would look like a copy
+            PrintLog(std::cerr, CYAN "SQLiteCipherDB" RESET " - " RED "Cannot write %s, copies of the vault "
+                     "won't be told apart" RESET, instancePath.c_str());
+            exec("COMMIT;");
+            return;
+        }
+    }
+    if (stored != 0 && stored != instance)
+    {
+        PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Vault file was copied, new vault id");
+        exec("INSERT OR REPLACE INTO vault_meta (key, value) "
+             "SELECT 'sync_peer:' || substr(key, 15) || ':' || printf('%016x', "
+             "(SELECT value FROM vault_meta WHERE key = 'vault_id')), value "
+             "FROM vault_meta WHERE key LIKE 'sync_exported:%';"
+             "UPDATE change_log SET synced = 1 WHERE synced = 0 AND change_seq <= COALESCE("
+             "(SELECT value FROM vault_meta WHERE key = 'sync_exported:' || change_log.user_id), 0);"
+             "UPDATE vault_meta SET value = (random() & 0x7fffffffffffffff) | 1 WHERE key = 'vault_id';"
+             "DELETE FROM vault_meta WHERE key LIKE 'sync_exported:%';");
+    }
+    std::string sql = "DELETE FROM vault_meta WHERE key = 'vault_inode';"
+                      "INSERT OR REPLACE INTO vault_meta (key, value) VALUES ('vault_instance', "
+                    + std::to_string(instance) + ");"
+                      "COMMIT;";
+    exec(sql.c_str());
+}
+
+// A deleted record is remembered (tombstone and change_log row) so refreshes
+// and peers learn about it, and so an older version arriving later loses.
+// Users with sync peers forget them once every peer has applied them (see
+// pruneDeletions), the others after SYNC_DELETION_HORIZON_DAYS
+void SQLiteCipherDB::expireDeletions(sqlite3 *db)
+{
+    // Newest expired deletion per user. Deletion sequences grow with time,
+    // so every deletion up to it is older too
+    std::string expired =
+        "(SELECT MAX(c.change_seq) FROM change_log c WHERE c.user_id = %1.user_id AND c.deleted = 1 "
+        "AND c.deleted_at < CAST(strftime('%s', 'now') AS INTEGER) - "
+        + std::to_string(SYNC_DELETION_HORIZON_DAYS * 86400LL) + " "
+        "AND NOT EXISTS (SELECT 1 FROM vault_meta WHERE key LIKE 'sync_peer:' || c.user_id || ':%'))";
+    auto bound = [&expired](const std::string &table)
+    {
+        std::string sql = expired;
+        sql.replace(sql.find("%1"), 2, table);
+        return sql;
+    };
+    // Tombstones first: they are matched against the change_log rows
+    std::string sqls[] = {
+        "DELETE FROM password_tombstones WHERE change_seq <= " + bound("password_tombstones"),
+        "DELETE FROM change_log WHERE deleted = 1 AND change_seq <= " + bound("change_log"),
+    };
+
+    bool ok = sqlite3_exec(db, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr) == SQLITE_OK;
+    int dropped = 0;
+    for (const std::string &sql : sqls)
+    {
+        ok = ok && sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+        dropped += ok ? sqlite3_changes(db) : 0;
+    }
+    ok = ok && sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr) == SQLITE_OK;
+    if (!ok)
+    {
+        // Only bookkeeping: the vault works the same, the rows wait for the next open
+        PrintLog(std::cerr, CYAN "SQLiteCipherDB" RESET " - " RED "Cannot expire old deletions: %s" RESET,
+                 sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        return;
+    }
+    if (dropped > 0)
+        PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Forgot deletions older than %d days (%d rows)",
+                 SYNC_DELETION_HORIZON_DAYS, dropped);
+}
+
+// SQL side of normalizeUrl, only registered on the setup connection for the backfill
+static void sqlUrlKey(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    (void)argc;
+    const unsigned char *text = sqlite3_value_text(argv[0]);
+    NormalizedUrl normalized = normalizeUrl(text ? reinterpret_cast<const char *>(text) : "");
+    const std::string &key = sqlite3_user_data(ctx) ? normalized.domain : normalized.host;
+    sqlite3_result_text(ctx, key.c_str(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+}
+
+void SQLiteCipherDB::migrateUrlIndex(sqlite3 *db)
+{
+    // Normalized lookup keys of the website column (see UrlNormalizer.hpp)
+    const char *checkSql = "SELECT COUNT(*) FROM pragma_table_info('passwords') WHERE name = 'domain'";
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v2(db, checkSql, -1, &stmt, nullptr);
+    bool hasDomain = (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) > 0);
+    sqlite3_finalize(stmt);
+
+    if (!hasDomain)
+    {
+        PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Adding host and domain columns to passwords...");
+        const char *alterSql = "ALTER TABLE passwords ADD COLUMN host TEXT NOT NULL DEFAULT '';"
+                               "ALTER TABLE passwords ADD COLUMN domain TEXT NOT NULL DEFAULT '';";
+        if (sqlite3_exec(db, alterSql, nullptr, nullptr, nullptr) != SQLITE_OK)
+            throw std::runtime_error(std::string(RED "Error" RESET " Failed to migrate passwords table: ") + sqlite3_errmsg(db));
+    }
+
+    // Rules changed since the keys were computed: recompute every row
+    long long version = 0;
+    sqlite3_prepare_v2(db, "SELECT value FROM vault_meta WHERE key = 'url_index'", -1, &stmt, nullptr);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        version = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+
+    static int domainFlag = 1;
+    sqlite3_create_function_v2(db, "passman_url_host", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                               nullptr, sqlUrlKey, nullptr, nullptr, nullptr);
+    sqlite3_create_function_v2(db, "passman_url_domain", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                               &domainFlag, sqlUrlKey, nullptr, nullptr, nullptr);
+
+    std::string sql = "BEGIN IMMEDIATE;"
+                      "UPDATE passwords SET host = passman_url_host(website), domain = passman_url_domain(website)";
+    // Domain is never empty for a non empty website, so empty ones were
+    // written by a build that predates the columns
+    if (version == URL_INDEX_VERSION)
+        sql += " WHERE domain = '' AND website <> ''";
+    sql += ";INSERT OR REPLACE INTO vault_meta (key, value) VALUES ('url_index', " + std::to_string(URL_INDEX_VERSION) + ");"
+           "CREATE INDEX IF NOT EXISTS idx_passwords_user_domain ON passwords(user_id, domain);"
+           "COMMIT;";
+
+    char *errMsg = nullptr;
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        PrintLog(std::cerr, RED "%s" RESET, errMsg ? errMsg : sqlite3_errmsg(db));
+        sqlite3_free(errMsg);
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        throw std::runtime_error(RED "Error" RESET " Failed to build the url index");
+    }
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Url index ready (version %d)", URL_INDEX_VERSION);
+}
+
 SQLiteCipherDB::~SQLiteCipherDB()
 {
-    // Check for db state
-    if (db != nullptr)
-        sqlite3_close(db);
-    db = nullptr;
+    // Flush pending writes and close every connection
+    connections.reset();
 
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - db closed");
 }
@@ -97,28 +491,33 @@ bool SQLiteCipherDB::createUser(const std::string &username,
 {
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Adding new user %s...", username.c_str());
 
-    // sql line
-    const char *sql = "INSERT INTO users (username, password_hash, password_salt, is_admin) VALUES (?, ?, ?, ?);";
-
-    // prepare order to db
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-
-    // Binding parameters values
-    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, passwordHash.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, salt.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 4, isMaster ? 1 : 0);
-
-    // Send the order to the spql
-    int rSql = sqlite3_step(stmt);
-    if (rSql != SQLITE_DONE)
+    DBWriter &writer = connections->writer();
+    auto op = [&writer, username, passwordHash, salt, isMaster](sqlite3 *)
+    {
+        // sql line
+        const char *sql = "INSERT INTO users (username, password_hash, password_salt, is_admin) VALUES (?, ?, ?, ?);";
+
+        // prepare order to db
+        sqlite3_stmt *stmt = writer.prepare(sql);
+        if (!stmt)
+            return false;
+
+        // Binding parameters values
+        sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, passwordHash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, salt.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, isMaster ? 1 : 0);
+
+        // Send the order to the spql
+        int rSql = sqlite3_step(stmt);
+        return rSql == SQLITE_DONE;
+    };
+
+    if (!writer.submit(op).get())
     {
-        sqlite3_finalize(stmt); // finalize db order
         PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - " RED " Can´t add user %s to the db" RESET, username.c_str());
         return false;
     }
-    sqlite3_finalize(stmt); // finalize db order
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " -  user %s added to the db" RESET, username.c_str());
     return true;
 }
@@ -135,8 +534,8 @@ bool SQLiteCipherDB::getUserHash(
     const char *sql = "SELECT password_hash, password_salt FROM users WHERE username = ?";
 
     // Prepare order to db
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
 
     // Binding parameters values
     sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
@@ -145,7 +544,6 @@ bool SQLiteCipherDB::getUserHash(
     int rSql = sqlite3_step(stmt);
     if (rSql != SQLITE_ROW) // Handle sqlite order here (if not found a SQLITE ROW)
     {
-        sqlite3_finalize(stmt); // finalize db order
         PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - " RED " Can´t find %s in the db" RESET, username.c_str());
         return false;
     }
@@ -161,14 +559,12 @@ bool SQLiteCipherDB::getUserHash(
     }
     else
     {
-        sqlite3_finalize(stmt); // finalize db order
         if (hash_ptr == nullptr)
             PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - " RED " Can´t find %s hash in the db" RESET, username.c_str());
         if (salt_ptr == nullptr)
             PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - " RED " Can´t find %s salt in the db" RESET, username.c_str());
         return false;
     }
-    sqlite3_finalize(stmt); // finalize db order
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - %s hash and salt obtaining", username.c_str());
     return true;
 }
@@ -182,8 +578,8 @@ bool SQLiteCipherDB::userExists(const std::string &username) const
     const char *sql = "SELECT COUNT(*) FROM users WHERE username = ?";
 
     // Prepare order to db
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
 
     // Binding parameters values
     sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
@@ -192,13 +588,11 @@ bool SQLiteCipherDB::userExists(const std::string &username) const
     int rSql = sqlite3_step(stmt);
     if (rSql != SQLITE_ROW) // Handle sqlite order here (if not found a SQLITE ROW)
     {
-        sqlite3_finalize(stmt); // finalize db order
         PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - " RED " Can´t find %s user in the db" RESET, username.c_str());
         return false;
     }
     // Get column 0 (username) as integer
     int count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt); // finalize db order
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " -  %s user appears %d times", username.c_str(), count);
     return (count > 0);
 }
@@ -215,11 +609,10 @@ bool SQLiteCipherDB::isMasterUser(const std::string &username) const
 
     // Check user count (is admin or not)
     const char *countSql = "SELECT COUNT(*) FROM users";
-    sqlite3_stmt *countStmt = nullptr;
-    sqlite3_prepare_v2(db, countSql, -1, &countStmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *countStmt = conn.prepare(countSql);
     sqlite3_step(countStmt);
     int userCount = sqlite3_column_int(countStmt, 0);
-    sqlite3_finalize(countStmt);
 
     // Decide is_admin
     int is_admin = (userCount == 0) ? 1 : 0;
@@ -239,21 +632,19 @@ bool SQLiteCipherDB::hasMasterUser() const
     const char *sql = "SELECT COUNT(*) FROM users WHERE is_admin = 1";
 
     // Prepare order to db
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
 
     // Send the order to the sql
     int rSql = sqlite3_step(stmt);
     if (rSql != SQLITE_ROW)
     {
-        sqlite3_finalize(stmt);
         PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - " RED "Error checking for master user" RESET);
         return false;
     }
 
     // Get the count of admin users
     int adminCount = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
 
     if (adminCount > 0)
     {
@@ -274,20 +665,18 @@ int SQLiteCipherDB::getUserIdByUsername(const std::string &username) const
 
     const char *sql = "SELECT id FROM users WHERE username = ?";
 
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
 
     sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
     int rSql = sqlite3_step(stmt);
     if (rSql != SQLITE_ROW)
     {
-        sqlite3_finalize(stmt);
         PrintLog(std::cerr, CYAN "SQLiteCipherDB" RESET " - " RED "Can't find [%s] users ID" RESET, username.c_str());
         return -1;
     }
     
     int user_id = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
 
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - User [%s] ID: %d", username.c_str(), user_id);
     return user_id;
@@ -304,29 +693,69 @@ bool SQLiteCipherDB::addPassword(
 {
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Adding new password for %s...", website.c_str());
 
-    const char *sql = "INSERT INTO passwords (user_id, website, username, encrypted_password, iv) VALUES (?, ?, ?, ?, ?);";
-
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-
-    sqlite3_bind_int(stmt, 1, user_id);
-    sqlite3_bind_text(stmt, 2, website.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, username.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, encrypted_password.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 5, iv.c_str(), -1, SQLITE_STATIC);
-
-    int rSql = sqlite3_step(stmt);
-    if (rSql != SQLITE_DONE)
+    if (!addPasswordAsync(user_id, website, username, encrypted_password, iv).get())
     {
-        sqlite3_finalize(stmt);
         PrintLog(std::cerr, CYAN "SQLiteCipherDB" RESET " - " RED "Can't add password for %s" RESET, website.c_str());
         return false;
     }
-    sqlite3_finalize(stmt);
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Password for %s added successfully", website.c_str());
     return true;
 }
 
+std::future<bool> SQLiteCipherDB::addPasswordAsync(
+    int user_id,
+    const std::string &website,
+    const std::string &username,
+    const std::string &encrypted_password,
+    const std::string &iv,
+    WriteCallback onDone) const
+{
+    NormalizedUrl url = normalizeUrl(website);
+    DBWriter &writer = connections->writer();
+    auto op = [&writer, user_id, website, username, encrypted_password, iv, url](sqlite3 *)
+    {
+        const char *sql = "INSERT INTO passwords (user_id, website, username, encrypted_password, iv, host, domain) "
+                          "VALUES (?, ?, ?, ?, ?, ?, ?);";
+
+        sqlite3_stmt *stmt = writer.prepare(sql);
+        if (!stmt)
+            return false;
+
+        sqlite3_bind_int(stmt, 1, user_id);
+        sqlite3_bind_text(stmt, 2, website.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, username.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, encrypted_password.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 5, iv.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 6, url.host.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 7, url.domain.c_str(), -1, SQLITE_STATIC);
+
+        int rSql = sqlite3_step(stmt);
+        return rSql == SQLITE_DONE;
+    };
+    return writer.submit(op, onDone);
+}
+
+// id, website, username, encrypted_password, iv, created_at of the current step.
+// The views live until the next step or reset of stmt
+static PasswordView readRow(sqlite3_stmt *stmt)
+{
+    auto column = [stmt](int index)
+    {
+        // text first, then bytes: the length is the one of the text conversion
+        const char *text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, index));
+        return std::string_view(text ? text : "", text ? sqlite3_column_bytes(stmt, index) : 0);
+    };
+
+    PasswordView row;
+    row.id = sqlite3_column_int(stmt, 0);
+    row.website = column(1);
+    row.username = column(2);
+    row.encrypted_password = column(3);
+    row.iv = column(4);
+    row.created_at = column(5);
+    return row;
+}
+
 // Get all passwords from the database
 std::vector<Password> SQLiteCipherDB::getAllPasswords() const
 {
@@ -336,24 +765,12 @@ std::vector<Password> SQLiteCipherDB::getAllPasswords() const
     std::vector<Password> passwords;
     const char *sql = "SELECT id, website, username, encrypted_password, iv, created_at FROM passwords;";
 
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
 
+    // Rows are built in place, no per row log (it cost more than the row)
     while (sqlite3_step(stmt) == SQLITE_ROW)
-    {
-        int id = sqlite3_column_int(stmt, 0);
-        const char *website_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-        const char *user_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
-        const char *pass_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
-        const char *iv_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4));
-        const char *created_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 5));
-
-        Password pwd(id, website_ptr, user_ptr, pass_ptr, iv_ptr, created_ptr);
-        passwords.push_back(pwd);
-
-        PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Password loaded: %s", website_ptr);
-    }
-    sqlite3_finalize(stmt);
+        passwords.emplace_back(readRow(stmt));
 
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Retrieved %lu passwords", passwords.size());
     return passwords;
@@ -367,30 +784,58 @@ std::vector<Password> SQLiteCipherDB::getPasswordsByUserId(int user_id) const
     std::vector<Password> pwds;
     const char *sql = "SELECT id, website, username, encrypted_password, iv, created_at FROM passwords WHERE user_id = ?";
 
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
 
     // Bind user_id variable into the sql order
     sqlite3_bind_int(stmt, 1, user_id);
 
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        pwds.emplace_back(readRow(stmt));
+
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Retrieved %lu passwords for user [%d]", pwds.size(), user_id);
+    return pwds;
+}
+
+size_t SQLiteCipherDB::forEachPassword(int user_id, const std::function<void(const PasswordView &)> &fn) const
+{
+    const char *sql = "SELECT id, website, username, encrypted_password, iv, created_at FROM passwords WHERE user_id = ? "
+                      "ORDER BY id";
+
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
+    sqlite3_bind_int(stmt, 1, user_id);
+
+    size_t rows = 0;
     while (sqlite3_step(stmt) == SQLITE_ROW)
     {
-        int id = sqlite3_column_int(stmt, 0);
-        const char *website_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
-        const char *user_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
-        const char *pass_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
-        const char *iv_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4));
-        const char *created_ptr = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 5));
+        fn(readRow(stmt));
+        rows++;
+    }
+    return rows;
+}
 
-        Password pwd(id, website_ptr, user_ptr, pass_ptr, iv_ptr, created_ptr);
-        pwds.push_back(pwd);
+void SQLiteCipherDB::loadVaultCache(int user_id, VaultCache &cache) const
+{
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Loading [%d] user id passwords into the cache...", user_id);
+
+    // Size the columns and the arena up front (only a hint if a write lands in between)
+    const char *sizeSql = "SELECT COUNT(*), TOTAL(LENGTH(website) + (LENGTH(encrypted_password) + LENGTH(iv)) / 2) "
+                          "FROM passwords WHERE user_id = ?";
 
-        PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Password loaded: %s for user id [%d]", website_ptr, user_id);
+    cache.clear();
+    {
+        ReaderLease conn = connections->reader();
+        sqlite3_stmt *sizeStmt = conn.prepare(sizeSql);
+        sqlite3_bind_int(sizeStmt, 1, user_id);
+        if (sqlite3_step(sizeStmt) == SQLITE_ROW)
+            cache.reserve(sqlite3_column_int64(sizeStmt, 0), static_cast<size_t>(sqlite3_column_double(sizeStmt, 1)));
     }
-    sqlite3_finalize(stmt);
 
-    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Retrieved %lu passwords for user [%d]", pwds.size(), user_id);
-    return pwds;
+    forEachPassword(user_id, [&cache](const PasswordView &row) { cache.append(row); });
+
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Cached %lu passwords (%lu bytes, %lu interned strings) for user [%d]",
+             cache.size(), cache.memoryUsage(), cache.internedCount(), user_id);
 }
 
 // Get a specific password by ID
@@ -400,31 +845,51 @@ bool SQLiteCipherDB::getPassword(int id, Password &password) const
 
     const char *sql = "SELECT id, website, username, encrypted_password, iv, created_at FROM passwords WHERE id = ?";
 
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
 
     sqlite3_bind_int(stmt, 1, id);
 
     int rSql = sqlite3_step(stmt);
     if (rSql != SQLITE_ROW)
     {
-        sqlite3_finalize(stmt);
         PrintLog(std::cerr, CYAN "SQLiteCipherDB" RESET " - " RED "Password with ID %d not found" RESET, id);
         return false;
     }
 
-    password.id = sqlite3_column_int(stmt, 0);
-    password.website = std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)));
-    password.username = std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)));
-    password.encrypted_password = std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3)));
-    password.iv = std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4)));
-    password.created_at = std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 5)));
+    password = Password(readRow(stmt));
 
-    sqlite3_finalize(stmt);
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Password retrieved successfully");
     return true;
 }
 
+// Look up entries by URL through idx_passwords_user_domain
+std::vector<UrlMatch> SQLiteCipherDB::findByUrl(int user_id, const std::string &url) const
+{
+    std::vector<UrlMatch> matches;
+    NormalizedUrl wanted = normalizeUrl(url);
+    if (wanted.domain.empty())
+        return matches;
+
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Looking up %s (domain %s)...", wanted.host.c_str(), wanted.domain.c_str());
+
+    const char *sql = "SELECT id, website, username, encrypted_password, iv, created_at, host = ? AS exact "
+                      "FROM passwords WHERE user_id = ? AND domain = ? ORDER BY exact DESC, id";
+
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
+
+    sqlite3_bind_text(stmt, 1, wanted.host.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, user_id);
+    sqlite3_bind_text(stmt, 3, wanted.domain.c_str(), -1, SQLITE_STATIC);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        matches.push_back(UrlMatch{Password(readRow(stmt)), sqlite3_column_int(stmt, 6) != 0});
+
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - %lu entries match %s", matches.size(), wanted.host.c_str());
+    return matches;
+}
+
 // Update a password by ID
 bool SQLiteCipherDB::updatePassword(
     int id,
@@ -435,53 +900,101 @@ bool SQLiteCipherDB::updatePassword(
 {
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Updating password with ID %d...", id);
 
-    const char *sql = "UPDATE passwords SET website = ?, username = ?, encrypted_password = ?, iv = ? WHERE id = ?";
-
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-
-    sqlite3_bind_text(stmt, 1, website.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, encrypted_password.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, iv.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 5, id);
-
-    int rSql = sqlite3_step(stmt);
-    if (rSql != SQLITE_DONE)
+    if (!updatePasswordAsync(id, website, username, encrypted_password, iv).get())
     {
-        sqlite3_finalize(stmt);
         PrintLog(std::cerr, CYAN "SQLiteCipherDB" RESET " - " RED "Failed to update password with ID %d" RESET, id);
         return false;
     }
-    sqlite3_finalize(stmt);
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Password with ID %d updated successfully", id);
     return true;
 }
 
+std::future<bool> SQLiteCipherDB::updatePasswordAsync(
+    int id,
+    const std::string &website,
+    const std::string &username,
+    const std::string &encrypted_password,
+    const std::string &iv,
+    WriteCallback onDone) const
+{
+    NormalizedUrl url = normalizeUrl(website);
+    DBWriter &writer = connections->writer();
+    auto op = [&writer, id, website, username, encrypted_password, iv, url](sqlite3 *)
+    {
+        const char *sql = "UPDATE passwords SET website = ?, username = ?, encrypted_password = ?, iv = ?, "
+                          "host = ?, domain = ? WHERE id = ?";
+
+        sqlite3_stmt *stmt = writer.prepare(sql);
+        if (!stmt)
+            return false;
+
+        sqlite3_bind_text(stmt, 1, website.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, encrypted_password.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, iv.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 5, url.host.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 6, url.domain.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 7, id);
+
+        int rSql = sqlite3_step(stmt);
+        return rSql == SQLITE_DONE;
+    };
+    return writer.submit(op, notifyPasswordChanged(id, std::move(onDone)));
+}
+
 // Delete a password by ID
 bool SQLiteCipherDB::deletePassword(int id) const
 {
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Deleting password with ID %d...", id);
 
-    const char *sql = "DELETE FROM passwords WHERE id = ?";
-
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
-
-    sqlite3_bind_int(stmt, 1, id);
-
-    int rSql = sqlite3_step(stmt);
-    if (rSql != SQLITE_DONE)
+    if (!deletePasswordAsync(id).get())
     {
-        sqlite3_finalize(stmt);
         PrintLog(std::cerr, CYAN "SQLiteCipherDB" RESET " - " RED "Failed to delete password with ID %d" RESET, id);
         return false;
     }
-    sqlite3_finalize(stmt);
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Password with ID %d deleted successfully", id);
     return true;
 }
 
+std::future<bool> SQLiteCipherDB::deletePasswordAsync(int id, WriteCallback onDone) const
+{
+    DBWriter &writer = connections->writer();
+    auto op = [&writer, id](sqlite3 *)
+    {
+        const char *sql = "DELETE FROM passwords WHERE id = ?";
+
+        sqlite3_stmt *stmt = writer.prepare(sql);
+        if (!stmt)
+            return false;
+
+        sqlite3_bind_int(stmt, 1, id);
+
+        int rSql = sqlite3_step(stmt);
+        return rSql == SQLITE_DONE;
+    };
+    return writer.submit(op, notifyPasswordChanged(id, std::move(onDone)));
+}
+
+void SQLiteCipherDB::setPasswordChangeListener(PasswordChangeListener listener)
+{
+    passwordChanged = std::move(listener);
+}
+
+// Runs the listener after a successful commit, then the caller's own callback
+WriteCallback SQLiteCipherDB::notifyPasswordChanged(int id, WriteCallback onDone) const
+{
+    if (!passwordChanged)
+        return onDone;
+
+    return [this, id, onDone = std::move(onDone)](bool ok)
+    {
+        if (ok)
+            passwordChanged(id);
+        if (onDone)
+            onDone(ok);
+    };
+}
+
 // Get the number of stored passwords
 int SQLiteCipherDB::getPasswordCount() const
 {
@@ -489,20 +1002,373 @@ int SQLiteCipherDB::getPasswordCount() const
 
     const char *sql = "SELECT COUNT(*) FROM passwords";
 
-    sqlite3_stmt *stmt = nullptr;
-    sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
 
     int rSql = sqlite3_step(stmt);
     if (rSql != SQLITE_ROW)
     {
-        sqlite3_finalize(stmt);
         PrintLog(std::cerr, CYAN "SQLiteCipherDB" RESET " - " RED "Failed to get password count" RESET);
         return 0;
     }
 
     int count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
 
     PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Total passwords: %d", count);
     return count;
 }
+
+// ============ CHANGE DETECTION ============
+
+const std::string &SQLiteCipherDB::getPath() const
+{
+    return dbPath;
+}
+
+const DatabaseCipher *SQLiteCipherDB::getCipher() const
+{
+    return cipher.get();
+}
+
+// PRAGMA data_version only changes when another connection commits, so polling it is cheap
+long long SQLiteCipherDB::getDataVersion() const
+{
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare("PRAGMA data_version");
+
+    long long version = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        version = sqlite3_column_int64(stmt, 0);
+
+    return version;
+}
+
+// Get the last change sequence number stamped by the triggers
+long long SQLiteCipherDB::getChangeSeq() const
+{
+    const char *sql = "SELECT value FROM vault_meta WHERE key = 'change_seq'";
+
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
+
+    long long seq = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        seq = sqlite3_column_int64(stmt, 0);
+
+    return seq;
+}
+
+// Get the user's passwords inserted or updated after seq
+std::vector<Password> SQLiteCipherDB::getPasswordsChangedSince(int user_id, long long seq) const
+{
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Retrieving [%d] user id passwords changed since %lld...", user_id, seq);
+
+    std::vector<Password> pwds;
+    const char *sql = "SELECT id, website, username, encrypted_password, iv, created_at FROM passwords "
+                      "WHERE user_id = ? AND change_seq > ? ORDER BY change_seq";
+
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
+
+    sqlite3_bind_int(stmt, 1, user_id);
+    sqlite3_bind_int64(stmt, 2, seq);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        pwds.emplace_back(readRow(stmt));
+
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - %lu passwords changed for user [%d]", pwds.size(), user_id);
+    return pwds;
+}
+
+// Get the ids of the user's passwords deleted after seq
+std::vector<int> SQLiteCipherDB::getDeletedPasswordIdsSince(int user_id, long long seq) const
+{
+    std::vector<int> ids;
+    const char *sql = "SELECT id FROM password_tombstones WHERE user_id = ? AND change_seq > ?";
+
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
+
+    sqlite3_bind_int(stmt, 1, user_id);
+    sqlite3_bind_int64(stmt, 2, seq);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        ids.push_back(sqlite3_column_int(stmt, 0));
+
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - %lu passwords deleted for user [%d]", ids.size(), user_id);
+    return ids;
+}
+
+// ============ SYNC ============
+
+long long SQLiteCipherDB::getVaultId() const
+{
+    return getSyncState("vault_id");
+}
+
+long long SQLiteCipherDB::getSyncState(const std::string &key, long long fallback) const
+{
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare("SELECT value FROM vault_meta WHERE key = ?");
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+
+    long long value = fallback;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        value = sqlite3_column_int64(stmt, 0);
+    return value;
+}
+
+bool SQLiteCipherDB::setSyncState(const std::string &key, long long value) const
+{
+    DBWriter &writer = connections->writer();
+    auto op = [&writer, key, value](sqlite3 *)
+    {
+        sqlite3_stmt *stmt = writer.prepare("INSERT OR REPLACE INTO vault_meta (key, value) VALUES (?, ?)");
+        if (!stmt)
+            return false;
+        sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, value);
+        int rSql = sqlite3_step(stmt);
+        return rSql == SQLITE_DONE;
+    };
+    return writer.submit(op).get();
+}
+
+size_t SQLiteCipherDB::pruneDeletions(int user_id, long long seq) const
+{
+    auto dropped = std::make_shared<size_t>(0);
+    DBWriter &writer = connections->writer();
+    auto op = [&writer, user_id, seq, dropped](sqlite3 *wdb)
+    {
+        const char *sqls[] = {
+            "DELETE FROM password_tombstones WHERE user_id = ? AND change_seq <= ?",
+            "DELETE FROM change_log WHERE user_id = ? AND change_seq <= ? AND deleted = 1",
+        };
+        bool ok = true;
+        for (const char *sql : sqls)
+        {
+            sqlite3_stmt *stmt = ok ? writer.prepare(sql) : nullptr;
+            ok = stmt != nullptr;
+            if (ok)
+            {
+                sqlite3_bind_int(stmt, 1, user_id);
+                sqlite3_bind_int64(stmt, 2, seq);
+                ok = sqlite3_step(stmt) == SQLITE_DONE;
+                *dropped += ok ? sqlite3_changes(wdb) : 0;
+            }
+        }
+        return ok;
+    };
+    if (!writer.submit(op).get())
+        return 0;
+    return *dropped;
+}
+
+size_t SQLiteCipherDB::forEachLocalChange(int user_id, long long seq, size_t limit,
+                                          const std::function<void(const SyncRecord &)> &fn) const
+{
+    // Range scan of idx_change_log_user_seq: only the rows past seq are read
+    const char *sql = "SELECT c.uuid, c.revision, c.origin, c.change_seq, c.deleted, "
+                      "p.website, p.username, p.encrypted_password, p.iv, p.created_at "
+                      "FROM change_log c LEFT JOIN passwords p ON p.uuid = c.uuid "
+                      "WHERE c.user_id = ? AND c.change_seq > ? AND c.synced = 0 ORDER BY c.change_seq LIMIT ?";
+
+    ReaderLease conn = connections->reader();
+    sqlite3_stmt *stmt = conn.prepare(sql);
+    sqlite3_bind_int(stmt, 1, user_id);
+    sqlite3_bind_int64(stmt, 2, seq);
+    sqlite3_bind_int64(stmt, 3, static_cast<long long>(limit));
+
+    auto column = [stmt](int index)
+    {
+        const char *text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, index));
+        return std::string_view(text ? text : "", text ? sqlite3_column_bytes(stmt, index) : 0);
+    };
+
+    size_t rows = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        SyncRecord record;
+        record.uuid = column(0);
+        record.revision = sqlite3_column_int64(stmt, 1);
+        record.origin = sqlite3_column_int64(stmt, 2);
+        record.changeSeq = sqlite3_column_int64(stmt, 3);
+        record.deleted = sqlite3_column_int(stmt, 4) != 0;
+        if (!record.deleted)
+        {
+            record.website = column(5);
+            record.username = column(6);
+            record.encrypted_password = column(7);
+            record.iv = column(8);
+            record.created_at = column(9);
+        }
+        fn(record);
+        rows++;
+    }
+    return rows;
+}
+
+// Greater version wins: revision, then origin. Equal versions only differ for
+// rows edited on two copies before they had sync, the greater iv settles those
+static bool newerVersion(const SyncRecord &incoming, long long revision, long long origin, std::string_view iv)
+{
+    if (incoming.revision != revision)
+        return incoming.revision > revision;
+    if (incoming.origin != origin)
+        return incoming.origin > origin;
+    return !incoming.deleted && incoming.iv > iv;
+}
+
+SyncApplyStats SQLiteCipherDB::applySyncRecords(int user_id, std::span<const SyncRecord> records,
+                                                const std::string &stateKey, long long stateValue) const
+{
+    SyncApplyStats stats;
+    auto changed = std::make_shared<std::vector<int>>();
+
+    DBWriter &writer = connections->writer();
+    auto op = [&, user_id, changed](sqlite3 *wdb)
+    {
+        const char *sqls[] = {
+            // 0: local version
+            "SELECT c.user_id, c.revision, c.origin, p.id, p.iv FROM change_log c "
+            "LEFT JOIN passwords p ON p.uuid = c.uuid WHERE c.uuid = ?",
+            // 1..3: writes, the triggers keep change_seq and the tombstones
+            "DELETE FROM passwords WHERE id = ?",
+            "UPDATE passwords SET website = ?, username = ?, encrypted_password = ?, iv = ?, host = ?, domain = ?, "
+            "revision = ?, origin = ? WHERE id = ?",
+            "INSERT INTO passwords (user_id, website, username, encrypted_password, iv, host, domain, created_at, "
+            "uuid, revision, origin) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+            // 4: the peer's version, whatever the triggers made of it
+            "UPDATE passwords SET revision = ?, origin = ? WHERE id = ?",
+            // 5: applied versions are not exported again
+            "INSERT OR REPLACE INTO change_log (uuid, user_id, change_seq, revision, origin, deleted, synced, deleted_at) "
+            "VALUES (?, ?, (SELECT value FROM vault_meta WHERE key = 'change_seq'), ?, ?, ?, 1, "
+            "CASE WHEN ?5 THEN CAST(strftime('%s', 'now') AS INTEGER) ELSE 0 END)",
+            "INSERT OR REPLACE INTO vault_meta (key, value) VALUES (?, ?)",
+        };
+        sqlite3_stmt *stmts[7] = {};
+        bool ok = true;
+        for (int i = 0; i < 7 && ok; i++)
+            ok = (stmts[i] = writer.prepare(sqls[i])) != nullptr;
+        auto [local, del, upd, ins, fix, log, state] = stmts;
+        auto text = [](sqlite3_stmt *stmt, int index, std::string_view value)
+        {
+            sqlite3_bind_text(stmt, index, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+        };
+        auto run = [&ok](sqlite3_stmt *stmt)
+        {
+            ok = ok && sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        };
+
+        for (size_t i = 0; ok && i < records.size(); i++)
+        {
+            const SyncRecord &record = records[i];
+            text(local, 1, record.uuid);
+            int id = 0;
+            if (sqlite3_step(local) == SQLITE_ROW)
+            {
+                const char *iv = reinterpret_cast<const char *>(sqlite3_column_text(local, 4));
+                bool mine = sqlite3_column_int(local, 0) == user_id;
+                bool newer = newerVersion(record, sqlite3_column_int64(local, 1), sqlite3_column_int64(local, 2),
+                                          iv ? iv : "");
+                id = sqlite3_column_int(local, 3);
+                sqlite3_reset(local);
+                if (!mine || !newer)
+                {
+                    stats.stale++;
+                    continue;
+                }
+            }
+            else
+                sqlite3_reset(local);
+
+            if (record.deleted)
+            {
+                if (id != 0)
+                {
+                    sqlite3_bind_int(del, 1, id);
+                    run(del);
+                    changed->push_back(id);
+                    stats.deleted++;
+                }
+                else
+                    stats.stale++;
+            }
+            else
+            {
+                NormalizedUrl url = normalizeUrl(std::string(record.website));
+                sqlite3_stmt *write = id != 0 ? upd : ins;
+                int n = 1;
+                if (id == 0)
+                    sqlite3_bind_int(write, n++, user_id);
+                text(write, n++, record.website);
+                text(write, n++, record.username);
+                text(write, n++, record.encrypted_password);
+                text(write, n++, record.iv);
+                sqlite3_bind_text(write, n++, url.host.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(write, n++, url.domain.c_str(), -1, SQLITE_TRANSIENT);
+                if (id == 0)
+                {
+                    text(write, n++, record.created_at);
+                    text(write, n++, record.uuid);
+                }
+                sqlite3_bind_int64(write, n++, record.revision);
+                sqlite3_bind_int64(write, n++, record.origin);
+                if (id != 0)
+                    sqlite3_bind_int(write, n++, id);
+                run(write);
+                if (id != 0)
+                {
+                    changed->push_back(id);
+                    stats.updated++;
+                }
+                else
+                {
+                    id = static_cast<int>(sqlite3_last_insert_rowid(wdb));
+                    stats.added++;
+                }
+
+                sqlite3_bind_int64(fix, 1, record.revision);
+                sqlite3_bind_int64(fix, 2, record.origin);
+                sqlite3_bind_int(fix, 3, id);
+                run(fix);
+            }
+
+            // Kept for deletions of records never seen here too: older versions
+            // arriving later must lose against them
+            text(log, 1, record.uuid);
+            sqlite3_bind_int(log, 2, user_id);
+            sqlite3_bind_int64(log, 3, record.revision);
+            sqlite3_bind_int64(log, 4, record.origin);
+            sqlite3_bind_int(log, 5, record.deleted ? 1 : 0);
+            run(log);
+        }
+
+        if (ok)
+        {
+            sqlite3_bind_text(state, 1, stateKey.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(state, 2, stateValue);
+            run(state);
+        }
+        return ok;
+    };
+
+    // Updated and deleted ids go to the listener once committed
+    WriteCallback onDone = nullptr;
+    if (passwordChanged)
+        onDone = [this, changed](bool ok)
+        {
+            if (ok)
+                for (int id : *changed)
+                    passwordChanged(id);
+        };
+
+    if (!writer.submit(op, onDone).get())
+        throw std::runtime_error("Failed to apply synced records");
+
+    PrintLog(std::cout, CYAN "SQLiteCipherDB" RESET " - Sync applied for user [%d]: %lu added, %lu updated, %lu deleted, %lu stale",
+             user_id, stats.added, stats.updated, stats.deleted, stats.stale);
+    return stats;
+}
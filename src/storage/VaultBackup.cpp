@@ -0,0 +1,288 @@
+#include "VaultBackup.hpp"
+#include "DBWriter.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <zlib.h>
+#include <algorithm>
+
+#define BACKUP_EXTENSION ".db"
+#define BACKUP_GZ_EXTENSION ".db.gz"
+#define BACKUP_PARTIAL_SUFFIX ".partial"
+#define BACKUP_GZ_CHUNK (64 * 1024)
+
+static bool endsWith(const std::string &text, const char *suffix)
+{
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+static void syncDirectory(const std::string &dir)
+{
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0)
+    {
+        fsync(dirFd);
+        close(dirFd);
+    }
+}
+
+// Empty file only the user can read, SQLite keeps the mode when it opens it
+static void createPrivateFile(const std::string &path)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create " + path + ": " + strerror(errno));
+    close(fd);
+}
+
+// Sortable local time with milliseconds: 20261019-141200-123
+static std::string timestamp()
+{
+    auto now = std::chrono::system_clock::now();
+    time_t seconds = std::chrono::system_clock::to_time_t(now);
+    long millis = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char buffer[32];
+    size_t length = strftime(buffer, sizeof(buffer), "%Y%m%d-%H%M%S", &local);
+    snprintf(buffer + length, sizeof(buffer) - length, "-%03ld", millis);
+    return buffer;
+}
+
+VaultBackup::VaultBackup(const std::string &dbPath, const DatabaseCipher *cipher, BackupOptions options)
+    : _dbPath(dbPath), _cipher(cipher), _options(std::move(options))
+{
+    _dir = _options.dir.empty() ? _dbPath + BACKUP_DIR_SUFFIX : _options.dir;
+
+    std::string pathCopy = _dbPath;
+    _prefix = basename(pathCopy.data());
+    if (endsWith(_prefix, BACKUP_EXTENSION))
+        _prefix.resize(_prefix.size() - strlen(BACKUP_EXTENSION));
+    _prefix += "-";
+}
+
+const std::string &VaultBackup::directory() const
+{
+    return _dir;
+}
+
+sqlite3 *VaultBackup::openConnection(const std::string &path, int flags) const
+{
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(path.c_str(), &db, flags, _cipher ? _cipher->vfsName() : nullptr) != SQLITE_OK)
+    {
+        std::string err = sqlite3_errmsg(db);
+        sqlite3_close(db);
+        throw std::runtime_error("Cannot open " + path + ": " + err);
+    }
+    sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT_MS);
+    try
+    {
+        if (_cipher)
+            _cipher->apply(db);
+    }
+    catch (const std::exception &e)
+    {
+        sqlite3_close(db);
+        throw;
+    }
+    return db;
+}
+
+// sqlite3_backup_step in chunks, yielding between them
+void VaultBackup::copyPages(const std::string &tmpPath, BackupProgressCallback &progress,
+                            const CancellationToken &token, BackupResult &result) const
+{
+    sqlite3 *src = openConnection(_dbPath, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+    sqlite3 *dst = nullptr;
+    sqlite3_backup *backup = nullptr;
+    auto cleanup = [&]()
+    {
+        if (backup)
+            sqlite3_backup_finish(backup);
+        sqlite3_close(dst);
+        sqlite3_close(src);
+    };
+
+    try
+    {
+        // One read snapshot for the whole copy. In WAL mode writers go on,
+        // and their commits don't make SQLite restart the copy (it does when
+        // every step opens its own read transaction and sees a new commit)
+        if (sqlite3_exec(src, "BEGIN; SELECT count(*) FROM sqlite_master;", nullptr, nullptr, nullptr) != SQLITE_OK)
+            throw std::runtime_error(std::string("snapshot: ") + sqlite3_errmsg(src));
+
+        // Same cipher and key as the vault: the copy is encrypted like it
+        dst = openConnection(tmpPath, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX);
+        backup = sqlite3_backup_init(dst, "main", src, "main");
+        if (!backup)
+            throw std::runtime_error(std::string("backup init: ") + sqlite3_errmsg(dst));
+
+        int rSql;
+        do
+        {
+            token.throwIfCancelled();
+            rSql = sqlite3_backup_step(backup, _options.pagesPerStep);
+            result.steps++;
+
+            if (progress && (rSql == SQLITE_OK || rSql == SQLITE_DONE))
+            {
+                int total = sqlite3_backup_pagecount(backup);
+                progress(BackupProgress{total - sqlite3_backup_remaining(backup), total});
+            }
+            // Busy: a writer holds a lock SQLite needs, retry after the pause
+            if (rSql == SQLITE_OK || rSql == SQLITE_BUSY || rSql == SQLITE_LOCKED)
+                std::this_thread::sleep_for(std::chrono::milliseconds(_options.pauseMs));
+        } while (rSql == SQLITE_OK || rSql == SQLITE_BUSY || rSql == SQLITE_LOCKED);
+
+        result.pages = sqlite3_backup_pagecount(backup);
+        rSql = sqlite3_backup_finish(backup);
+        backup = nullptr;
+        if (rSql != SQLITE_OK)
+            throw std::runtime_error(std::string("backup step: ") + sqlite3_errstr(rSql));
+    }
+    catch (...)
+    {
+        cleanup();
+        throw;
+    }
+    cleanup();
+}
+
+void VaultBackup::compressFile(const std::string &srcPath, const std::string &dstPath,
+                               const CancellationToken &token) const
+{
+    int in = open(srcPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        throw std::runtime_error("Cannot read " + srcPath + ": " + strerror(errno));
+    int out = open(dstPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+    gzFile gz = out >= 0 ? gzdopen(out, "wb6") : nullptr;
+    if (!gz)
+    {
+        if (out >= 0)
+            close(out);
+        close(in);
+        throw std::runtime_error("Cannot create " + dstPath);
+    }
+
+    std::vector<char> buffer(BACKUP_GZ_CHUNK);
+    ssize_t n;
+    bool ok = true;
+    while (ok && (n = read(in, buffer.data(), buffer.size())) > 0)
+        ok = !token.isCancelled() && gzwrite(gz, buffer.data(), static_cast<unsigned>(n)) == n;
+    ok = ok && n == 0;
+    close(in);
+    if (gzclose(gz) != Z_OK || !ok)
+    {
+        unlink(dstPath.c_str());
+        token.throwIfCancelled();
+        throw std::runtime_error("Cannot compress into " + dstPath);
+    }
+
+    // gzclose does not sync
+    int fd = open(dstPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+std::vector<std::string> VaultBackup::list() const
+{
+    std::vector<std::string> backups;
+    DIR *dir = opendir(_dir.c_str());
+    if (!dir)
+        return backups;
+
+    // <prefix>YYYYmmdd-HHMMSS-mmm.db[.gz]: the names sort by date
+    const size_t stampLength = strlen("YYYYmmdd-HHMMSS-mmm");
+    while (struct dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        bool gz = endsWith(name, BACKUP_GZ_EXTENSION);
+        size_t extension = strlen(gz ? BACKUP_GZ_EXTENSION : BACKUP_EXTENSION);
+        if (name.compare(0, _prefix.size(), _prefix) != 0 || (!gz && !endsWith(name, BACKUP_EXTENSION))
+            || name.size() != _prefix.size() + stampLength + extension)
+            continue;
+        backups.push_back(_dir + "/" + name);
+    }
+    closedir(dir);
+    std::sort(backups.begin(), backups.end());
+    return backups;
+}
+
+std::vector<std::string> VaultBackup::rotate() const
+{
+    std::vector<std::string> removed;
+    std::vector<std::string> backups = list();
+    if (_options.keep == 0 || backups.size() <= _options.keep)
+        return removed;
+
+    for (size_t i = 0; i < backups.size() - _options.keep; i++)
+    {
+        if (unlink(backups[i].c_str()) == 0)
+            removed.push_back(backups[i]);
+        else
+            PrintLog(std::cerr, CYAN "VaultBackup" RESET " - " RED "can't remove %s: %s" RESET,
+                     backups[i].c_str(), strerror(errno));
+    }
+    if (!removed.empty())
+        syncDirectory(_dir);
+    return removed;
+}
+
+BackupResult VaultBackup::run(BackupProgressCallback progress, CancellationToken token) const
+{
+    auto start = std::chrono::steady_clock::now();
+    BackupResult result;
+
+    if (mkdir(_dir.c_str(), 0700) != 0 && errno != EEXIST)
+        throw std::runtime_error("Cannot create backup directory " + _dir + ": " + strerror(errno));
+
+    // Compressing random bytes only costs time
+    bool compress = _options.compress && !_cipher;
+    if (_options.compress && _cipher)
+        PrintLog(std::cout, CYAN "VaultBackup" RESET " - Encrypted vault, the backup is not compressed");
+
+    std::string name = _prefix + timestamp();
+    std::string tmpPath = _dir + "/." + name + BACKUP_EXTENSION BACKUP_PARTIAL_SUFFIX;
+    std::string gzTmpPath = _dir + "/." + name + BACKUP_GZ_EXTENSION BACKUP_PARTIAL_SUFFIX;
+    result.path = _dir + "/" + name + (compress ? BACKUP_GZ_EXTENSION : BACKUP_EXTENSION);
+    PrintLog(std::cout, CYAN "VaultBackup" RESET " - Backing up %s to %s...", _dbPath.c_str(), result.path.c_str());
+
+    try
+    {
+        createPrivateFile(tmpPath);
+        copyPages(tmpPath, progress, token, result);
+        if (compress)
+        {
+            compressFile(tmpPath, gzTmpPath, token);
+            unlink(tmpPath.c_str());
+            tmpPath = gzTmpPath;
+        }
+        if (rename(tmpPath.c_str(), result.path.c_str()) != 0)
+            throw std::runtime_error("Cannot rename the backup to " + result.path + ": " + strerror(errno));
+    }
+    catch (...)
+    {
+        unlink(tmpPath.c_str());
+        unlink((tmpPath + "-journal").c_str());
+        unlink(gzTmpPath.c_str());
+        throw;
+    }
+    syncDirectory(_dir);
+
+    struct stat st;
+    if (stat(result.path.c_str(), &st) == 0)
+        result.bytes = st.st_size;
+    result.removed = rotate();
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    PrintLog(std::cout, CYAN "VaultBackup" GREEN " - %d pages backed up in %d steps (%.0f ms, %lld bytes)" RESET,
+             result.pages, result.steps, result.ms, result.bytes);
+    return result;
+}
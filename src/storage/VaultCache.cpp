@@ -0,0 +1,201 @@
+#include "VaultCache.hpp"
+#include "CryptoManager.hpp"
+
+#include <algorithm>
+#include <limits>
+
+static int hexNibble(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+VaultCache::VaultCache()
+    : _internIndex(0, InternHash{this}, InternEqual{this})
+{
+}
+
+size_t VaultCache::InternHash::operator()(uint32_t index) const
+{
+    return std::hash<std::string_view>()(cache->text(cache->_interned[index]));
+}
+
+bool VaultCache::InternEqual::operator()(uint32_t a, uint32_t b) const
+{
+    return cache->text(cache->_interned[a]) == cache->text(cache->_interned[b]);
+}
+
+std::string_view VaultCache::text(Span span) const
+{
+    return std::string_view(_arena).substr(span.offset, span.length);
+}
+
+VaultCache::Span VaultCache::store(std::string_view value)
+{
+    if (_arena.size() + value.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error(RED "Error" RESET " vault cache arena full");
+
+    Span span{static_cast<uint32_t>(_arena.size()), static_cast<uint32_t>(value.size())};
+    _arena.append(value);
+    return span;
+}
+
+// Hex is decoded into the arena, an invalid record is kept empty (it fails to decrypt)
+VaultCache::Span VaultCache::storeRecord(std::string_view ivHex, std::string_view ciphertextHex)
+{
+    size_t start = _arena.size();
+    if (ivHex.size() != 2 * CRYPTO_IV_SIZE)
+        return Span{static_cast<uint32_t>(start), 0};
+
+    for (std::string_view hex : {ivHex, ciphertextHex})
+    {
+        if (hex.size() % 2 != 0)
+        {
+            _arena.resize(start);
+            return Span{static_cast<uint32_t>(start), 0};
+        }
+        for (size_t i = 0; i < hex.size(); i += 2)
+        {
+            int hi = hexNibble(hex[i]);
+            int lo = hexNibble(hex[i + 1]);
+            if (hi < 0 || lo < 0)
+            {
+                _arena.resize(start);
+                return Span{static_cast<uint32_t>(start), 0};
+            }
+            _arena.push_back(static_cast<char>((hi << 4) | lo));
+        }
+    }
+
+    if (_arena.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error(RED "Error" RESET " vault cache arena full");
+    return Span{static_cast<uint32_t>(start), static_cast<uint32_t>(_arena.size() - start)};
+}
+
+uint32_t VaultCache::intern(std::string_view value)
+{
+    // Store it as a candidate, take it back if an equal string is already there
+    size_t arenaSize = _arena.size();
+    uint32_t candidate = static_cast<uint32_t>(_interned.size());
+    _interned.push_back(store(value));
+
+    auto [it, inserted] = _internIndex.insert(candidate);
+    if (!inserted)
+    {
+        _interned.pop_back();
+        _arena.resize(arenaSize);
+    }
+    return *it;
+}
+
+void VaultCache::reserve(size_t entries, size_t textBytes)
+{
+    _ids.reserve(entries);
+    _websites.reserve(entries);
+    _usernames.reserve(entries);
+    _createdAt.reserve(entries);
+    _records.reserve(entries);
+    _arena.reserve(textBytes);
+}
+
+void VaultCache::append(const PasswordView &row)
+{
+    _ids.push_back(row.id);
+    _websites.push_back(store(row.website));
+    _usernames.push_back(intern(row.username));
+    _createdAt.push_back(intern(row.created_at));
+    _records.push_back(storeRecord(row.iv, row.encrypted_password));
+}
+
+void VaultCache::clear()
+{
+    _ids.clear();
+    _websites.clear();
+    _usernames.clear();
+    _createdAt.clear();
+    _records.clear();
+    _arena.clear();
+    _interned.clear();
+    _internIndex.clear();
+}
+
+size_t VaultCache::size() const
+{
+    return _ids.size();
+}
+
+bool VaultCache::empty() const
+{
+    return _ids.empty();
+}
+
+CachedEntry VaultCache::operator[](size_t index) const
+{
+    CachedEntry entry;
+    entry.id = _ids[index];
+    entry.website = text(_websites[index]);
+    entry.username = text(_interned[_usernames[index]]);
+    entry.created_at = text(_interned[_createdAt[index]]);
+
+    std::string_view record = text(_records[index]);
+    if (record.size() > CRYPTO_IV_SIZE)
+    {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(record.data());
+        entry.iv = std::span<const unsigned char>(bytes, CRYPTO_IV_SIZE);
+        entry.ciphertext = std::span<const unsigned char>(bytes + CRYPTO_IV_SIZE, record.size() - CRYPTO_IV_SIZE);
+    }
+    return entry;
+}
+
+bool VaultCache::find(int id, CachedEntry &entry) const
+{
+    auto it = std::lower_bound(_ids.begin(), _ids.end(), id);
+    if (it == _ids.end() || *it != id)
+        return false;
+    entry = (*this)[it - _ids.begin()];
+    return true;
+}
+
+int VaultCache::id(size_t index) const
+{
+    return _ids[index];
+}
+
+std::string_view VaultCache::website(size_t index) const
+{
+    return text(_websites[index]);
+}
+
+std::string_view VaultCache::username(size_t index) const
+{
+    return text(_interned[_usernames[index]]);
+}
+
+uint32_t VaultCache::usernameKey(size_t index) const
+{
+    return _usernames[index];
+}
+
+size_t VaultCache::internedCount() const
+{
+    return _interned.size();
+}
+
+size_t VaultCache::memoryUsage() const
+{
+    size_t bytes = _ids.capacity() * sizeof(int)
+                 + (_websites.capacity() + _records.capacity()) * sizeof(Span)
+                 + (_usernames.capacity() + _createdAt.capacity()) * sizeof(uint32_t)
+                 + _arena.capacity()
+                 + _interned.capacity() * sizeof(Span);
+
+    // Buckets plus one node (next pointer, value, cached hash) per interned string
+    bytes += _internIndex.bucket_count() * sizeof(void *)
+           + _internIndex.size() * (sizeof(void *) + sizeof(uint32_t) + sizeof(size_t));
+    return bytes;
+}
@@ -0,0 +1,141 @@
+#include "VaultWatcher.hpp"
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <climits>
+
+VaultWatcher::VaultWatcher(const std::string &dbPath, std::function<void()> onChange, int pollMs)
+    : _onChange(onChange), _pollMs(pollMs), _inotifyFd(-1), _wakeFd(-1), _running(false)
+{
+    // Split db path into directory and file name, the WAL is created next to the db
+    size_t slash = dbPath.find_last_of('/');
+    _dirPath = (slash == std::string::npos) ? "." : dbPath.substr(0, slash);
+    _dbName = (slash == std::string::npos) ? dbPath : dbPath.substr(slash + 1);
+}
+
+VaultWatcher::~VaultWatcher()
+{
+    stop();
+}
+
+bool VaultWatcher::start()
+{
+    if (_running)
+        return true;
+
+    PrintLog(std::cout, CYAN "VaultWatcher" RESET " - Watching %s/%s...", _dirPath.c_str(), _dbName.c_str());
+
+    // Watch the directory: SQLite creates, truncates and deletes the WAL file
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd == -1 ||
+        inotify_add_watch(_inotifyFd, _dirPath.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1)
+    {
+        // Without inotify the watcher still polls every _pollMs
+        PrintLog(std::cerr, CYAN "VaultWatcher" RESET " - " YELLOW "inotify unavailable (%s), falling back to polling" RESET,
+                 strerror(errno));
+        if (_inotifyFd != -1)
+            close(_inotifyFd);
+        _inotifyFd = -1;
+    }
+
+    // eventfd used to wake the thread up on stop()
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeFd == -1)
+    {
+        PrintLog(std::cerr, RED "VaultWatcher - eventfd failed: %s" RESET, strerror(errno));
+        if (_inotifyFd != -1)
+            close(_inotifyFd);
+        _inotifyFd = -1;
+        return false;
+    }
+
+    _running = true;
+    _thread = std::thread(&VaultWatcher::run, this);
+    return true;
+}
+
+void VaultWatcher::stop()
+{
+    if (!_running)
+        return;
+
+    _running = false;
+    uint64_t one = 1;
+    if (write(_wakeFd, &one, sizeof(one)) == -1)
+        PrintLog(std::cerr, RED "VaultWatcher - failed to wake watcher thread: %s" RESET, strerror(errno));
+    if (_thread.joinable())
+        _thread.join();
+
+    if (_inotifyFd != -1)
+        close(_inotifyFd);
+    close(_wakeFd);
+    _inotifyFd = -1;
+    _wakeFd = -1;
+
+    PrintLog(std::cout, CYAN "VaultWatcher" RESET " - stopped");
+}
+
+bool VaultWatcher::drainEvents()
+{
+    bool touched = false;
+    alignas(struct inotify_event) char buffer[4096];
+    std::string walName = _dbName + "-wal";
+
+    while (true)
+    {
+        ssize_t len = read(_inotifyFd, buffer, sizeof(buffer));
+        if (len <= 0)
+            break;
+
+        for (char *ptr = buffer; ptr < buffer + len;)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            if (event->len > 0 && (_dbName == event->name || walName == event->name))
+                touched = true;
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return touched;
+}
+
+void VaultWatcher::run()
+{
+    struct pollfd fds[2];
+    fds[0].fd = _wakeFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = _inotifyFd;
+    fds[1].events = POLLIN;
+    nfds_t nfds = (_inotifyFd != -1) ? 2 : 1;
+
+    while (_running)
+    {
+        int res = poll(fds, nfds, _pollMs);
+        if (!_running)
+            break;
+
+        if (res < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            PrintLog(std::cerr, RED "VaultWatcher - poll failed: %s" RESET, strerror(errno));
+            break;
+        }
+
+        // Timeout: fallback poll, the receiver checks data_version so this is cheap
+        if (res == 0)
+        {
+            _onChange();
+            continue;
+        }
+
+        if (nfds == 2 && (fds[1].revents & POLLIN) && drainEvents())
+        {
+            // One commit touches the WAL several times, coalesce the burst
+            std::this_thread::sleep_for(std::chrono::milliseconds(WATCHER_DEBOUNCE_MS));
+            drainEvents();
+            _onChange();
+        }
+    }
+}
@@ -1,6 +1,7 @@
 #include "AddPasswordDialog.hpp"
 
-AddPasswordDialog::AddPasswordDialog(QWidget *parent) : QDialog(parent)
+AddPasswordDialog::AddPasswordDialog(VaultContext &vault, QWidget *parent)
+    : QDialog(parent), _vault(vault)
 {
     // Window Title
     setWindowTitle("Add Password Manager");
@@ -66,36 +67,35 @@ void AddPasswordDialog::onSaveClicked()
         return;
     }
 
-    // Get services from SessionManager
-    SQLiteCipherDB *db = SESSION->getDatabase();
-    CryptoManager *crypto = SESSION->getCryptoManager();
-
-    // Check for database and crypto
-    if (!db || !crypto)
-    {
-        QMessageBox::warning(this, "Error", "Database or Crypto service not initialized");
-        return;
-    }
-
-    // Get master password and salt from session
-    std::string masterPassword = SESSION->getMasterPassword();
-    std::string userSalt = SESSION->getUserSalt();
+    saveBttn->setEnabled(false);
+    spawn(saveEntry(web, user, pass), CancellationToken::any(_cancel.token(), _vault.session().revocationToken()));
+}
 
-    auto [ciphertext, iv] = crypto->encryptPassword(
-        pass.toStdString(),
-        masterPassword,
-        userSalt
+Task<void> AddPasswordDialog::saveEntry(QString web, QString user, QString pass)
+{
+    AsyncDatabase *db = &_vault.asyncDatabase();
+    AsyncCrypto *crypto = &_vault.asyncCrypto();
+
+    // The task owns its copies of the session secrets
+    auto [ciphertext, iv] = co_await crypto->encryptPassword(
+        toSecureString(pass),
+        SecureString(_vault.session().getMasterPassword()),
+        SecureString(_vault.session().getUserSalt())
     );
     
     // Add the password to the db
-    if (db->addPassword(SESSION->getUserId(), web.toStdString(), user.toStdString(), ciphertext, iv)) 
+    bool added = co_await db->addPassword(_vault.session().getUserId(), web.toStdString(), user.toStdString(), ciphertext, iv);
+    if (added)
     {
         PrintLog(std::cout, GREEN "Password saved for %s" RESET, web.toStdString().c_str());
         QMessageBox::information(this, "Success", "Password saved successfully!");
         accept(); // Cerrar dialog
     }
     else
+    {
         QMessageBox::critical(this, "Error", "Failed to save password");
+        saveBttn->setEnabled(true);
+    }
 }
 
 void AddPasswordDialog::onCancelClicked()
@@ -1,7 +1,7 @@
 #include "EditPasswordDialog.hpp"
 
-EditPasswordDialog::EditPasswordDialog(QWidget *parent, int id)
-    : QDialog(parent), _passwordId(id)
+EditPasswordDialog::EditPasswordDialog(VaultContext &vault, QWidget *parent, int id)
+    : QDialog(parent), _vault(vault), _passwordId(id)
 {
     // Window Title
     setWindowTitle("Edit Password Manager");
@@ -10,41 +10,11 @@ EditPasswordDialog::EditPasswordDialog(QWidget *parent, int id)
     PrintLog(std::cout, YELLOW "Edit Password Dialog" RESET " - Initialazing UI for %d ID password", _passwordId);
     setupUi();
 
-    // Populate fields with existing password data
+    // Populate fields with existing password data (saving waits until it is loaded)
     if (id)
     {
-        // Get database from SessionManager
-        SQLiteCipherDB *db = SESSION->getDatabase();
-        if (!db)
-        {
-            QMessageBox::critical(this, "Error", "Database service not available");
-            return;
-        }
-
-        // Obtain all passwords from db
-        std::vector<Password> passwords = db->getAllPasswords();
-        // Iterate for each password in the vector
-        for (const auto &pwd : passwords)
-        {
-            if (pwd.id == id)
-            {
-                webEdit->setText(QString::fromStdString(pwd.website));
-                webStr = pwd.website;
-                userEdit->setText(QString::fromStdString(pwd.username));
-                userStr = pwd.username;
-
-                // Decrypt password before show in the ui
-                std::string password_decrypt = SESSION->getCryptoManager()->decryptPassword(
-                    pwd.encrypted_password,
-                    pwd.iv, SESSION->getMasterPassword(),
-                    SESSION->getUserSalt());
-
-                passEdit->setText(QString::fromStdString(password_decrypt));
-                passEdit->setEchoMode(QLineEdit::Password); // ← Show "*"
-                passStr = password_decrypt;
-                break;
-            }
-        }
+        saveBttn->setEnabled(false);
+        spawn(loadEntry(), CancellationToken::any(_cancel.token(), _vault.session().revocationToken()));
     }
 
     // Connect signal to slot
@@ -55,6 +25,42 @@ EditPasswordDialog::EditPasswordDialog(QWidget *parent, int id)
 
 EditPasswordDialog::~EditPasswordDialog() {}
 
+Task<void> EditPasswordDialog::loadEntry()
+{
+    AsyncDatabase *db = &_vault.asyncDatabase();
+    AsyncCrypto *crypto = &_vault.asyncCrypto();
+
+    // Obtain the password from db
+    std::optional<Password> pwd = co_await db->getPassword(_passwordId);
+    if (!pwd)
+    {
+        QMessageBox::warning(this, "Error", "Password not found");
+        co_return;
+    }
+
+    // Decrypt password before show in the ui, unless it was just decrypted
+    SecureString password_decrypt;
+    if (!_vault.secrets().get(_passwordId, pwd->iv, password_decrypt))
+    {
+        password_decrypt = co_await crypto->decryptPassword(
+            pwd->encrypted_password,
+            pwd->iv, SecureString(_vault.session().getMasterPassword()),
+            SecureString(_vault.session().getUserSalt()));
+        _vault.secrets().put(_passwordId, pwd->iv, password_decrypt);
+    }
+
+    webEdit->setText(QString::fromStdString(pwd->website));
+    webStr = pwd->website;
+    userEdit->setText(QString::fromStdString(pwd->username));
+    userStr = pwd->username;
+
+    passEdit->setText(toQString(password_decrypt));
+    passEdit->setEchoMode(QLineEdit::Password); // ← Show "*"
+    passStr = std::move(password_decrypt);
+
+    saveBttn->setEnabled(true);
+}
+
 void EditPasswordDialog::setupUi()
 {
     // Widgets creation
@@ -101,44 +107,45 @@ void EditPasswordDialog::onSaveClicked()
     }
 
     // Validate at least diferent password
-    if (pass.toStdString() == passStr)
+    if (toSecureString(pass).view().equals(passStr))
     {
         QMessageBox::warning(this, "Warning", "Same password detected");
         return;
     }
 
-    // Get services from SessionManager
-    SQLiteCipherDB *db = SESSION->getDatabase();
-    CryptoManager *crypto = SESSION->getCryptoManager();
-
-    // Check for database and crypto
-    if (!db || !crypto)
-    {
-        QMessageBox::warning(this, "Error", "Database or Crypto service not initialized");
-        return;
-    }
-
-    // Get master password and salt from session
-    std::string masterPassword = SESSION->getMasterPassword();
-    std::string userSalt = SESSION->getUserSalt();
-
-    auto [ciphertext, iv] = crypto->encryptPassword(
-        pass.toStdString(),
-        masterPassword,
-        userSalt);
+    saveBttn->setEnabled(false);
+    spawn(saveEntry(web, user, pass), CancellationToken::any(_cancel.token(), _vault.session().revocationToken()));
+}
 
-    if (db->updatePassword(_passwordId,
-                           web.toStdString(),
-                           user.toStdString(),
-                           ciphertext,
-                           iv))
+Task<void> EditPasswordDialog::saveEntry(QString web, QString user, QString pass)
+{
+    AsyncDatabase *db = &_vault.asyncDatabase();
+    AsyncCrypto *crypto = &_vault.asyncCrypto();
+
+    // The task owns its copies of the session secrets
+    auto [ciphertext, iv] = co_await crypto->encryptPassword(
+        toSecureString(pass),
+        SecureString(_vault.session().getMasterPassword()),
+        SecureString(_vault.session().getUserSalt()));
+
+    bool updated = co_await db->updatePassword(_passwordId,
+                                               web.toStdString(),
+                                               user.toStdString(),
+                                               ciphertext,
+                                               iv);
+    if (updated)
     {
+        // Write-through: the next reveal of this entry needs no decryption
+        _vault.secrets().put(_passwordId, iv, toSecureString(pass));
         PrintLog(std::cout, GREEN "Password edited for %s" RESET, web.toStdString().c_str());
         QMessageBox::information(this, "Success", "Password edited successfully!");
         accept();
     }
     else
+    {
         QMessageBox::critical(this, "Error", "Failed to edit password");
+        saveBttn->setEnabled(true);
+    }
 }
 
 void EditPasswordDialog::onCancelClicked()
@@ -0,0 +1,18 @@
+#include "GuiExecutor.hpp"
+
+GuiExecutor::GuiExecutor()
+{
+    setCurrent(this);
+    PrintLog(std::cout, CYAN "GuiExecutor" RESET " - bound to the GUI thread");
+}
+
+GuiExecutor::~GuiExecutor()
+{
+    setCurrent(nullptr);
+}
+
+void GuiExecutor::post(std::function<void()> fn)
+{
+    // Queued on qApp: runs on the main thread on the next event loop iteration
+    QMetaObject::invokeMethod(qApp, std::move(fn), Qt::QueuedConnection);
+}
@@ -1,7 +1,8 @@
 #include "LoginDialog.hpp"
 #include <cctype>
 
-LoginDialog::LoginDialog(QWidget *parent) : QDialog(parent)
+LoginDialog::LoginDialog(VaultContext &vault, QWidget *parent)
+    : QDialog(parent), _vault(vault)
 {
     // Window Title
     setWindowTitle("Password Manager - Authentication");
@@ -149,13 +150,13 @@ void LoginDialog::setupRegisterTab()
     tabWidget->addTab(registerTab, "Registrarse");
 }
 
-int LoginDialog::calculatePasswordStrength(const std::string &password)
+int LoginDialog::calculatePasswordStrength(SecretView password)
 {
     int strength = 0;
 
     // Length check
-    if (password.length() >= 8) strength += 25;
-    if (password.length() >= 12) strength += 10;
+    if (password.size() >= 8) strength += 25;
+    if (password.size() >= 12) strength += 10;
 
     // Contains lowercase
     bool hasLower = false;
@@ -201,10 +202,10 @@ int LoginDialog::calculatePasswordStrength(const std::string &password)
     return std::min(strength, 100);
 }
 
-bool LoginDialog::validatePassword(const std::string &password)
+bool LoginDialog::validatePassword(SecretView password)
 {
     // Minimum 8 characters
-    if (password.length() < 8) return false;
+    if (password.size() < 8) return false;
 
     // Must have at least one uppercase, one lowercase, one digit
     bool hasUpper = false, hasLower = false, hasDigit = false;
@@ -229,19 +230,13 @@ void LoginDialog::onLoginClicked()
         return;
     }
 
-    // Get services from SessionManager
-    AuthenticationManager *authM = SESSION->getAuthenticationManager();
-    SQLiteCipherDB *db = SESSION->getDatabase();
-
-    // Check for authenticator manager
-    if (!authM || !db)
-    {
-        QMessageBox::warning(this, "Error", "Sistema de autenticación no inicializado");
-        return;
-    }
+    // Services of the vault being opened
+    AuthenticationManager *authM = &_vault.auth();
+    SQLiteCipherDB *db = &_vault.database();
 
     // Authenticate user with the auth Manager
-    if (authM->authenticateUser(user.toStdString(), pass.toStdString()))
+    SecureString master = toSecureString(pass);
+    if (authM->authenticateUser(user.toStdString(), master))
     {
         PrintLog(std::cout, GREEN "Login successful for user: %s" RESET, user.toStdString().c_str());
         
@@ -250,13 +245,7 @@ void LoginDialog::onLoginClicked()
         if (db->getUserHash(user.toStdString(), hash, salt))
         {
             int user_id = db->getUserIdByUsername(user.toStdString());
-            SESSION->setUserId(user_id);
-            SESSION->setMasterPassword(pass.toStdString());
-            SESSION->setUsername(user.toStdString());
-            SESSION->setUserSalt(salt);
-            SESSION->setAuthenticated(true);
-
-            PrintLog(std::cout, CYAN "SessionManager" GREEN " - Session initialized for user ID: %d" RESET, user_id);
+            _vault.session().beginSession(user_id, user.toStdString(), std::move(master), salt);
         }
         accept();
     }
@@ -283,7 +272,7 @@ void LoginDialog::onRegisterClicked()
     }
 
     // Validate username doesn't exist
-    SQLiteCipherDB *db = SESSION->getDatabase();
+    SQLiteCipherDB *db = &_vault.database();
     if (db->userExists(user.toStdString()))
     {
         QMessageBox::warning(this, "Error", "El usuario ya existe");
@@ -302,7 +291,8 @@ void LoginDialog::onRegisterClicked()
     }
 
     // Validate password strength
-    if (!validatePassword(pass.toStdString()))
+    SecureString master = toSecureString(pass);
+    if (!validatePassword(master))
     {
         QMessageBox::warning(this, "Error", 
             "La contraseña debe tener:\n"
@@ -316,16 +306,10 @@ void LoginDialog::onRegisterClicked()
         return;
     }
 
-    // Get services
-    AuthenticationManager *authM = SESSION->getAuthenticationManager();
-    if (!authM)
-    {
-        QMessageBox::critical(this, "Error", "Sistema de autenticación no inicializado");
-        return;
-    }
+    AuthenticationManager *authM = &_vault.auth();
 
     // Register user
-    if (authM->registerNewUser(user.toStdString(), pass.toStdString(), true))
+    if (authM->registerNewUser(user.toStdString(), master, true))
     {
         PrintLog(std::cout, GREEN "New user registered: %s" RESET, user.toStdString().c_str());
         
@@ -334,13 +318,7 @@ void LoginDialog::onRegisterClicked()
         if (db->getUserHash(user.toStdString(), hash, salt))
         {
             int user_id = db->getUserIdByUsername(user.toStdString());
-            SESSION->setUserId(user_id);
-            SESSION->setMasterPassword(pass.toStdString());
-            SESSION->setUsername(user.toStdString());
-            SESSION->setUserSalt(salt);
-            SESSION->setAuthenticated(true);
-
-            PrintLog(std::cout, CYAN "SessionManager" GREEN " - Session initialized for new user ID: %d" RESET, user_id);
+            _vault.session().beginSession(user_id, user.toStdString(), std::move(master), salt);
             QMessageBox::information(this, "Éxito", "¡Usuario registrado correctamente!");
         }
         accept();
@@ -376,7 +354,7 @@ void LoginDialog::onShowPasswordToggled(bool checked)
 
 void LoginDialog::onPasswordChanged(const QString &pass)
 {
-    int strength = calculatePasswordStrength(pass.toStdString());
+    int strength = calculatePasswordStrength(toSecureString(pass));
     passwordStrengthBar->setValue(strength);
 
     if (strength < 25)
@@ -1,7 +1,9 @@
 #include "MainWindow.hpp"
 
 // MainWindow Constructor
-MainWindow::MainWindow() : QMainWindow()
+MainWindow::MainWindow(VaultContext &vault, QWidget *parent)
+    : QMainWindow(parent), _vault(vault), _lastDataVersion(-1), _lastChangeSeq(0), _loadGeneration(0),
+      _tablePartial(false)
 {
     // Window Setup
     setWindowTitle("Password Manager - Secure Storage");
@@ -16,13 +18,47 @@ MainWindow::MainWindow() : QMainWindow()
     PrintLog(std::cout, YELLOW "Main Window" RESET " - Establishing buttons connection...");
     connect(addBttn, &QPushButton::clicked, this, &MainWindow::onClickAddPssBttn);
     connect(logoutBttn, &QPushButton::clicked, this, &MainWindow::onClickLogoutBttn);
+    connect(lockBttn, &QPushButton::clicked, this, &MainWindow::onClickLockBttn);
+    connect(pinBttn, &QPushButton::clicked, this, &MainWindow::onClickPinBttn);
+    connect(backupBttn, &QPushButton::clicked, this, &MainWindow::onClickBackupBttn);
+    connect(unlockBttn, &QPushButton::clicked, this, &MainWindow::onClickUnlockBttn);
+    connect(unlockEdit, &QLineEdit::returnPressed, this, &MainWindow::onClickUnlockBttn);
+
+    // Lock after IDLE_LOCK_MS without input anywhere in the application
+    idleTimer = new QTimer(this);
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(IDLE_LOCK_MS);
+    connect(idleTimer, &QTimer::timeout, this, &MainWindow::lockVault);
+    qApp->installEventFilter(this);
+    idleTimer->start();
+
+    secretsTimer = new QTimer(this);
+    secretsTimer->setInterval(SECRET_PURGE_MS);
+    connect(secretsTimer, &QTimer::timeout, this, [this]() { _vault.secrets().purgeExpired(); });
+    secretsTimer->start();
+
+    // Watch the db for commits made by other instances
+    // The watcher thread only posts to the GUI thread, Qt drops the call if this window is gone
+    vaultWatcher = std::make_unique<VaultWatcher>(_vault.database().getPath(), [this]()
+        { QMetaObject::invokeMethod(this, [this]() { this->onVaultChanged(); }, Qt::QueuedConnection); });
+    vaultWatcher->start();
 
     PrintLog(std::cout, YELLOW "Main Window" RESET " - Showing UI...");
     show();
 }
 
 // MainWindow Destructor
-MainWindow::~MainWindow() {}
+MainWindow::~MainWindow()
+{
+    qApp->removeEventFilter(this);
+    if (vaultWatcher)
+        vaultWatcher->stop();
+
+    // The backup uses the vault's cipher: stop it at its next step
+    _cancel.cancel();
+    if (_backup.valid())
+        _backup.wait();
+}
 
 // Sets up the full layout of this window
 void MainWindow::setupUI()
@@ -43,7 +79,7 @@ void MainWindow::setupUI()
     QHBoxLayout *headerLayout = new QHBoxLayout();
 
     // Title label
-    std::string title = "Your Passwords [" + SESSION->getUsername() + "]";
+    std::string title = "Your Passwords [" + _vault.session().getUsername() + "]";
     QLabel *tittleLabel = new QLabel(title.c_str(), this);
     QFont tittleFont = tittleLabel->font();
     tittleFont.setPointSize(16);
@@ -86,6 +122,34 @@ void MainWindow::setupUI()
 
     mainLayout->addWidget(passwordTable);
 
+    // ============ LOCK SECTION ============ //
+    // Replaces the table while locked
+    lockPanel = new QWidget(this);
+    QVBoxLayout *lockLayout = new QVBoxLayout(lockPanel);
+    lockLayout->addStretch();
+    QLabel *lockLabel = new QLabel("Vault locked", lockPanel);
+    lockLabel->setAlignment(Qt::AlignCenter);
+    lockLayout->addWidget(lockLabel);
+
+    unlockEdit = new QLineEdit(lockPanel);
+    unlockEdit->setEchoMode(QLineEdit::Password);
+    unlockEdit->setPlaceholderText("Master password");
+    unlockEdit->setMaximumWidth(300);
+    lockLayout->addWidget(unlockEdit, 0, Qt::AlignCenter);
+
+    unlockPinCheck = new QCheckBox("Unlock with PIN", lockPanel);
+    lockLayout->addWidget(unlockPinCheck, 0, Qt::AlignCenter);
+    connect(unlockPinCheck, &QCheckBox::toggled, this, [this](bool pin)
+            { unlockEdit->setPlaceholderText(pin ? "PIN" : "Master password"); });
+
+    unlockBttn = new QPushButton("Unlock", lockPanel);
+    unlockBttn->setMinimumWidth(150);
+    lockLayout->addWidget(unlockBttn, 0, Qt::AlignCenter);
+    lockLayout->addStretch();
+
+    lockPanel->hide();
+    mainLayout->addWidget(lockPanel);
+
     // ============ BUTTONS SECTION ============ //
     QHBoxLayout *bttnLayout = new QHBoxLayout();
     bttnLayout->setSpacing(8);
@@ -96,8 +160,20 @@ void MainWindow::setupUI()
     logoutBttn = new QPushButton("Logout", this);
     logoutBttn->setMinimumWidth(150);
 
+    lockBttn = new QPushButton("Lock", this);
+    lockBttn->setMinimumWidth(100);
+
+    pinBttn = new QPushButton("Set PIN", this);
+    pinBttn->setMinimumWidth(100);
+
+    backupBttn = new QPushButton("Backup", this);
+    backupBttn->setMinimumWidth(100);
+
     bttnLayout->addWidget(addBttn);
     bttnLayout->addStretch();
+    bttnLayout->addWidget(backupBttn);
+    bttnLayout->addWidget(pinBttn);
+    bttnLayout->addWidget(lockBttn);
     bttnLayout->addWidget(logoutBttn);
 
     mainLayout->addLayout(bttnLayout);
@@ -115,90 +191,218 @@ void MainWindow::updateUi()
     // Table minimun size
     setMinimumSize(800, 500);
 
-    // Get database from SessionManager
-    SQLiteCipherDB *db = SESSION->getDatabase();
-    CryptoManager *crypt = SESSION->getCryptoManager();
+    // Loading and decryption run in the background, rows appear when ready.
+    // Dropped if the window closes or the session is revoked meanwhile
+    spawn(reloadTable(), CancellationToken::any(_cancel.token(), _vault.session().revocationToken()));
+}
 
-    if (!db || !crypt)
-    {
-        QMessageBox::critical(this, "Error", "Some service are not available");
-        return;
-    }
+Task<void> MainWindow::reloadTable()
+{
+    // Services of the vault shown by this window
+    SQLiteCipherDB *syncDb = &_vault.database();
+    AsyncDatabase *db = &_vault.asyncDatabase();
+    AsyncCrypto *crypt = &_vault.asyncCrypto();
+
+    // A newer reload makes this one obsolete
+    unsigned int generation = ++_loadGeneration;
+
+    // data_version is per connection: read it here, on the GUI thread's reader
+    long long version = syncDb->getDataVersion();
+
+    // Remember where we are so later external changes are applied incrementally
+    long long seq = co_await db->getChangeSeq();
+
+    // Obtain all passwords from db, the key is derived once for every chunk
+    std::vector<Password> passwords = co_await db->listPasswords(_vault.session().getUserId());
+    SecureBytes key = co_await crypt->deriveKey(
+        SecureString(_vault.session().getMasterPassword()), SecureString(_vault.session().getUserSalt()));
+
+    // Back on the GUI thread
+    if (generation != _loadGeneration)
+        co_return;
 
     // Clean current passwordTable
     if (passwordTable->rowCount() > 0)
         passwordTable->setRowCount(0);
 
-    // Obtain all passwords from db
-    std::vector<Password> passwords = db->getPasswordsByUserId(SESSION->getUserId());
+    _lastDataVersion = version;
+    _lastChangeSeq = seq;
+    _tablePartial = true;
+
+    // Decrypt on the crypto pool and show UI_DECRYPT_BATCH rows at a time,
+    // each chunk's plaintexts are wiped before the next one is decrypted
+    for (size_t start = 0; start < passwords.size(); start += UI_DECRYPT_BATCH)
+    {
+        size_t end = std::min(passwords.size(), start + UI_DECRYPT_BATCH);
+        std::vector<SecureString> plaintexts = co_await crypt->decryptPasswords(
+            std::vector<Password>(passwords.begin() + start, passwords.begin() + end), key);
+
+        // Superseded or locked meanwhile
+        if (generation != _loadGeneration)
+            co_return;
+
+        for (size_t i = start; i < end; i++)
+        {
+            // New row for each iteration
+            int row = passwordTable->rowCount();
+            passwordTable->insertRow(row);
+            fillRow(row, passwords[i], plaintexts[i - start]);
+        }
+    }
+    _tablePartial = false;
+
+    // Changes skipped while the table was filling
+    refreshChangedRows();
+}
+
+// Fill a table row with the data of a password
+void MainWindow::fillRow(int row, const Password &pwd, SecretView plaintext)
+{
+    // WEB ITEM
+    QTableWidgetItem *webItem = new QTableWidgetItem(QString::fromStdString(pwd.website));
+    webItem->setTextAlignment(Qt::AlignVCenter | Qt::AlignLeft);
+
+    // WEB USER ITEM
+    QTableWidgetItem *userItem = new QTableWidgetItem(QString::fromStdString(pwd.username));
+    userItem->setTextAlignment(Qt::AlignVCenter | Qt::AlignLeft);
+
+    // WEB USER PASS ITEM
+    QLineEdit *pwdEdit = new QLineEdit(this);
+
+    pwdEdit->setText(toQString(plaintext));
+    pwdEdit->setEchoMode(QLineEdit::Password); // ← Show "*"
+    pwdEdit->setReadOnly(true);
+    pwdEdit->setProperty("passwordId", pwd.id); // save ID for later
+    // Ciphertext kept so an unlock refills the column without a db reload
+    pwdEdit->setProperty("ciphertext", QString::fromStdString(pwd.encrypted_password));
+    pwdEdit->setProperty("iv", QString::fromStdString(pwd.iv));
+    pwdEdit->setAlignment(Qt::AlignVCenter | Qt::AlignLeft);
+
+    // WEB USER PASS ACTION ITEM
+    QWidget *actionWidget = new QWidget(this);
+    QHBoxLayout *actionLayout = new QHBoxLayout(actionWidget);
+    actionLayout->setContentsMargins(5, 5, 5, 5);
+    actionLayout->setSpacing(8);
+    actionLayout->setAlignment(Qt::AlignCenter);
+
+    // WEB USER PASS ACTION BUTTONS
+    // Crete three buttons for password in db: view, edit and delete
+    QPushButton *viewBtn = new QPushButton("👁", this);
+    viewBtn->setMaximumWidth(38);
+    viewBtn->setMaximumHeight(38);
+    QPushButton *editBtn = new QPushButton("✏️", this);
+    editBtn->setMaximumWidth(38);
+    editBtn->setMaximumHeight(38);
+    QPushButton *deleteBtn = new QPushButton("🗑️", this);
+    deleteBtn->setMaximumWidth(38);
+    deleteBtn->setMaximumHeight(38);
+
+    // Connect butons with functions
+    connect(viewBtn, &QPushButton::clicked, this, [this, pwd]()
+            { this->onViewPassword(pwd.id); });
+    connect(editBtn, &QPushButton::clicked, this, [this, pwd]()
+            { this->onEditPassword(pwd.id); });
+    connect(deleteBtn, &QPushButton::clicked, this, [this, pwd]()
+            { this->onDeletePassword(pwd.id); });
+    // Add buttons to action layout
+    actionLayout->addWidget(viewBtn);
+    actionLayout->addWidget(editBtn);
+    actionLayout->addWidget(deleteBtn);
+
+    // Put widgets into passwordTable
+    passwordTable->setItem(row, 0, webItem);
+    passwordTable->setItem(row, 1, userItem);
+    passwordTable->setCellWidget(row, 2, pwdEdit);
+    passwordTable->setCellWidget(row, 3, actionWidget);
+}
 
-    // Iterate for each password in the vector
-    for (const auto &pwd : passwords)
+// Look for the row whose password widget holds the given id
+int MainWindow::findRowByPasswordId(int id) const
+{
+    for (int row = 0; row < passwordTable->rowCount(); row++)
     {
-        // New row for each iteration
-        int row = passwordTable->rowCount();
-        passwordTable->insertRow(row);
-
-        // WEB ITEM
-        QTableWidgetItem *webItem = new QTableWidgetItem(QString::fromStdString(pwd.website));
-        webItem->setTextAlignment(Qt::AlignVCenter | Qt::AlignLeft);
-
-        // WEB USER ITEM
-        QTableWidgetItem *userItem = new QTableWidgetItem(QString::fromStdString(pwd.username));
-        userItem->setTextAlignment(Qt::AlignVCenter | Qt::AlignLeft);
-
-        // WEB USER PASS ITEM
-        QLineEdit *pwdEdit = new QLineEdit(this);
-
-        // Decrypt password before show in the ui
-        std::string password_decrypt = crypt->decryptPassword(
-            pwd.encrypted_password,
-            pwd.iv, SESSION->getMasterPassword(),
-            SESSION->getUserSalt());
-
-        pwdEdit->setText(QString::fromStdString(password_decrypt));
-        pwdEdit->setEchoMode(QLineEdit::Password); // ← Show "*"
-        pwdEdit->setReadOnly(true);
-        pwdEdit->setProperty("passwordId", pwd.id); // save ID for later
-        pwdEdit->setAlignment(Qt::AlignVCenter | Qt::AlignLeft);
-
-        // WEB USER PASS ACTION ITEM
-        QWidget *actionWidget = new QWidget(this);
-        QHBoxLayout *actionLayout = new QHBoxLayout(actionWidget);
-        actionLayout->setContentsMargins(5, 5, 5, 5);
-        actionLayout->setSpacing(8);
-        actionLayout->setAlignment(Qt::AlignCenter);
-
-        // WEB USER PASS ACTION BUTTONS
-        // Crete three buttons for password in db: view, edit and delete
-        QPushButton *viewBtn = new QPushButton("👁", this);
-        viewBtn->setMaximumWidth(38);
-        viewBtn->setMaximumHeight(38);
-        QPushButton *editBtn = new QPushButton("✏️", this);
-        editBtn->setMaximumWidth(38);
-        editBtn->setMaximumHeight(38);
-        QPushButton *deleteBtn = new QPushButton("🗑️", this);
-        deleteBtn->setMaximumWidth(38);
-        deleteBtn->setMaximumHeight(38);
-
-        // Connect butons with functions
-        connect(viewBtn, &QPushButton::clicked, this, [this, pwd]()
-                { this->onViewPassword(pwd.id); });
-        connect(editBtn, &QPushButton::clicked, this, [this, pwd]()
-                { this->onEditPassword(pwd.id); });
-        connect(deleteBtn, &QPushButton::clicked, this, [this, pwd]()
-                { this->onDeletePassword(pwd.id); });
-        // Add buttons to action layout
-        actionLayout->addWidget(viewBtn);
-        actionLayout->addWidget(editBtn);
-        actionLayout->addWidget(deleteBtn);
-
-        // Put widgets into passwordTable
-        passwordTable->setItem(row, 0, webItem);
-        passwordTable->setItem(row, 1, userItem);
-        passwordTable->setCellWidget(row, 2, pwdEdit);
-        passwordTable->setCellWidget(row, 3, actionWidget);
+        QLineEdit *pwdEdit = qobject_cast<QLineEdit *>(passwordTable->cellWidget(row, 2));
+        if (pwdEdit && pwdEdit->property("passwordId").toInt() == id)
+            return row;
     }
+    return -1;
+}
+
+// Another instance may have committed: confirm with data_version before touching the table
+void MainWindow::onVaultChanged()
+{
+    // Picked up by the unlock
+    if (!_vault.session().isAuthenticated() || _vault.session().isLocked())
+        return;
+
+    long long version = _vault.database().getDataVersion();
+    if (version == _lastDataVersion)
+        return;
+    _lastDataVersion = version;
+
+    PrintLog(std::cout, YELLOW "Main Window" RESET " - External vault change detected, refreshing...");
+    refreshChangedRows();
+}
+
+// Update only the rows written or deleted since the last refresh
+void MainWindow::refreshChangedRows()
+{
+    spawn(applyChanges(), CancellationToken::any(_cancel.token(), _vault.session().revocationToken()));
+}
+
+Task<void> MainWindow::applyChanges()
+{
+    AsyncDatabase *db = &_vault.asyncDatabase();
+    AsyncCrypto *crypt = &_vault.asyncCrypto();
+
+    unsigned int generation = _loadGeneration;
+    long long since = _lastChangeSeq;
+
+    // The reload filling the table applies them once done
+    if (_tablePartial)
+        co_return;
+
+    // Read the sequence first: rows committed meanwhile are simply picked up again next time
+    long long seq = co_await db->getChangeSeq();
+    if (seq == since)
+        co_return;
+
+    int user_id = _vault.session().getUserId();
+    std::vector<int> deleted = co_await db->getDeletedPasswordIdsSince(user_id, since);
+    std::vector<Password> changed = co_await db->getPasswordsChangedSince(user_id, since);
+    std::vector<SecureString> plaintexts = co_await crypt->decryptPasswords(
+        changed, SecureString(_vault.session().getMasterPassword()), SecureString(_vault.session().getUserSalt()));
+
+    // A full reload started meanwhile and will show everything
+    if (generation != _loadGeneration)
+        co_return;
+
+    // Written by another instance: drop what we decrypted before, keep the fresh plaintexts
+    for (int id : deleted)
+        _vault.secrets().invalidate(id);
+    for (size_t i = 0; i < changed.size(); i++)
+        _vault.secrets().put(changed[i].id, changed[i].iv, plaintexts[i]);
+
+    for (int id : deleted)
+    {
+        int row = findRowByPasswordId(id);
+        if (row != -1)
+            passwordTable->removeRow(row);
+    }
+
+    for (size_t i = 0; i < changed.size(); i++)
+    {
+        int row = findRowByPasswordId(changed[i].id);
+        if (row == -1)
+        {
+            row = passwordTable->rowCount();
+            passwordTable->insertRow(row);
+        }
+        fillRow(row, changed[i], plaintexts[i]);
+    }
+
+    if (seq > _lastChangeSeq)
+        _lastChangeSeq = seq;
 }
 
 // Buttons handle
@@ -207,7 +411,7 @@ void MainWindow::onClickAddPssBttn()
     PrintLog(std::cout, MAGENTA "Add Password Button" RESET " - Adding a new password...");
 
     // Create add password dialog
-    AddPasswordDialog dialog(this);
+    AddPasswordDialog dialog(_vault, this);
 
     // Show dialog
     if (dialog.exec() == QDialog::Accepted)
@@ -227,7 +431,7 @@ void MainWindow::onClickLogoutBttn()
     // Close window
     if (reply == QMessageBox::Yes)
     {
-        SESSION->clearSession();
+        _vault.session().clearSession();
         this->close();
     }
 }
@@ -237,32 +441,23 @@ void MainWindow::onViewPassword(int id)
     PrintLog(std::cout, MAGENTA "View Password" RESET " for ID %d", id);
 
     // Find the file with the id
-    for (int row = 0; row < passwordTable->rowCount(); row++)
-    {
-        QLineEdit *pwdEdit = qobject_cast<QLineEdit *>(passwordTable->cellWidget(row, 2));
-        if (pwdEdit && pwdEdit->property("passwordId").toInt() == id)
-        {
-            // Toggle between password (hidden) and normal (view)
-            if (pwdEdit->echoMode() == QLineEdit::Password)
-                pwdEdit->setEchoMode(QLineEdit::Normal);
-            else
-                pwdEdit->setEchoMode(QLineEdit::Password);
-            break;
-        }
-    }
+    int row = findRowByPasswordId(id);
+    if (row == -1)
+        return;
+
+    // Toggle between password (hidden) and normal (view)
+    QLineEdit *pwdEdit = qobject_cast<QLineEdit *>(passwordTable->cellWidget(row, 2));
+    if (pwdEdit->echoMode() == QLineEdit::Password)
+        pwdEdit->setEchoMode(QLineEdit::Normal);
+    else
+        pwdEdit->setEchoMode(QLineEdit::Password);
 }
 
 void MainWindow::onEditPassword(int id)
 {
     PrintLog(std::cout, MAGENTA "Edit Password" RESET " for ID %d ", id);
 
-    // Get database from SessionManager
-    SQLiteCipherDB *db = SESSION->getDatabase();
-    if (!db)
-    {
-        QMessageBox::critical(this, "Error", "Database service not available");
-        return;
-    }
+    SQLiteCipherDB *db = &_vault.database();
 
     // Obtain db password
     Password pwd;
@@ -271,7 +466,7 @@ void MainWindow::onEditPassword(int id)
         QMessageBox::warning(this, "Error", "Password not found");
         return;
     }
-    EditPasswordDialog dial(this, id);
+    EditPasswordDialog dial(_vault, this, id);
     if (dial.exec() == QDialog::Accepted)
         updateUi();
 }
@@ -280,13 +475,7 @@ void MainWindow::onDeletePassword(int id)
 {
     PrintLog(std::cout, MAGENTA "Delete Password" RESET " with %d ID", id);
 
-    // Get database from SessionManager
-    SQLiteCipherDB *db = SESSION->getDatabase();
-    if (!db)
-    {
-        QMessageBox::critical(this, "Error", "Database service not available");
-        return;
-    }
+    SQLiteCipherDB *db = &_vault.database();
 
     // Confirm
     QMessageBox::StandardButton reply = QMessageBox::question(this, "Delete Password", "Are you sure to delete password", QMessageBox::Yes | QMessageBox::No);
@@ -295,8 +484,254 @@ void MainWindow::onDeletePassword(int id)
     if (!db->getPassword(id, pwd))
         QMessageBox::warning(this, "Warning", "password not found in the db");
 
-    // Delete and refresh
+    // Delete on the writer thread without blocking the UI, the row is removed once it commits
     if (reply == QMessageBox::Yes)
-        db->deletePassword(id);
-    this->updateUi();
+    {
+        QPointer<MainWindow> self(this);
+        db->deletePasswordAsync(id, [self](bool ok)
+        {
+            // Back to the GUI thread, the window may be gone by then
+            QMetaObject::invokeMethod(qApp, [self, ok]()
+            {
+                if (!self)
+                    return;
+                if (!ok)
+                    QMessageBox::warning(self, "Error", "Failed to delete password");
+                self->refreshChangedRows();
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    switch (event->type())
+    {
+        case QEvent::KeyPress:
+        case QEvent::MouseButtonPress:
+        case QEvent::MouseMove:
+        case QEvent::Wheel:
+            if (!_vault.session().isLocked())
+                idleTimer->start();
+            break;
+        default:
+            break;
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+void MainWindow::onClickLockBttn()
+{
+    PrintLog(std::cout, MAGENTA "Lock Button" RESET " - Locking vault...");
+    lockVault();
+}
+
+void MainWindow::lockVault()
+{
+    if (!_vault.session().lock())
+        return;
+
+    // Open dialogs may show or be about to save secrets
+    for (QDialog *dialog : findChildren<QDialog *>())
+        dialog->reject();
+
+    // Drop pending loads and wipe every shown password, the rest of the row stays
+    ++_loadGeneration;
+    for (int row = 0; row < passwordTable->rowCount(); row++)
+    {
+        QLineEdit *pwdEdit = qobject_cast<QLineEdit *>(passwordTable->cellWidget(row, 2));
+        if (pwdEdit)
+        {
+            pwdEdit->clear();
+            pwdEdit->setEchoMode(QLineEdit::Password);
+        }
+    }
+    showLocked(true);
+}
+
+void MainWindow::showLocked(bool locked)
+{
+    passwordTable->setVisible(!locked);
+    lockPanel->setVisible(locked);
+    addBttn->setEnabled(!locked);
+    lockBttn->setEnabled(!locked);
+    pinBttn->setEnabled(!locked);
+
+    if (locked)
+    {
+        idleTimer->stop();
+        bool pin = _vault.session().hasUnlockPin();
+        unlockPinCheck->setEnabled(pin);
+        unlockPinCheck->setChecked(pin);
+        unlockEdit->clear();
+        unlockEdit->setFocus();
+    }
+    else
+        idleTimer->start();
+}
+
+void MainWindow::onClickUnlockBttn()
+{
+    SecureString secret = toSecureString(unlockEdit->text());
+    unlockEdit->clear();
+    if (secret.empty())
+        return;
+
+    bool withPin = unlockPinCheck->isChecked();
+    bool ok = withPin ? _vault.session().unlockWithPin(secret) : _vault.session().unlock(secret);
+    if (!ok)
+    {
+        if (withPin && !_vault.session().hasUnlockPin())
+        {
+            QMessageBox::warning(this, "Locked", "Too many wrong PINs, use your master password");
+            unlockPinCheck->setChecked(false);
+            unlockPinCheck->setEnabled(false);
+        }
+        else
+            QMessageBox::warning(this, "Locked", withPin ? "Wrong PIN" : "Wrong master password");
+        unlockEdit->setFocus();
+        return;
+    }
+
+    PrintLog(std::cout, GREEN "Main Window" RESET " - Vault unlocked");
+    showLocked(false);
+    // A table left half filled by the lock is loaded again from the db
+    if (_tablePartial)
+        updateUi();
+    else
+        spawn(restorePasswords(), CancellationToken::any(_cancel.token(), _vault.session().revocationToken()));
+}
+
+void MainWindow::onClickPinBttn()
+{
+    bool ok = false;
+    QString pin = QInputDialog::getText(this, "Unlock PIN",
+        "PIN to unlock this session (kept in memory only):", QLineEdit::Password, QString(), &ok);
+    if (!ok)
+        return;
+
+    try
+    {
+        _vault.session().setUnlockPin(toSecureString(pin));
+        QMessageBox::information(this, "Unlock PIN", "PIN set until you log out");
+    }
+    catch (const std::exception &e)
+    {
+        QMessageBox::warning(this, "Unlock PIN", e.what());
+    }
+}
+
+void MainWindow::onClickBackupBttn()
+{
+    // One backup at a time
+    if (_backup.valid() && _backup.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    PrintLog(std::cout, MAGENTA "Backup Button" RESET " - Backing up the vault...");
+    backupBttn->setEnabled(false);
+
+    QPointer<MainWindow> self(this);
+    std::string dbPath = _vault.database().getPath();
+    const DatabaseCipher *cipher = _vault.database().getCipher();
+    CancellationToken token = CancellationToken::any(_cancel.token(), _vault.closingToken());
+
+    // Copied in small steps on a background worker, progress and the outcome
+    // come back to the GUI thread (the window may be gone by then)
+    _backup = _vault.submit(TaskPriority::Background, [self, dbPath, cipher, token]()
+    {
+        auto onGui = [self](std::function<void(MainWindow *)> fn)
+        {
+            QMetaObject::invokeMethod(qApp, [self, fn]()
+            {
+                if (self)
+                    fn(self);
+            }, Qt::QueuedConnection);
+        };
+        auto done = [](MainWindow *window)
+        {
+            window->backupBttn->setText("Backup");
+            window->backupBttn->setEnabled(true);
+        };
+
+        int lastPercent = -1;
+        auto progress = [&](const BackupProgress &p)
+        {
+            int percent = p.total > 0 ? p.copied * 100 / p.total : 100;
+            if (percent == lastPercent)
+                return;
+            lastPercent = percent;
+            onGui([percent](MainWindow *window) { window->backupBttn->setText(QString("Backup %1%").arg(percent)); });
+        };
+
+        try
+        {
+            BackupResult result = VaultBackup(dbPath, cipher).run(progress, token);
+            onGui([done, path = result.path](MainWindow *window)
+            {
+                done(window);
+                QMessageBox::information(window, "Backup", QString::fromStdString("Vault backed up to " + path));
+            });
+        }
+        catch (const OperationCancelled &)
+        {
+        }
+        catch (const std::exception &e)
+        {
+            onGui([done, err = std::string(e.what())](MainWindow *window)
+            {
+                done(window);
+                QMessageBox::warning(window, "Backup", QString::fromStdString("Backup failed: " + err));
+            });
+        }
+    });
+}
+
+Task<void> MainWindow::restorePasswords()
+{
+    AsyncCrypto *crypt = &_vault.asyncCrypto();
+    unsigned int generation = _loadGeneration;
+
+    // Ciphertexts of the rows still shown, no db access needed
+    std::vector<Password> rows;
+    for (int row = 0; row < passwordTable->rowCount(); row++)
+    {
+        QLineEdit *pwdEdit = qobject_cast<QLineEdit *>(passwordTable->cellWidget(row, 2));
+        if (!pwdEdit)
+            continue;
+        Password pwd;
+        pwd.id = pwdEdit->property("passwordId").toInt();
+        pwd.encrypted_password = pwdEdit->property("ciphertext").toString().toStdString();
+        pwd.iv = pwdEdit->property("iv").toString().toStdString();
+        rows.push_back(std::move(pwd));
+    }
+
+    SecureBytes key = co_await crypt->deriveKey(
+        SecureString(_vault.session().getMasterPassword()), SecureString(_vault.session().getUserSalt()));
+
+    // Same bounded chunks as a reload
+    for (size_t start = 0; start < rows.size(); start += UI_DECRYPT_BATCH)
+    {
+        size_t end = std::min(rows.size(), start + UI_DECRYPT_BATCH);
+        std::vector<SecureString> plaintexts = co_await crypt->decryptPasswords(
+            std::vector<Password>(rows.begin() + start, rows.begin() + end), key);
+
+        // A full reload started meanwhile and will show everything
+        if (generation != _loadGeneration)
+            co_return;
+
+        for (size_t i = start; i < end; i++)
+        {
+            int row = findRowByPasswordId(rows[i].id);
+            if (row == -1)
+                continue;
+            QLineEdit *pwdEdit = qobject_cast<QLineEdit *>(passwordTable->cellWidget(row, 2));
+            // Rewritten by applyChanges while this chunk was decrypting
+            if (pwdEdit->property("ciphertext").toString().toStdString() != rows[i].encrypted_password)
+                continue;
+            pwdEdit->setText(toQString(plaintexts[i - start]));
+        }
+    }
+
+    // Catch up with what other instances wrote while locked
+    refreshChangedRows();
 }
@@ -0,0 +1,138 @@
+// Warm record decryption must not touch the heap (CryptoManager hot path):
+// operator new and OpenSSL's allocator are counted while the loops run
+#include "CryptoManager.hpp"
+
+#include <openssl/crypto.h>
+#include <new>
+
+#define ALLOC_TEST_ROUNDS 10000
+#define ALLOC_TEST_BATCH 64
+
+static std::atomic<bool> g_counting(false);
+static std::atomic<size_t> g_allocations(0);
+
+static void *countedMalloc(size_t size)
+{
+    if (g_counting)
+        g_allocations++;
+    return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size)
+{
+    void *p = countedMalloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static void *sslMalloc(size_t size, const char *, int)
+{
+    return countedMalloc(size);
+}
+
+static void *sslRealloc(void *p, size_t size, const char *, int)
+{
+    if (g_counting)
+        g_allocations++;
+    return realloc(p, size);
+}
+
+static void sslFree(void *p, const char *, int)
+{
+    free(p);
+}
+
+static int fail(const char *what, size_t allocations)
+{
+    fprintf(stderr, "FAIL %s: %zu heap allocations in %d warm rounds\n", what, allocations, ALLOC_TEST_ROUNDS);
+    return 1;
+}
+
+// Allocations made by fn over ALLOC_TEST_ROUNDS calls
+template <typename F>
+static size_t countAllocations(F fn)
+{
+    g_allocations = 0;
+    g_counting = true;
+    for (int i = 0; i < ALLOC_TEST_ROUNDS; i++)
+        fn();
+    g_counting = false;
+    return g_allocations;
+}
+
+int main()
+{
+    // Before OpenSSL allocates anything
+    if (!CRYPTO_set_mem_functions(sslMalloc, sslRealloc, sslFree))
+    {
+        fprintf(stderr, "FAIL OpenSSL allocated before the test could hook it\n");
+        return 1;
+    }
+    RedirectLogs(nullptr);
+
+    CryptoManager crypto;
+    std::string master = "Secret123!";
+    std::string salt = "00112233445566778899aabbccddeeff";
+    std::string secret = "correct horse battery staple";
+    auto [ciphertextHex, ivHex] = crypto.encryptPassword(SecretView(secret), SecretView(master), SecretView(salt));
+
+    unsigned char key[CRYPTO_KEY_SIZE];
+    crypto.deriveKey(SecretView(master), SecretView(salt), key);
+
+    // Raw inputs of decryptInto
+    unsigned char iv[CRYPTO_IV_SIZE];
+    std::vector<unsigned char> ciphertext(ciphertextHex.size() / 2);
+    for (size_t i = 0; i < ciphertext.size(); i++)
+        ciphertext[i] = static_cast<unsigned char>(std::stoi(ciphertextHex.substr(2 * i, 2), nullptr, 16));
+    for (size_t i = 0; i < CRYPTO_IV_SIZE; i++)
+        iv[i] = static_cast<unsigned char>(std::stoi(ivHex.substr(2 * i, 2), nullptr, 16));
+
+    char out[256];
+    unsigned char raw[256];
+    bool ok = true;
+    auto decryptRecord = [&]()
+    {
+        int length = crypto.decryptRecordInto(key, ciphertextHex, ivHex, out, sizeof(out));
+        ok = ok && length == static_cast<int>(secret.size()) && memcmp(out, secret.data(), length) == 0;
+    };
+    auto decryptRaw = [&]()
+    {
+        int length = crypto.decryptInto(key, iv, ciphertext.data(), ciphertext.size(), raw, sizeof(raw));
+        ok = ok && length == static_cast<int>(secret.size()) && memcmp(raw, secret.data(), length) == 0;
+    };
+
+    // Warm up: the first call on the thread creates its cipher contexts
+    decryptRecord();
+    decryptRaw();
+    if (!ok)
+    {
+        fprintf(stderr, "FAIL records don't decrypt\n");
+        return 1;
+    }
+
+    size_t allocations = countAllocations(decryptRecord);
+    if (allocations != 0)
+        return fail("decryptRecordInto", allocations);
+    allocations = countAllocations(decryptRaw);
+    if (allocations != 0)
+        return fail("decryptInto", allocations);
+    if (!ok)
+    {
+        fprintf(stderr, "FAIL wrong plaintext on a warm round\n");
+        return 1;
+    }
+
+    printf("decryptRecordInto / decryptInto: 0 heap allocations in %d warm rounds each\n", ALLOC_TEST_ROUNDS);
+    return 0;
+}
@@ -0,0 +1,75 @@
+// A whole-vault batch keeps every plaintext alive in the secure arena at
+// once: it must go past vm.max_map_count records (one mapping each would
+// run out) and come back intact. Usage: crypto_batch_limit_test [records]
+#include "CryptoManager.hpp"
+
+#include <thread>
+
+// Default above the usual vm.max_map_count (65530)
+#define BATCH_TEST_RECORDS 100000
+
+// The limit of this machine, so the test covers it wherever it runs
+static size_t mapCountLimit()
+{
+    FILE *file = fopen("/proc/sys/vm/max_map_count", "r");
+    unsigned long limit = 0;
+    if (file)
+    {
+        if (fscanf(file, "%lu", &limit) != 1)
+            limit = 0;
+        fclose(file);
+    }
+    return limit;
+}
+
+int main(int argc, char **argv)
+{
+    size_t records = argc > 1 ? strtoul(argv[1], nullptr, 10) : std::max<size_t>(BATCH_TEST_RECORDS, mapCountLimit() + 1000);
+    RedirectLogs(nullptr);
+
+    CryptoManager crypto;
+    std::string master = "Secret123!";
+    std::string salt = "00112233445566778899aabbccddeeff";
+
+    std::vector<std::string> secrets(records);
+    std::vector<SecretView> plaintexts;
+    plaintexts.reserve(records);
+    for (size_t i = 0; i < records; i++)
+    {
+        secrets[i] = "P@ss-" + std::to_string(i) + "-limit";
+        plaintexts.emplace_back(secrets[i]);
+    }
+
+    TaskScheduler pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<EncryptedField> fields;
+    std::vector<SecureString> out;
+    try
+    {
+        crypto.encryptBatch(plaintexts, fields, SecretView(master), SecretView(salt), &pool);
+        size_t failed = crypto.decryptBatch(fields, out, SecretView(master), SecretView(salt), &pool);
+        if (failed != 0)
+        {
+            fprintf(stderr, "FAIL %zu of %zu records didn't decrypt\n", failed, records);
+            return 1;
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        SecureMemoryStats stats = SecureArena::instance().getStats();
+        fprintf(stderr, "FAIL out of secure memory after %zu regions, %llu own mappings\n",
+                stats.regions, stats.largeAllocations);
+        return 1;
+    }
+
+    for (size_t i = 0; i < records; i++)
+        if (out[i].view().size() != secrets[i].size() || memcmp(out[i].view().data(), secrets[i].data(), secrets[i].size()) != 0)
+        {
+            fprintf(stderr, "FAIL record %zu came back wrong\n", i);
+            return 1;
+        }
+
+    SecureMemoryStats stats = SecureArena::instance().getStats();
+    printf("%zu records decrypted at once: %zu KiB in %zu regions, %llu own mappings, %llu mlock failures\n",
+           records, stats.arenaBytes / 1024, stats.regions, stats.largeAllocations, stats.lockFailures);
+    return 0;
+}